@@ -0,0 +1,270 @@
+// bachat-bench: times the data paths behind the UI on generated histories and prints the
+// results as JSON, one entry per benchmark and size, for comparison between releases.
+//
+//   bachat-bench [--rows N]... [--threads N] [--dir DIR] [--out FILE] [--keep]
+//
+// Without --rows it runs 10k, 1M and 10M rows.
+#include "Expense.h"
+#include "ExpenseAggregator.h"
+#include "ExpenseGenerator.h"
+#include "ExpensePack.h"
+#include "ExpenseSortIndex.h"
+#include "ExpenseStore.h"
+#include "ExpenseTotals.h"
+#include "ThreadPool.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+	struct BenchmarkResult
+	{
+		std::string name;
+		size_t rows;
+		double seconds;
+		uint64_t peakRssBytes;
+		uint64_t fileBytes = 0;          // size of the file read or written, where there is one
+		double compressionRatio = 0;     // text file bytes per packed byte
+		uint64_t storeBytes = 0;         // ExpenseStore::MemoryUsage after the benchmark, where it built one
+	};
+
+	uint64_t FileBytes(const std::string& fileName) {
+		std::error_code ec;
+		std::uintmax_t size = std::filesystem::file_size(fileName, ec);
+		return ec ? 0 : static_cast<uint64_t>(size);
+	}
+
+	// Lets each benchmark report its own peak instead of the peak of the whole run (Linux only)
+	void ResetPeakRss() {
+#ifdef __linux__
+		std::ofstream clearRefs("/proc/self/clear_refs");
+		clearRefs << "5";
+#endif
+	}
+
+	uint64_t PeakRssBytes() {
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters;
+		GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+		return counters.PeakWorkingSetSize;
+#else
+#ifdef __linux__
+		std::ifstream status("/proc/self/status");
+		std::string line;
+		while (std::getline(status, line)) {
+			if (line.compare(0, 6, "VmHWM:") == 0) {
+				return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+			}
+		}
+#endif
+		rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+		return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+		return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+	}
+
+	BenchmarkResult Measure(const std::string& name, size_t rows, const std::function<void()>& body) {
+		ResetPeakRss();
+		auto start = std::chrono::steady_clock::now();
+		body();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		BenchmarkResult result{ name, rows, elapsed.count(), PeakRssBytes() };
+		std::cerr << name << " " << rows << " rows: " << result.seconds * 1000 << " ms\n";
+		return result;
+	}
+
+	void RunSize(size_t rows, const std::filesystem::path& directory, bool keep, ThreadPool& pool, std::vector<BenchmarkResult>& results) {
+		const std::string textFile = (directory / ("bench-" + std::to_string(rows) + ".txt")).string();
+		const std::string savedFile = (directory / ("bench-" + std::to_string(rows) + "-saved.txt")).string();
+		const std::string packFile = (directory / ("bench-" + std::to_string(rows) + ".bbs")).string();
+
+		results.push_back(Measure("generate", rows, [&]() { GenerateExpenseFile(textFile, rows); }));
+
+		ExpenseStore store;
+		results.push_back(Measure("load", rows, [&]() { LoadExpenseFromFile(store, textFile); }));
+		results.back().fileBytes = FileBytes(textFile);
+		const ExpenseStoreMemory memory = store.MemoryUsage();
+		results.back().storeBytes = memory.TotalBytes();
+		std::cerr << "store " << rows << " rows: " << memory.TotalBytes() / (1024 * 1024) << " MB, "
+			<< memory.BytesPerRow() << " bytes/row (columns " << memory.columnBytes / (1024 * 1024) << " MB, descriptions "
+			<< memory.descriptionBytes / (1024 * 1024) << " MB in " << memory.arenaChunks << " arena chunks of "
+			<< memory.arenaBytes / (1024 * 1024) << " MB)\n";
+		results.push_back(Measure("save", rows, [&]() { AddExpenseToFile(store, savedFile); }));
+
+		// The compressed encoding of snapshot segments, written and read back as one pack
+		results.push_back(Measure("pack_save", rows, [&]() {
+			WriteExpensePack(packFile, store, 0, store.Size(), 0);
+			}));
+		results.back().fileBytes = FileBytes(packFile);
+		results.back().compressionRatio = results.back().fileBytes ? static_cast<double>(FileBytes(textFile)) / results.back().fileBytes : 0;
+		std::cerr << "pack " << rows << " rows: " << results.back().fileBytes << " bytes, "
+			<< results.back().compressionRatio << "x smaller than text\n";
+		results.push_back(Measure("pack_load", rows, [&]() {
+			std::ifstream istream(packFile, std::ios::binary);
+			std::string pack(static_cast<size_t>(FileBytes(packFile)), '\0');
+			istream.read(&pack[0], static_cast<std::streamsize>(pack.size()));
+			ExpenseBatch batch;
+			ExpenseStore packed;
+			if (CheckExpensePack(pack.data(), pack.size()) && DecodeExpensePack(pack.data(), pack.size(), batch)) {
+				batch.AppendTo(packed);
+			}
+			}));
+		results.back().fileBytes = FileBytes(packFile);
+
+		// The first Order() call of a column is the full sort a column header click triggers
+		const std::pair<const char*, SortColumn> columns[] = {
+			{ "sort_category", SortColumn::Category }, { "sort_amount", SortColumn::Amount }, { "sort_date", SortColumn::Date },
+		};
+		for (const auto& column : columns) {
+			ExpenseSortIndex sortIndex(store);
+			results.push_back(Measure(column.first, rows, [&]() { sortIndex.Order(column.second); }));
+		}
+
+		results.push_back(Measure("aggregate_month_category", rows, [&]() {
+			AggregateExpenses(store, AggregateQuery(), pool);
+			}));
+		results.push_back(Measure("aggregate_month_description", rows, [&]() {
+			AggregateQuery query;
+			query.group = AggregateGroup::Description;
+			AggregateExpenses(store, query, pool);
+			}));
+		{
+			// With the date order already built, as it is once the list was sorted by date
+			ExpenseSortIndex sortIndex(store);
+			sortIndex.Order(SortColumn::Date);
+			results.push_back(Measure("aggregate_year_description_range", rows, [&]() {
+				AggregateQuery query;
+				query.group = AggregateGroup::Description;
+				ParseIsoDate("2022-01-01", query.fromDay);
+				ParseIsoDate("2022-12-31", query.toDay);
+				AggregateExpenses(store, query, pool, &sortIndex);
+				}));
+		}
+		results.push_back(Measure("totals_cache_build", rows, [&]() {
+			ExpenseTotalsCache totalsCache(store);
+			totalsCache.Cells();
+			}));
+
+		// The sums behind the total under the list; the volatile keeps them from being optimised away
+		volatile int64_t total = 0;
+		results.push_back(Measure("sum_amounts", rows, [&]() {
+			total = SumCents(store.Amounts().data(), store.Size());
+			}));
+		results.push_back(Measure("sum_amounts_date_range", rows, [&]() {
+			int32_t fromDay = 0, toDay = 0;
+			ParseIsoDate("2022-01-01", fromDay);
+			ParseIsoDate("2022-12-31", toDay);
+			total = SumCentsBetween(store.Amounts().data(), store.Days().data(), store.Size(), fromDay, toDay);
+			}));
+
+		if (!keep) {
+			std::error_code ec;
+			std::filesystem::remove(textFile, ec);
+			std::filesystem::remove(savedFile, ec);
+			std::filesystem::remove(packFile, ec);
+		}
+	}
+
+	std::string ToJson(const std::vector<BenchmarkResult>& results, unsigned threads) {
+		std::ostringstream json;
+		json << "{\n  \"threads\": " << threads << ",\n  \"results\": [";
+		for (size_t i = 0; i < results.size(); i++) {
+			const BenchmarkResult& result = results[i];
+			double rowsPerSecond = result.seconds > 0 ? result.rows / result.seconds : 0;
+			json << (i ? ",\n" : "\n")
+				<< "    {\"benchmark\": \"" << result.name << "\", \"rows\": " << result.rows
+				<< ", \"seconds\": " << result.seconds
+				<< ", \"rows_per_second\": " << static_cast<uint64_t>(rowsPerSecond)
+				<< ", \"peak_rss_bytes\": " << result.peakRssBytes;
+			if (result.fileBytes) {
+				json << ", \"file_bytes\": " << result.fileBytes
+					<< ", \"bytes_per_second\": " << static_cast<uint64_t>(result.seconds > 0 ? result.fileBytes / result.seconds : 0);
+			}
+			if (result.storeBytes) {
+				json << ", \"store_bytes\": " << result.storeBytes
+					<< ", \"store_bytes_per_row\": " << (result.rows ? result.storeBytes / result.rows : 0);
+			}
+			if (result.compressionRatio > 0) {
+				json << ", \"compression_ratio\": " << result.compressionRatio;
+			}
+			json << "}";
+		}
+		json << "\n  ]\n}\n";
+		return json.str();
+	}
+
+	int Usage() {
+		std::cerr << "usage: bachat-bench [--rows N]... [--threads N] [--dir DIR] [--out FILE] [--keep]\n";
+		return 2;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<size_t> sizes;
+	unsigned threads = 0;
+	std::filesystem::path directory = std::filesystem::temp_directory_path();
+	std::string outFile;
+	bool keep = false;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--rows" && hasValue) {
+			sizes.push_back(std::strtoull(argv[++i], nullptr, 10));
+		}
+		else if (arg == "--threads" && hasValue) {
+			threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (arg == "--dir" && hasValue) {
+			directory = argv[++i];
+		}
+		else if (arg == "--out" && hasValue) {
+			outFile = argv[++i];
+		}
+		else if (arg == "--keep") {
+			keep = true;
+		}
+		else {
+			return Usage();
+		}
+	}
+	if (sizes.empty()) {
+		sizes = { 10000, 1000000, 10000000 };
+	}
+
+	ThreadPool pool(threads);
+	std::vector<BenchmarkResult> results;
+	for (size_t rows : sizes) {
+		RunSize(rows, directory, keep, pool, results);
+	}
+
+	std::string json = ToJson(results, pool.ThreadCount());
+	if (outFile.empty()) {
+		std::cout << json;
+	}
+	else {
+		std::ofstream(outFile) << json;
+	}
+	return 0;
+}
@@ -0,0 +1,438 @@
+// bachat-cli: headless access to the expense history for scripts and nightly jobs.
+//
+//   bachat-cli [--data DIR] import [--keep-duplicates] FILE...
+//   bachat-cli [--data DIR] export [--format text|csv] [--out FILE]
+//   bachat-cli [--data DIR] totals [--period day|week|month|quarter|year] [--from DATE] [--to DATE]
+//   bachat-cli [--data DIR] query [--from DATE] [--to DATE] [--category NAME] [--search TEXT]
+//                                 [--min AMOUNT] [--max AMOUNT] [--limit N]
+//
+// DIR holds the app's expense.bbs, expense.journal and expense.txt (default: the current
+// directory). Every command streams the history through ExpenseHistoryReader, so memory stays
+// bounded whatever the size of the history. import adds the new rows to the month segments and
+// rewrites only the months they fall in (and any the journal had changed) through
+// WriteExpenseSegments; besides those months' rows it keeps a fingerprint index of the history,
+// to skip rows it already has the way the app does (--keep-duplicates imports them anyway). A
+// history saved before month segments is split into them on its first import. totals and query
+// with --from or --to only read the month segments whose days overlap the range. Do not run
+// import while the app has the same directory open.
+#include "Expense.h"
+#include "ExpenseAggregator.h"
+#include "ExpenseDuplicateIndex.h"
+#include "ExpenseReader.h"
+#include "ExpenseSegments.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+	struct DataFiles
+	{
+		std::string snapshot;
+		std::string journal;
+		std::string legacy;
+	};
+
+	// "--name value" options and the plain arguments of one command
+	struct Arguments
+	{
+		std::map<std::string, std::string> options;
+		std::vector<std::string> files;
+
+		bool Has(const std::string& name) const { return options.count(name) != 0; }
+		std::string Get(const std::string& name, const std::string& fallback = std::string()) const {
+			auto found = options.find(name);
+			return found == options.end() ? fallback : found->second;
+		}
+	};
+
+	int Fail(const std::string& message) {
+		std::cerr << "bachat-cli: " << message << "\n";
+		return 1;
+	}
+
+	int Usage() {
+		std::cerr <<
+			"usage: bachat-cli [--data DIR] import [--keep-duplicates] FILE...\n"
+			"       bachat-cli [--data DIR] export [--format text|csv] [--out FILE]\n"
+			"       bachat-cli [--data DIR] totals [--period day|week|month|quarter|year] [--from DATE] [--to DATE]\n"
+			"       bachat-cli [--data DIR] query [--from DATE] [--to DATE] [--category NAME] [--search TEXT]\n"
+			"                                     [--min AMOUNT] [--max AMOUNT] [--limit N]\n";
+		return 2;
+	}
+
+	bool OpenHistory(ExpenseHistoryReader& history, const DataFiles& files) {
+		if (!history.Open(files.snapshot, files.journal, files.legacy)) {
+			std::cerr << "bachat-cli: cannot read the expense history in " << files.snapshot << "\n";
+			return false;
+		}
+		if (history.SkippedLines() > 0) {
+			std::cerr << "bachat-cli: " << history.SkippedLines() << " malformed lines in " << files.legacy << " were skipped\n";
+		}
+		return true;
+	}
+
+	// A segment is only read when its rows come up, so damage can also show up halfway through
+	bool HistoryFailed(const ExpenseHistoryReader& history, const DataFiles& files) {
+		if (history.Failed()) {
+			std::cerr << "bachat-cli: a segment of " << files.snapshot << " is damaged\n";
+		}
+		return history.Failed();
+	}
+
+	std::string CsvField(std::string_view text) {
+		if (text.find_first_of(",\"\r\n") == std::string_view::npos) {
+			return std::string(text);
+		}
+		std::string quoted = "\"";
+		for (char c : text) {
+			quoted += c;
+			if (c == '"') {
+				quoted += '"';
+			}
+		}
+		return quoted + "\"";
+	}
+
+	void WriteCsvRow(std::ostream& ostream, const ExpenseRecord& record) {
+		ostream << FormatIsoDate(record.day) << ',' << CsvField(record.description) << ','
+			<< CsvField(record.category) << ',' << FormatAmountCents(record.amountCents) << '\n';
+	}
+
+	void WriteTextRow(std::ostream& ostream, const ExpenseRecord& record) {
+		std::string description(record.description), category(record.category);
+		std::replace(description.begin(), description.end(), ' ', '_');
+		std::replace(category.begin(), category.end(), ' ', '_');
+		ostream << '\n' << description << ' ' << category << ' ' << FormatAmountCents(record.amountCents) << ' ' << FormatIsoDate(record.day);
+	}
+
+	bool ParseDateOption(const Arguments& arguments, const std::string& name, int32_t& day) {
+		if (!arguments.Has(name)) {
+			return true;
+		}
+		if (!ParseIsoDate(arguments.Get(name), day)) {
+			std::cerr << "bachat-cli: --" << name << " expects a YYYY-MM-DD date\n";
+			return false;
+		}
+		return true;
+	}
+
+	uint64_t RecordFingerprint(const ExpenseRecord& record) {
+		return ExpenseDuplicateIndex::Fingerprint(record.description, record.category, record.amountCents, record.day);
+	}
+
+	// The rule of MainFrame::OnImportBatch: a row is a duplicate while the history still has an
+	// unmatched row with the same fingerprint, so three identical coffees against a history with
+	// two add just one. Rows are only checked against the history, not against each other.
+	bool TakeDuplicate(ExpenseDuplicateIndex& history, std::unordered_map<uint64_t, uint32_t>& matched, const ExpenseRecord& record) {
+		uint64_t fingerprint = RecordFingerprint(record);
+		uint32_t inHistory = history.Count(fingerprint);
+		if (inHistory == 0) {
+			return false;
+		}
+		uint32_t& count = matched[fingerprint];
+		if (count == inHistory) {
+			return false;
+		}
+		count++;
+		return true;
+	}
+
+	// Two streaming passes: the first indexes the history's fingerprints and works out which
+	// month segments the new rows land in, the second gathers those segments' rows, making the
+	// same duplicate decisions again, and saves them
+	int Import(const DataFiles& files, const Arguments& arguments) {
+		if (arguments.files.empty()) {
+			return Usage();
+		}
+		const bool keepDuplicates = arguments.Has("keep-duplicates");
+
+		ExpenseHistoryReader history;
+		if (!OpenHistory(history, files)) {
+			return 1;
+		}
+		// The saved layout with the journal applied lines up with the rows; a history from
+		// before segments has none and is laid out afresh, every segment dirty
+		ExpenseSegmentLayout layout = history.JournalState().segments;
+		const bool partition = layout.Rows() != history.Size();
+		if (partition) {
+			layout.Clear();
+		}
+		ExpenseStore noRows;
+		ExpenseDuplicateIndex fingerprints(noRows);
+		ExpenseRecord record;
+		while (history.Next(record)) {
+			fingerprints.InsertFingerprint(RecordFingerprint(record));
+			if (partition) {
+				layout.Add(record.day);
+			}
+		}
+		if (HistoryFailed(history, files)) {
+			return 1;
+		}
+		std::unordered_map<uint64_t, uint32_t> matched;
+		for (const std::string& input : arguments.files) {
+			ExpenseFileReader reader;
+			if (!reader.Open(input)) {
+				return Fail("cannot open " + input);
+			}
+			while (reader.Next(record)) {
+				if (!TakeDuplicate(fingerprints, matched, record) || keepDuplicates) {
+					layout.Add(record.day);
+				}
+			}
+		}
+		matched.clear();
+
+		// Walks the runs along the rows, history first and then the new ones
+		std::vector<ExpenseStore> segmentRows(layout.Segments().size());
+		const std::vector<ExpenseSegmentLayout::Run>& runs = layout.Runs();
+		size_t run = 0;
+		uint32_t runLeft = runs.empty() ? 0 : runs[0].rows;
+		auto gather = [&](const ExpenseRecord& record) {
+			while (runLeft == 0) {
+				runLeft = runs[++run].rows;
+			}
+			runLeft--;
+			const uint32_t segment = runs[run].segment;
+			if (layout.Segments()[segment].dirty) {
+				segmentRows[segment].Add(record.description, record.category, record.amountCents, record.day);
+			}
+		};
+		if (!history.Open(files.snapshot, files.journal, files.legacy)) {
+			return Fail("cannot read the expense history in " + files.snapshot);
+		}
+		while (history.Next(record)) {
+			gather(record);
+		}
+		if (HistoryFailed(history, files)) {
+			return 1;
+		}
+		const uint64_t sequence = history.LastSequence();
+		history.Close();
+
+		for (const std::string& input : arguments.files) {
+			ExpenseFileReader reader;
+			reader.Open(input);
+			size_t imported = 0, duplicates = 0;
+			while (reader.Next(record)) {
+				if (TakeDuplicate(fingerprints, matched, record)) {
+					duplicates++;
+					if (!keepDuplicates) {
+						continue;
+					}
+				}
+				gather(record);
+				imported++;
+			}
+			for (const ExpenseParseError& error : reader.Errors()) {
+				std::cerr << input << ":" << error.line << ": " << error.message << "\n";
+			}
+			std::cerr << input << ": imported " << imported << " rows, skipped " << reader.SkippedLines() << ", "
+				<< duplicates << (keepDuplicates ? " duplicates kept\n" : " duplicates skipped\n");
+		}
+
+		// The snapshot covers every journal record, so the log starts over once it is in place
+		ExpenseStore dirtyRows;
+		ExpenseSegmentLayout plan = layout.PlanSave(segmentRows, dirtyRows);
+		if (!WriteExpenseSegments(files.snapshot, plan, dirtyRows, sequence)) {
+			return Fail("writing " + files.snapshot + " failed");
+		}
+		std::error_code ec;
+		std::filesystem::remove(files.journal, ec);
+		return 0;
+	}
+
+	int Export(const DataFiles& files, const Arguments& arguments) {
+		std::string format = arguments.Get("format", "text");
+		if (format != "text" && format != "csv") {
+			return Usage();
+		}
+		ExpenseHistoryReader history;
+		if (!OpenHistory(history, files)) {
+			return 1;
+		}
+
+		std::ofstream file;
+		if (arguments.Has("out")) {
+			file.open(arguments.Get("out"), std::ios::binary | std::ios::trunc);
+			if (!file) {
+				return Fail("cannot write " + arguments.Get("out"));
+			}
+		}
+		std::ostream& ostream = file.is_open() ? file : std::cout;
+
+		ExpenseRecord record;
+		if (format == "csv") {
+			ostream << "date,description,category,amount\n";
+			while (history.Next(record)) {
+				WriteCsvRow(ostream, record);
+			}
+		}
+		else {
+			ostream << history.Size();
+			while (history.Next(record)) {
+				WriteTextRow(ostream, record);
+			}
+		}
+		if (HistoryFailed(history, files)) {
+			return 1;
+		}
+		ostream.flush();
+		return ostream.good() ? 0 : Fail("write failed");
+	}
+
+	int Totals(const DataFiles& files, const Arguments& arguments) {
+		const std::string periods[] = { "day", "week", "month", "quarter", "year" };
+		std::string periodName = arguments.Get("period", "month");
+		auto found = std::find(std::begin(periods), std::end(periods), periodName);
+		if (found == std::end(periods)) {
+			return Usage();
+		}
+		AggregatePeriod period = static_cast<AggregatePeriod>(found - std::begin(periods));
+		int32_t fromDay = INT32_MIN, toDay = INT32_MAX;
+		if (!ParseDateOption(arguments, "from", fromDay) || !ParseDateOption(arguments, "to", toDay)) {
+			return 2;
+		}
+
+		ExpenseHistoryReader history;
+		if (!OpenHistory(history, files)) {
+			return 1;
+		}
+		history.LimitDays(fromDay, toDay);
+
+		// Only the (period, category) table is kept, never the rows
+		std::unordered_map<std::string, uint32_t> categoryIds;
+		std::vector<std::string> categoryNames;
+		std::unordered_map<uint64_t, int64_t> sums;
+		std::string key;
+		ExpenseRecord record;
+		while (history.Next(record)) {
+			if (record.day < fromDay || record.day > toDay) {
+				continue;
+			}
+			key.assign(record.category);
+			auto category = categoryIds.find(key);
+			if (category == categoryIds.end()) {
+				category = categoryIds.emplace(key, static_cast<uint32_t>(categoryNames.size())).first;
+				categoryNames.push_back(key);
+			}
+			uint64_t cell = static_cast<uint64_t>(static_cast<uint32_t>(PeriodOfDay(period, record.day))) << 32 | category->second;
+			sums[cell] += record.amountCents;
+		}
+		if (HistoryFailed(history, files)) {
+			return 1;
+		}
+
+		std::vector<std::pair<uint64_t, int64_t>> cells(sums.begin(), sums.end());
+		std::sort(cells.begin(), cells.end(), [&categoryNames](const std::pair<uint64_t, int64_t>& a, const std::pair<uint64_t, int64_t>& b) {
+			int32_t periodA = static_cast<int32_t>(a.first >> 32), periodB = static_cast<int32_t>(b.first >> 32);
+			if (periodA != periodB) {
+				return periodA < periodB;
+			}
+			return categoryNames[static_cast<uint32_t>(a.first)] < categoryNames[static_cast<uint32_t>(b.first)];
+			});
+		for (const auto& cell : cells) {
+			std::cout << FormatPeriod(period, static_cast<int32_t>(cell.first >> 32)) << '\t'
+				<< categoryNames[static_cast<uint32_t>(cell.first)] << '\t' << FormatAmountCents(cell.second) << '\n';
+		}
+		return 0;
+	}
+
+	int Query(const DataFiles& files, const Arguments& arguments) {
+		int32_t fromDay = INT32_MIN, toDay = INT32_MAX;
+		int64_t minCents = INT64_MIN, maxCents = INT64_MAX;
+		if (!ParseDateOption(arguments, "from", fromDay) || !ParseDateOption(arguments, "to", toDay)) {
+			return 2;
+		}
+		if ((arguments.Has("min") && !ParseAmountCents(arguments.Get("min"), minCents))
+			|| (arguments.Has("max") && !ParseAmountCents(arguments.Get("max"), maxCents))) {
+			return Fail("--min and --max expect an amount");
+		}
+		uint64_t limit = arguments.Has("limit") ? std::strtoull(arguments.Get("limit").c_str(), nullptr, 10) : UINT64_MAX;
+		std::string category = arguments.Get("category");
+		std::string search = arguments.Get("search");
+		auto lower = [](unsigned char c) { return static_cast<char>(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c); };
+		std::transform(search.begin(), search.end(), search.begin(), lower);
+
+		ExpenseHistoryReader history;
+		if (!OpenHistory(history, files)) {
+			return 1;
+		}
+		history.LimitDays(fromDay, toDay);
+		std::cout << "date,description,category,amount\n";
+		ExpenseRecord record;
+		uint64_t matched = 0;
+		while (matched < limit && history.Next(record)) {
+			if (record.day < fromDay || record.day > toDay || record.amountCents < minCents || record.amountCents > maxCents) {
+				continue;
+			}
+			if (!category.empty() && record.category != category) {
+				continue;
+			}
+			if (!search.empty()) {
+				auto match = std::search(record.description.begin(), record.description.end(), search.begin(), search.end(),
+					[&lower](char a, char b) { return lower(static_cast<unsigned char>(a)) == b; });
+				if (match == record.description.end()) {
+					continue;
+				}
+			}
+			WriteCsvRow(std::cout, record);
+			matched++;
+		}
+		return HistoryFailed(history, files) ? 1 : 0;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::ios::sync_with_stdio(false);
+	std::filesystem::path directory = ".";
+	int i = 1;
+	if (i + 1 < argc && std::string(argv[i]) == "--data") {
+		directory = argv[i + 1];
+		i += 2;
+	}
+	if (i >= argc) {
+		return Usage();
+	}
+	std::string command = argv[i++];
+
+	Arguments arguments;
+	for (; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--keep-duplicates") {
+			arguments.options[arg.substr(2)];  // a flag without a value
+		}
+		else if (arg.compare(0, 2, "--") == 0) {
+			if (i + 1 >= argc) {
+				return Usage();
+			}
+			arguments.options[arg.substr(2)] = argv[++i];
+		}
+		else {
+			arguments.files.push_back(arg);
+		}
+	}
+
+	DataFiles files{ (directory / "expense.bbs").string(), (directory / "expense.journal").string(), (directory / "expense.txt").string() };
+	if (command == "import") {
+		return Import(files, arguments);
+	}
+	if (command == "export") {
+		return Export(files, arguments);
+	}
+	if (command == "totals") {
+		return Totals(files, arguments);
+	}
+	if (command == "query") {
+		return Query(files, arguments);
+	}
+	return Usage();
+}
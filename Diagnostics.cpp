@@ -0,0 +1,141 @@
+#include "Diagnostics.h"
+#include <algorithm>
+#include <fstream>
+
+std::atomic<bool> Diagnostics::enabled{ false };
+Diagnostics::Counters Diagnostics::counters[Diagnostics::MetricCount];
+
+namespace {
+	int BucketOf(uint64_t nanos) {
+		uint64_t micros = nanos / 1000;
+		int bucket = 0;
+		while (micros > 0 && bucket < Diagnostics::BucketCount - 1) {
+			micros >>= 1;
+			bucket++;
+		}
+		return bucket;
+	}
+
+	void AppendField(std::string& json, const char* name, uint64_t value, bool last = false) {
+		json += "\"";
+		json += name;
+		json += "\": ";
+		json += std::to_string(value);
+		json += last ? "" : ", ";
+	}
+}
+
+uint64_t Diagnostics::Stats::PercentileNanos(double fraction) const
+{
+	if (calls == 0) {
+		return 0;
+	}
+	uint64_t wanted = static_cast<uint64_t>(fraction * static_cast<double>(calls));
+	uint64_t seen = 0;
+	for (int bucket = 0; bucket < BucketCount; bucket++) {
+		seen += buckets[bucket];
+		if (seen > wanted || seen == calls) {
+			return bucket == 0 ? 1000 : std::min(maxNanos, (uint64_t(1) << bucket) * 1000);
+		}
+	}
+	return maxNanos;
+}
+
+void Diagnostics::Record(DiagnosticsMetric metric, uint64_t nanos, uint64_t rows, uint64_t bytesRead, uint64_t bytesWritten)
+{
+	Counters& counter = counters[static_cast<int>(metric)];
+	counter.calls.fetch_add(1, std::memory_order_relaxed);
+	counter.totalNanos.fetch_add(nanos, std::memory_order_relaxed);
+	counter.rows.fetch_add(rows, std::memory_order_relaxed);
+	counter.bytesRead.fetch_add(bytesRead, std::memory_order_relaxed);
+	counter.bytesWritten.fetch_add(bytesWritten, std::memory_order_relaxed);
+	counter.buckets[BucketOf(nanos)].fetch_add(1, std::memory_order_relaxed);
+	uint64_t max = counter.maxNanos.load(std::memory_order_relaxed);
+	while (nanos > max && !counter.maxNanos.compare_exchange_weak(max, nanos, std::memory_order_relaxed)) {
+	}
+}
+
+Diagnostics::Stats Diagnostics::Read(DiagnosticsMetric metric)
+{
+	const Counters& counter = counters[static_cast<int>(metric)];
+	Stats stats;
+	stats.calls = counter.calls.load(std::memory_order_relaxed);
+	stats.totalNanos = counter.totalNanos.load(std::memory_order_relaxed);
+	stats.maxNanos = counter.maxNanos.load(std::memory_order_relaxed);
+	stats.rows = counter.rows.load(std::memory_order_relaxed);
+	stats.bytesRead = counter.bytesRead.load(std::memory_order_relaxed);
+	stats.bytesWritten = counter.bytesWritten.load(std::memory_order_relaxed);
+	for (int bucket = 0; bucket < BucketCount; bucket++) {
+		stats.buckets[bucket] = counter.buckets[bucket].load(std::memory_order_relaxed);
+	}
+	return stats;
+}
+
+void Diagnostics::Reset()
+{
+	for (Counters& counter : counters) {
+		counter.calls = 0;
+		counter.totalNanos = 0;
+		counter.maxNanos = 0;
+		counter.rows = 0;
+		counter.bytesRead = 0;
+		counter.bytesWritten = 0;
+		for (std::atomic<uint64_t>& bucket : counter.buckets) {
+			bucket = 0;
+		}
+	}
+}
+
+const char* Diagnostics::Name(DiagnosticsMetric metric)
+{
+	switch (metric) {
+	case DiagnosticsMetric::Load: return "load";
+	case DiagnosticsMetric::Parse: return "parse";
+	case DiagnosticsMetric::Save: return "save";
+	case DiagnosticsMetric::JournalWrite: return "journal_write";
+	case DiagnosticsMetric::Sort: return "sort";
+	case DiagnosticsMetric::Aggregate: return "aggregate";
+	case DiagnosticsMetric::ListFill: return "list_fill";
+	case DiagnosticsMetric::Theme: return "theme";
+	default: return "unknown";
+	}
+}
+
+// One object per metric; the histogram lists the calls per power-of-two bucket in microseconds
+std::string Diagnostics::ToJson()
+{
+	std::string json = "{\n  \"enabled\": ";
+	json += Enabled() ? "true" : "false";
+	json += ",\n  \"metrics\": {";
+	for (int m = 0; m < MetricCount; m++) {
+		Stats stats = Read(static_cast<DiagnosticsMetric>(m));
+		json += m == 0 ? "\n" : ",\n";
+		json += "    \"";
+		json += Name(static_cast<DiagnosticsMetric>(m));
+		json += "\": { ";
+		AppendField(json, "calls", stats.calls);
+		AppendField(json, "total_ns", stats.totalNanos);
+		AppendField(json, "max_ns", stats.maxNanos);
+		AppendField(json, "p50_ns", stats.PercentileNanos(0.5));
+		AppendField(json, "p95_ns", stats.PercentileNanos(0.95));
+		AppendField(json, "rows", stats.rows);
+		AppendField(json, "bytes_read", stats.bytesRead);
+		AppendField(json, "bytes_written", stats.bytesWritten);
+		json += "\"histogram_us\": [";
+		for (int bucket = 0; bucket < BucketCount; bucket++) {
+			json += bucket == 0 ? "" : ", ";
+			json += std::to_string(stats.buckets[bucket]);
+		}
+		json += "] }";
+	}
+	json += "\n  }\n}\n";
+	return json;
+}
+
+bool Diagnostics::WriteJson(const std::string& fileName)
+{
+	std::ofstream ostream(fileName, std::ios::binary | std::ios::trunc);
+	std::string json = ToJson();
+	ostream.write(json.data(), static_cast<std::streamsize>(json.size()));
+	return ostream.good();
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Hot paths that report to Diagnostics
+enum class DiagnosticsMetric { Load, Parse, Save, JournalWrite, Sort, Aggregate, ListFill, Theme, Count };
+
+// Process-wide latency histograms and row and byte counters for the hot paths, shown in the
+// Diagnostics dialog and dumped as JSON. Collection is off until Enable(true); while it is off a
+// DiagnosticsTimer costs one relaxed atomic load and never reads the clock. The counters are
+// relaxed atomics, so worker threads report without taking a lock.
+class Diagnostics
+{
+public:
+	// Bucket b counts the calls that took [2^(b-1), 2^b) microseconds; bucket 0 is under 1 us
+	static constexpr int BucketCount = 32;
+	static constexpr int MetricCount = static_cast<int>(DiagnosticsMetric::Count);
+
+	struct Stats
+	{
+		uint64_t calls = 0;
+		uint64_t totalNanos = 0;
+		uint64_t maxNanos = 0;
+		uint64_t rows = 0;
+		uint64_t bytesRead = 0;
+		uint64_t bytesWritten = 0;
+		uint64_t buckets[BucketCount] = {};
+
+		// Upper edge of the bucket that holds the given fraction of the calls
+		uint64_t PercentileNanos(double fraction) const;
+	};
+
+	static bool Enabled() { return enabled.load(std::memory_order_relaxed); }
+	static void Enable(bool on) { enabled.store(on, std::memory_order_relaxed); }
+
+	static void Record(DiagnosticsMetric metric, uint64_t nanos, uint64_t rows, uint64_t bytesRead, uint64_t bytesWritten);
+	static Stats Read(DiagnosticsMetric metric);
+	static void Reset();
+	static const char* Name(DiagnosticsMetric metric);
+
+	static std::string ToJson();
+	// Returns false if the file could not be written completely
+	static bool WriteJson(const std::string& fileName);
+
+private:
+	struct Counters
+	{
+		std::atomic<uint64_t> calls{ 0 };
+		std::atomic<uint64_t> totalNanos{ 0 };
+		std::atomic<uint64_t> maxNanos{ 0 };
+		std::atomic<uint64_t> rows{ 0 };
+		std::atomic<uint64_t> bytesRead{ 0 };
+		std::atomic<uint64_t> bytesWritten{ 0 };
+		std::atomic<uint64_t> buckets[BucketCount] = {};
+	};
+
+	static std::atomic<bool> enabled;
+	static Counters counters[MetricCount];
+};
+
+// Times its scope (or until Stop) and reports it with the rows and bytes it was given
+class DiagnosticsTimer
+{
+public:
+	explicit DiagnosticsTimer(DiagnosticsMetric metric, uint64_t rows = 0)
+		: metric(metric), rows(rows), running(Diagnostics::Enabled())
+	{
+		if (running) {
+			start = std::chrono::steady_clock::now();
+		}
+	}
+	~DiagnosticsTimer() { Stop(); }
+	DiagnosticsTimer(const DiagnosticsTimer&) = delete;
+	DiagnosticsTimer& operator=(const DiagnosticsTimer&) = delete;
+
+	void Rows(uint64_t count) { rows = count; }
+	void BytesRead(uint64_t bytes) { bytesRead = bytes; }
+	void BytesWritten(uint64_t bytes) { bytesWritten = bytes; }
+
+	void Stop()
+	{
+		if (running) {
+			running = false;
+			auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+			Diagnostics::Record(metric, static_cast<uint64_t>(nanos), rows, bytesRead, bytesWritten);
+		}
+	}
+
+private:
+	DiagnosticsMetric metric;
+	uint64_t rows;
+	uint64_t bytesRead = 0;
+	uint64_t bytesWritten = 0;
+	bool running;
+	std::chrono::steady_clock::time_point start;
+};
@@ -4,6 +4,10 @@
 #include <vector>
 #include <fstream>
 #include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <array>
 
 void AddExpenseToFile(const std::vector<Expense>& expenses, const std::string& fileName)
 {
@@ -46,3 +50,176 @@ std::vector<Expense> LoadExpenseFromFile(const std::string& fileName)
 	}
 	return expenses;
 }
+
+bool ParseAmountCents(std::string_view text, int64_t& cents)
+{
+	size_t i = 0;
+	bool negative = false;
+	if (i < text.size() && (text[i] == '-' || text[i] == '+')) {
+		negative = text[i] == '-';
+		i++;
+	}
+
+	int64_t whole = 0;
+	size_t wholeDigits = 0;
+	while (i < text.size() && text[i] >= '0' && text[i] <= '9') {
+		if (whole > (INT64_MAX / 100 - 9) / 10) {
+			return false; // Too large to hold in cents
+		}
+		whole = whole * 10 + (text[i] - '0');
+		wholeDigits++;
+		i++;
+	}
+
+	int64_t fraction = 0;
+	size_t fractionDigits = 0;
+	if (i < text.size() && text[i] == '.') {
+		i++;
+		while (i < text.size() && text[i] >= '0' && text[i] <= '9') {
+			if (++fractionDigits > 2) {
+				return false;
+			}
+			fraction = fraction * 10 + (text[i] - '0');
+			i++;
+		}
+	}
+
+	if (i != text.size() || wholeDigits + fractionDigits == 0) {
+		return false;
+	}
+	if (fractionDigits == 1) {
+		fraction *= 10;
+	}
+
+	cents = whole * 100 + fraction;
+	if (negative) {
+		cents = -cents;
+	}
+	return true;
+}
+
+std::string FormatAmountCents(int64_t cents)
+{
+	char buffer[32];
+	uint64_t magnitude = cents < 0 ? 0 - static_cast<uint64_t>(cents) : static_cast<uint64_t>(cents);
+	std::snprintf(buffer, sizeof(buffer), "%s%llu.%02llu", cents < 0 ? "-" : "",
+		static_cast<unsigned long long>(magnitude / 100), static_cast<unsigned long long>(magnitude % 100));
+	return buffer;
+}
+
+// Civil date <-> day number conversions (proleptic Gregorian calendar)
+int32_t CivilToDay(int year, int month, int dayOfMonth)
+{
+	year -= month <= 2;
+	const int era = (year >= 0 ? year : year - 399) / 400;
+	const int yearOfEra = year - era * 400;
+	const int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + dayOfMonth - 1;
+	const int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+	return era * 146097 + dayOfEra - 719468;
+}
+
+void DayToCivil(int32_t day, int& year, int& month, int& dayOfMonth)
+{
+	const int32_t z = day + 719468;
+	const int32_t era = (z >= 0 ? z : z - 146096) / 146097;
+	const int32_t dayOfEra = z - era * 146097;
+	const int32_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+	const int32_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+	const int32_t mp = (5 * dayOfYear + 2) / 153;
+	dayOfMonth = dayOfYear - (153 * mp + 2) / 5 + 1;
+	month = mp < 10 ? mp + 3 : mp - 9;
+	year = yearOfEra + era * 400 + (month <= 2);
+}
+
+bool ParseIsoDate(std::string_view text, int32_t& day)
+{
+	if (text.size() != 10 || text[4] != '-' || text[7] != '-') {
+		return false;
+	}
+	int fields[3] = { 0, 0, 0 };
+	const size_t starts[3] = { 0, 5, 8 };
+	const size_t lengths[3] = { 4, 2, 2 };
+	for (int f = 0; f < 3; f++) {
+		for (size_t i = starts[f]; i < starts[f] + lengths[f]; i++) {
+			if (text[i] < '0' || text[i] > '9') {
+				return false;
+			}
+			fields[f] = fields[f] * 10 + (text[i] - '0');
+		}
+	}
+
+	static const int daysInMonth[12] = { 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	const int year = fields[0], month = fields[1], dayOfMonth = fields[2];
+	if (month < 1 || month > 12 || dayOfMonth < 1 || dayOfMonth > daysInMonth[month - 1]) {
+		return false;
+	}
+	bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+	if (month == 2 && dayOfMonth == 29 && !leap) {
+		return false;
+	}
+
+	day = CivilToDay(year, month, dayOfMonth);
+	return true;
+}
+
+std::string FormatIsoDate(int32_t day)
+{
+	int year, month, dayOfMonth;
+	DayToCivil(day, year, month, dayOfMonth);
+	char buffer[32];
+	std::snprintf(buffer, sizeof(buffer), "%04d-%02d-%02d", year, month, dayOfMonth);
+	return buffer;
+}
+
+int32_t MonthOfDay(int32_t day)
+{
+	int year, month, dayOfMonth;
+	DayToCivil(day, year, month, dayOfMonth);
+	return year * 12 + (month - 1);
+}
+
+std::string FormatMonth(int32_t month)
+{
+	char buffer[16];
+	std::snprintf(buffer, sizeof(buffer), "%04d-%02d", month / 12, month % 12 + 1);
+	return buffer;
+}
+
+namespace {
+	// Eight tables, so the loop below can take the checksum eight bytes at a time
+	std::array<std::array<uint32_t, 256>, 8> MakeCrcTables() {
+		std::array<std::array<uint32_t, 256>, 8> tables{};
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t crc = i;
+			for (int bit = 0; bit < 8; bit++) {
+				crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+			}
+			tables[0][i] = crc;
+		}
+		for (uint32_t i = 0; i < 256; i++) {
+			for (size_t k = 1; k < tables.size(); k++) {
+				tables[k][i] = tables[0][tables[k - 1][i] & 0xFF] ^ (tables[k - 1][i] >> 8);
+			}
+		}
+		return tables;
+	}
+}
+
+uint32_t Crc32(const char* data, size_t size)
+{
+	static const std::array<std::array<uint32_t, 256>, 8> tables = MakeCrcTables();
+	const auto* bytes = reinterpret_cast<const uint8_t*>(data);
+	uint32_t crc = 0xFFFFFFFFu;
+	for (; size >= 8; size -= 8, bytes += 8) {
+		uint32_t low, high;
+		std::memcpy(&low, bytes, 4);
+		std::memcpy(&high, bytes + 4, 4);
+		low ^= crc;
+		crc = tables[7][low & 0xFF] ^ tables[6][(low >> 8) & 0xFF] ^ tables[5][(low >> 16) & 0xFF] ^ tables[4][low >> 24]
+			^ tables[3][high & 0xFF] ^ tables[2][(high >> 8) & 0xFF] ^ tables[1][(high >> 16) & 0xFF] ^ tables[0][high >> 24];
+	}
+	for (; size > 0; size--, bytes++) {
+		crc = tables[0][(crc ^ *bytes) & 0xFF] ^ (crc >> 8);
+	}
+	return crc ^ 0xFFFFFFFFu;
+}
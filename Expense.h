@@ -1,7 +1,8 @@
 #pragma once
 #include <vector>
-
+#include <cstdint>
 #include <string>
+#include <string_view>
 
 struct Expense
 {
@@ -13,3 +14,40 @@ struct Expense
 
 void AddExpenseToFile(const std::vector<Expense>& expenses, const std::string& fileName);
 std::vector<Expense> LoadExpenseFromFile(const std::string& fileName);
+
+// Amounts are kept as integer cents ("120.5" -> 12050). Returns false for anything that
+// is not a plain decimal number with at most two fractional digits.
+bool ParseAmountCents(std::string_view text, int64_t& cents);
+std::string FormatAmountCents(int64_t cents);
+
+// An exact amount in cents, validated once when it enters the app and never parsed again.
+// It is a single int64, the same as the store's amount column.
+struct Money
+{
+	int64_t cents = 0;
+
+	static bool Parse(std::string_view text, Money& money) { return ParseAmountCents(text, money.cents); }
+	std::string ToString() const { return FormatAmountCents(cents); }
+
+	Money& operator+=(Money other) { cents += other.cents; return *this; }
+	Money& operator-=(Money other) { cents -= other.cents; return *this; }
+	friend Money operator+(Money a, Money b) { return a += b; }
+	friend Money operator-(Money a, Money b) { return a -= b; }
+	friend bool operator==(Money a, Money b) { return a.cents == b.cents; }
+	friend bool operator!=(Money a, Money b) { return a.cents != b.cents; }
+	friend bool operator<(Money a, Money b) { return a.cents < b.cents; }
+};
+static_assert(sizeof(Money) == sizeof(int64_t), "Money must match the amount column");
+
+// Dates are kept as day numbers counted from 1970-01-01 ("2025-08-05" -> 20305).
+bool ParseIsoDate(std::string_view text, int32_t& day);
+std::string FormatIsoDate(int32_t day);
+void DayToCivil(int32_t day, int& year, int& month, int& dayOfMonth);
+int32_t CivilToDay(int year, int month, int dayOfMonth);
+
+// Month key used for monthly grouping: year * 12 + (month - 1)
+int32_t MonthOfDay(int32_t day);
+std::string FormatMonth(int32_t month);
+
+// CRC-32 (the zlib polynomial) of a block, for the checksums of the binary data files
+uint32_t Crc32(const char* data, size_t size);
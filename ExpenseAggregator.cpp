@@ -0,0 +1,357 @@
+#include "ExpenseAggregator.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+	struct Sum
+	{
+		int64_t cents = 0;
+		size_t rows = 0;
+	};
+
+	// Ids for distinct descriptions, in an open-addressing table keyed by the store's description
+	// hash; the text is only compared when two hashes match
+	class DescriptionIds
+	{
+	public:
+		const std::vector<std::string_view>& Names() const { return names; }
+		const std::vector<uint32_t>& Hashes() const { return hashes; }
+
+		uint32_t Intern(uint32_t hash, std::string_view description) {
+			if ((names.size() + 1) * 4 > slots.size() * 3) {
+				Grow();
+			}
+			const size_t mask = slots.size() - 1;
+			size_t slot = Mix(hash) & mask;
+			for (; slots[slot] != Empty; slot = (slot + 1) & mask) {
+				uint32_t id = slots[slot];
+				if (hashes[id] == hash && names[id] == description) {
+					return id;
+				}
+			}
+			uint32_t id = static_cast<uint32_t>(names.size());
+			slots[slot] = id;
+			names.push_back(description);
+			hashes.push_back(hash);
+			return id;
+		}
+
+	private:
+		static constexpr uint32_t Empty = UINT32_MAX;
+
+		std::vector<uint32_t> slots;  // ids, Empty when free
+		std::vector<std::string_view> names;
+		std::vector<uint32_t> hashes;
+
+		// FNV-1a leaves the low bits weak, so they are mixed before masking
+		static size_t Mix(uint32_t hash) {
+			return static_cast<size_t>((hash * 0x9E3779B97F4A7C15ULL) >> 32);
+		}
+
+		void Grow() {
+			slots.assign(std::max<size_t>(slots.size() * 2, 1024), Empty);
+			const size_t mask = slots.size() - 1;
+			for (uint32_t id = 0; id < names.size(); id++) {
+				size_t slot = Mix(hashes[id]) & mask;
+				while (slots[slot] != Empty) {
+					slot = (slot + 1) & mask;
+				}
+				slots[slot] = id;
+			}
+		}
+	};
+
+	uint64_t KeyOf(int32_t period, uint32_t group) {
+		return (static_cast<uint64_t>(static_cast<uint32_t>(period)) << 32) | group;
+	}
+
+	// Sums by (period << 32 | group) in one open-addressing array; grouping by description makes
+	// hundreds of thousands of them, where a node per sum would cost an allocation each
+	class SumTable
+	{
+	public:
+		struct Entry
+		{
+			uint64_t key = 0;
+			int64_t cents = 0;
+			size_t rows = 0;   // 0 marks a free slot; a sum always has rows
+		};
+
+		void Add(uint64_t key, int64_t cents, size_t rows) {
+			if ((used + 1) * 4 > entries.size() * 3) {
+				Grow();
+			}
+			Entry& entry = Find(key);
+			if (entry.rows == 0) {
+				entry.key = key;
+				used++;
+			}
+			entry.cents += cents;
+			entry.rows += rows;
+		}
+
+		size_t Size() const { return used; }
+		// Every sum, free slots included; skip those with no rows
+		const std::vector<Entry>& Entries() const { return entries; }
+
+	private:
+		std::vector<Entry> entries;
+		size_t used = 0;
+
+		Entry& Find(uint64_t key) {
+			const size_t mask = entries.size() - 1;
+			size_t slot = static_cast<size_t>((key * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+			while (entries[slot].rows != 0 && entries[slot].key != key) {
+				slot = (slot + 1) & mask;
+			}
+			return entries[slot];
+		}
+
+		void Grow() {
+			std::vector<Entry> old(std::max<size_t>(entries.size() * 2, 1024));
+			old.swap(entries);
+			for (const Entry& entry : old) {
+				if (entry.rows != 0) {
+					Find(entry.key) = entry;
+				}
+			}
+		}
+	};
+
+	// Everything one thread collects over its share of the rows
+	struct Partial
+	{
+		SumTable sums;
+		DescriptionIds descriptions;              // only for description grouping
+		size_t matchedRows = 0;
+
+		// Rows mostly come in date order, so the sums of the period being scanned are kept in an
+		// array by group and only moved into the table when the period changes
+		void Add(int32_t period, uint32_t group, int64_t cents) {
+			if (period != currentPeriod) {
+				Flush();
+				currentPeriod = period;
+			}
+			if (group >= current.size()) {
+				current.resize(static_cast<size_t>(group) + 1);
+			}
+			Sum& sum = current[group];
+			if (sum.rows == 0) {
+				touched.push_back(group);
+			}
+			sum.cents += cents;
+			sum.rows++;
+			matchedRows++;
+		}
+
+		void Flush() {
+			for (uint32_t group : touched) {
+				sums.Add(KeyOf(currentPeriod, group), current[group].cents, current[group].rows);
+				current[group] = Sum();
+			}
+			touched.clear();
+		}
+
+	private:
+		int32_t currentPeriod = 0;
+		std::vector<Sum> current;
+		std::vector<uint32_t> touched;
+	};
+
+	bool Bounded(const AggregateQuery& query) {
+		return query.fromDay != INT32_MIN || query.toDay != INT32_MAX;
+	}
+}
+
+int32_t PeriodOfDay(AggregatePeriod period, int32_t day)
+{
+	int year, month, dayOfMonth;
+	switch (period) {
+	case AggregatePeriod::Day:
+		return day;
+	case AggregatePeriod::Week:
+		// 1970-01-01 was a Thursday, so Mondays are the days with (day + 3) % 7 == 0
+		return day - ((day + 3) % 7 + 7) % 7;
+	case AggregatePeriod::Month:
+		return MonthOfDay(day);
+	case AggregatePeriod::Quarter:
+		DayToCivil(day, year, month, dayOfMonth);
+		return year * 4 + (month - 1) / 3;
+	case AggregatePeriod::Year:
+	default:
+		DayToCivil(day, year, month, dayOfMonth);
+		return year;
+	}
+}
+
+std::string FormatPeriod(AggregatePeriod period, int32_t key)
+{
+	char buffer[32];
+	switch (period) {
+	case AggregatePeriod::Day:
+		return FormatIsoDate(key);
+	case AggregatePeriod::Week:
+		return "Week of " + FormatIsoDate(key);
+	case AggregatePeriod::Month:
+		return FormatMonth(key);
+	case AggregatePeriod::Quarter:
+		std::snprintf(buffer, sizeof(buffer), "%04d-Q%d", key / 4, key % 4 + 1);
+		return buffer;
+	case AggregatePeriod::Year:
+	default:
+		std::snprintf(buffer, sizeof(buffer), "%04d", key);
+		return buffer;
+	}
+}
+
+AggregateResult AggregateExpenses(const ExpenseStore& store, const AggregateQuery& query, ThreadPool& pool, ExpenseSortIndex* sortIndex)
+{
+	const std::vector<int64_t>& amounts = store.Amounts();
+	const std::vector<int32_t>& days = store.Days();
+	const std::vector<ExpenseStore::CategoryId>& categories = store.CategoryIds();
+	const std::vector<uint32_t>& hashes = store.DescriptionHashes();
+	const bool byDescription = query.group == AggregateGroup::Description;
+
+	// A bounded range reads only its slice of the date order; every row in it matches
+	const ExpenseStore::RowId* slice = nullptr;
+	size_t count = store.Size();
+	if (sortIndex && Bounded(query)) {
+		std::pair<size_t, size_t> range = sortIndex->DateRange(query.fromDay, query.toDay);
+		slice = sortIndex->Order(SortColumn::Date).data() + range.first;
+		count = range.second - range.first;
+	}
+
+	std::vector<Partial> partials(pool.ThreadCount());
+	pool.ParallelFor(count, [&](unsigned part, size_t begin, size_t end) {
+		Partial& partial = partials[part];
+		// Consecutive rows usually share a day, so the period is only recomputed when it changes
+		int32_t lastDay = 0, period = PeriodOfDay(query.period, 0);
+		for (size_t i = begin; i < end; i++) {
+			const size_t row = slice ? slice[i] : i;
+			const int32_t day = days[row];
+			if (day < query.fromDay || day > query.toDay) {
+				continue;
+			}
+			if (day != lastDay) {
+				lastDay = day;
+				period = PeriodOfDay(query.period, day);
+			}
+
+			uint32_t group = categories[row];
+			if (byDescription) {
+				group = partial.descriptions.Intern(hashes[row], store.Description(static_cast<ExpenseStore::RowId>(row)));
+			}
+
+			partial.Add(period, group, amounts[row]);
+		}
+		partial.Flush();
+		});
+
+	// Merge the thread-local tables, translating per-thread description ids to shared ones
+	AggregateResult result;
+	SumTable merged;
+	DescriptionIds groupIds;
+	if (!byDescription) {
+		for (ExpenseStore::CategoryId id = 0; id < store.CategoryCount(); id++) {
+			result.groupNames.push_back(store.CategoryName(id));
+		}
+	}
+	for (Partial& partial : partials) {
+		std::vector<uint32_t> remap;
+		if (byDescription) {
+			const std::vector<std::string_view>& names = partial.descriptions.Names();
+			remap.resize(names.size());
+			for (size_t i = 0; i < names.size(); i++) {
+				remap[i] = groupIds.Intern(partial.descriptions.Hashes()[i], names[i]);
+			}
+		}
+		for (const SumTable::Entry& sum : partial.sums.Entries()) {
+			if (sum.rows == 0) {
+				continue;
+			}
+			uint32_t group = static_cast<uint32_t>(sum.key & 0xFFFFFFFFu);
+			merged.Add(KeyOf(static_cast<int32_t>(sum.key >> 32), byDescription ? remap[group] : group), sum.cents, sum.rows);
+		}
+		result.matchedRows += partial.matchedRows;
+	}
+	if (byDescription) {
+		result.groupNames = groupIds.Names();
+	}
+
+	result.rows.reserve(merged.Size());
+	for (const SumTable::Entry& sum : merged.Entries()) {
+		if (sum.rows != 0) {
+			result.rows.push_back(AggregateResult::Row{ static_cast<int32_t>(sum.key >> 32), static_cast<uint32_t>(sum.key & 0xFFFFFFFFu), sum.cents, sum.rows });
+		}
+	}
+	// The names are ranked once, so the rows sort on integers instead of comparing text
+	std::vector<uint32_t> byName(result.groupNames.size());
+	for (uint32_t group = 0; group < byName.size(); group++) {
+		byName[group] = group;
+	}
+	std::sort(byName.begin(), byName.end(), [&result](uint32_t a, uint32_t b) {
+		return result.groupNames[a] < result.groupNames[b];
+		});
+	std::vector<uint32_t> rank(byName.size());
+	for (uint32_t i = 0; i < byName.size(); i++) {
+		rank[byName[i]] = i;
+	}
+	std::sort(result.rows.begin(), result.rows.end(), [&rank](const AggregateResult::Row& a, const AggregateResult::Row& b) {
+		if (a.period != b.period) {
+			return a.period < b.period;
+		}
+		return rank[a.group] < rank[b.group];
+		});
+	return result;
+}
+
+std::vector<ExpenseStore::RowId> AggregatedRows(const ExpenseStore& store, const AggregateQuery& query,
+	const int32_t* period, const std::string_view* group, ExpenseSortIndex* sortIndex)
+{
+	std::vector<ExpenseStore::RowId> rows;
+	const bool byDescription = query.group == AggregateGroup::Description;
+	ExpenseStore::CategoryId category = ExpenseStore::NoCategory;
+	if (group && !byDescription) {
+		category = store.FindCategory(*group);
+		if (category == ExpenseStore::NoCategory) {
+			return rows;
+		}
+	}
+	const uint32_t groupHash = group && byDescription ? ExpenseStore::HashDescription(*group) : 0;
+
+	const ExpenseStore::RowId* slice = nullptr;
+	size_t count = store.Size();
+	if (sortIndex && Bounded(query)) {
+		std::pair<size_t, size_t> range = sortIndex->DateRange(query.fromDay, query.toDay);
+		slice = sortIndex->Order(SortColumn::Date).data() + range.first;
+		count = range.second - range.first;
+	}
+
+	int32_t lastDay = 0, lastPeriod = PeriodOfDay(query.period, 0);
+	for (size_t i = 0; i < count; i++) {
+		const ExpenseStore::RowId id = slice ? slice[i] : static_cast<ExpenseStore::RowId>(i);
+		const int32_t day = store.Day(id);
+		if (day < query.fromDay || day > query.toDay) {
+			continue;
+		}
+		if (period) {
+			if (day != lastDay) {
+				lastDay = day;
+				lastPeriod = PeriodOfDay(query.period, day);
+			}
+			if (lastPeriod != *period) {
+				continue;
+			}
+		}
+		if (group) {
+			if (byDescription ? store.DescriptionHashes()[id] != groupHash || store.Description(id) != *group : store.CategoryOf(id) != category) {
+				continue;
+			}
+		}
+		rows.push_back(id);
+	}
+	if (slice) {
+		std::sort(rows.begin(), rows.end());
+	}
+	return rows;
+}
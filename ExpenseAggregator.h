@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ExpenseSortIndex.h"
+#include "ExpenseStore.h"
+#include "ThreadPool.h"
+
+enum class AggregatePeriod { Day, Week, Month, Quarter, Year };
+enum class AggregateGroup { Category, Description };
+
+struct AggregateQuery
+{
+	int32_t fromDay = INT32_MIN;              // inclusive day number range
+	int32_t toDay = INT32_MAX;
+	AggregatePeriod period = AggregatePeriod::Month;
+	AggregateGroup group = AggregateGroup::Category;
+};
+
+struct AggregateResult
+{
+	struct Row
+	{
+		int32_t period;                       // see PeriodOfDay
+		uint32_t group;                       // index into groupNames
+		int64_t cents;
+		size_t rows;
+	};
+
+	std::vector<Row> rows;                    // ordered by period, then group name
+	std::vector<std::string_view> groupNames; // views into the store; valid until it changes
+	size_t matchedRows = 0;
+};
+
+// Period key of a day: the day itself, the Monday starting its week, year * 12 + month - 1,
+// year * 4 + quarter - 1 or the year
+int32_t PeriodOfDay(AggregatePeriod period, int32_t day);
+std::string FormatPeriod(AggregatePeriod period, int32_t key);
+
+// Totals over a date range grouped by period and category or description.
+// The rows are split across the pool; each thread fills its own hash table and the
+// partial tables are merged at the end, so no locks are taken during the scan. Descriptions
+// are grouped by the hash the store keeps for them, so their text is only compared, never
+// hashed. Given a sort index, a bounded range only visits the rows of its date slice.
+AggregateResult AggregateExpenses(const ExpenseStore& store, const AggregateQuery& query, ThreadPool& pool,
+	ExpenseSortIndex* sortIndex = nullptr);
+
+// The rows behind one total: those in the query's range that fall in the period and group, in
+// row order. A null period or group matches every period or group.
+std::vector<ExpenseStore::RowId> AggregatedRows(const ExpenseStore& store, const AggregateQuery& query,
+	const int32_t* period, const std::string_view* group, ExpenseSortIndex* sortIndex = nullptr);
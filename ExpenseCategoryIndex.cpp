@@ -0,0 +1,133 @@
+#include "ExpenseCategoryIndex.h"
+#include <algorithm>
+
+namespace {
+	unsigned char Fold(char c) {
+		unsigned char byte = static_cast<unsigned char>(c);
+		return byte >= 'A' && byte <= 'Z' ? static_cast<unsigned char>(byte + ('a' - 'A')) : byte;
+	}
+}
+
+ExpenseCategoryIndex::ExpenseCategoryIndex(const ExpenseStore& store)
+	: store(store)
+{
+}
+
+std::vector<ExpenseStore::CategoryId> ExpenseCategoryIndex::Complete(std::string_view prefix, size_t limit)
+{
+	if (!built) {
+		Build();
+	}
+	std::vector<ExpenseStore::CategoryId> matches;
+
+	uint32_t node = 0;
+	for (char c : prefix) {
+		const auto& children = nodes[node].children;
+		auto child = std::lower_bound(children.begin(), children.end(), std::make_pair(Fold(c), uint32_t(0)));
+		if (child == children.end() || child->first != Fold(c)) {
+			return matches;
+		}
+		node = child->second;
+	}
+
+	// Every name below the prefix node matches; there are few enough categories to rank them all
+	std::vector<uint32_t> pending{ node };
+	while (!pending.empty()) {
+		const Node& current = nodes[pending.back()];
+		pending.pop_back();
+		matches.insert(matches.end(), current.categories.begin(), current.categories.end());
+		for (const auto& child : current.children) {
+			pending.push_back(child.second);
+		}
+	}
+
+	auto ranked = [this](ExpenseStore::CategoryId a, ExpenseStore::CategoryId b) {
+		return uses[a] != uses[b] ? uses[a] > uses[b] : store.CategoryName(a) < store.CategoryName(b);
+	};
+	if (limit < matches.size()) {
+		std::partial_sort(matches.begin(), matches.begin() + limit, matches.end(), ranked);
+		matches.resize(limit);
+	}
+	else {
+		std::sort(matches.begin(), matches.end(), ranked);
+	}
+	return matches;
+}
+
+size_t ExpenseCategoryIndex::Uses(ExpenseStore::CategoryId category)
+{
+	if (!built) {
+		Build();
+	}
+	return category < uses.size() ? uses[category] : 0;
+}
+
+void ExpenseCategoryIndex::Insert(ExpenseStore::RowId row)
+{
+	if (!built) {
+		return;
+	}
+	AddNewCategories();
+	uses[store.CategoryOf(row)]++;
+}
+
+void ExpenseCategoryIndex::EraseRows(const std::vector<ExpenseStore::RowId>& rows)
+{
+	// Use counts do not care about positions; each row just gives back its count
+	for (ExpenseStore::RowId row : rows) {
+		Erase(row);
+	}
+}
+
+void ExpenseCategoryIndex::Erase(ExpenseStore::RowId row)
+{
+	if (!built) {
+		return;
+	}
+	uses[store.CategoryOf(row)]--;
+}
+
+void ExpenseCategoryIndex::Clear()
+{
+	nodes = {};
+	uses = {};
+	built = false;
+}
+
+void ExpenseCategoryIndex::Build()
+{
+	nodes.assign(1, Node());
+	uses.clear();
+	AddNewCategories();
+	for (ExpenseStore::CategoryId category : store.CategoryIds()) {
+		uses[category]++;
+	}
+	built = true;
+}
+
+// The dictionary only grows, so new names are the ids past the ones already counted
+void ExpenseCategoryIndex::AddNewCategories()
+{
+	for (ExpenseStore::CategoryId category = static_cast<ExpenseStore::CategoryId>(uses.size()); category < store.CategoryCount(); category++) {
+		AddName(category);
+		uses.push_back(0);
+	}
+}
+
+void ExpenseCategoryIndex::AddName(ExpenseStore::CategoryId category)
+{
+	uint32_t node = 0;
+	for (char c : store.CategoryName(category)) {
+		auto& children = nodes[node].children;
+		auto child = std::lower_bound(children.begin(), children.end(), std::make_pair(Fold(c), uint32_t(0)));
+		if (child != children.end() && child->first == Fold(c)) {
+			node = child->second;
+			continue;
+		}
+		uint32_t next = static_cast<uint32_t>(nodes.size());
+		children.insert(child, std::make_pair(Fold(c), next));
+		nodes.emplace_back();  // may reallocate, so children is not used past this point
+		node = next;
+	}
+	nodes[node].categories.push_back(category);
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "ExpenseStore.h"
+
+// Usage counts for the store's category dictionary plus a prefix trie over the names, used to
+// autocomplete the category input. Names are matched ignoring ASCII case and suggestions are
+// ranked by how many rows use them. Counts are taken from the store on first use and then
+// adjusted by one on every add and remove.
+class ExpenseCategoryIndex
+{
+public:
+	explicit ExpenseCategoryIndex(const ExpenseStore& store);
+
+	// Up to limit categories starting with prefix, most used first, then by name
+	std::vector<ExpenseStore::CategoryId> Complete(std::string_view prefix, size_t limit = SIZE_MAX);
+	size_t Uses(ExpenseStore::CategoryId category);
+
+	// Call after the row was added to the store
+	void Insert(ExpenseStore::RowId row);
+	// Call before the row is removed from the store
+	void Erase(ExpenseStore::RowId row);
+	// Call before the ascending rows are removed from the store with RemoveRows
+	void EraseRows(const std::vector<ExpenseStore::RowId>& rows);
+	// Drops the counts and the trie; they are rebuilt on next use
+	void Clear();
+
+private:
+	struct Node
+	{
+		std::vector<std::pair<unsigned char, uint32_t>> children;  // folded byte -> node, sorted by byte
+		std::vector<ExpenseStore::CategoryId> categories;          // names that end here
+	};
+
+	const ExpenseStore& store;
+	std::vector<Node> nodes;      // nodes[0] is the root
+	std::vector<size_t> uses;     // category id -> rows
+	bool built = false;
+
+	void Build();
+	void AddNewCategories();
+	void AddName(ExpenseStore::CategoryId category);
+};
@@ -0,0 +1,283 @@
+#include "ExpenseCsv.h"
+#include "Expense.h"
+#include <algorithm>
+#include <cctype>
+
+namespace {
+	std::string_view Trim(std::string_view text) {
+		while (!text.empty() && std::isspace(static_cast<unsigned char>(text.front()))) {
+			text.remove_prefix(1);
+		}
+		while (!text.empty() && std::isspace(static_cast<unsigned char>(text.back()))) {
+			text.remove_suffix(1);
+		}
+		return text;
+	}
+
+	bool IsDigit(char c) {
+		return c >= '0' && c <= '9';
+	}
+
+	// Letters of a currency code and the bytes of a symbol such as '$' or a UTF-8 '€'
+	bool IsCurrency(char c) {
+		return std::isalpha(static_cast<unsigned char>(c)) || static_cast<unsigned char>(c) >= 0x80 || c == '$';
+	}
+
+	// Reads up to maxDigits digits; false if there are none
+	bool ReadNumber(std::string_view text, size_t& i, size_t maxDigits, int& value) {
+		size_t start = i;
+		value = 0;
+		while (i < text.size() && IsDigit(text[i]) && i - start < maxDigits) {
+			value = value * 10 + (text[i++] - '0');
+		}
+		return i > start;
+	}
+
+	std::string Lower(std::string_view text) {
+		std::string lower(Trim(text));
+		std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+		return lower;
+	}
+
+	std::string_view Field(const std::vector<std::string_view>& fields, size_t count, int column) {
+		return column >= 0 && static_cast<size_t>(column) < count ? fields[static_cast<size_t>(column)] : std::string_view();
+	}
+}
+
+size_t SplitCsvLine(std::string_view line, char delimiter, char quote, std::vector<std::string_view>& fields, std::string& scratch)
+{
+	scratch.clear();
+	scratch.reserve(line.size());
+	size_t count = 0;
+	size_t i = 0;
+	while (true) {
+		std::string_view field;
+		while (i < line.size() && line[i] == ' ' && delimiter != ' ') {
+			i++;
+		}
+		if (quote != '\0' && i < line.size() && line[i] == quote) {
+			// Copy the unescaped text into scratch; its capacity covers the whole line
+			size_t start = scratch.size();
+			for (i++; i < line.size(); i++) {
+				if (line[i] != quote) {
+					scratch += line[i];
+				}
+				else if (i + 1 < line.size() && line[i + 1] == quote) {
+					scratch += quote;
+					i++;
+				}
+				else {
+					i++;
+					break;
+				}
+			}
+			field = std::string_view(scratch.data() + start, scratch.size() - start);
+			while (i < line.size() && line[i] != delimiter) {
+				i++;
+			}
+		}
+		else {
+			size_t start = i;
+			while (i < line.size() && line[i] != delimiter) {
+				i++;
+			}
+			field = Trim(line.substr(start, i - start));
+		}
+
+		if (count == fields.size()) {
+			fields.push_back(field);
+		}
+		else {
+			fields[count] = field;
+		}
+		count++;
+		if (i >= line.size()) {
+			return count;
+		}
+		i++; // the delimiter
+	}
+}
+
+bool MapCsvHeader(std::string_view line, CsvImportOptions& options)
+{
+	std::vector<std::string_view> fields;
+	std::string scratch;
+	size_t count = SplitCsvLine(line, options.delimiter, options.quote, fields, scratch);
+	int found[4] = { -1, -1, -1, -1 };
+	for (size_t i = 0; i < count; i++) {
+		std::string name = Lower(fields[i]);
+		int index = static_cast<int>(i);
+		if (name == "description" || name == "memo" || name == "narration" || name == "details" || name == "payee") {
+			found[0] = index;
+		}
+		else if (name == "category") {
+			found[1] = index;
+		}
+		else if (name == "amount" || name == "value" || name == "debit") {
+			found[2] = index;
+		}
+		else if (name == "date" || name == "transaction date" || name == "posted date" || name == "posting date" || name == "value date") {
+			found[3] = index;
+		}
+	}
+	if (found[2] < 0 || found[3] < 0) {
+		return false;
+	}
+	options.descriptionColumn = found[0];
+	options.categoryColumn = found[1];
+	options.amountColumn = found[2];
+	options.dateColumn = found[3];
+	return true;
+}
+
+char DetectCsvDelimiter(std::string_view line)
+{
+	const char candidates[] = { ',', ';', '\t', '|' };
+	char best = ',';
+	long bestCount = 0;
+	for (char candidate : candidates) {
+		long count = static_cast<long>(std::count(line.begin(), line.end(), candidate));
+		if (count > bestCount) {
+			best = candidate;
+			bestCount = count;
+		}
+	}
+	return best;
+}
+
+bool ParseCsvRow(std::string_view line, const CsvImportOptions& options, CsvRow& row, std::vector<std::string_view>& fields, std::string& scratch)
+{
+	if (!line.empty() && line.back() == '\r') {
+		line.remove_suffix(1);
+	}
+	if (Trim(line).empty()) {
+		return false;
+	}
+	size_t count = SplitCsvLine(line, options.delimiter, options.quote, fields, scratch);
+
+	row.error = nullptr;
+	row.errorField = {};
+	std::string_view amount = Field(fields, count, options.amountColumn);
+	std::string_view date = Field(fields, count, options.dateColumn);
+	if (!ParseCsvAmount(amount, options.decimalSeparator, row.amountCents)) {
+		row.error = "invalid amount";
+		row.errorField = amount;
+		return true;
+	}
+	if (!ParseCsvDate(date, options.dateFormat, row.day)) {
+		row.error = "invalid date";
+		row.errorField = date;
+		return true;
+	}
+	if (options.negateAmounts) {
+		row.amountCents = -row.amountCents;
+	}
+	row.description = Field(fields, count, options.descriptionColumn);
+	row.category = Field(fields, count, options.categoryColumn);
+	if (row.category.empty()) {
+		row.category = options.defaultCategory;
+	}
+	return true;
+}
+
+// Three numbers in the given order with any single separator, optionally followed by a time
+bool ParseCsvDate(std::string_view text, CsvDateFormat format, int32_t& day)
+{
+	text = Trim(text);
+	if (format == CsvDateFormat::YearMonthDay && ParseIsoDate(text.substr(0, 10), day)) {
+		return text.size() == 10 || text[10] == ' ' || text[10] == 'T';
+	}
+
+	int parts[3];
+	size_t i = 0;
+	for (int p = 0; p < 3; p++) {
+		if (p > 0) {
+			if (i >= text.size() || IsDigit(text[i])) {
+				return false;
+			}
+			i++;
+		}
+		size_t maxDigits = (format == CsvDateFormat::YearMonthDay && p == 0) || (format != CsvDateFormat::YearMonthDay && p == 2) ? 4 : 2;
+		if (!ReadNumber(text, i, maxDigits, parts[p])) {
+			return false;
+		}
+	}
+	if (i < text.size() && text[i] != ' ' && text[i] != 'T') {
+		return false;
+	}
+
+	int year, month, dayOfMonth;
+	switch (format) {
+	case CsvDateFormat::DayMonthYear:
+		dayOfMonth = parts[0]; month = parts[1]; year = parts[2];
+		break;
+	case CsvDateFormat::MonthDayYear:
+		month = parts[0]; dayOfMonth = parts[1]; year = parts[2];
+		break;
+	case CsvDateFormat::YearMonthDay:
+	default:
+		year = parts[0]; month = parts[1]; dayOfMonth = parts[2];
+		break;
+	}
+	if (year < 100) {
+		year += 2000;
+	}
+	if (month < 1 || month > 12 || dayOfMonth < 1 || dayOfMonth > 31) {
+		return false;
+	}
+	// Reject dates like 31/02 that CivilToDay would roll over into the next month
+	day = CivilToDay(year, month, dayOfMonth);
+	int checkYear, checkMonth, checkDay;
+	DayToCivil(day, checkYear, checkMonth, checkDay);
+	return checkMonth == month && checkDay == dayOfMonth;
+}
+
+// Accepts a currency symbol or code before or after the number, thousands separators and
+// accounting style "(12.50)" negatives
+bool ParseCsvAmount(std::string_view text, char decimalSeparator, int64_t& cents)
+{
+	const char thousandsSeparator = decimalSeparator == ',' ? '.' : ',';
+	text = Trim(text);
+	bool parenthesised = text.size() >= 2 && text.front() == '(' && text.back() == ')';
+	if (parenthesised) {
+		text = text.substr(1, text.size() - 2);
+	}
+
+	char normalised[64];
+	size_t length = 0;
+	if (parenthesised) {
+		normalised[length++] = '-';
+	}
+	// A sign may come before the currency, as in "-$12.50"
+	if (!text.empty() && (text.front() == '-' || text.front() == '+')) {
+		normalised[length++] = text.front();
+		text.remove_prefix(1);
+	}
+	// Letters inside the number are not stripped, so "1e3" or "12abc34" is an invalid amount
+	while (!text.empty() && IsCurrency(text.front())) {
+		text.remove_prefix(1);
+	}
+	while (!text.empty() && IsCurrency(text.back())) {
+		text.remove_suffix(1);
+	}
+	text = Trim(text);
+
+	for (char c : text) {
+		if (length + 1 >= sizeof(normalised)) {
+			return false;
+		}
+		if (IsDigit(c) || c == '-' || c == '+') {
+			normalised[length++] = c;
+		}
+		else if (c == decimalSeparator) {
+			normalised[length++] = '.';
+		}
+		else if (c == thousandsSeparator || c == ' ' || c == '\'') {
+			continue;
+		}
+		else {
+			return false;
+		}
+	}
+	return ParseAmountCents(std::string_view(normalised, length), cents);
+}
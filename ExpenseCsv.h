@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class CsvDateFormat { YearMonthDay, DayMonthYear, MonthDayYear };
+
+// How the columns of a bank or spreadsheet export map onto an expense
+struct CsvImportOptions
+{
+	char delimiter = ',';
+	char quote = '"';                         // '\0' when fields are never quoted
+	bool hasHeader = true;
+	int descriptionColumn = 0;                // field index, -1 when the file has no such column
+	int categoryColumn = 1;
+	int amountColumn = 2;
+	int dateColumn = 3;
+	CsvDateFormat dateFormat = CsvDateFormat::YearMonthDay;
+	char decimalSeparator = '.';              // the other of '.' and ',' is taken as a thousands separator
+	bool negateAmounts = false;               // for statements that list spending as negative amounts
+	std::string defaultCategory = "Uncategorized";
+};
+
+// One normalised row; the views point into the line or the scratch buffer given to ParseCsvRow
+struct CsvRow
+{
+	std::string_view description;
+	std::string_view category;
+	int64_t amountCents = 0;
+	int32_t day = 0;
+	const char* error = nullptr;              // set when the row is malformed
+	std::string_view errorField;
+};
+
+// Splits one line into fields. Quoted fields may contain the delimiter and doubled quotes but
+// not line breaks. Fields that needed unescaping are written to scratch, which is sized up
+// front so the views stay valid until the next call.
+size_t SplitCsvLine(std::string_view line, char delimiter, char quote, std::vector<std::string_view>& fields, std::string& scratch);
+
+// Recognises a header line by its column names (description/memo/payee, category, amount/value,
+// date/...) and sets the column indices from it. Returns false and leaves the options alone
+// when the line does not look like a header.
+bool MapCsvHeader(std::string_view line, CsvImportOptions& options);
+
+// Guesses the delimiter from the first line: the most frequent of ',', ';', tab and '|'
+char DetectCsvDelimiter(std::string_view line);
+
+// Parses and normalises one data line. Returns false for blank lines; check row.error otherwise.
+bool ParseCsvRow(std::string_view line, const CsvImportOptions& options, CsvRow& row, std::vector<std::string_view>& fields, std::string& scratch);
+
+bool ParseCsvDate(std::string_view text, CsvDateFormat format, int32_t& day);
+bool ParseCsvAmount(std::string_view text, char decimalSeparator, int64_t& cents);
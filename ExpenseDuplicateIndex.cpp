@@ -0,0 +1,206 @@
+#include "ExpenseDuplicateIndex.h"
+
+namespace {
+	const size_t MinSlots = 1024;
+
+	uint64_t Mix(uint64_t x) {
+		x ^= x >> 30;
+		x *= 0xbf58476d1ce4e5b9ULL;
+		x ^= x >> 27;
+		x *= 0x94d049bb133111ebULL;
+		return x ^ (x >> 31);
+	}
+
+	uint64_t HashBytes(uint64_t hash, std::string_view text) {
+		for (char c : text) {
+			hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+		}
+		return hash;
+	}
+
+	// Four bits in one filter word, so a lookup touches a single cache line
+	uint64_t BloomBits(uint64_t hash) {
+		return (uint64_t(1) << (hash & 63)) | (uint64_t(1) << ((hash >> 6) & 63))
+			| (uint64_t(1) << ((hash >> 12) & 63)) | (uint64_t(1) << ((hash >> 18) & 63));
+	}
+
+	// The table key: the upper 56 bits of the fingerprint, shifted clear of the count
+	uint64_t KeyOf(uint64_t fingerprint) {
+		return fingerprint & ~uint64_t(0xff);
+	}
+}
+
+ExpenseDuplicateIndex::ExpenseDuplicateIndex(const ExpenseStore& store)
+	: store(store)
+{
+}
+
+uint64_t ExpenseDuplicateIndex::Fingerprint(std::string_view description, std::string_view category, int64_t amountCents, int32_t day)
+{
+	// FNV-1a over both strings with their lengths, so "ab"+"c" and "a"+"bc" differ
+	uint64_t hash = HashBytes(0xcbf29ce484222325ULL, description);
+	hash = Mix(hash ^ description.size());
+	hash = HashBytes(hash, category);
+	hash = Mix(hash ^ category.size());
+	hash = Mix(hash ^ static_cast<uint64_t>(amountCents));
+	return Mix(hash ^ static_cast<uint32_t>(day));
+}
+
+uint32_t ExpenseDuplicateIndex::Count(uint64_t fingerprint)
+{
+	if (!built) {
+		Build();
+	}
+	uint64_t key = KeyOf(fingerprint);
+	if (!MayContain(key)) {
+		return 0;
+	}
+	size_t slot = Find(key);
+	return slots[slot] ? static_cast<uint32_t>(slots[slot] & CountMask) : 0;
+}
+
+void ExpenseDuplicateIndex::Insert(ExpenseStore::RowId row)
+{
+	if (built) {
+		Add(RowFingerprint(row));
+	}
+}
+
+void ExpenseDuplicateIndex::InsertRange(ExpenseStore::RowId first, ExpenseStore::RowId last)
+{
+	for (ExpenseStore::RowId row = first; built && row < last; row++) {
+		Add(RowFingerprint(row));
+	}
+}
+
+void ExpenseDuplicateIndex::InsertFingerprint(uint64_t fingerprint)
+{
+	if (!built) {
+		Build();
+	}
+	Add(fingerprint);
+}
+
+void ExpenseDuplicateIndex::EraseRows(const std::vector<ExpenseStore::RowId>& rows)
+{
+	// Fingerprints are position free, so each row is simply uncounted
+	for (ExpenseStore::RowId row : rows) {
+		Erase(row);
+	}
+}
+
+void ExpenseDuplicateIndex::Erase(ExpenseStore::RowId row)
+{
+	if (!built) {
+		return;
+	}
+	size_t slot = Find(KeyOf(RowFingerprint(row)));
+	uint64_t count = slots[slot] & CountMask;
+	if (count == 0 || count == CountMask) {
+		return; // Saturated counts stay put; the Bloom filter keeps stale bits either way
+	}
+	if (count > 1) {
+		slots[slot]--;
+		return;
+	}
+
+	// Backward-shift deletion keeps every probe sequence unbroken without tombstones
+	const size_t mask = slots.size() - 1;
+	size_t hole = slot;
+	for (size_t next = (hole + 1) & mask; slots[next]; next = (next + 1) & mask) {
+		size_t home = static_cast<size_t>(Mix(KeyOf(slots[next]))) & mask;
+		if (((next - home) & mask) >= ((next - hole) & mask)) {
+			slots[hole] = slots[next];
+			hole = next;
+		}
+	}
+	slots[hole] = 0;
+	used--;
+}
+
+void ExpenseDuplicateIndex::Clear()
+{
+	slots.clear();
+	slots.shrink_to_fit();
+	bloom.clear();
+	bloom.shrink_to_fit();
+	used = 0;
+	built = false;
+}
+
+void ExpenseDuplicateIndex::Build()
+{
+	size_t slotCount = MinSlots;
+	while (slotCount * 3 / 4 < store.Size()) {
+		slotCount *= 2;
+	}
+	slots.assign(slotCount, 0);
+	bloom.assign(slotCount / 8, 0);  // eight bits per slot, so ten or more per row at up to 75% load
+	used = 0;
+	built = true;
+	for (ExpenseStore::RowId row = 0; row < store.Size(); row++) {
+		Add(RowFingerprint(row));
+	}
+}
+
+void ExpenseDuplicateIndex::Add(uint64_t fingerprint)
+{
+	uint64_t key = KeyOf(fingerprint);
+	size_t slot = Find(key);
+	if (slots[slot]) {
+		if ((slots[slot] & CountMask) < CountMask) {
+			slots[slot]++;
+		}
+		return;
+	}
+	slots[slot] = key | 1;
+	used++;
+	AddToBloom(key);
+	if (used * 4 > slots.size() * 3) {
+		Grow();
+	}
+}
+
+// Doubles the table and rebuilds the filter from the keys it already has
+void ExpenseDuplicateIndex::Grow()
+{
+	std::vector<uint64_t> old;
+	old.swap(slots);
+	slots.assign(old.size() * 2, 0);
+	bloom.assign(slots.size() / 8, 0);
+	for (uint64_t entry : old) {
+		if (entry) {
+			slots[Find(KeyOf(entry))] = entry;
+			AddToBloom(KeyOf(entry));
+		}
+	}
+}
+
+void ExpenseDuplicateIndex::AddToBloom(uint64_t key)
+{
+	uint64_t hash = Mix(key ^ 0x9e3779b97f4a7c15ULL);
+	bloom[static_cast<size_t>(hash >> 24) & (bloom.size() - 1)] |= BloomBits(hash);
+}
+
+bool ExpenseDuplicateIndex::MayContain(uint64_t key) const
+{
+	uint64_t hash = Mix(key ^ 0x9e3779b97f4a7c15ULL);
+	uint64_t bits = BloomBits(hash);
+	return (bloom[static_cast<size_t>(hash >> 24) & (bloom.size() - 1)] & bits) == bits;
+}
+
+// The slot holding key, or the empty slot where it would go
+size_t ExpenseDuplicateIndex::Find(uint64_t key) const
+{
+	const size_t mask = slots.size() - 1;
+	size_t slot = static_cast<size_t>(Mix(key)) & mask;
+	while (slots[slot] && KeyOf(slots[slot]) != key) {
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+uint64_t ExpenseDuplicateIndex::RowFingerprint(ExpenseStore::RowId row) const
+{
+	return Fingerprint(store.Description(row), store.Category(row), store.AmountCents(row), store.Day(row));
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "ExpenseStore.h"
+
+// Counts of row fingerprints, for spotting rows that are already in the history.
+// A fingerprint is a 64-bit hash of (description, category, amount, date); only its upper 56
+// bits are kept, packed with an 8-bit count into one word of an open-addressing table, so the
+// index costs 11-21 bytes per distinct row and never copies the strings. A Bloom filter of ten
+// or more bits per row sits in front of the table and answers most misses from one cache line.
+// The index is built on first use and then kept up to date on every add and remove.
+class ExpenseDuplicateIndex
+{
+public:
+	explicit ExpenseDuplicateIndex(const ExpenseStore& store);
+
+	static uint64_t Fingerprint(std::string_view description, std::string_view category, int64_t amountCents, int32_t day);
+
+	// Rows of the store with this fingerprint, in O(1)
+	uint32_t Count(uint64_t fingerprint);
+
+	// Call after the row was added to the store
+	void Insert(ExpenseStore::RowId row);
+	// Call after rows [first, last) were appended in one go
+	void InsertRange(ExpenseStore::RowId first, ExpenseStore::RowId last);
+	// Counts a row that is not in the store, for checking against a history that is only streamed
+	void InsertFingerprint(uint64_t fingerprint);
+	// Call before the row is removed from the store
+	void Erase(ExpenseStore::RowId row);
+	// Call before the ascending rows are removed from the store with RemoveRows
+	void EraseRows(const std::vector<ExpenseStore::RowId>& rows);
+	// Drops the index; it is rebuilt on next use
+	void Clear();
+
+	size_t MemoryBytes() const { return (slots.capacity() + bloom.capacity()) * sizeof(uint64_t); }
+
+private:
+	static constexpr uint64_t CountMask = 0xff;
+
+	const ExpenseStore& store;
+	std::vector<uint64_t> slots;     // fingerprint << 8 | count, 0 when empty
+	size_t used = 0;
+	std::vector<uint64_t> bloom;     // one word per key, four bits set in it
+	bool built = false;
+
+	void Build();
+	void Add(uint64_t fingerprint);
+	void Grow();
+	void AddToBloom(uint64_t key);
+	bool MayContain(uint64_t key) const;
+	size_t Find(uint64_t key) const;
+	uint64_t RowFingerprint(ExpenseStore::RowId row) const;
+};
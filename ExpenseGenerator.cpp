@@ -0,0 +1,70 @@
+#include "ExpenseGenerator.h"
+#include "Expense.h"
+#include <algorithm>
+#include <fstream>
+
+namespace {
+	// SplitMix64: tiny and fully specified, unlike the std distributions whose output varies by library
+	struct Random
+	{
+		uint64_t state;
+
+		uint64_t Next() {
+			uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+			return z ^ (z >> 31);
+		}
+		uint64_t Below(uint64_t bound) {
+			return Next() % bound;
+		}
+	};
+
+	const char* const Descriptions[] = {
+		"Uber_ride", "Groceries", "Coffee", "Rent", "Electricity_bill", "Internet", "Lunch", "Dinner",
+		"Movie_tickets", "Pharmacy", "Gym_membership", "Bus_pass", "Books", "Amazon_order", "Phone_recharge",
+		"Fuel", "Water_bill", "Doctor_visit", "Haircut", "Gift", "Snacks", "Train_ticket", "Streaming",
+		"Insurance", "Laundry", "Parking", "Stationery", "Tea", "Bakery", "Hardware_store",
+	};
+	const char* const Categories[] = {
+		"Food", "Transport", "Bills", "Shopping", "Health", "Entertainment", "Rent", "Education",
+		"Personal_Care", "Gifts", "Travel", "Insurance", "Household", "Subscriptions", "Fitness", "Other",
+	};
+	const size_t DescriptionCount = sizeof(Descriptions) / sizeof(Descriptions[0]);
+	const size_t CategoryCount = sizeof(Categories) / sizeof(Categories[0]);
+	const int32_t HistoryDays = 5 * 365;
+}
+
+bool GenerateExpenseFile(const std::string& fileName, size_t rows, uint64_t seed)
+{
+	std::ofstream ostream(fileName, std::ios::binary | std::ios::trunc);
+	ostream << rows;
+
+	Random random{ seed };
+	const int32_t firstDay = CivilToDay(2020, 1, 1);
+	std::string buffer;
+	buffer.reserve(1 << 20);
+	for (size_t row = 0; row < rows; row++) {
+		// The smaller of two draws favours the first categories, as real spending does
+		size_t category = static_cast<size_t>(std::min(random.Below(CategoryCount), random.Below(CategoryCount)));
+		int32_t day = firstDay + static_cast<int32_t>(row * HistoryDays / rows) + static_cast<int32_t>(random.Below(7)) - 3;
+
+		buffer += '\n';
+		buffer += Descriptions[random.Below(DescriptionCount)];
+		buffer += '_';
+		buffer += std::to_string(random.Below(500));
+		buffer += ' ';
+		buffer += Categories[category];
+		buffer += ' ';
+		buffer += FormatAmountCents(static_cast<int64_t>(100 + random.Below(200000)));
+		buffer += ' ';
+		buffer += FormatIsoDate(day);
+		if (buffer.size() > (1 << 20) - 128) {
+			ostream.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+			buffer.clear();
+		}
+	}
+	ostream.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+	ostream.flush();
+	return ostream.good();
+}
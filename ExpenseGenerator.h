@@ -0,0 +1,9 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Writes a synthetic expense history of the given size in the legacy expense.txt format.
+// The output depends only on rows and seed, so benchmark runs on different machines and
+// releases read byte-identical files. Categories follow a skewed distribution and dates
+// advance over five years from 2020-01-01 with a few days of jitter, like a real history.
+bool GenerateExpenseFile(const std::string& fileName, size_t rows, uint64_t seed = 1);
@@ -0,0 +1,251 @@
+#include "ExpenseImporter.h"
+#include "ExpenseDuplicateIndex.h"
+#include "Diagnostics.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace {
+	// Size of the blocks the reader hands to the parsers
+	const size_t BlockBytes = 4 << 20;
+	// Blocks read but not yet delivered, per parser thread
+	const size_t BlocksAheadPerThread = 2;
+	// Batches delivered but not yet acknowledged by the consumer
+	const size_t MaxUnacknowledged = 2;
+}
+
+ExpenseImporter::ExpenseImporter(unsigned threads)
+	: threadCount(threads ? threads : std::max(1u, std::thread::hardware_concurrency()))
+{
+}
+
+ExpenseImporter::~ExpenseImporter()
+{
+	Cancel();
+}
+
+bool ExpenseImporter::Start(const std::string& fileName, const CsvImportOptions& options, BatchHandler handler)
+{
+	Cancel();
+	std::ifstream probe(fileName, std::ios::binary | std::ios::ate);
+	if (!probe) {
+		return false;
+	}
+	fileSize = static_cast<uint64_t>(probe.tellg());
+
+	this->fileName = fileName;
+	this->options = options;
+	this->handler = std::move(handler);
+	blocks.clear();
+	parsed.clear();
+	blocksRead = 0;
+	blocksDelivered = 0;
+	unacknowledged = 0;
+	readDone = false;
+	cancelled = false;
+	headerLines = 0;
+
+	reader = std::thread(&ExpenseImporter::ReadLoop, this);
+	for (unsigned i = 0; i < threadCount; i++) {
+		parsers.emplace_back(&ExpenseImporter::ParseLoop, this);
+	}
+	committer = std::thread(&ExpenseImporter::CommitLoop, this);
+	return true;
+}
+
+void ExpenseImporter::Acknowledge()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (unacknowledged > 0) {
+		unacknowledged--;
+	}
+	batchesChanged.notify_all();
+}
+
+void ExpenseImporter::Cancel()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		cancelled = true;
+	}
+	blocksChanged.notify_all();
+	batchesChanged.notify_all();
+	if (reader.joinable()) {
+		reader.join();
+	}
+	for (std::thread& parser : parsers) {
+		parser.join();
+	}
+	parsers.clear();
+	if (committer.joinable()) {
+		committer.join();
+	}
+}
+
+void ExpenseImporter::ReadLoop()
+{
+	std::ifstream istream(fileName, std::ios::binary);
+	std::string carry;
+	uint64_t offset = 0;
+	bool skipHeader = options.hasHeader;
+	const size_t maxAhead = BlocksAheadPerThread * threadCount;
+
+	while (istream) {
+		std::string text;
+		text.swap(carry);
+		size_t kept = text.size();
+		text.resize(kept + BlockBytes);
+		istream.read(&text[kept], static_cast<std::streamsize>(BlockBytes));
+		size_t read = static_cast<size_t>(istream.gcount());
+		text.resize(kept + read);
+		offset += read;
+
+		if (skipHeader) {
+			size_t newline = text.find('\n');
+			if (newline == std::string::npos && istream) {
+				carry.swap(text);
+				continue;
+			}
+			text.erase(0, newline == std::string::npos ? text.size() : newline + 1);
+			headerLines = 1;
+			skipHeader = false;
+		}
+
+		// Cut after the last complete line; the rest starts the next block
+		if (istream) {
+			size_t newline = text.rfind('\n');
+			if (newline == std::string::npos) {
+				carry.swap(text);
+				continue;
+			}
+			carry.assign(text, newline + 1, std::string::npos);
+			text.resize(newline + 1);
+		}
+		if (text.empty()) {
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(mutex);
+		blocksChanged.wait(lock, [&] { return cancelled || blocksRead - blocksDelivered < maxAhead; });
+		if (cancelled) {
+			return;
+		}
+		blocks.push_back(Block{ blocksRead++, std::move(text), offset - carry.size() });
+		blocksChanged.notify_all();
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	readDone = true;
+	blocksChanged.notify_all();
+	batchesChanged.notify_all();
+}
+
+void ExpenseImporter::ParseLoop()
+{
+	while (true) {
+		Block block;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			blocksChanged.wait(lock, [this] { return cancelled || readDone || !blocks.empty(); });
+			if (cancelled || blocks.empty()) {
+				return;
+			}
+			block = std::move(blocks.front());
+			blocks.pop_front();
+		}
+
+		auto batch = std::make_shared<Batch>();
+		ParseBlock(block, *batch);
+		batch->bytesDone = block.endOffset;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		parsed.emplace(block.index, std::move(batch));
+		batchesChanged.notify_all();
+	}
+}
+
+void ExpenseImporter::CommitLoop()
+{
+	size_t lines = 0;
+	bool counted = false;
+	while (true) {
+		std::shared_ptr<Batch> batch;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			batchesChanged.wait(lock, [this] {
+				return cancelled || (unacknowledged < MaxUnacknowledged && (parsed.count(blocksDelivered) || (readDone && blocksDelivered == blocksRead)));
+			});
+			if (cancelled) {
+				return;
+			}
+			if (!counted) {
+				lines = headerLines;
+				counted = true;
+			}
+			auto found = parsed.find(blocksDelivered);
+			if (found == parsed.end()) {
+				break; // Everything has been delivered
+			}
+			batch = std::move(found->second);
+			parsed.erase(found);
+			blocksDelivered++;
+			unacknowledged++;
+			blocksChanged.notify_all();
+		}
+
+		// Error line numbers are block relative until here
+		for (ExpenseParseError& error : batch->errors) {
+			error.line += lines;
+		}
+		lines += batch->lines;
+		handler(std::move(batch));
+	}
+
+	auto last = std::make_shared<Batch>();
+	last->bytesDone = fileSize;
+	last->last = true;
+	handler(std::move(last));
+}
+
+void ExpenseImporter::ParseBlock(const Block& block, Batch& batch) const
+{
+	DiagnosticsTimer timer(DiagnosticsMetric::Parse);
+	timer.BytesRead(block.text.size());
+	std::vector<std::string_view> fields;
+	std::string scratch;
+	CsvRow row;
+
+	// Rows average well above 32 bytes, so this is a safe upper bound
+	size_t estimate = block.text.size() / 32;
+	batch.Reserve(estimate);
+	batch.fingerprints.reserve(estimate);
+
+	const char* cursor = block.text.data();
+	const char* end = cursor + block.text.size();
+	while (cursor < end) {
+		const char* newline = static_cast<const char*>(memchr(cursor, '\n', static_cast<size_t>(end - cursor)));
+		const char* lineEnd = newline ? newline : end;
+		std::string_view line(cursor, static_cast<size_t>(lineEnd - cursor));
+		cursor = newline ? newline + 1 : end;
+		batch.lines++;
+
+		if (!ParseCsvRow(line, options, row, fields, scratch)) {
+			continue;
+		}
+		if (row.error) {
+			if (batch.errors.size() < ExpenseParseReport::MaxErrors) {
+				std::string text(row.error);
+				text += " '";
+				text.append(row.errorField.substr(0, 40));
+				text += "'";
+				batch.errors.push_back(ExpenseParseError{ batch.lines, std::move(text) });
+			}
+			batch.errorCount++;
+			continue;
+		}
+
+		batch.Add(row.description, row.category, row.amountCents, row.day);
+		batch.fingerprints.push_back(ExpenseDuplicateIndex::Fingerprint(row.description, row.category, row.amountCents, row.day));
+	}
+	timer.Rows(batch.Size());
+}
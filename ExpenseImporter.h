@@ -0,0 +1,89 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ExpenseCsv.h"
+#include "ExpenseParser.h"
+#include "ExpenseStore.h"
+
+// Streaming CSV import. A reader thread cuts the file into newline-aligned blocks, parser threads
+// turn the blocks into column batches in parallel, and a single committer thread hands the
+// batches to the consumer in file order. At most a few blocks are in memory at any time: the
+// reader waits while the parsers are behind and the committer waits until the consumer has
+// acknowledged what it was given, so a file of any size is imported in bounded memory. The
+// parsers also fingerprint every row, leaving the consumer an O(1) duplicate check per row.
+class ExpenseImporter
+{
+public:
+	// Rows parsed from one block
+	struct Batch : ExpenseBatch
+	{
+		std::vector<uint64_t> fingerprints;             // ExpenseDuplicateIndex::Fingerprint of each row
+
+		std::vector<ExpenseParseError> errors;          // with file line numbers
+		size_t errorCount = 0;
+		size_t lines = 0;
+		uint64_t bytesDone = 0;                         // file offset reached with this batch
+		bool last = false;                              // the end of the file; has no rows
+	};
+	using BatchHandler = std::function<void(std::shared_ptr<Batch> batch)>;
+
+	// threads == 0 parses on every hardware thread
+	explicit ExpenseImporter(unsigned threads = 0);
+	~ExpenseImporter();
+	ExpenseImporter(const ExpenseImporter&) = delete;
+	ExpenseImporter& operator=(const ExpenseImporter&) = delete;
+
+	// Starts importing in the background; handler is called on the committer thread once per
+	// batch and once more with a last batch. Returns false if the file cannot be opened.
+	bool Start(const std::string& fileName, const CsvImportOptions& options, BatchHandler handler);
+	// Tells the pipeline the consumer is done with a batch, letting it run ahead again
+	void Acknowledge();
+	// Stops the threads; the handler is not called again once this returns. Not to be called
+	// from the handler itself.
+	void Cancel();
+
+	uint64_t FileSize() const { return fileSize; }
+
+private:
+	struct Block
+	{
+		size_t index = 0;
+		std::string text;
+		uint64_t endOffset = 0;                         // file offset just past the block
+	};
+
+	unsigned threadCount;
+	CsvImportOptions options;
+	BatchHandler handler;
+	std::string fileName;
+	uint64_t fileSize = 0;
+	size_t headerLines = 0;
+
+	std::thread reader;
+	std::vector<std::thread> parsers;
+	std::thread committer;
+
+	std::mutex mutex;
+	std::condition_variable blocksChanged;            // wakes the parsers and the reader
+	std::condition_variable batchesChanged;           // wakes the committer
+	std::deque<Block> blocks;
+	std::map<size_t, std::shared_ptr<Batch>> parsed;  // finished batches by block index
+	size_t blocksRead = 0;
+	size_t blocksDelivered = 0;
+	size_t unacknowledged = 0;
+	bool readDone = false;
+	bool cancelled = false;
+
+	void ReadLoop();
+	void ParseLoop();
+	void CommitLoop();
+	void ParseBlock(const Block& block, Batch& batch) const;
+};
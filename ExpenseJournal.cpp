@@ -0,0 +1,719 @@
+#include "ExpenseJournal.h"
+#include "ExpenseSnapshot.h"
+#include "Diagnostics.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+namespace {
+	const char JournalMagic[4] = { 'B', 'B', 'J', '1' };
+	// type (1) + sequence (8) + payload length (4)
+	const size_t RecordHeaderSize = 13;
+	const size_t RecordChecksumSize = 4;
+	// Larger payloads can only come from a damaged length field
+	const uint32_t MaxPayloadSize = 64 * 1024 * 1024;
+	// Compaction never starts for fewer records than this
+	const uint64_t MinCompactionRecords = 4096;
+	// Rows put back together are split into records of about this size, well below MaxPayloadSize
+	const size_t InsertRowsPayloadSize = 4 * 1024 * 1024;
+
+	template <typename T>
+	void Put(std::string& buffer, T value) {
+		buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+	}
+
+	template <typename T>
+	bool Get(const char*& cursor, const char* end, T& value) {
+		if (static_cast<size_t>(end - cursor) < sizeof(value)) {
+			return false;
+		}
+		std::memcpy(&value, cursor, sizeof(value));
+		cursor += sizeof(value);
+		return true;
+	}
+
+	bool GetText(const char*& cursor, const char* end, std::string_view& text) {
+		uint32_t length;
+		if (!Get(cursor, end, length) || static_cast<size_t>(end - cursor) < length) {
+			return false;
+		}
+		text = std::string_view(cursor, length);
+		cursor += length;
+		return true;
+	}
+}
+
+ExpenseJournal::ExpenseJournal(std::string snapshotFile, std::string journalFile, std::string legacyFile)
+	: snapshotFile(std::move(snapshotFile)), journalFile(std::move(journalFile)), legacyFile(std::move(legacyFile))
+{
+}
+
+ExpenseJournal::~ExpenseJournal()
+{
+	Close();
+}
+
+bool ExpenseJournal::Open(ExpenseStore& store, size_t* skippedLines)
+{
+	Close();
+	DiagnosticsTimer timer(DiagnosticsMetric::Load);
+
+	uint64_t snapshotSequence = 0;
+	size_t skipped = 0;
+	segments.Clear();
+	std::error_code ec;
+	if (std::filesystem::exists(snapshotFile, ec)) {
+		if (!LoadExpenseSegments(store, snapshotFile, &snapshotSequence, &segments)) {
+			store.Clear();
+			segments.Clear();
+			return false;
+		}
+	}
+	else {
+		skipped = LoadExpenseFromFile(store, legacyFile, &snapshotSequence);
+	}
+	if (skippedLines) {
+		*skippedLines = skipped;
+	}
+	lastSequence = snapshotSequence;
+	savedSequence = snapshotSequence;
+	recordsSinceSnapshot = 0;
+	unloadedRows = 0;
+	// Rows no segment accounts for came from the legacy file or a snapshot from before segments
+	snapshotMissing = segments.Rows() != store.Size();
+	ReplayLog(store, snapshotSequence);
+	OpenLogForAppend();
+	timer.Rows(store.Size());
+	CompactIfNeeded(store);
+	return true;
+}
+
+void ExpenseJournal::Resume(const LoadState& state)
+{
+	Close();
+
+	std::error_code ec;
+	if (state.badHeader) {
+		std::filesystem::rename(journalFile, journalFile + ".corrupt", ec);
+	}
+	else if (state.damaged) {
+		std::filesystem::resize_file(journalFile, static_cast<uintmax_t>(state.intactBytes), ec);
+	}
+	lastSequence = state.lastSequence;
+	savedSequence = state.lastSequence;
+	recordsSinceSnapshot = state.journalRecords;
+	snapshotMissing = state.snapshotMissing;
+	segments = state.segments;
+	unloadedRows = 0;
+	OpenLogForAppend();
+}
+
+void ExpenseJournal::Close()
+{
+	WaitForCompaction();
+	std::lock_guard<std::mutex> lock(logMutex);
+	if (log.is_open()) {
+		log.close();
+	}
+}
+
+void ExpenseJournal::AppendAdd(const ExpenseStore& store, ExpenseStore::RowId row)
+{
+	std::string record;
+	EncodeAdd(record, store, row);
+	WriteRecords(record, 1);
+	segments.Add(store.Day(row));
+}
+
+void ExpenseJournal::AppendAdds(const ExpenseStore& store, ExpenseStore::RowId first, ExpenseStore::RowId last)
+{
+	if (first >= last) {
+		return;
+	}
+	std::string records;
+	for (ExpenseStore::RowId row = first; row < last; row++) {
+		EncodeAdd(records, store, row);
+		segments.Add(store.Day(row));
+	}
+	WriteRecords(records, last - first);
+}
+
+void ExpenseJournal::AppendRemove(ExpenseStore::RowId row)
+{
+	row += unloadedRows;
+	std::string payload;
+	Put<uint32_t>(payload, row);
+	std::string record;
+	EncodeRecord(record, RecordType::Remove, payload);
+	WriteRecords(record, 1);
+	segments.Remove(row);
+}
+
+void ExpenseJournal::AppendRemoveRows(const std::vector<ExpenseStore::RowId>& rows)
+{
+	std::string payload;
+	payload.reserve(sizeof(uint32_t) * (rows.size() + 1));
+	Put<uint32_t>(payload, static_cast<uint32_t>(rows.size()));
+	for (ExpenseStore::RowId row : rows) {
+		Put<uint32_t>(payload, row + unloadedRows);
+	}
+	std::string record;
+	EncodeRecord(record, RecordType::RemoveRows, payload);
+	WriteRecords(record, 1);
+	if (unloadedRows == 0) {
+		segments.RemoveRows(rows);
+		return;
+	}
+	std::vector<ExpenseStore::RowId> shifted(rows);
+	for (ExpenseStore::RowId& row : shifted) {
+		row += unloadedRows;
+	}
+	segments.RemoveRows(shifted);
+}
+
+ExpenseSegmentLayout ExpenseJournal::AppendClear()
+{
+	std::string record;
+	EncodeRecord(record, RecordType::Clear, std::string_view());
+	WriteRecords(record, 1);
+	ExpenseSegmentLayout before;
+	std::swap(before, segments);
+	segments.Clear();
+	return before;
+}
+
+// The segment files stay until a save writes a manifest without them, and no save has started
+// since the clear, so the clean segments of the old layout are still on disk
+bool ExpenseJournal::AppendUndoClear(ExpenseSegmentLayout before, uint64_t clearSequence)
+{
+	if (clearSequence <= savedSequence) {
+		return false;
+	}
+	std::string record;
+	EncodeRecord(record, RecordType::UndoClear, std::string_view());
+	WriteRecords(record, 1);
+	segments = std::move(before);
+	return true;
+}
+
+void ExpenseJournal::AppendInsert(const ExpenseStore& store, ExpenseStore::RowId row)
+{
+	std::string record;
+	EncodeAdd(record, store, row, RecordType::Insert);
+	WriteRecords(record, 1);
+	segments.Insert(row + unloadedRows, store.Day(row));
+}
+
+void ExpenseJournal::AppendInsertRows(const ExpenseStore& store, const std::vector<ExpenseStore::RowId>& rows)
+{
+	if (rows.empty()) {
+		return;
+	}
+	// The positions ascend, so each record's rows are valid positions once the records before it applied
+	std::string records;
+	std::string payload;
+	std::vector<int32_t> days;
+	days.reserve(rows.size());
+	std::vector<ExpenseStore::RowId> positions;
+	positions.reserve(rows.size());
+	size_t count = 0;
+	size_t recordCount = 0;
+	for (size_t i = 0; i < rows.size(); i++) {
+		ExpenseStore::RowId row = rows[i];
+		std::string_view description = store.Description(row);
+		std::string_view category = store.Category(row);
+		Put<uint32_t>(payload, row + unloadedRows);
+		Put<int64_t>(payload, store.AmountCents(row));
+		Put<int32_t>(payload, store.Day(row));
+		Put<uint32_t>(payload, static_cast<uint32_t>(description.size()));
+		payload.append(description);
+		Put<uint32_t>(payload, static_cast<uint32_t>(category.size()));
+		payload.append(category);
+		days.push_back(store.Day(row));
+		positions.push_back(row + unloadedRows);
+		count++;
+		if (payload.size() >= InsertRowsPayloadSize || i + 1 == rows.size()) {
+			std::string counted;
+			counted.reserve(sizeof(uint32_t) + payload.size());
+			Put<uint32_t>(counted, static_cast<uint32_t>(count));
+			counted += payload;
+			EncodeRecord(records, RecordType::InsertRows, counted);
+			recordCount++;
+			payload.clear();
+			count = 0;
+		}
+	}
+	WriteRecords(records, recordCount);
+	segments.InsertRows(positions, days);
+}
+
+void ExpenseJournal::EncodeAdd(std::string& out, const ExpenseStore& store, ExpenseStore::RowId row, RecordType type)
+{
+	std::string_view description = store.Description(row);
+	std::string_view category = store.Category(row);
+
+	std::string payload;
+	payload.reserve(3 * sizeof(uint32_t) + sizeof(int64_t) + sizeof(int32_t) + description.size() + category.size());
+	if (type == RecordType::Insert) {
+		Put<uint32_t>(payload, row + unloadedRows);
+	}
+	Put<int64_t>(payload, store.AmountCents(row));
+	Put<int32_t>(payload, store.Day(row));
+	Put<uint32_t>(payload, static_cast<uint32_t>(description.size()));
+	payload.append(description);
+	Put<uint32_t>(payload, static_cast<uint32_t>(category.size()));
+	payload.append(category);
+	EncodeRecord(out, type, payload);
+}
+
+void ExpenseJournal::EncodeRecord(std::string& out, RecordType type, std::string_view payload)
+{
+	size_t start = out.size();
+	Put<uint8_t>(out, static_cast<uint8_t>(type));
+	Put<uint64_t>(out, ++lastSequence);
+	Put<uint32_t>(out, static_cast<uint32_t>(payload.size()));
+	out += payload;
+	Put<uint32_t>(out, Crc32(out.data() + start, out.size() - start));
+}
+
+// Records are flushed together, so a batch of adds costs one write
+void ExpenseJournal::WriteRecords(const std::string& records, size_t count)
+{
+	DiagnosticsTimer timer(DiagnosticsMetric::JournalWrite, count);
+	timer.BytesWritten(records.size());
+	std::lock_guard<std::mutex> lock(logMutex);
+	recordsSinceSnapshot += count;
+	if (logFailed) {
+		return;
+	}
+	if (!WriteToLog(records)) {
+		logFailed = true;
+		return;
+	}
+	logBytes += records.size();
+}
+
+// Appends and flushes the records. A failed write may leave part of them on disk, so the log is
+// cut back to where they started and they go once more through a reopened file.
+bool ExpenseJournal::WriteToLog(const std::string& records)
+{
+	if (log.is_open()) {
+		log.write(records.data(), static_cast<std::streamsize>(records.size()));
+		log.flush();
+		if (log.good()) {
+			return true;
+		}
+		log.close();
+	}
+	std::error_code ec;
+	std::filesystem::resize_file(journalFile, static_cast<uintmax_t>(logBytes), ec);
+	if (ec) {
+		return false;
+	}
+	log.clear();
+	log.open(journalFile, std::ios::binary | std::ios::app);
+	log.write(records.data(), static_cast<std::streamsize>(records.size()));
+	log.flush();
+	return log.good();
+}
+
+bool ExpenseJournal::ReplayLog(ExpenseStore& store, uint64_t snapshotSequence)
+{
+	ExpenseJournalReader reader;
+	if (!reader.Open(journalFile)) {
+		if (reader.BadHeader()) {
+			// Not a journal we understand: keep it for inspection and start a new one
+			std::error_code ec;
+			std::filesystem::rename(journalFile, journalFile + ".corrupt", ec);
+			return false;
+		}
+		return true;
+	}
+
+	ExpenseJournalReader::Record record;
+	ExpenseClearedRows cleared;
+	uint64_t intactBytes = 0;
+	bool intact = true;
+	while (intact && reader.Next(record)) {
+		recordsSinceSnapshot++;
+		if (record.sequence <= snapshotSequence) {
+			continue; // Already part of the snapshot
+		}
+
+		intact = ApplyJournalRecord(store, segments, record, cleared);
+		if (intact) {
+			lastSequence = record.sequence;
+		}
+	}
+	intactBytes = intact ? reader.IntactBytes() : reader.RecordOffset();
+	intact = intact && !reader.Damaged();
+	reader.Close();
+
+	if (!intact) {
+		// Drop the torn or damaged tail so new records are appended after the last good one
+		std::error_code ec;
+		std::filesystem::resize_file(journalFile, static_cast<uintmax_t>(intactBytes), ec);
+	}
+	return intact;
+}
+
+void ExpenseJournal::OpenLogForAppend()
+{
+	std::lock_guard<std::mutex> lock(logMutex);
+	std::error_code ec;
+	uintmax_t size = std::filesystem::file_size(journalFile, ec);
+	log.clear();
+	log.open(journalFile, std::ios::binary | std::ios::app);
+	if (ec || size == 0) {
+		log.write(JournalMagic, sizeof(JournalMagic));
+		log.flush();
+		size = sizeof(JournalMagic);
+	}
+	logBytes = size;
+	logFailed = !log.good();
+}
+
+void ExpenseJournal::CompactIfNeeded(const ExpenseStore& store)
+{
+	if (compacting || unloadedRows > 0) {
+		return;
+	}
+	WaitForCompaction();
+	// Records the log missed are only in the segments marked dirty, so those are saved at once and
+	// the log starts over from the save
+	const bool dropTail = logFailed;
+	// The segments a failed save claimed may not exist, so they all go again. The log still holds
+	// every record, so nothing is lost meanwhile; the first retry comes with the next record and
+	// each further failure doubles the wait, up to the usual interval.
+	if (saveFailed.exchange(false)) {
+		snapshotMissing = true;
+		failedSaves++;
+	}
+	else if (!snapshotMissing) {
+		failedSaves = 0;
+	}
+	uint64_t threshold;
+	if (dropTail) {
+		threshold = 0;
+	}
+	else if (!snapshotMissing) {
+		// Rewriting n dirty rows is only worth it after about n / 2 records, which keeps the amortized cost per mutation O(1)
+		threshold = std::max<uint64_t>(MinCompactionRecords, segments.DirtyRows() / 2);
+	}
+	else if (failedSaves == 0) {
+		threshold = 0;
+	}
+	else {
+		threshold = std::min<uint64_t>(uint64_t(1) << std::min<uint64_t>(failedSaves - 1, 12), MinCompactionRecords);
+	}
+	if (recordsSinceSnapshot < threshold) {
+		return;
+	}
+	if (snapshotMissing) {
+		segments.Partition(store);
+	}
+
+	uint64_t logOffset;
+	{
+		std::lock_guard<std::mutex> lock(logMutex);
+		logOffset = logBytes;
+	}
+	ExpenseStore dirtyRows;
+	ExpenseSegmentLayout plan = segments.PlanSave(store, dirtyRows);
+	recordsSinceSnapshot = 0;
+	savedSequence = lastSequence;
+	snapshotMissing = false;
+	compacting = true;
+	compactionThread = std::thread(&ExpenseJournal::Compact, this, std::move(plan), std::move(dirtyRows), lastSequence, logOffset, dropTail);
+}
+
+bool ExpenseJournal::Recover(const ExpenseStore& store)
+{
+	WaitForCompaction();
+	if (logFailed) {
+		CompactIfNeeded(store);
+		WaitForCompaction();
+	}
+	return !logFailed;
+}
+
+void ExpenseJournal::Compact(ExpenseSegmentLayout plan, ExpenseStore dirtyRows, uint64_t sequence, uint64_t logOffset, bool dropTail)
+{
+	DiagnosticsTimer timer(DiagnosticsMetric::Save, dirtyRows.Size());
+	std::error_code ec;
+	uint64_t bytesWritten = 0;
+	if (!WriteExpenseSegments(snapshotFile, plan, dirtyRows, sequence, &bytesWritten)) {
+		saveFailed = true;
+		compacting = false;
+		return;
+	}
+	timer.BytesWritten(bytesWritten);
+
+	// The snapshot now covers every record up to logOffset; only the records appended since are
+	// carried over. After a failed write nothing past logOffset was written whole, so none are.
+	std::lock_guard<std::mutex> lock(logMutex);
+	log.close();
+	std::string journalTemp = journalFile + ".tmp";
+	bool copied;
+	{
+		std::ofstream ostream(journalTemp, std::ios::binary | std::ios::trunc);
+		ostream.write(JournalMagic, sizeof(JournalMagic));
+		if (dropTail) {
+			copied = true;
+		}
+		else {
+			std::ifstream istream(journalFile, std::ios::binary);
+			istream.seekg(static_cast<std::streamoff>(logOffset));
+			std::string tail((std::istreambuf_iterator<char>(istream)), std::istreambuf_iterator<char>());
+			ostream.write(tail.data(), static_cast<std::streamsize>(tail.size()));
+			copied = istream.is_open();
+		}
+		ostream.flush();
+		copied = copied && ostream.good();
+	}
+	std::error_code renamed;
+	if (copied) {
+		std::filesystem::rename(journalTemp, journalFile, renamed);
+	}
+	if (!copied || renamed) {
+		std::filesystem::remove(journalTemp, ec);
+	}
+
+	// A log that cannot be reopened takes no records; the next compaction starts it over
+	std::uintmax_t size = std::filesystem::file_size(journalFile, ec);
+	log.clear();
+	log.open(journalFile, std::ios::binary | std::ios::app);
+	logBytes = ec ? 0 : size;
+	if (ec || !log.is_open()) {
+		log.close();
+		logFailed = true;
+	}
+	else if (dropTail && copied && !renamed) {
+		logFailed = false;
+	}
+	compacting = false;
+}
+
+void ExpenseJournal::WaitForCompaction()
+{
+	if (compactionThread.joinable()) {
+		compactionThread.join();
+	}
+}
+
+bool ExpenseJournalReader::Open(const std::string& journalFile)
+{
+	Close();
+	istream.open(journalFile, std::ios::binary);
+	char magic[sizeof(JournalMagic)];
+	if (!istream.read(magic, sizeof(magic))) {
+		badHeader = istream.gcount() != 0;
+		istream.close();
+		return false;
+	}
+	if (std::memcmp(magic, JournalMagic, sizeof(JournalMagic)) != 0) {
+		badHeader = true;
+		istream.close();
+		return false;
+	}
+	intactBytes = sizeof(JournalMagic);
+	recordOffset = intactBytes;
+	return true;
+}
+
+void ExpenseJournalReader::Close()
+{
+	if (istream.is_open()) {
+		istream.close();
+	}
+	istream.clear();
+	badHeader = false;
+	damaged = false;
+	recordOffset = 0;
+	intactBytes = 0;
+}
+
+bool ExpenseJournalReader::Next(Record& record)
+{
+	if (!istream.is_open() || damaged) {
+		return false;
+	}
+	buffer.resize(RecordHeaderSize);
+	if (!istream.read(&buffer[0], RecordHeaderSize)) {
+		damaged = istream.gcount() != 0; // A clean end of file falls exactly between records
+		return false;
+	}
+
+	const char* cursor = buffer.data();
+	const char* end = buffer.data() + buffer.size();
+	uint8_t type = 0;
+	uint32_t payloadSize = 0;
+	Get(cursor, end, type);
+	Get(cursor, end, record.sequence);
+	Get(cursor, end, payloadSize);
+	if (payloadSize > MaxPayloadSize) {
+		damaged = true;
+		return false;
+	}
+	buffer.resize(RecordHeaderSize + payloadSize + RecordChecksumSize);
+	uint32_t checksum = 0;
+	if (!istream.read(&buffer[RecordHeaderSize], payloadSize + RecordChecksumSize)) {
+		damaged = true;
+		return false;
+	}
+	std::memcpy(&checksum, buffer.data() + RecordHeaderSize + payloadSize, sizeof(checksum));
+	if (checksum != Crc32(buffer.data(), RecordHeaderSize + payloadSize)) {
+		damaged = true;
+		return false;
+	}
+
+	const char* payload = buffer.data() + RecordHeaderSize;
+	const char* payloadEnd = payload + payloadSize;
+	record.type = static_cast<ExpenseJournal::RecordType>(type);
+	bool valid = false;
+	switch (record.type) {
+	case ExpenseJournal::RecordType::Add:
+		valid = Get(payload, payloadEnd, record.amountCents) && Get(payload, payloadEnd, record.day)
+			&& GetText(payload, payloadEnd, record.description) && GetText(payload, payloadEnd, record.category);
+		break;
+	case ExpenseJournal::RecordType::Remove:
+		valid = Get(payload, payloadEnd, record.row);
+		break;
+	case ExpenseJournal::RecordType::RemoveRows: {
+		uint32_t count = 0;
+		valid = Get(payload, payloadEnd, count) && static_cast<size_t>(payloadEnd - payload) == count * sizeof(uint32_t);
+		record.rows.resize(valid ? count : 0);
+		for (uint32_t i = 0; valid && i < count; i++) {
+			Get(payload, payloadEnd, record.rows[i]);
+			valid = i == 0 || record.rows[i - 1] < record.rows[i];
+		}
+		break;
+	}
+	case ExpenseJournal::RecordType::Insert:
+		valid = Get(payload, payloadEnd, record.row) && Get(payload, payloadEnd, record.amountCents) && Get(payload, payloadEnd, record.day)
+			&& GetText(payload, payloadEnd, record.description) && GetText(payload, payloadEnd, record.category);
+		break;
+	case ExpenseJournal::RecordType::InsertRows: {
+		uint32_t count = 0;
+		valid = Get(payload, payloadEnd, count) && count <= payloadSize;
+		record.rows.resize(valid ? count : 0);
+		record.amounts.resize(record.rows.size());
+		record.days.resize(record.rows.size());
+		record.descriptions.resize(record.rows.size());
+		record.categories.resize(record.rows.size());
+		for (uint32_t i = 0; valid && i < count; i++) {
+			valid = Get(payload, payloadEnd, record.rows[i]) && Get(payload, payloadEnd, record.amounts[i]) && Get(payload, payloadEnd, record.days[i])
+				&& GetText(payload, payloadEnd, record.descriptions[i]) && GetText(payload, payloadEnd, record.categories[i])
+				&& (i == 0 || record.rows[i - 1] < record.rows[i]);
+		}
+		valid = valid && payload == payloadEnd;
+		break;
+	}
+	case ExpenseJournal::RecordType::Clear:
+	case ExpenseJournal::RecordType::UndoClear:
+		valid = payloadSize == 0;
+		break;
+	}
+	if (!valid) {
+		damaged = true;
+		return false;
+	}
+	recordOffset = intactBytes;
+	intactBytes += buffer.size();
+	return true;
+}
+
+namespace {
+	bool ApplyToStore(ExpenseStore& store, const ExpenseJournalReader::Record& record)
+	{
+		switch (record.type) {
+		case ExpenseJournal::RecordType::Add:
+			store.Add(record.description, record.category, record.amountCents, record.day);
+			return true;
+		case ExpenseJournal::RecordType::Remove:
+			if (record.row >= store.Size()) {
+				return false;
+			}
+			store.Remove(record.row);
+			return true;
+		case ExpenseJournal::RecordType::RemoveRows:
+			if (!record.rows.empty() && record.rows.back() >= store.Size()) {
+				return false;
+			}
+			store.RemoveRows(record.rows);
+			return true;
+		case ExpenseJournal::RecordType::Insert:
+			if (record.row > store.Size()) {
+				return false;
+			}
+			store.Insert(record.row, record.description, record.category, record.amountCents, record.day);
+			return true;
+		case ExpenseJournal::RecordType::InsertRows: {
+			if (!record.rows.empty() && record.rows.back() >= store.Size() + record.rows.size()) {
+				return false;
+			}
+			ExpenseStore rows;
+			for (size_t i = 0; i < record.rows.size(); i++) {
+				rows.Add(record.descriptions[i], record.categories[i], record.amounts[i], record.days[i]);
+			}
+			store.InsertRows(record.rows, rows);
+			return true;
+		}
+		default:
+			return false;
+		}
+	}
+}
+
+// A clear keeps what it removed until the end of the replay, as the app's undo step keeps it;
+// an undo clear is only ever logged once the rows added since have been undone again
+bool ApplyJournalRecord(ExpenseStore& store, ExpenseSegmentLayout& segments, const ExpenseJournalReader::Record& record, ExpenseClearedRows& cleared)
+{
+	if (record.type == ExpenseJournal::RecordType::Clear) {
+		cleared.rows = store.TakeRows();
+		std::swap(cleared.segments, segments);
+		segments.Clear();
+		cleared.valid = true;
+		return true;
+	}
+	if (record.type == ExpenseJournal::RecordType::UndoClear) {
+		if (!cleared.valid || !store.Empty()) {
+			return false;
+		}
+		store.RestoreRows(std::move(cleared.rows));
+		segments = std::move(cleared.segments);
+		cleared = ExpenseClearedRows();
+		return true;
+	}
+	if (!ApplyToStore(store, record)) {
+		return false;
+	}
+	ApplyJournalRecord(segments, record);
+	return true;
+}
+
+void ApplyJournalRecord(ExpenseSegmentLayout& segments, const ExpenseJournalReader::Record& record)
+{
+	switch (record.type) {
+	case ExpenseJournal::RecordType::Add:
+		segments.Add(record.day);
+		break;
+	case ExpenseJournal::RecordType::Remove:
+		segments.Remove(record.row);
+		break;
+	case ExpenseJournal::RecordType::Clear:
+		segments.Clear();
+		break;
+	case ExpenseJournal::RecordType::RemoveRows:
+		segments.RemoveRows(record.rows);
+		break;
+	case ExpenseJournal::RecordType::Insert:
+		segments.Insert(record.row, record.day);
+		break;
+	case ExpenseJournal::RecordType::InsertRows:
+		segments.InsertRows(record.rows, record.days);
+		break;
+	case ExpenseJournal::RecordType::UndoClear:
+		break;
+	}
+}
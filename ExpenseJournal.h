@@ -0,0 +1,177 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "ExpenseSegments.h"
+#include "ExpenseStore.h"
+
+// Append-only operation log kept next to the binary expense snapshot.
+// Every mutation is written as one checksummed record and flushed right away, so a
+// change costs O(1) I/O and a crash loses at most the record being written. Once the
+// log grows large it is folded into the snapshot on a background thread; the journal
+// tracks which month segments the records touched, and only those are rewritten.
+class ExpenseJournal
+{
+public:
+	// legacyFile is the text expense file read (and converted once) when there is no binary snapshot yet
+	ExpenseJournal(std::string snapshotFile, std::string journalFile, std::string legacyFile);
+	~ExpenseJournal();
+
+	// Loads the snapshot, replays the log records newer than it and opens the log for appending.
+	// The legacy file is only read when there is no snapshot. A snapshot that exists but cannot be
+	// read is never replaced by the legacy file, whose rows the log's row positions do not refer
+	// to: Open then returns false and leaves the store empty and the log closed.
+	// skippedLines receives the number of legacy lines that had to be skipped.
+	bool Open(ExpenseStore& store, size_t* skippedLines = nullptr);
+	void Close();
+
+	// What a streaming reader such as ExpenseHistoryReader found while reading the files itself
+	struct LoadState
+	{
+		uint64_t lastSequence = 0;       // last record that applied
+		uint64_t journalRecords = 0;
+		uint64_t intactBytes = 0;        // where the usable part of the log ends
+		bool damaged = false;            // the log has a torn or damaged tail past intactBytes
+		bool badHeader = false;          // the log is not a journal at all
+		bool snapshotMissing = false;    // the rows came from the legacy file or an unsegmented snapshot
+		ExpenseSegmentLayout segments;   // the saved segments with the replayed records applied
+	};
+	// Opens the log for appending after the rows were loaded elsewhere instead of by Open:
+	// repairs the log the way Open would and carries on after state.lastSequence
+	void Resume(const LoadState& state);
+	// Rows of the history in front of the store's first row that are not loaded yet, as while the
+	// older months still load: the store's row positions are logged shifted past them, and no
+	// compaction starts until they are in and this is back to 0. Nothing may be cleared meanwhile.
+	void SetUnloadedRows(ExpenseStore::RowId rows) { unloadedRows = rows; }
+
+	void AppendAdd(const ExpenseStore& store, ExpenseStore::RowId row);
+	// Logs rows [first, last) with a single write and flush
+	void AppendAdds(const ExpenseStore& store, ExpenseStore::RowId first, ExpenseStore::RowId last);
+	void AppendRemove(ExpenseStore::RowId row);
+	// Logs a batch removal as one record; rows are ascending, as ExpenseStore::RemoveRows takes them
+	void AppendRemoveRows(const std::vector<ExpenseStore::RowId>& rows);
+	// Logs a clear and returns the segment layout from before it, for AppendUndoClear
+	ExpenseSegmentLayout AppendClear();
+	// Logs the undoing of the clear logged as clearSequence, once its rows are back in the store and
+	// nothing else is: replay puts back the rows as they were before that clear record, and the
+	// segments return to the layout before had, clean ones still clean. Logs nothing and returns
+	// false when a save since the clear has covered its record; the rows then go in as adds.
+	bool AppendUndoClear(ExpenseSegmentLayout before, uint64_t clearSequence);
+	// Logs a row put back at its old position, as undoing a remove does
+	void AppendInsert(const ExpenseStore& store, ExpenseStore::RowId row);
+	// Logs rows put back at the ascending positions they now have, as undoing a batch removal
+	// does, with a single write and flush
+	void AppendInsertRows(const ExpenseStore& store, const std::vector<ExpenseStore::RowId>& rows);
+
+	// Starts a background compaction once the log holds more records than the dirty segments are
+	// worth rewriting for. Their rows are copied here, so the save works from a consistent state
+	// while the caller carries on changing the store. After a failed save it tries again at the
+	// next record, backing off to the usual interval while saving keeps failing.
+	void CompactIfNeeded(const ExpenseStore& store);
+
+	uint64_t LastSequence() const { return lastSequence; }
+
+	// True once a record could not be written even after reopening the log. Records are then
+	// no longer written, as a later one would not replay without the lost one; the store still
+	// has every change, and the next compaction saves the changed segments and starts the log
+	// over, which clears this.
+	bool Failed() const { return logFailed; }
+	// Runs that compaction right away and waits for it; true once the log takes records again.
+	// Fails while rows are unloaded, which the save would miss.
+	bool Recover(const ExpenseStore& store);
+
+	enum class RecordType : uint8_t { Add = 1, Remove = 2, Clear = 3, Insert = 4, RemoveRows = 5, InsertRows = 6, UndoClear = 7 };
+
+private:
+
+	std::string snapshotFile;
+	std::string journalFile;
+	std::string legacyFile;
+
+	std::mutex logMutex;             // guards log and logBytes against the compaction thread
+	std::ofstream log;
+	uint64_t logBytes = 0;
+	uint64_t lastSequence = 0;
+	uint64_t recordsSinceSnapshot = 0;
+	uint64_t savedSequence = 0;      // records up to here may be gone from the log
+	bool snapshotMissing = false;    // save every segment at the next chance, whatever the log size
+	ExpenseSegmentLayout segments;   // the store's segments, dirty where records changed them
+	ExpenseStore::RowId unloadedRows = 0;
+
+	std::thread compactionThread;
+	std::atomic<bool> compacting{ false };
+	std::atomic<bool> saveFailed{ false };  // the segments it claimed for writing may not exist
+	std::atomic<bool> logFailed{ false };   // records since then were not written, see Failed
+	uint64_t failedSaves = 0;        // in a row, which spaces out the retries
+
+	void EncodeAdd(std::string& out, const ExpenseStore& store, ExpenseStore::RowId row, RecordType type = RecordType::Add);
+	void EncodeRecord(std::string& out, RecordType type, std::string_view payload);
+	void WriteRecords(const std::string& records, size_t count);
+	bool WriteToLog(const std::string& records);
+	bool ReplayLog(ExpenseStore& store, uint64_t snapshotSequence);
+	void OpenLogForAppend();
+	void Compact(ExpenseSegmentLayout plan, ExpenseStore dirtyRows, uint64_t sequence, uint64_t logOffset, bool dropTail);
+	void WaitForCompaction();
+};
+
+// Reads the records of a journal file one at a time, so replaying never holds the whole log
+class ExpenseJournalReader
+{
+public:
+	struct Record
+	{
+		ExpenseJournal::RecordType type;
+		uint64_t sequence;
+		int64_t amountCents;                  // Add
+		int32_t day;
+		std::string_view description;         // valid until the next call
+		std::string_view category;
+		uint32_t row;                         // Remove, Insert (which also has the Add fields)
+		std::vector<uint32_t> rows;           // RemoveRows, InsertRows: ascending positions
+		std::vector<int64_t> amounts;         // InsertRows: the Add fields of each row
+		std::vector<int32_t> days;
+		std::vector<std::string_view> descriptions;
+		std::vector<std::string_view> categories;
+	};
+
+	// False if the file is missing, empty or not a journal; BadHeader() tells the last case apart
+	bool Open(const std::string& journalFile);
+	void Close();
+	// False at the end of the log or at the first torn or damaged record
+	bool Next(Record& record);
+
+	bool BadHeader() const { return badHeader; }
+	bool Damaged() const { return damaged; }
+	// Where the last record returned by Next starts, and where the intact part of the log ends
+	uint64_t RecordOffset() const { return recordOffset; }
+	uint64_t IntactBytes() const { return intactBytes; }
+
+private:
+	std::ifstream istream;
+	std::string buffer;
+	bool badHeader = false;
+	bool damaged = false;
+	uint64_t recordOffset = 0;
+	uint64_t intactBytes = 0;
+};
+
+// What replaying the last clear record set aside, for an undo clear record that follows it
+struct ExpenseClearedRows
+{
+	ExpenseStore rows;
+	ExpenseSegmentLayout segments;
+	bool valid = false;
+};
+
+// Applies one replayed record to the store and its segment layout; false if it names a row the
+// store does not have, or undoes a clear that is not the store's last change, where replaying
+// has to stop
+bool ApplyJournalRecord(ExpenseStore& store, ExpenseSegmentLayout& segments, const ExpenseJournalReader::Record& record, ExpenseClearedRows& cleared);
+// The record applied to the segment layout alone, for a replay that keeps no rows; it cannot
+// undo a clear and ignores undo clear records
+void ApplyJournalRecord(ExpenseSegmentLayout& segments, const ExpenseJournalReader::Record& record);
@@ -0,0 +1,104 @@
+#include "ExpenseListCtrl.h"
+#include <algorithm>
+
+ExpenseListCtrl::ExpenseListCtrl(wxWindow* parent, const ExpenseStore& store)
+	: wxListCtrl(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxLC_REPORT | wxLC_VIRTUAL | wxBORDER_SUNKEN),
+	store(store)
+{
+}
+
+void ExpenseListCtrl::ShowAllRows() {
+	mode = Mode::AllRows;
+	order = nullptr;
+	rows.clear();
+	rows.shrink_to_fit();
+	RefreshRows();
+}
+
+void ExpenseListCtrl::ShowOrder(const std::vector<ExpenseStore::RowId>& newOrder, bool newReversed, size_t newFirst, size_t newLast) {
+	mode = Mode::Order;
+	order = &newOrder;
+	reversed = newReversed;
+	first = newFirst;
+	last = newLast;
+	rows.clear();
+	rows.shrink_to_fit();
+	RefreshRows();
+}
+
+void ExpenseListCtrl::SetRows(std::vector<ExpenseStore::RowId> newRows) {
+	mode = Mode::Rows;
+	order = nullptr;
+	rows = std::move(newRows);
+	RefreshRows();
+}
+
+ExpenseStore::RowId ExpenseListCtrl::RowAt(long item) const {
+	switch (mode) {
+	case Mode::Order:
+		return reversed ? (*order)[first + RowCount() - 1 - item] : (*order)[first + item];
+	case Mode::Rows:
+		return rows[item];
+	case Mode::AllRows:
+	default:
+		return static_cast<ExpenseStore::RowId>(item);
+	}
+}
+
+std::vector<ExpenseStore::RowId> ExpenseListCtrl::SelectedRows() const {
+	std::vector<ExpenseStore::RowId> selected;
+	selected.reserve(static_cast<size_t>(GetSelectedItemCount()));
+	for (long item = GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED); item != -1;
+		item = GetNextItem(item, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED)) {
+		selected.push_back(RowAt(item));
+	}
+	// A sorted or reversed view hands them out of row order
+	std::sort(selected.begin(), selected.end());
+	return selected;
+}
+
+void ExpenseListCtrl::ClearSelection() {
+	SetItemState(-1, 0, wxLIST_STATE_SELECTED);  // -1 is every item, in one call
+}
+
+size_t ExpenseListCtrl::RowCount() const {
+	switch (mode) {
+	case Mode::Order:
+		return std::min(last, order->size()) - std::min(first, order->size());
+	case Mode::Rows:
+		return rows.size();
+	case Mode::AllRows:
+	default:
+		return store.Size();
+	}
+}
+
+void ExpenseListCtrl::RefreshRows() {
+	SetItemCount(static_cast<long>(RowCount()));
+	Refresh();
+}
+
+// Called by wxWidgets only for the cells that are currently visible
+wxString ExpenseListCtrl::OnGetItemText(long item, long column) const {
+	if (item < 0 || static_cast<size_t>(item) >= RowCount()) {
+		return wxEmptyString;
+	}
+
+	ExpenseStore::RowId row = RowAt(item);
+	switch (column) {
+	case 0: {
+		std::string_view description = store.Description(row);
+		return wxString(description.data(), description.size());
+	}
+	case 1: {
+		std::string_view category = store.Category(row);
+		return wxString(category.data(), category.size());
+	}
+	case 2:
+		return FormatAmountCents(store.AmountCents(row));
+	case 3:
+		return FormatIsoDate(store.Day(row));
+	default:
+		return wxEmptyString;
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <wx/wx.h>
+#include <wx/listctrl.h>
+#include <vector>
+#include "ExpenseStore.h"
+
+// Owner-data (wxLC_VIRTUAL) list over an ExpenseStore. The control keeps no text of its own:
+// it only maps list items to store rows and formats the cells that are on screen.
+// Items map to rows in one of three ways: every row in insertion order, a slice of an ordering
+// owned by someone else (a sort index) walked forwards or backwards, or an explicit row list.
+class ExpenseListCtrl : public wxListCtrl
+{
+public:
+    ExpenseListCtrl(wxWindow* parent, const ExpenseStore& store);
+
+    // Shows every stored row in insertion order
+    void ShowAllRows();
+    // Shows positions [first, last) of an ordering that is kept up to date elsewhere; it must
+    // outlive the view. The default range follows the ordering as it grows and shrinks.
+    void ShowOrder(const std::vector<ExpenseStore::RowId>& order, bool reversed, size_t first = 0, size_t last = SIZE_MAX);
+    // Shows exactly these rows
+    void SetRows(std::vector<ExpenseStore::RowId> newRows);
+
+    ExpenseStore::RowId RowAt(long item) const;
+    // Store rows of every selected item, ascending
+    std::vector<ExpenseStore::RowId> SelectedRows() const;
+    void ClearSelection();
+    size_t RowCount() const;
+    void RefreshRows();
+
+protected:
+    wxString OnGetItemText(long item, long column) const override;
+
+private:
+    enum class Mode { AllRows, Order, Rows };
+
+    const ExpenseStore& store;
+    Mode mode = Mode::AllRows;
+    const std::vector<ExpenseStore::RowId>* order = nullptr;
+    bool reversed = false;
+    size_t first = 0;
+    size_t last = SIZE_MAX;
+    std::vector<ExpenseStore::RowId> rows;
+};
@@ -0,0 +1,148 @@
+#include "ExpenseLoader.h"
+#include <filesystem>
+#include "Diagnostics.h"
+
+namespace {
+	// Rows per batch: large enough that appending and indexing stay bulk operations, small
+	// enough that the window keeps up with the rows as they arrive
+	const size_t BatchRows = 64 * 1024;
+	// Batches delivered but not yet acknowledged by the consumer
+	const size_t MaxUnacknowledged = 2;
+}
+
+ExpenseHistoryLoader::~ExpenseHistoryLoader()
+{
+	Cancel();
+}
+
+void ExpenseHistoryLoader::Start(const std::string& snapshotFile, const std::string& journalFile, const std::string& legacyFile, BatchHandler handler)
+{
+	Cancel();
+	this->snapshotFile = snapshotFile;
+	this->journalFile = journalFile;
+	this->legacyFile = legacyFile;
+	this->handler = std::move(handler);
+	unacknowledged = 0;
+	cancelled = false;
+	thread = std::thread(&ExpenseHistoryLoader::LoadLoop, this);
+}
+
+void ExpenseHistoryLoader::Acknowledge()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (unacknowledged > 0) {
+		unacknowledged--;
+	}
+	acknowledged.notify_all();
+}
+
+void ExpenseHistoryLoader::Cancel()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		cancelled = true;
+	}
+	acknowledged.notify_all();
+	if (thread.joinable()) {
+		thread.join();
+	}
+}
+
+void ExpenseHistoryLoader::LoadLoop()
+{
+	DiagnosticsTimer timer(DiagnosticsMetric::Load);
+	ExpenseHistoryReader reader;
+	// Every row ends up in the store, so bounding the decoded segments would only cost time
+	reader.LimitPagedRows(SIZE_MAX);
+	auto last = std::make_shared<Batch>();
+	last->last = true;
+	if (!reader.Open(snapshotFile, journalFile, legacyFile)) {
+		last->failed = true;
+		if (WaitForConsumer()) {
+			handler(std::move(last));
+		}
+		return;
+	}
+
+	// The newest month first, so the consumer can take changes while the older rows load
+	const uint64_t olderRows = reader.SkipOlderRows();
+	uint64_t rowsDone = 0;
+	if (!StreamRows(reader, false, rowsDone)) {
+		return;
+	}
+	if (olderRows > 0 && !reader.Failed()) {
+		auto newest = std::make_shared<Batch>();
+		newest->newestLoaded = true;
+		newest->rowsDone = rowsDone;
+		newest->totalRows = reader.Size();
+		newest->journal = reader.JournalState();
+		newest->olderRows = olderRows;
+		newest->olderMonths = reader.OlderMonths();
+		if (!WaitForConsumer()) {
+			return;
+		}
+		handler(std::move(newest));
+		reader.ReadOlderRows();
+		if (!StreamRows(reader, true, rowsDone)) {
+			return;
+		}
+	}
+
+	last->failed = reader.Failed();
+	last->rowsDone = rowsDone;
+	last->totalRows = reader.Size();
+	last->skippedLines = reader.SkippedLines();
+	last->journal = reader.JournalState();
+	reader.Close();
+	if (Diagnostics::Enabled()) {
+		std::error_code ec;
+		uint64_t bytes = 0;
+		for (const std::string* file : { &snapshotFile, &journalFile, &legacyFile }) {
+			std::uintmax_t size = std::filesystem::file_size(*file, ec);
+			bytes += ec ? 0 : size;
+		}
+		timer.Rows(rowsDone);
+		timer.BytesRead(bytes);
+	}
+	timer.Stop();  // The time until the consumer takes the last batch is not part of loading
+	if (WaitForConsumer()) {
+		handler(std::move(last));
+	}
+}
+
+bool ExpenseHistoryLoader::StreamRows(ExpenseHistoryReader& reader, bool older, uint64_t& rowsDone)
+{
+	ExpenseRecord record;
+	bool more = true;
+	while (more) {
+		auto batch = std::make_shared<Batch>();
+		batch->Reserve(BatchRows);
+		while (batch->Size() < BatchRows && (more = reader.Next(record))) {
+			batch->Add(record.description, record.category, record.amountCents, record.day);
+		}
+		if (batch->Size() == 0) {
+			break;
+		}
+		rowsDone += batch->Size();
+		batch->rowsDone = rowsDone;
+		batch->totalRows = reader.Size();
+		batch->older = older;
+		if (!WaitForConsumer()) {
+			return false;
+		}
+		handler(std::move(batch));
+	}
+	return true;
+}
+
+// Blocks until the consumer has room for another batch; false once cancelled
+bool ExpenseHistoryLoader::WaitForConsumer()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	acknowledged.wait(lock, [this] { return cancelled || unacknowledged < MaxUnacknowledged; });
+	if (cancelled) {
+		return false;
+	}
+	unacknowledged++;
+	return true;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ExpenseJournal.h"
+#include "ExpenseReader.h"
+#include "ExpenseStore.h"
+
+// Loads the saved history on a background thread and hands it over in batches, so the window
+// can show up at once and fill in as rows arrive. The rows stream through ExpenseHistoryReader,
+// which keeps only the journal's removals in memory, and the loader waits while the consumer
+// has not yet acknowledged what it was given. The journal is not touched: the consumer passes
+// the last batch's journal state to ExpenseJournal::Resume to go on logging after the rows.
+//
+// A history in month segments comes newest month first: the rows from the newest month's first
+// run on, then a batch marked newestLoaded with the journal state, so the consumer can resume
+// the journal and take changes while the older rows follow in batches marked older.
+class ExpenseHistoryLoader
+{
+public:
+	struct Batch : ExpenseBatch
+	{
+		uint64_t rowsDone = 0;                  // rows delivered up to and including this batch
+		uint64_t totalRows = 0;
+		bool last = false;                      // the end of the history; has no rows
+		bool failed = false;                    // set on the last batch if the files could not be read
+		size_t skippedLines = 0;                // last batch: legacy lines that could not be read
+		ExpenseJournal::LoadState journal;      // last and newestLoaded batches: for ExpenseJournal::Resume
+		bool newestLoaded = false;              // no rows: everything but the older rows has been delivered
+		bool older = false;                     // rows that go in front of all rows delivered before newestLoaded
+		uint64_t olderRows = 0;                 // newestLoaded batch: how many older rows follow
+		std::vector<ExpenseMonthTotal> olderMonths;  // newestLoaded batch: their totals by month
+	};
+	using BatchHandler = std::function<void(std::shared_ptr<Batch> batch)>;
+
+	ExpenseHistoryLoader() = default;
+	~ExpenseHistoryLoader();
+	ExpenseHistoryLoader(const ExpenseHistoryLoader&) = delete;
+	ExpenseHistoryLoader& operator=(const ExpenseHistoryLoader&) = delete;
+
+	// Starts loading in the background; handler is called on the loader thread once per batch
+	// and once more with a last batch
+	void Start(const std::string& snapshotFile, const std::string& journalFile, const std::string& legacyFile, BatchHandler handler);
+	// Tells the loader the consumer is done with a batch, letting it run ahead again
+	void Acknowledge();
+	// Stops the thread; the handler is not called again once this returns. Not to be called
+	// from the handler itself.
+	void Cancel();
+
+private:
+	std::string snapshotFile, journalFile, legacyFile;
+	BatchHandler handler;
+	std::thread thread;
+
+	std::mutex mutex;
+	std::condition_variable acknowledged;
+	size_t unacknowledged = 0;
+	bool cancelled = false;
+
+	void LoadLoop();
+	// Hands over the rows Next returns in batches; false once cancelled
+	bool StreamRows(ExpenseHistoryReader& reader, bool older, uint64_t& rowsDone);
+	bool WaitForConsumer();
+};
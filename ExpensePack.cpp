@@ -0,0 +1,424 @@
+#include "ExpensePack.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace {
+	const char PackMagic[8] = { 'B', 'B', 'P', 'A', 'C', 'K', '\r', '\n' };
+
+	struct PackHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t payloadCrc;
+		uint64_t rows;
+		uint64_t sequence;
+		uint64_t payloadSize;
+	};
+
+	// Every row takes at least a byte in each of the four varint columns
+	const uint64_t MinRowBytes = 4;
+
+	const int HashBits = 14;
+	const size_t MinMatch = 4;
+	const size_t MaxOffset = 65535;
+	const size_t WildCopy = 16;
+
+	void PutVarint(std::string& out, uint64_t value) {
+		while (value >= 0x80) {
+			out.push_back(static_cast<char>(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back(static_cast<char>(value));
+	}
+
+	inline bool GetVarint(const uint8_t*& cursor, const uint8_t* end, uint64_t& value) {
+		if (cursor < end && *cursor < 0x80) {
+			value = *cursor++;
+			return true;
+		}
+		value = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			if (cursor == end) {
+				return false;
+			}
+			const uint8_t byte = *cursor++;
+			value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			if (byte < 0x80) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	uint64_t ZigZag(int64_t value) {
+		return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+	}
+
+	int64_t UnZigZag(uint64_t value) {
+		return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+	}
+
+	void PutSection(std::string& out, const std::string& section) {
+		PutVarint(out, section.size());
+		out.append(section);
+	}
+
+	// Narrows the cursor to the next length-prefixed section; the caller must consume all of it
+	bool GetSection(const uint8_t*& cursor, const uint8_t* end, const uint8_t*& sectionEnd) {
+		uint64_t length;
+		if (!GetVarint(cursor, end, length) || length > static_cast<uint64_t>(end - cursor)) {
+			return false;
+		}
+		sectionEnd = cursor + length;
+		return true;
+	}
+
+	uint32_t Read32(const char* data) {
+		uint32_t value;
+		std::memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	// Lengths that do not fit the 4-bit token field continue in bytes of 255 and a final remainder
+	void PutLength(std::string& out, size_t length) {
+		for (length -= 15; length >= 255; length -= 255) {
+			out.push_back(static_cast<char>(255));
+		}
+		out.push_back(static_cast<char>(length));
+	}
+
+	bool GetLength(const uint8_t*& cursor, const uint8_t* end, size_t& length) {
+		uint8_t byte;
+		do {
+			if (cursor == end) {
+				return false;
+			}
+			byte = *cursor++;
+			length += byte;
+		} while (byte == 255);
+		return true;
+	}
+
+	void PutSequence(std::string& out, const char* literals, size_t literalCount, size_t offset, size_t matchLength) {
+		const size_t matchCode = matchLength == 0 ? 0 : matchLength - MinMatch;
+		out.push_back(static_cast<char>((std::min<size_t>(literalCount, 15) << 4) | std::min<size_t>(matchCode, 15)));
+		if (literalCount >= 15) {
+			PutLength(out, literalCount);
+		}
+		out.append(literals, literalCount);
+		if (matchLength == 0) {
+			return;
+		}
+		out.push_back(static_cast<char>(offset & 0xFF));
+		out.push_back(static_cast<char>(offset >> 8));
+		if (matchCode >= 15) {
+			PutLength(out, matchCode);
+		}
+	}
+}
+
+void LzCompress(const char* data, size_t size, std::string& out)
+{
+	// Positions + 1 of the last 4-byte sequence with each hash, 0 for none
+	std::vector<uint32_t> table(size_t(1) << HashBits, 0);
+	size_t anchor = 0;
+	size_t position = 0;
+	while (position + MinMatch <= size) {
+		const uint32_t sequence = Read32(data + position);
+		const uint32_t hash = (sequence * 2654435761u) >> (32 - HashBits);
+		const size_t candidate = table[hash];
+		table[hash] = static_cast<uint32_t>(position + 1);
+		if (candidate == 0 || position + 1 - candidate > MaxOffset || Read32(data + candidate - 1) != sequence) {
+			position++;
+			continue;
+		}
+		const size_t match = candidate - 1;
+		size_t length = MinMatch;
+		while (position + length < size && data[match + length] == data[position + length]) {
+			length++;
+		}
+		PutSequence(out, data + anchor, position - anchor, position - match, length);
+		position += length;
+		anchor = position;
+	}
+	// The last sequence has only literals, which is how the decoder knows it is the last
+	PutSequence(out, data + anchor, size - anchor, 0, 0);
+}
+
+bool LzDecompress(const char* data, size_t size, char* out, size_t outSize)
+{
+	const uint8_t* cursor = reinterpret_cast<const uint8_t*>(data);
+	const uint8_t* const end = cursor + size;
+	char* target = out;
+	char* const targetEnd = out + outSize;
+	for (;;) {
+		if (cursor == end) {
+			return false;
+		}
+		const uint8_t token = *cursor++;
+		size_t literals = token >> 4;
+		if (literals == 15 && !GetLength(cursor, end, literals)) {
+			return false;
+		}
+		if (literals > static_cast<size_t>(end - cursor) || literals > static_cast<size_t>(targetEnd - target)) {
+			return false;
+		}
+		// Short runs are copied as a fixed 16 bytes where both buffers have room, which compiles to
+		// two moves instead of a memcpy call; the bytes past the run are overwritten later anyway
+		if (literals <= WildCopy && static_cast<size_t>(end - cursor) >= WildCopy && static_cast<size_t>(targetEnd - target) >= WildCopy) {
+			std::memcpy(target, cursor, WildCopy);
+		}
+		else {
+			std::memcpy(target, cursor, literals);
+		}
+		cursor += literals;
+		target += literals;
+		if (cursor == end) {
+			return target == targetEnd;
+		}
+
+		if (end - cursor < 2) {
+			return false;
+		}
+		const size_t offset = cursor[0] | (static_cast<size_t>(cursor[1]) << 8);
+		cursor += 2;
+		size_t length = token & 15;
+		if (length == 15 && !GetLength(cursor, end, length)) {
+			return false;
+		}
+		length += MinMatch;
+		if (offset == 0 || offset > static_cast<size_t>(target - out) || length > static_cast<size_t>(targetEnd - target)) {
+			return false;
+		}
+		const char* match = target - offset;
+		if (offset >= WildCopy && length <= WildCopy && static_cast<size_t>(targetEnd - target) >= WildCopy) {
+			std::memcpy(target, match, WildCopy);
+		}
+		else if (offset >= length) {
+			std::memcpy(target, match, length);
+		}
+		else {
+			// An overlapping match repeats the last offset bytes, so it is copied forward byte by byte
+			for (size_t i = 0; i < length; i++) {
+				target[i] = match[i];
+			}
+		}
+		target += length;
+	}
+}
+
+void EncodeExpensePack(const ExpenseStore& store, ExpenseStore::RowId first, size_t count, uint64_t sequence, std::string& out)
+{
+	const ExpenseStore::RowId last = first + static_cast<ExpenseStore::RowId>(count);
+	std::string payload;
+
+	// The file's category table lists only the categories its rows use, in order of first use
+	std::vector<uint32_t> localIds(store.CategoryCount(), UINT32_MAX);
+	std::vector<ExpenseStore::CategoryId> used;
+	std::string section;
+	for (ExpenseStore::RowId row = first; row < last; row++) {
+		const ExpenseStore::CategoryId id = store.CategoryOf(row);
+		if (localIds[id] == UINT32_MAX) {
+			localIds[id] = static_cast<uint32_t>(used.size());
+			used.push_back(id);
+		}
+		PutVarint(section, localIds[id]);
+	}
+	const std::string categorySection = std::move(section);
+	PutVarint(payload, used.size());
+	for (ExpenseStore::CategoryId id : used) {
+		const std::string_view name = store.CategoryName(id);
+		PutVarint(payload, name.size());
+		payload.append(name);
+	}
+
+	section.clear();
+	int64_t previousDay = 0;
+	for (ExpenseStore::RowId row = first; row < last; row++) {
+		PutVarint(section, ZigZag(store.Day(row) - previousDay));
+		previousDay = store.Day(row);
+	}
+	PutSection(payload, section);
+
+	section.clear();
+	for (ExpenseStore::RowId row = first; row < last; row++) {
+		PutVarint(section, ZigZag(store.AmountCents(row)));
+	}
+	PutSection(payload, section);
+	PutSection(payload, categorySection);
+
+	section.clear();
+	std::string heap;
+	for (ExpenseStore::RowId row = first; row < last; row++) {
+		PutVarint(section, store.Description(row).size());
+		heap.append(store.Description(row));
+	}
+	PutSection(payload, section);
+
+	std::string compressed;
+	for (size_t start = 0; start < heap.size(); start += ExpensePackBlockSize) {
+		const size_t blockSize = std::min(ExpensePackBlockSize, heap.size() - start);
+		compressed.clear();
+		LzCompress(heap.data() + start, blockSize, compressed);
+		// A stored size equal to the raw size marks a block kept as it was
+		const bool keep = compressed.size() < blockSize;
+		PutVarint(payload, blockSize);
+		PutVarint(payload, keep ? compressed.size() : blockSize);
+		payload.append(keep ? compressed.data() : heap.data() + start, keep ? compressed.size() : blockSize);
+	}
+
+	PackHeader header = {};
+	std::memcpy(header.magic, PackMagic, sizeof(PackMagic));
+	header.version = ExpensePackVersion;
+	header.payloadCrc = Crc32(payload.data(), payload.size());
+	header.rows = count;
+	header.sequence = sequence;
+	header.payloadSize = payload.size();
+	out.clear();
+	out.reserve(sizeof(header) + payload.size());
+	out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.append(payload);
+}
+
+bool WriteExpensePack(const std::string& fileName, const ExpenseStore& store, ExpenseStore::RowId first, size_t count, uint64_t sequence)
+{
+	std::string pack;
+	EncodeExpensePack(store, first, count, sequence, pack);
+	std::ofstream ostream(fileName, std::ios::binary | std::ios::trunc);
+	ostream.write(pack.data(), static_cast<std::streamsize>(pack.size()));
+	ostream.flush();
+	return ostream.good();
+}
+
+bool IsExpensePack(const char* data, size_t size)
+{
+	return size >= sizeof(PackMagic) && std::memcmp(data, PackMagic, sizeof(PackMagic)) == 0;
+}
+
+bool CheckExpensePack(const char* data, size_t size, uint64_t* rows, uint64_t* sequence)
+{
+	PackHeader header;
+	if (size < sizeof(header) || !IsExpensePack(data, size)) {
+		return false;
+	}
+	std::memcpy(&header, data, sizeof(header));
+	if (header.version != ExpensePackVersion || header.payloadSize != size - sizeof(header)
+		|| header.rows > header.payloadSize / MinRowBytes || header.rows >= UINT32_MAX
+		|| header.payloadCrc != Crc32(data + sizeof(header), header.payloadSize)) {
+		return false;
+	}
+	if (rows) {
+		*rows = header.rows;
+	}
+	if (sequence) {
+		*sequence = header.sequence;
+	}
+	return true;
+}
+
+bool DecodeExpensePack(const char* data, size_t size, ExpenseBatch& batch)
+{
+	PackHeader header;
+	if (size < sizeof(header)) {
+		return false;
+	}
+	std::memcpy(&header, data, sizeof(header));
+	if (header.payloadSize != size - sizeof(header) || header.rows > header.payloadSize / MinRowBytes) {
+		return false;
+	}
+	const size_t rows = static_cast<size_t>(header.rows);
+	const uint8_t* cursor = reinterpret_cast<const uint8_t*>(data) + sizeof(header);
+	const uint8_t* const end = cursor + header.payloadSize;
+
+	// The batch's name lookup is left empty: decoded batches are only read and appended
+	uint64_t categoryCount;
+	if (!GetVarint(cursor, end, categoryCount) || categoryCount > static_cast<uint64_t>(end - cursor)) {
+		return false;
+	}
+	for (uint64_t id = 0; id < categoryCount; id++) {
+		uint64_t length;
+		if (!GetVarint(cursor, end, length) || length > static_cast<uint64_t>(end - cursor)) {
+			return false;
+		}
+		batch.categoryNames.emplace_back(reinterpret_cast<const char*>(cursor), static_cast<size_t>(length));
+		cursor += length;
+	}
+
+	const uint8_t* sectionEnd;
+	uint64_t value;
+	batch.days.resize(rows);
+	if (!GetSection(cursor, end, sectionEnd)) {
+		return false;
+	}
+	int64_t day = 0;
+	for (size_t row = 0; row < rows; row++) {
+		if (!GetVarint(cursor, sectionEnd, value)) {
+			return false;
+		}
+		day += UnZigZag(value);
+		batch.days[row] = static_cast<int32_t>(day);
+	}
+
+	batch.amounts.resize(rows);
+	if (cursor != sectionEnd || !GetSection(cursor, end, sectionEnd)) {
+		return false;
+	}
+	for (size_t row = 0; row < rows; row++) {
+		if (!GetVarint(cursor, sectionEnd, value)) {
+			return false;
+		}
+		batch.amounts[row] = UnZigZag(value);
+	}
+
+	batch.categories.resize(rows);
+	if (cursor != sectionEnd || !GetSection(cursor, end, sectionEnd)) {
+		return false;
+	}
+	for (size_t row = 0; row < rows; row++) {
+		if (!GetVarint(cursor, sectionEnd, value) || value >= categoryCount) {
+			return false;
+		}
+		batch.categories[row] = static_cast<uint32_t>(value);
+	}
+
+	batch.descriptionOffsets.resize(rows + 1);
+	batch.descriptionOffsets[0] = 0;
+	if (cursor != sectionEnd || !GetSection(cursor, end, sectionEnd)) {
+		return false;
+	}
+	for (size_t row = 0; row < rows; row++) {
+		if (!GetVarint(cursor, sectionEnd, value) || value > UINT32_MAX) {
+			return false;
+		}
+		batch.descriptionOffsets[row + 1] = batch.descriptionOffsets[row] + value;
+	}
+	if (cursor != sectionEnd) {
+		return false;
+	}
+
+	// Compression is bounded at 255 bytes out per byte in, so a larger total is damage
+	const uint64_t heapSize = batch.descriptionOffsets[rows];
+	if (heapSize / 255 > static_cast<uint64_t>(end - cursor)) {
+		return false;
+	}
+	batch.descriptionHeap.resize(static_cast<size_t>(heapSize));
+	for (size_t start = 0; start < heapSize;) {
+		uint64_t rawSize, storedSize;
+		if (!GetVarint(cursor, end, rawSize) || !GetVarint(cursor, end, storedSize)
+			|| rawSize == 0 || rawSize > ExpensePackBlockSize || rawSize > heapSize - start
+			|| storedSize > rawSize || storedSize > static_cast<uint64_t>(end - cursor)) {
+			return false;
+		}
+		char* target = &batch.descriptionHeap[start];
+		if (storedSize == rawSize) {
+			std::memcpy(target, cursor, static_cast<size_t>(rawSize));
+		}
+		else if (!LzDecompress(reinterpret_cast<const char*>(cursor), static_cast<size_t>(storedSize), target, static_cast<size_t>(rawSize))) {
+			return false;
+		}
+		cursor += storedSize;
+		start += static_cast<size_t>(rawSize);
+	}
+	return cursor == end;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "ExpenseStore.h"
+
+// Compressed encoding of a run of expense rows, used for the snapshot segments that hold a long
+// history, where the mapped ExpenseSnapshot layout spends 24 bytes a row on fixed-width columns.
+//
+// Layout: a fixed header (row count, sequence, payload size and CRC) followed by the payload
+//   categories     varint count, then varint length + name for each category the rows use
+//   days           zigzag varint delta from the previous row's day (rows are mostly in date order)
+//   amounts        zigzag varint cents
+//   category ids   varint ids into the file's own category table
+//   descriptions   varint length of each, then the descriptions back to back in blocks of
+//                  ExpensePackBlockSize bytes, each LZ-compressed unless that does not make it smaller
+//
+// The first four column sections are prefixed with their varint byte length. Decoding checks
+// every length and offset against the payload, so a damaged file is rejected, never misread.
+constexpr uint32_t ExpensePackVersion = 1;
+constexpr size_t ExpensePackBlockSize = 64 * 1024;
+
+// Encodes count rows of the store starting at first
+void EncodeExpensePack(const ExpenseStore& store, ExpenseStore::RowId first, size_t count, uint64_t sequence, std::string& out);
+bool WriteExpensePack(const std::string& fileName, const ExpenseStore& store, ExpenseStore::RowId first, size_t count, uint64_t sequence);
+
+// True if the data starts like a pack; CheckExpensePack then reads the header and verifies the CRC
+bool IsExpensePack(const char* data, size_t size);
+bool CheckExpensePack(const char* data, size_t size, uint64_t* rows = nullptr, uint64_t* sequence = nullptr);
+// Decodes a pack CheckExpensePack accepted into an empty batch; false if the payload is damaged
+bool DecodeExpensePack(const char* data, size_t size, ExpenseBatch& batch);
+
+// The block compression used for the descriptions: LZ77 with 4-byte minimum matches and 16-bit
+// offsets in the token format of LZ4, so it decodes with little more than memcpy.
+// LzDecompress fails unless the input expands to exactly outSize bytes.
+void LzCompress(const char* data, size_t size, std::string& out);
+bool LzDecompress(const char* data, size_t size, char* out, size_t outSize);
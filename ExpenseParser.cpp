@@ -0,0 +1,331 @@
+#include "ExpenseParser.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+	// Inputs smaller than this are parsed on the calling thread
+	const size_t MinChunkBytes = 256 * 1024;
+	const size_t ChunksPerThread = 4;
+
+	// Rows parsed from one newline-aligned slice of the input, in store column layout
+	struct ParsedChunk
+	{
+		const char* begin = nullptr;
+		const char* end = nullptr;
+		size_t lines = 0;
+
+		std::vector<int64_t> amounts;
+		std::vector<int32_t> days;
+		std::vector<uint32_t> categories;
+		std::vector<uint64_t> descriptionOffsets{ 0 };
+		std::string descriptionHeap;
+		std::vector<std::string> categoryNames;
+		std::unordered_map<std::string_view, uint32_t> categoryLookup; // raw token -> chunk category id
+
+		std::vector<ExpenseParseError> errors;  // line numbers are chunk relative until merged
+		size_t errorCount = 0;
+	};
+
+	bool IsBlank(char c) {
+		return c == ' ' || c == '\t';
+	}
+
+	std::string_view NextField(const char*& cursor, const char* end) {
+		while (cursor < end && IsBlank(*cursor)) {
+			cursor++;
+		}
+		const char* start = cursor;
+		while (cursor < end && !IsBlank(*cursor)) {
+			cursor++;
+		}
+		return std::string_view(start, static_cast<size_t>(cursor - start));
+	}
+
+	void AddError(ParsedChunk& chunk, size_t line, const char* message, std::string_view field = {}) {
+		if (chunk.errors.size() < ExpenseParseReport::MaxErrors) {
+			std::string text(message);
+			if (!field.empty()) {
+				text += " '";
+				text.append(field.substr(0, 40));
+				text += "'";
+			}
+			chunk.errors.push_back(ExpenseParseError{ line, std::move(text) });
+		}
+		chunk.errorCount++;
+	}
+
+	void ParseLine(ParsedChunk& chunk, const char* cursor, const char* end, size_t line) {
+		ExpenseLine parsed = ParseExpenseLine(std::string_view(cursor, static_cast<size_t>(end - cursor)));
+		if (parsed.kind == ExpenseLine::Kind::Error) {
+			AddError(chunk, line, parsed.error, parsed.errorField);
+			return;
+		}
+		if (parsed.kind != ExpenseLine::Kind::Row) {
+			return;
+		}
+
+		auto found = chunk.categoryLookup.find(parsed.category);
+		uint32_t categoryId;
+		if (found != chunk.categoryLookup.end()) {
+			categoryId = found->second;
+		}
+		else {
+			categoryId = static_cast<uint32_t>(chunk.categoryNames.size());
+			chunk.categoryNames.emplace_back(parsed.category);
+			std::replace(chunk.categoryNames.back().begin(), chunk.categoryNames.back().end(), '_', ' ');
+			chunk.categoryLookup.emplace(parsed.category, categoryId);
+		}
+
+		size_t start = chunk.descriptionHeap.size();
+		chunk.descriptionHeap.append(parsed.description);
+		std::replace(chunk.descriptionHeap.begin() + start, chunk.descriptionHeap.end(), '_', ' ');
+
+		chunk.amounts.push_back(parsed.amountCents);
+		chunk.days.push_back(parsed.day);
+		chunk.categories.push_back(categoryId);
+		chunk.descriptionOffsets.push_back(chunk.descriptionHeap.size());
+	}
+
+	void ParseChunk(ParsedChunk& chunk) {
+		// Rough guess of 40 bytes per line keeps reallocations down
+		size_t expectedRows = static_cast<size_t>(chunk.end - chunk.begin) / 40;
+		chunk.amounts.reserve(expectedRows);
+		chunk.days.reserve(expectedRows);
+		chunk.categories.reserve(expectedRows);
+		chunk.descriptionOffsets.reserve(expectedRows + 1);
+
+		const char* cursor = chunk.begin;
+		while (cursor < chunk.end) {
+			const char* lineEnd = static_cast<const char*>(std::memchr(cursor, '\n', static_cast<size_t>(chunk.end - cursor)));
+			const char* next = lineEnd ? lineEnd + 1 : chunk.end;
+			if (!lineEnd) {
+				lineEnd = chunk.end;
+			}
+			if (lineEnd > cursor && lineEnd[-1] == '\r') {
+				lineEnd--;
+			}
+			ParseLine(chunk, cursor, lineEnd, chunk.lines++);
+			cursor = next;
+		}
+	}
+
+	// Start of the last line with anything but blanks on it, end if there is none
+	const char* LastLine(const char* begin, const char* end) {
+		const char* lineEnd = end;
+		while (lineEnd > begin) {
+			const char* lineStart = lineEnd;
+			while (lineStart > begin && lineStart[-1] != '\n') {
+				lineStart--;
+			}
+			if (std::any_of(lineStart, lineEnd, [](char c) { return !IsBlank(c) && c != '\r' && c != '\n'; })) {
+				return lineStart;
+			}
+			lineEnd = lineStart > begin ? lineStart - 1 : begin;
+		}
+		return end;
+	}
+
+	// Parses the count header on the first line; returns the start of the second line
+	const char* ParseHeader(std::string_view text, ExpenseParseReport& report, bool& valid) {
+		const char* begin = text.data();
+		const char* end = text.data() + text.size();
+		const char* lineEnd = static_cast<const char*>(std::memchr(begin, '\n', text.size()));
+		const char* next = lineEnd ? lineEnd + 1 : end;
+		if (!lineEnd) {
+			lineEnd = end;
+		}
+		if (lineEnd > begin && lineEnd[-1] == '\r') {
+			lineEnd--;
+		}
+
+		const char* cursor = begin;
+		std::string_view count = NextField(cursor, lineEnd);
+		std::from_chars_result result = std::from_chars(count.data(), count.data() + count.size(), report.declaredRows);
+		valid = !count.empty() && result.ec == std::errc() && result.ptr == count.data() + count.size();
+		valid = valid && NextField(cursor, lineEnd).empty();
+		if (!valid) {
+			report.declaredRows = 0;
+			report.errors.push_back(ExpenseParseError{ 1, "missing or invalid row count header" });
+			report.errorCount++;
+		}
+		return next;
+	}
+}
+
+ExpenseLine ParseExpenseLine(std::string_view text)
+{
+	ExpenseLine line;
+	const char* cursor = text.data();
+	const char* end = text.data() + text.size();
+	if (cursor < end && end[-1] == '\r') {
+		end--;
+	}
+
+	line.description = NextField(cursor, end);
+	if (line.description.empty()) {
+		return line; // Blank line
+	}
+	line.kind = ExpenseLine::Kind::Error;
+	line.category = NextField(cursor, end);
+	std::string_view amount = NextField(cursor, end);
+	std::string_view date = NextField(cursor, end);
+	if (date.empty() || !NextField(cursor, end).empty()) {
+		line.error = "expected 4 fields: description category amount date";
+		return line;
+	}
+	if (!ParseAmountCents(amount, line.amountCents)) {
+		line.error = "invalid amount";
+		line.errorField = amount;
+		return line;
+	}
+	if (!ParseIsoDate(date, line.day)) {
+		line.error = "invalid date";
+		line.errorField = date;
+		return line;
+	}
+	line.kind = ExpenseLine::Kind::Row;
+	return line;
+}
+
+bool ParseSequenceTrailer(std::string_view text, uint64_t& sequence)
+{
+	const char* cursor = text.data();
+	const char* end = text.data() + text.size();
+	if (cursor < end && end[-1] == '\r') {
+		end--;
+	}
+	if (NextField(cursor, end) != "#sequence") {
+		return false;
+	}
+	std::string_view value = NextField(cursor, end);
+	std::from_chars_result result = std::from_chars(value.data(), value.data() + value.size(), sequence);
+	return !value.empty() && result.ec == std::errc() && result.ptr == value.data() + value.size() && NextField(cursor, end).empty();
+}
+
+bool ParseExpenseText(std::string_view text, ExpenseStore& store, ExpenseParseReport& report, unsigned threads)
+{
+	report = ExpenseParseReport();
+	if (text.empty()) {
+		return true;
+	}
+
+	bool headerValid;
+	const char* body = ParseHeader(text, report, headerValid);
+	const char* end = text.data() + text.size();
+
+	// A "#sequence N" last line is set aside; whether it is the trailer depends on the rows before it
+	const char* trailer = LastLine(body, end);
+	const char* trailerEnd = static_cast<const char*>(std::memchr(trailer, '\n', static_cast<size_t>(end - trailer)));
+	uint64_t trailerSequence = 0;
+	if (ParseSequenceTrailer(std::string_view(trailer, static_cast<size_t>((trailerEnd ? trailerEnd : end) - trailer)), trailerSequence)) {
+		end = trailer;
+	}
+	else {
+		trailer = nullptr;
+	}
+	const size_t bodySize = static_cast<size_t>(end - body);
+
+	if (threads == 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	size_t chunkCount = std::max<size_t>(1, std::min<size_t>(threads * ChunksPerThread, bodySize / MinChunkBytes));
+
+	// Cut the body into roughly equal chunks that always end just after a newline
+	std::vector<ParsedChunk> chunks(chunkCount);
+	const char* cursor = body;
+	for (size_t i = 0; i < chunkCount; i++) {
+		chunks[i].begin = cursor;
+		if (i + 1 == chunkCount) {
+			cursor = end;
+		}
+		else {
+			const char* target = std::min(end, cursor + bodySize / chunkCount);
+			const char* newline = static_cast<const char*>(std::memchr(target, '\n', static_cast<size_t>(end - target)));
+			cursor = newline ? newline + 1 : end;
+		}
+		chunks[i].end = cursor;
+	}
+
+	std::atomic<size_t> nextChunk{ 0 };
+	auto worker = [&chunks, &nextChunk]() {
+		for (size_t i = nextChunk++; i < chunks.size(); i = nextChunk++) {
+			ParseChunk(chunks[i]);
+		}
+	};
+	std::vector<std::thread> workers;
+	for (unsigned t = 1; t < std::min<size_t>(threads, chunkCount); t++) {
+		workers.emplace_back(worker);
+	}
+	worker();
+	for (std::thread& thread : workers) {
+		thread.join();
+	}
+
+	// Merge in input order so rows keep their file order
+	size_t totalRows = 0, totalBytes = 0;
+	for (const ParsedChunk& chunk : chunks) {
+		totalRows += chunk.amounts.size();
+		totalBytes += chunk.descriptionHeap.size();
+	}
+	store.Reserve(store.Size() + totalRows, store.Empty() ? totalBytes : 0);
+
+	size_t line = 2; // the header is line 1
+	std::vector<std::string_view> categoryNames;
+	for (ParsedChunk& chunk : chunks) {
+		categoryNames.assign(chunk.categoryNames.begin(), chunk.categoryNames.end());
+		store.AppendColumns(chunk.amounts.size(), chunk.amounts.data(), chunk.days.data(), chunk.categories.data(),
+			categoryNames, chunk.descriptionOffsets.data(), chunk.descriptionHeap.data());
+		report.parsedRows += chunk.amounts.size();
+		report.skippedLines += chunk.errorCount;
+		report.errorCount += chunk.errorCount;
+		for (ExpenseParseError& error : chunk.errors) {
+			if (report.errors.size() < ExpenseParseReport::MaxErrors) {
+				error.line += line;
+				report.errors.push_back(std::move(error));
+			}
+		}
+		line += chunk.lines;
+		// Release each chunk as soon as it is merged to keep the peak memory down
+		chunk = ParsedChunk();
+	}
+
+	size_t foundRows = report.parsedRows + report.skippedLines;
+	if (trailer && foundRows >= report.declaredRows) {
+		report.sequence = trailerSequence;
+	}
+	else if (trailer) {
+		// The line stands where a declared row should be, so it is a malformed row
+		if (report.errors.size() < ExpenseParseReport::MaxErrors) {
+			report.errors.push_back(ExpenseParseError{ line, "expected 4 fields: description category amount date" });
+		}
+		report.skippedLines++;
+		report.errorCount++;
+		foundRows++;
+	}
+	if (headerValid && report.declaredRows != foundRows) {
+		std::string message = "count header says " + std::to_string(report.declaredRows) + " rows but the file has " + std::to_string(foundRows);
+		report.errors.insert(report.errors.begin(), ExpenseParseError{ 1, std::move(message) });
+		report.errorCount++;
+	}
+	return true;
+}
+
+bool ParseExpenseFile(const std::string& fileName, ExpenseStore& store, ExpenseParseReport& report, unsigned threads)
+{
+	report = ExpenseParseReport();
+	std::error_code ec;
+	if (!std::filesystem::exists(fileName, ec)) {
+		return false;
+	}
+	MappedFile file;
+	if (!file.Open(fileName)) {
+		return std::filesystem::file_size(fileName, ec) == 0 && !ec; // An empty file is just an empty history
+	}
+	return ParseExpenseText(std::string_view(file.Data(), file.Size()), store, report, threads);
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ExpenseStore.h"
+
+struct ExpenseParseError
+{
+	size_t line;             // 1-based line number in the input
+	std::string message;
+};
+
+struct ExpenseParseReport
+{
+	static constexpr size_t MaxErrors = 1000;  // only the first errors are kept, errorCount has them all
+
+	size_t declaredRows = 0;                   // the count header
+	size_t parsedRows = 0;
+	size_t skippedLines = 0;                   // malformed row lines that were not added
+	size_t errorCount = 0;
+	uint64_t sequence = 0;                     // the "#sequence N" trailer, 0 if absent
+	std::vector<ExpenseParseError> errors;
+
+	bool Ok() const { return errorCount == 0; }
+};
+
+// One line of the legacy text format, split and validated but not yet decoded
+struct ExpenseLine
+{
+	enum class Kind { Row, Blank, Error };
+
+	Kind kind = Kind::Blank;
+	std::string_view description;            // raw tokens: '_' still stands for a space
+	std::string_view category;
+	int64_t amountCents = 0;
+	int32_t day = 0;
+	const char* error = nullptr;             // Kind::Error
+	std::string_view errorField;
+};
+
+// Parses a row line without its '\n'; a trailing '\r' is ignored. There are no comment lines:
+// a description may start with '#' like any other.
+ExpenseLine ParseExpenseLine(std::string_view line);
+// True if the line is the "#sequence N" trailer AddExpenseToFile writes. Only a line after the
+// declared rows is read as one; anywhere else it is a malformed row.
+bool ParseSequenceTrailer(std::string_view line, uint64_t& sequence);
+
+// Parser for the legacy text format: a row count, then one "description category amount date"
+// line per expense with '_' in place of spaces. The input is cut into chunks at newline
+// boundaries and the chunks are parsed on all cores with std::from_chars style scanning and no
+// per-row allocation. Malformed lines are skipped and reported with their line number.
+// threads == 0 uses every hardware thread.
+bool ParseExpenseText(std::string_view text, ExpenseStore& store, ExpenseParseReport& report, unsigned threads = 0);
+// Returns false if the file does not exist
+bool ParseExpenseFile(const std::string& fileName, ExpenseStore& store, ExpenseParseReport& report, unsigned threads = 0);
@@ -0,0 +1,115 @@
+#include "ExpensePivot.h"
+#include <algorithm>
+#include <numeric>
+
+namespace {
+	// Stable, so equal amounts stay in label order whichever way the keys run
+	void OrderByKeys(std::vector<uint32_t>& order, const std::vector<int64_t>& keys, bool descending) {
+		std::iota(order.begin(), order.end(), 0u);
+		std::stable_sort(order.begin(), order.end(), [&keys, descending](uint32_t a, uint32_t b) {
+			return descending ? keys[b] < keys[a] : keys[a] < keys[b];
+			});
+	}
+
+	void OrderByLabel(std::vector<uint32_t>& order, bool descending) {
+		std::iota(order.begin(), order.end(), 0u);
+		if (descending) {
+			std::reverse(order.begin(), order.end());
+		}
+	}
+}
+
+void ExpensePivot::Build(const AggregateResult& result)
+{
+	*this = ExpensePivot();
+
+	// Columns are the groups that have a total, numbered in name order
+	std::vector<uint32_t> used;
+	std::vector<uint32_t> columnOfGroup(result.groupNames.size(), UINT32_MAX);
+	for (const AggregateResult::Row& row : result.rows) {
+		if (columnOfGroup[row.group] == UINT32_MAX) {
+			columnOfGroup[row.group] = 0;
+			used.push_back(row.group);
+		}
+	}
+	std::sort(used.begin(), used.end(), [&result](uint32_t a, uint32_t b) {
+		return result.groupNames[a] < result.groupNames[b];
+		});
+	groupNames.reserve(used.size());
+	for (uint32_t group : used) {
+		columnOfGroup[group] = static_cast<uint32_t>(groupNames.size());
+		groupNames.emplace_back(result.groupNames[group]);
+	}
+	columnTotals.resize(groupNames.size());
+
+	cellGroups.reserve(result.rows.size());
+	cells.reserve(result.rows.size());
+	for (const AggregateResult::Row& row : result.rows) {
+		if (periods.empty() || periods.back() != row.period) {
+			periods.push_back(row.period);
+			periodStart.push_back(cells.size());
+			rowTotals.emplace_back();
+		}
+		uint32_t column = columnOfGroup[row.group];
+		cellGroups.push_back(column);
+		cells.push_back(Cell{ row.cents, row.rows });
+		rowTotals.back().cents += row.cents;
+		rowTotals.back().rows += row.rows;
+		columnTotals[column].cents += row.cents;
+		columnTotals[column].rows += row.rows;
+		grandTotal.cents += row.cents;
+		grandTotal.rows += row.rows;
+	}
+	periodStart.push_back(cells.size());
+
+	rowOrder.resize(periods.size());
+	columnOrder.resize(groupNames.size());
+	OrderByLabel(rowOrder, false);
+	OrderByLabel(columnOrder, false);
+}
+
+ExpensePivot::Cell ExpensePivot::Find(uint32_t period, uint32_t group) const
+{
+	auto first = cellGroups.begin() + periodStart[period];
+	auto last = cellGroups.begin() + periodStart[period + 1];
+	auto it = std::lower_bound(first, last, group);
+	if (it == last || *it != group) {
+		return Cell();
+	}
+	return cells[it - cellGroups.begin()];
+}
+
+void ExpensePivot::SortRows(size_t column, bool descending)
+{
+	if (column == ByLabel) {
+		OrderByLabel(rowOrder, descending);
+		return;
+	}
+	std::vector<int64_t> keys(periods.size());
+	for (uint32_t period = 0; period < periods.size(); period++) {
+		keys[period] = column == ByTotal ? rowTotals[period].cents : Find(period, columnOrder[column]).cents;
+	}
+	OrderByKeys(rowOrder, keys, descending);
+}
+
+void ExpensePivot::SortColumns(size_t row, bool descending)
+{
+	if (row == ByLabel) {
+		OrderByLabel(columnOrder, descending);
+		return;
+	}
+	std::vector<int64_t> keys(groupNames.size());
+	if (row == ByTotal) {
+		for (size_t group = 0; group < groupNames.size(); group++) {
+			keys[group] = columnTotals[group].cents;
+		}
+	}
+	else {
+		// One pass over the row's cells; the groups it has no total for stay at zero
+		uint32_t period = rowOrder[row];
+		for (size_t cell = periodStart[period]; cell < periodStart[period + 1]; cell++) {
+			keys[cellGroups[cell]] = cells[cell].cents;
+		}
+	}
+	OrderByKeys(columnOrder, keys, descending);
+}
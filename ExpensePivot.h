@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ExpenseAggregator.h"
+
+// Period x group table of aggregated totals with row and column totals, behind the pivot grid
+// of the totals dialog. Only the non-empty cells are kept, period by period, so grouping by
+// description costs memory for the totals that exist rather than for every period and group.
+// Rows and columns are addressed by display position; SortRows and SortColumns only reorder
+// those positions and never touch the cells.
+class ExpensePivot
+{
+public:
+	struct Cell
+	{
+		int64_t cents = 0;
+		size_t rows = 0;
+	};
+
+	// Sort keys besides a displayed row or column
+	static constexpr size_t ByLabel = SIZE_MAX;      // the period, or the group name
+	static constexpr size_t ByTotal = SIZE_MAX - 1;
+
+	// Takes the rows as AggregateExpenses orders them: by period, then by group name
+	void Build(const AggregateResult& result);
+
+	size_t RowCount() const { return periods.size(); }
+	size_t ColumnCount() const { return groupNames.size(); }
+	int32_t Period(size_t row) const { return periods[rowOrder[row]]; }
+	const std::string& GroupName(size_t column) const { return groupNames[columnOrder[column]]; }
+	// An empty cell has zero rows
+	Cell At(size_t row, size_t column) const { return Find(rowOrder[row], columnOrder[column]); }
+	const Cell& RowTotal(size_t row) const { return rowTotals[rowOrder[row]]; }
+	const Cell& ColumnTotal(size_t column) const { return columnTotals[columnOrder[column]]; }
+	const Cell& GrandTotal() const { return grandTotal; }
+
+	// Orders the rows by their amounts in a displayed column, ByTotal or ByLabel. Ties keep
+	// period order.
+	void SortRows(size_t column, bool descending);
+	// Orders the columns by their amounts in a displayed row, ByTotal or ByLabel
+	void SortColumns(size_t row, bool descending);
+
+private:
+	std::vector<int32_t> periods;             // ascending
+	std::vector<std::string> groupNames;      // ascending; copies, so the table outlives changes to the store
+	std::vector<size_t> periodStart;          // period p owns cells [periodStart[p], periodStart[p + 1])
+	std::vector<uint32_t> cellGroups;         // ascending within a period
+	std::vector<Cell> cells;
+	std::vector<Cell> rowTotals;
+	std::vector<Cell> columnTotals;
+	Cell grandTotal;
+	std::vector<uint32_t> rowOrder;           // display row -> period
+	std::vector<uint32_t> columnOrder;        // display column -> group
+
+	Cell Find(uint32_t period, uint32_t group) const;
+};
@@ -0,0 +1,587 @@
+#include "ExpenseReader.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+
+namespace {
+	// Read size of the streaming buffer; lines longer than this just grow it
+	const size_t ChunkBytes = 1 << 20;
+
+	std::string_view Trim(std::string_view text) {
+		while (!text.empty() && std::isspace(static_cast<unsigned char>(text.front()))) {
+			text.remove_prefix(1);
+		}
+		while (!text.empty() && std::isspace(static_cast<unsigned char>(text.back()))) {
+			text.remove_suffix(1);
+		}
+		return text;
+	}
+
+	bool IsCountHeader(std::string_view text) {
+		text = Trim(text);
+		return !text.empty() && std::all_of(text.begin(), text.end(), [](char c) { return c >= '0' && c <= '9'; });
+	}
+}
+
+bool ExpenseFileReader::Open(const std::string& fileName)
+{
+	Close();
+	istream.open(fileName, std::ios::binary);
+	if (!istream) {
+		return false;
+	}
+
+	std::string_view first;
+	if (!ReadLine(first)) {
+		return true; // An empty file is just an empty history
+	}
+	if (IsCountHeader(first)) {
+		std::string_view count = Trim(first);
+		std::from_chars(count.data(), count.data() + count.size(), declaredRows);
+		return true;
+	}
+	csv = true;
+	ReadCsvHeader(first);
+	return true;
+}
+
+void ExpenseFileReader::Close()
+{
+	if (istream.is_open()) {
+		istream.close();
+	}
+	istream.clear();
+	buffer.clear();
+	bufferStart = 0;
+	endOfFile = false;
+	line = 0;
+	csv = false;
+	csvOptions = CsvImportOptions();
+	declaredRows = 0;
+	rowLines = 0;
+	sequence = 0;
+	skippedLines = 0;
+	errors.clear();
+	pendingLine.clear();
+	heldLine.clear();
+}
+
+bool ExpenseFileReader::Next(ExpenseRecord& record)
+{
+	if (!pendingLine.empty()) {
+		// The record's views point into the held line until the next call
+		heldLine.swap(pendingLine);
+		pendingLine.clear();
+		if (ParseCsvLine(heldLine, record)) {
+			return true;
+		}
+	}
+
+	std::string_view text;
+	while (ReadLine(text)) {
+		if (csv ? ParseCsvLine(text, record) : ParseTextLine(text, record)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ExpenseFileReader::ReadLine(std::string_view& text)
+{
+	size_t searchFrom = bufferStart;
+	while (true) {
+		size_t newline = buffer.find('\n', searchFrom);
+		if (newline != std::string::npos) {
+			text = std::string_view(buffer.data() + bufferStart, newline - bufferStart);
+			bufferStart = newline + 1;
+			line++;
+			return true;
+		}
+		if (endOfFile) {
+			if (bufferStart == buffer.size()) {
+				return false;
+			}
+			text = std::string_view(buffer.data() + bufferStart, buffer.size() - bufferStart);
+			bufferStart = buffer.size();
+			line++;
+			return true;
+		}
+
+		// Keep the partial line and read the next chunk after it
+		buffer.erase(0, bufferStart);
+		bufferStart = 0;
+		searchFrom = buffer.size();
+		buffer.resize(searchFrom + ChunkBytes);
+		istream.read(&buffer[searchFrom], static_cast<std::streamsize>(ChunkBytes));
+		size_t read = static_cast<size_t>(istream.gcount());
+		buffer.resize(searchFrom + read);
+		endOfFile = read < ChunkBytes;
+	}
+}
+
+bool ExpenseFileReader::ParseTextLine(std::string_view text, ExpenseRecord& record)
+{
+	if (rowLines >= declaredRows && ParseSequenceTrailer(text, sequence)) {
+		return false;
+	}
+	ExpenseLine parsed = ParseExpenseLine(text);
+	if (parsed.kind != ExpenseLine::Kind::Blank) {
+		rowLines++;
+	}
+	switch (parsed.kind) {
+	case ExpenseLine::Kind::Row:
+		description.assign(parsed.description);
+		std::replace(description.begin(), description.end(), '_', ' ');
+		category.assign(parsed.category);
+		std::replace(category.begin(), category.end(), '_', ' ');
+		record.description = description;
+		record.category = category;
+		record.amountCents = parsed.amountCents;
+		record.day = parsed.day;
+		return true;
+	case ExpenseLine::Kind::Error:
+		AddError(parsed.error, parsed.errorField);
+		return false;
+	default:
+		return false;
+	}
+}
+
+bool ExpenseFileReader::ParseCsvLine(std::string_view text, ExpenseRecord& record)
+{
+	CsvRow row;
+	if (!ParseCsvRow(text, csvOptions, row, fields, scratch)) {
+		return false;
+	}
+	if (row.error) {
+		AddError(row.error, row.errorField);
+		return false;
+	}
+	record.description = row.description;
+	record.category = row.category;
+	record.amountCents = row.amountCents;
+	record.day = row.day;
+	return true;
+}
+
+void ExpenseFileReader::ReadCsvHeader(std::string_view text)
+{
+	csvOptions.delimiter = DetectCsvDelimiter(text);
+	if (!MapCsvHeader(text, csvOptions)) {
+		// No header: the first line is already data in the default order
+		pendingLine.assign(text);
+	}
+}
+
+void ExpenseFileReader::AddError(const char* message, std::string_view field)
+{
+	if (errors.size() < ExpenseParseReport::MaxErrors) {
+		std::string text(message);
+		if (!field.empty()) {
+			text += " '";
+			text.append(field.substr(0, 40));
+			text += "'";
+		}
+		errors.push_back(ExpenseParseError{ line, std::move(text) });
+	}
+	skippedLines++;
+}
+
+bool ExpenseHistoryReader::Open(const std::string& snapshotFile, const std::string& journalFile, const std::string& legacyFile)
+{
+	Close();
+	this->snapshotFile = snapshotFile;
+	this->journalFile = journalFile;
+	this->legacyFile = legacyFile;
+	if (!OpenBase()) {
+		return false;
+	}
+	ReplayRemovals();
+	if (!inMemory) {
+		journal.Open(journalFile);
+	}
+	return true;
+}
+
+void ExpenseHistoryReader::Close()
+{
+	snapshot.Close();
+	legacy.Close();
+	journal.Close();
+	useSnapshot = false;
+	snapshotSequence = 0;
+	baseRows = 0;
+	lastSequence = 0;
+	liveRows = 0;
+	clearedBefore = 0;
+	removed.clear();
+	skippedLines = 0;
+	journalState = ExpenseJournal::LoadState();
+	nextRow = 0;
+	nextRemoved = 0;
+	inJournal = false;
+	failed = false;
+	limited = false;
+	fromDay = INT32_MIN;
+	toDay = INT32_MAX;
+	checkedRows = 0;
+	olderEnd = 0;
+	readingOlder = false;
+	olderMonths.clear();
+	replayed.Clear();
+	inMemory = false;
+}
+
+void ExpenseHistoryReader::LimitDays(int32_t fromDay, int32_t toDay)
+{
+	limited = true;
+	this->fromDay = fromDay;
+	this->toDay = toDay;
+	checkedRows = 0;
+}
+
+bool ExpenseHistoryReader::Next(ExpenseRecord& record)
+{
+	if (failed) {
+		return false;
+	}
+	if (inMemory) {
+		if (nextRow == replayed.Size()) {
+			return false;
+		}
+		ExpenseStore::RowId row = static_cast<ExpenseStore::RowId>(nextRow++);
+		record.description = replayed.Description(row);
+		record.category = replayed.Category(row);
+		record.amountCents = replayed.AmountCents(row);
+		record.day = replayed.Day(row);
+		return true;
+	}
+	if (!inJournal) {
+		if (useSnapshot) {
+			const uint64_t end = readingOlder ? olderEnd : baseRows;
+			while (nextRow < end) {
+				if (limited && nextRow >= checkedRows) {
+					// The manifest's day ranges tell which runs of rows can be passed over unread
+					int32_t minDay, maxDay;
+					size_t runEnd;
+					snapshot.RunOf(static_cast<size_t>(nextRow), minDay, maxDay, runEnd);
+					checkedRows = runEnd;
+					if (maxDay < fromDay || minDay > toDay) {
+						nextRow = runEnd;
+						continue;
+					}
+				}
+				uint64_t row = nextRow++;
+				if (IsLive(row)) {
+					record.description = snapshot.Description(static_cast<size_t>(row));
+					record.category = snapshot.Category(static_cast<size_t>(row));
+					record.amountCents = snapshot.AmountCents(static_cast<size_t>(row));
+					record.day = snapshot.Day(static_cast<size_t>(row));
+					failed = snapshot.Failed();
+					return !failed;
+				}
+			}
+			if (readingOlder) {
+				return false;
+			}
+		}
+		else {
+			while (legacy.Next(record)) {
+				if (IsLive(nextRow++)) {
+					return true;
+				}
+			}
+		}
+		inJournal = true;
+	}
+
+	ExpenseJournalReader::Record entry;
+	while (journal.Next(entry)) {
+		if (entry.sequence <= snapshotSequence) {
+			continue;
+		}
+		if (entry.sequence > lastSequence) {
+			break; // Past the point where replaying stops
+		}
+		if (entry.type == ExpenseJournal::RecordType::Add && IsLive(nextRow++)) {
+			record.description = entry.description;
+			record.category = entry.category;
+			record.amountCents = entry.amountCents;
+			record.day = entry.day;
+			return true;
+		}
+	}
+	journal.Close();  // The app may go on logging once the rows are in
+	return false;
+}
+
+uint64_t ExpenseHistoryReader::SkipOlderRows()
+{
+	if (inMemory || !useSnapshot || !snapshot.Segmented() || nextRow != 0) {
+		return 0;
+	}
+	const std::vector<ExpenseSegmentLayout::Segment>& segments = snapshot.Segments();
+	const std::vector<ExpenseSegmentLayout::Run>& runs = snapshot.Runs();
+	int32_t newest = INT32_MIN;
+	for (const ExpenseSegmentLayout::Segment& segment : segments) {
+		newest = std::max(newest, segment.month);
+	}
+	uint64_t start = 0;
+	size_t firstNewRun = 0;
+	while (firstNewRun < runs.size() && segments[runs[firstNewRun].segment].month != newest) {
+		start += runs[firstNewRun++].rows;
+	}
+	const size_t removedBefore = static_cast<size_t>(std::lower_bound(removed.begin(), removed.end(), start) - removed.begin());
+	const uint64_t older = start - std::min(start, clearedBefore) - removedBefore;
+	if (older == 0) {
+		return 0;
+	}
+
+	// A segment with rows past the split, or with rows cleared or removed since the save, has no
+	// saved total for its older rows
+	std::vector<bool> saved(segments.size(), true);
+	uint64_t first = 0;
+	for (size_t i = 0; i < runs.size(); i++) {
+		const uint64_t end = first + runs[i].rows;
+		auto removedInRun = std::lower_bound(removed.begin(), removed.end(), first);
+		if (i >= firstNewRun || first < clearedBefore || (removedInRun != removed.end() && *removedInRun < end)) {
+			saved[runs[i].segment] = false;
+		}
+		first = end;
+	}
+	std::vector<ExpenseMonthTotal> months;
+	auto monthOf = [&months](int32_t month) -> ExpenseMonthTotal& {
+		auto found = std::lower_bound(months.begin(), months.end(), month, [](const ExpenseMonthTotal& total, int32_t value) {
+			return total.month < value;
+			});
+		if (found == months.end() || found->month != month) {
+			found = months.insert(found, ExpenseMonthTotal{ month, 0, 0 });
+		}
+		return *found;
+	};
+	std::vector<bool> counted(segments.size());
+	first = 0;
+	for (size_t i = 0; i < firstNewRun; i++) {
+		const uint32_t segment = runs[i].segment;
+		ExpenseMonthTotal& total = monthOf(segments[segment].month);
+		if (saved[segment]) {
+			if (!counted[segment]) {
+				total.cents += segments[segment].cents;
+				total.rows += segments[segment].rows;
+				counted[segment] = true;
+			}
+		}
+		else {
+			for (uint64_t row = first; row < first + runs[i].rows; row++) {
+				if (IsLiveAt(row)) {
+					total.cents += snapshot.AmountCents(static_cast<size_t>(row));
+					total.rows++;
+				}
+			}
+		}
+		first += runs[i].rows;
+	}
+	if (snapshot.Failed()) {
+		failed = true;
+		return 0;
+	}
+	months.erase(std::remove_if(months.begin(), months.end(), [](const ExpenseMonthTotal& total) { return total.rows == 0; }), months.end());
+	olderMonths.swap(months);
+	olderEnd = start;
+	nextRow = start;
+	nextRemoved = removedBefore;
+	return older;
+}
+
+void ExpenseHistoryReader::ReadOlderRows()
+{
+	snapshot.Rewind();
+	readingOlder = true;
+	inJournal = false;
+	nextRow = 0;
+	nextRemoved = 0;
+	checkedRows = 0;
+}
+
+bool ExpenseHistoryReader::OpenBase()
+{
+	// The journal's row positions refer to the snapshot once there is one, so a snapshot that
+	// cannot be read is an error rather than a reason to read the older legacy file
+	if (std::ifstream(snapshotFile).is_open()) {
+		if (!snapshot.Open(snapshotFile)) {
+			return false;
+		}
+		useSnapshot = true;
+		baseRows = snapshot.Size();
+		snapshotSequence = snapshot.Sequence();
+		return true;
+	}
+
+	// The text file has no reliable row count and keeps its sequence at the end, so count it first
+	ExpenseRecord record;
+	if (!legacy.Open(legacyFile)) {
+		return !std::ifstream(legacyFile).is_open();
+	}
+	while (legacy.Next(record)) {
+		baseRows++;
+	}
+	snapshotSequence = legacy.Sequence();
+	skippedLines = legacy.SkippedLines();
+	return legacy.Open(legacyFile);
+}
+
+// Turns every remove record, which names a position in the rows alive at that moment, into a
+// position in add order
+void ExpenseHistoryReader::ReplayRemovals()
+{
+	lastSequence = snapshotSequence;
+	uint64_t added = baseRows;
+	liveRows = baseRows;
+	AssignSavedSegments();
+
+	ExpenseJournalReader::Record entry;
+	bool intact = true;
+	if (!journal.Open(journalFile)) {
+		journalState.badHeader = journal.BadHeader();
+	}
+	while (journal.Next(entry)) {
+		journalState.journalRecords++;
+		if (entry.sequence <= snapshotSequence) {
+			continue;
+		}
+		if (entry.type == ExpenseJournal::RecordType::Add) {
+			added++;
+			liveRows++;
+		}
+		else if (entry.type == ExpenseJournal::RecordType::Insert || entry.type == ExpenseJournal::RecordType::InsertRows
+			|| entry.type == ExpenseJournal::RecordType::UndoClear) {
+			journal.Close();
+			ReplayInMemory();
+			return;
+		}
+		else if (entry.type == ExpenseJournal::RecordType::RemoveRows) {
+			if (!entry.rows.empty() && entry.rows.back() >= liveRows) {
+				intact = false;
+				break;
+			}
+			// The rows ascend, so a single walk along removed finds every add-order position
+			std::vector<uint64_t> positions;
+			positions.reserve(entry.rows.size());
+			size_t j = 0;
+			for (uint32_t row : entry.rows) {
+				while (j < removed.size() && removed[j] - clearedBefore - j <= row) {
+					j++;
+				}
+				positions.push_back(clearedBefore + row + j);
+			}
+			std::vector<uint64_t> merged(removed.size() + positions.size());
+			std::merge(removed.begin(), removed.end(), positions.begin(), positions.end(), merged.begin());
+			removed.swap(merged);
+			liveRows -= entry.rows.size();
+		}
+		else if (entry.type == ExpenseJournal::RecordType::Remove) {
+			if (entry.row >= liveRows) {
+				intact = false; // The app stops replaying here too
+				break;
+			}
+			// Before removed[j] there are removed[j] - clearedBefore - j live rows; find the first j past the target
+			size_t low = 0, high = removed.size();
+			while (low < high) {
+				size_t middle = (low + high) / 2;
+				if (removed[middle] - clearedBefore - middle <= entry.row) {
+					low = middle + 1;
+				}
+				else {
+					high = middle;
+				}
+			}
+			size_t j = low;
+			removed.insert(removed.begin() + j, clearedBefore + entry.row + j);
+			liveRows--;
+		}
+		else {
+			clearedBefore = added;
+			removed.clear();
+			liveRows = 0;
+		}
+		ApplyJournalRecord(journalState.segments, entry);
+		lastSequence = entry.sequence;
+	}
+	journalState.lastSequence = lastSequence;
+	journalState.intactBytes = intact ? journal.IntactBytes() : journal.RecordOffset();
+	journalState.damaged = !intact || journal.Damaged();
+	journal.Close();
+}
+
+// Loads the base rows and applies every record the way ExpenseJournal::Open does
+void ExpenseHistoryReader::ReplayInMemory()
+{
+	inMemory = true;
+	ExpenseRecord record;
+	if (useSnapshot) {
+		for (size_t row = 0; row < baseRows; row++) {
+			replayed.Add(snapshot.Description(row), snapshot.Category(row), snapshot.AmountCents(row), snapshot.Day(row));
+		}
+	}
+	else {
+		while (legacy.Next(record)) {
+			replayed.Add(record.description, record.category, record.amountCents, record.day);
+		}
+	}
+	failed = snapshot.Failed();
+	journalState = ExpenseJournal::LoadState();
+	AssignSavedSegments();
+	snapshot.Close();
+	legacy.Close();
+	lastSequence = snapshotSequence;
+	ExpenseJournalReader::Record entry;
+	ExpenseClearedRows cleared;
+	bool intact = true;
+	journal.Open(journalFile);
+	while (journal.Next(entry)) {
+		journalState.journalRecords++;
+		if (entry.sequence <= snapshotSequence) {
+			continue;
+		}
+		if (!ApplyJournalRecord(replayed, journalState.segments, entry, cleared)) {
+			intact = false;
+			break;
+		}
+		lastSequence = entry.sequence;
+	}
+	journalState.lastSequence = lastSequence;
+	journalState.intactBytes = intact ? journal.IntactBytes() : journal.RecordOffset();
+	journalState.damaged = !intact || journal.Damaged();
+	journal.Close();
+	liveRows = replayed.Size();
+}
+
+// The layout the journal starts from; rows from the legacy file or a snapshot from before segments
+// have none, so the app saves them as segments at its first chance
+void ExpenseHistoryReader::AssignSavedSegments()
+{
+	bool segmented = useSnapshot && snapshot.Segmented();
+	if (segmented) {
+		journalState.segments.Assign(snapshot.Segments(), snapshot.Runs());
+	}
+	else {
+		journalState.segments.Assign({}, {});
+	}
+	journalState.snapshotMissing = !segmented && (baseRows > 0 || snapshotSequence != 0);
+}
+
+bool ExpenseHistoryReader::IsLiveAt(uint64_t row) const
+{
+	return row >= clearedBefore && !std::binary_search(removed.begin(), removed.end(), row);
+}
+
+bool ExpenseHistoryReader::IsLive(uint64_t row)
+{
+	if (row < clearedBefore) {
+		return false;
+	}
+	while (nextRemoved < removed.size() && removed[nextRemoved] < row) {
+		nextRemoved++;
+	}
+	return nextRemoved == removed.size() || removed[nextRemoved] != row;
+}
@@ -0,0 +1,154 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ExpenseCsv.h"
+#include "ExpenseJournal.h"
+#include "ExpenseParser.h"
+#include "ExpenseSegments.h"
+
+// One expense as it streams past; the views stay valid until the reader moves on
+struct ExpenseRecord
+{
+	std::string_view description;
+	std::string_view category;
+	int64_t amountCents = 0;
+	int32_t day = 0;
+};
+
+// Streams the rows of an expense file through a fixed-size buffer, so a file of any size is read
+// in bounded memory. Accepts the legacy text format (recognised by its row count header) and CSV
+// with a description, category, amount, date header in any order, as bank exports come. CSV
+// without a header is read in that column order; a missing category column reads as
+// "Uncategorized". CSV rows are parsed by ParseCsvRow with the delimiter guessed from the first
+// line and ISO dates.
+class ExpenseFileReader
+{
+public:
+	bool Open(const std::string& fileName);
+	void Close();
+	// False once the file is exhausted; malformed lines are skipped and reported
+	bool Next(ExpenseRecord& record);
+
+	bool IsCsv() const { return csv; }
+	uint64_t Sequence() const { return sequence; }  // the "#sequence N" trailer of a legacy file
+	size_t SkippedLines() const { return skippedLines; }
+	const std::vector<ExpenseParseError>& Errors() const { return errors; }
+
+private:
+	std::ifstream istream;
+	std::string buffer;
+	size_t bufferStart = 0;
+	bool endOfFile = false;
+	size_t line = 0;
+	bool csv = false;
+	CsvImportOptions csvOptions;
+	std::vector<std::string_view> fields;
+	std::string scratch;
+	std::string description;
+	std::string category;
+	size_t declaredRows = 0;                        // the count header of a legacy file
+	size_t rowLines = 0;                            // non-blank lines read after it
+	uint64_t sequence = 0;
+	size_t skippedLines = 0;
+	std::vector<ExpenseParseError> errors;
+	std::string pendingLine;                        // a CSV first line that turned out to be data
+	std::string heldLine;
+
+	bool ReadLine(std::string_view& text);
+	bool ParseTextLine(std::string_view text, ExpenseRecord& record);
+	bool ParseCsvLine(std::string_view text, ExpenseRecord& record);
+	void ReadCsvHeader(std::string_view text);
+	void AddError(const char* message, std::string_view field = {});
+};
+
+// The rows of one month among those ExpenseHistoryReader::SkipOlderRows set aside
+struct ExpenseMonthTotal
+{
+	int32_t month = 0;                  // see MonthOfDay
+	int64_t cents = 0;
+	uint64_t rows = 0;
+};
+
+// Streams the live rows of the app's data files: the binary snapshot (or the legacy text file
+// when there is none) followed by the journal, with removed and cleared rows left out. Only the
+// journal's remove records are kept in memory, so a history of any size is read in bounded
+// memory, in the same order ExpenseJournal::Open would load it. Snapshot segments are paged in as
+// their rows come up. A journal with insert or undo clear records (written by undoing a remove
+// or a clear) no longer lists rows in add order and is replayed into memory.
+class ExpenseHistoryReader
+{
+public:
+	// False if the files cannot be read, including a snapshot that exists but is damaged or
+	// incomplete: the legacy file is only read when there is no snapshot at all
+	bool Open(const std::string& snapshotFile, const std::string& journalFile, const std::string& legacyFile);
+	void Close();
+	bool Next(ExpenseRecord& record);
+	// True once Next stopped early because a snapshot segment turned out to be damaged
+	bool Failed() const { return failed; }
+	// Lets Next pass over the snapshot segments whose saved days all lie outside [fromDay, toDay]
+	// without reading them. Rows outside the range can still come up and Size still counts all rows.
+	void LimitDays(int32_t fromDay, int32_t toDay);
+	// Caps the snapshot rows kept decoded while reading (ExpenseSegmentedSnapshot::MaxPagedRows
+	// by default); a consumer that keeps every row anyway passes SIZE_MAX so no segment is
+	// decoded twice. Holds across Open.
+	void LimitPagedRows(size_t rows) { snapshot.LimitPagedRows(rows); }
+
+	// Splits the reading so the newest month comes first: Next goes on from the first run of the
+	// newest month's segment, journal rows included, and after ReadOlderRows returns the rows
+	// before that run. Returns how many live rows that sets aside; none, and nothing changes,
+	// when the history is not in month segments, was replayed in memory or starts with the
+	// newest month. Call right after Open.
+	uint64_t SkipOlderRows();
+	// Once Next has run out after SkipOlderRows: has it return the rows set aside, then stop
+	void ReadOlderRows();
+	// The set-aside rows by month, ascending. A month whose segments lie wholly among them and
+	// were not changed since the save is answered from the manifest; only the others are read.
+	const std::vector<ExpenseMonthTotal>& OlderMonths() const { return olderMonths; }
+
+	// Rows Next will return in total, known right after Open
+	uint64_t Size() const { return liveRows; }
+	uint64_t LastSequence() const { return lastSequence; }
+	size_t SkippedLines() const { return skippedLines; }
+	// For ExpenseJournal::Resume once the rows were read, so the app can go on logging after them
+	ExpenseJournal::LoadState JournalState() const { return journalState; }
+
+private:
+	std::string snapshotFile, journalFile, legacyFile;
+	ExpenseSegmentedSnapshot snapshot;
+	ExpenseFileReader legacy;
+	ExpenseJournalReader journal;
+	bool useSnapshot = false;
+	uint64_t snapshotSequence = 0;
+	uint64_t baseRows = 0;              // rows in the snapshot or legacy file
+	uint64_t lastSequence = 0;          // last journal record that applies
+	uint64_t liveRows = 0;
+	uint64_t clearedBefore = 0;         // rows before the last clear are gone
+	std::vector<uint64_t> removed;      // ascending positions of removed rows in add order
+	size_t skippedLines = 0;
+	ExpenseJournal::LoadState journalState;
+
+	uint64_t nextRow = 0;               // add-order position of the next row
+	size_t nextRemoved = 0;
+	bool inJournal = false;
+	bool failed = false;
+	bool limited = false;
+	int32_t fromDay = INT32_MIN, toDay = INT32_MAX;
+	uint64_t checkedRows = 0;           // snapshot rows before this are in segments that overlap the days
+	uint64_t olderEnd = 0;              // SkipOlderRows: add-order position where the newest month starts
+	bool readingOlder = false;
+	std::vector<ExpenseMonthTotal> olderMonths;
+
+	ExpenseStore replayed;              // the live rows, when the journal had to be replayed in memory
+	bool inMemory = false;
+
+	bool OpenBase();
+	void ReplayRemovals();
+	void ReplayInMemory();
+	void AssignSavedSegments();
+	bool IsLive(uint64_t row);
+	// The same without moving the cursor along removed
+	bool IsLiveAt(uint64_t row) const;
+};
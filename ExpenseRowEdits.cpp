@@ -0,0 +1,66 @@
+#include "ExpenseRowEdits.h"
+#include <algorithm>
+
+void ExpenseRowEdits::Insert(ExpenseStore::RowId row)
+{
+	auto position = std::lower_bound(inserted.begin(), inserted.end(), row);
+	for (auto it = position; it != inserted.end(); ++it) {
+		++*it;
+	}
+	inserted.insert(position, row);
+}
+
+void ExpenseRowEdits::Erase(ExpenseStore::RowId row)
+{
+	auto position = std::lower_bound(inserted.begin(), inserted.end(), row);
+	const size_t insertedBefore = static_cast<size_t>(position - inserted.begin());
+	if (position != inserted.end() && *position == row) {
+		position = inserted.erase(position);
+	}
+	else {
+		// The row is the survivor of the earlier state at this rank; skip the removed ones below it
+		ExpenseStore::RowId id = static_cast<ExpenseStore::RowId>(row - insertedBefore);
+		auto gap = removed.begin();
+		while (gap != removed.end() && *gap <= id) {
+			++gap;
+			++id;
+		}
+		removed.insert(gap, id);
+	}
+	for (auto it = position; it != inserted.end(); ++it) {
+		--*it;
+	}
+}
+
+void ExpenseRowEdits::Clear()
+{
+	removed.clear();
+	inserted.clear();
+}
+
+ExpenseStore::RowId ExpenseRowEdits::Map(ExpenseStore::RowId id) const
+{
+	auto gap = std::lower_bound(removed.begin(), removed.end(), id);
+	if (gap != removed.end() && *gap == id) {
+		return ExpenseStore::NoRow;
+	}
+	const size_t rank = id - static_cast<size_t>(gap - removed.begin());
+	// The survivors fill the positions the added rows left free, in order: count the added rows
+	// below this one's position, which are those with inserted[i] - i <= rank
+	size_t low = 0, high = inserted.size();
+	while (low < high) {
+		size_t middle = (low + high) / 2;
+		if (inserted[middle] - middle <= rank) {
+			low = middle + 1;
+		}
+		else {
+			high = middle;
+		}
+	}
+	return static_cast<ExpenseStore::RowId>(rank + low);
+}
+
+bool ExpenseRowEdits::Renumbers(size_t rows) const
+{
+	return !removed.empty() || (!inserted.empty() && inserted.front() < rows);
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include "ExpenseStore.h"
+
+// Single-row adds and removes made to the store since some earlier state of it, composed so
+// an index still numbered by that state can translate its row ids lazily or catch up in one
+// pass, instead of renumbering everything on every edit. Recording an edit costs O(k) in the
+// number of edits pending, translating an id O(log k).
+class ExpenseRowEdits
+{
+public:
+	bool Empty() const { return removed.empty() && inserted.empty(); }
+	size_t Size() const { return removed.size() + inserted.size(); }
+
+	// Call after a row was put at position row, with the later rows shifted up
+	void Insert(ExpenseStore::RowId row);
+	// Call when the row at position row is removed, with the later rows shifted down
+	void Erase(ExpenseStore::RowId row);
+	void Clear();
+
+	// The current id of a row of the earlier state, NoRow if it has been removed since
+	ExpenseStore::RowId Map(ExpenseStore::RowId id) const;
+	// Whether any of the first rows rows of the earlier state now has a different id
+	bool Renumbers(size_t rows) const;
+	// Current ids of the rows added since and still present, ascending
+	const std::vector<ExpenseStore::RowId>& Inserted() const { return inserted; }
+	// Rows of the earlier state removed since, ascending
+	const std::vector<ExpenseStore::RowId>& Removed() const { return removed; }
+
+private:
+	std::vector<ExpenseStore::RowId> removed;
+	std::vector<ExpenseStore::RowId> inserted;
+};
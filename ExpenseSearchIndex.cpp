@@ -0,0 +1,344 @@
+#include "ExpenseSearchIndex.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+	const size_t GramLength = 3;
+	// Every query checks the rows added since the last catch-up one by one, and recording an
+	// edit costs O(k) in those pending, so the lists catch up after this many
+	const size_t MaxPendingEdits = 1024;
+
+	// Only ASCII is folded so multi-byte UTF-8 sequences are compared byte for byte
+	unsigned char Fold(char c) {
+		unsigned char byte = static_cast<unsigned char>(c);
+		return byte >= 'A' && byte <= 'Z' ? static_cast<unsigned char>(byte + ('a' - 'A')) : byte;
+	}
+
+	std::string FoldText(std::string_view text) {
+		std::string folded(text.size(), '\0');
+		std::transform(text.begin(), text.end(), folded.begin(), [](char c) { return static_cast<char>(Fold(c)); });
+		return folded;
+	}
+
+	// One bit per letter and digit, the remaining bytes share the upper bits
+	uint64_t CharacterBit(char c) {
+		unsigned char byte = Fold(c);
+		if (byte >= 'a' && byte <= 'z') {
+			return uint64_t(1) << (byte - 'a');
+		}
+		if (byte >= '0' && byte <= '9') {
+			return uint64_t(1) << (26 + byte - '0');
+		}
+		return uint64_t(1) << (36 + byte % 28);
+	}
+
+	uint64_t CharacterMask(std::string_view text) {
+		uint64_t mask = 0;
+		for (char c : text) {
+			mask |= CharacterBit(c);
+		}
+		return mask;
+	}
+}
+
+ExpenseSearchIndex::ExpenseSearchIndex(const ExpenseStore& store)
+	: store(store)
+{
+}
+
+std::vector<ExpenseStore::RowId> ExpenseSearchIndex::Find(std::string_view text)
+{
+	const std::string folded = FoldText(text);
+	std::vector<ExpenseStore::RowId> rows;
+	if (!built) {
+		Build();
+	}
+	if (folded.size() < GramLength) {
+		// Short queries have no trigram; the character masks rule out most rows without touching the text
+		const uint64_t mask = CharacterMask(folded);
+		for (ExpenseStore::RowId id = 0; id < characterMasks.size(); id++) {
+			if ((characterMasks[id] & mask) != mask) {
+				continue;
+			}
+			ExpenseStore::RowId row = pending.Empty() ? id : pending.Map(id);
+			if (row != ExpenseStore::NoRow && Contains(row, folded)) {
+				rows.push_back(row);
+			}
+		}
+	}
+	else {
+		CollectTrigrams(folded);
+		std::vector<const std::vector<ExpenseStore::RowId>*> lists;
+		lists.reserve(trigrams.size());
+		for (uint32_t trigram : trigrams) {
+			auto found = postings.find(trigram);
+			if (found == postings.end()) {
+				lists.clear(); // No description in the lists has this trigram
+				break;
+			}
+			lists.push_back(&found->second);
+		}
+
+		if (!lists.empty()) {
+			// Start from the rarest trigram so every later step only thins out a short list
+			std::sort(lists.begin(), lists.end(), [](const std::vector<ExpenseStore::RowId>* a, const std::vector<ExpenseStore::RowId>* b) {
+				return a->size() < b->size();
+				});
+			rows = *lists[0];
+			for (size_t i = 1; i < lists.size() && !rows.empty(); i++) {
+				const std::vector<ExpenseStore::RowId>& list = *lists[i];
+				auto cursor = list.begin();
+				auto kept = rows.begin();
+				for (ExpenseStore::RowId row : rows) {
+					cursor = std::lower_bound(cursor, list.end(), row);
+					if (cursor == list.end()) {
+						break;
+					}
+					if (*cursor == row) {
+						*kept++ = row;
+					}
+				}
+				rows.erase(kept, rows.end());
+			}
+		}
+
+		// The lists still number rows as they were before the pending edits; renumbering is
+		// monotonic, so the translated rows stay ascending
+		if (!pending.Empty()) {
+			size_t kept = 0;
+			for (ExpenseStore::RowId id : rows) {
+				ExpenseStore::RowId row = pending.Map(id);
+				if (row != ExpenseStore::NoRow) {
+					rows[kept++] = row;
+				}
+			}
+			rows.resize(kept);
+		}
+
+		// Sharing every trigram does not mean the trigrams are adjacent, so longer queries are confirmed
+		if (folded.size() > GramLength) {
+			rows.erase(std::remove_if(rows.begin(), rows.end(), [this, &folded](ExpenseStore::RowId row) {
+				return !Contains(row, folded);
+				}), rows.end());
+		}
+	}
+
+	// Rows added since the last catch-up are in neither the lists nor the masks; check them directly
+	const std::vector<ExpenseStore::RowId>& added = pending.Inserted();
+	if (!added.empty()) {
+		size_t middle = rows.size();
+		for (ExpenseStore::RowId row : added) {
+			if (Contains(row, folded)) {
+				rows.push_back(row);
+			}
+		}
+		std::inplace_merge(rows.begin(), rows.begin() + middle, rows.end());
+	}
+	return rows;
+}
+
+void ExpenseSearchIndex::Insert(ExpenseStore::RowId row)
+{
+	if (!built) {
+		return;
+	}
+	if (pending.Empty() && row + 1 == store.Size()) {
+		// New rows get the highest id, so they only go on the ends of their lists
+		characterMasks.push_back(CharacterMask(store.Description(row)));
+		AddToLists(row);
+		return;
+	}
+	// Anything else would shift the later rows in every list; that waits for a catch-up
+	pending.Insert(row);
+	if (pending.Size() >= MaxPendingEdits) {
+		CatchUp();
+	}
+}
+
+void ExpenseSearchIndex::EraseRows(const std::vector<ExpenseStore::RowId>& rows)
+{
+	if (!built || rows.empty()) {
+		return;
+	}
+	CatchUp();
+	// Renumbering is monotonic, so every list stays ascending after one filtering pass
+	std::vector<ExpenseStore::RowId> ids = store.IdsAfterRemoving(rows);
+	size_t kept = 0;
+	for (ExpenseStore::RowId row = 0; row < characterMasks.size(); row++) {
+		if (ids[row] != ExpenseStore::NoRow) {
+			characterMasks[kept++] = characterMasks[row];
+		}
+	}
+	characterMasks.resize(kept);
+	for (auto it = postings.begin(); it != postings.end();) {
+		std::vector<ExpenseStore::RowId>& list = it->second;
+		size_t listKept = 0;
+		for (ExpenseStore::RowId id : list) {
+			if (ids[id] != ExpenseStore::NoRow) {
+				list[listKept++] = ids[id];
+			}
+		}
+		list.resize(listKept);
+		it = list.empty() ? postings.erase(it) : std::next(it);
+	}
+}
+
+void ExpenseSearchIndex::Erase(ExpenseStore::RowId row)
+{
+	if (!built) {
+		return;
+	}
+	if (pending.Empty() && row + 1 == characterMasks.size()) {
+		// Taking back the last row only trims the ends of its lists
+		characterMasks.pop_back();
+		CollectTrigrams(store.Description(row));
+		for (uint32_t trigram : trigrams) {
+			auto found = postings.find(trigram);
+			if (found == postings.end()) {
+				continue;
+			}
+			std::vector<ExpenseStore::RowId>& list = found->second;
+			if (!list.empty() && list.back() == row) {
+				list.pop_back();
+			}
+			if (list.empty()) {
+				postings.erase(found);
+			}
+		}
+		return;
+	}
+	// Catching up reads the store, which still matches the pending edits until this row goes
+	if (pending.Size() >= MaxPendingEdits) {
+		CatchUp();
+	}
+	pending.Erase(row);
+}
+
+void ExpenseSearchIndex::Clear()
+{
+	postings = {};
+	characterMasks = {};
+	pending.Clear();
+	built = false;
+}
+
+void ExpenseSearchIndex::Build()
+{
+	postings.clear();
+	characterMasks.resize(store.Size());
+	for (ExpenseStore::RowId row = 0; row < store.Size(); row++) {
+		std::string_view description = store.Description(row);
+		characterMasks[row] = CharacterMask(description);
+		CollectTrigrams(description);
+		for (uint32_t trigram : trigrams) {
+			postings[trigram].push_back(row);
+		}
+	}
+	pending.Clear();
+	built = true;
+}
+
+// Renumbers the lists and masks through the pending edits in one pass and adds the rows
+// added since
+void ExpenseSearchIndex::CatchUp()
+{
+	if (pending.Empty()) {
+		return;
+	}
+	const size_t rows = characterMasks.size() + pending.Inserted().size() - pending.Removed().size();
+	if (pending.Renumbers(characterMasks.size())) {
+		std::vector<ExpenseStore::RowId> ids(characterMasks.size());
+		std::vector<uint64_t> masks(rows);
+		for (ExpenseStore::RowId id = 0; id < ids.size(); id++) {
+			ids[id] = pending.Map(id);
+			if (ids[id] != ExpenseStore::NoRow) {
+				masks[ids[id]] = characterMasks[id];
+			}
+		}
+		characterMasks.swap(masks);
+		for (auto it = postings.begin(); it != postings.end();) {
+			std::vector<ExpenseStore::RowId>& list = it->second;
+			size_t kept = 0;
+			for (ExpenseStore::RowId id : list) {
+				if (ids[id] != ExpenseStore::NoRow) {
+					list[kept++] = ids[id];
+				}
+			}
+			list.resize(kept);
+			it = list.empty() ? postings.erase(it) : std::next(it);
+		}
+	}
+	else {
+		characterMasks.resize(rows);
+	}
+	for (ExpenseStore::RowId row : pending.Inserted()) {
+		characterMasks[row] = CharacterMask(store.Description(row));
+		AddToLists(row);
+	}
+	pending.Clear();
+}
+
+void ExpenseSearchIndex::AddToLists(ExpenseStore::RowId row)
+{
+	CollectTrigrams(store.Description(row));
+	for (uint32_t trigram : trigrams) {
+		std::vector<ExpenseStore::RowId>& list = postings[trigram];
+		// Rows are mostly added at the end, so this is nearly always an append
+		if (list.empty() || list.back() < row) {
+			list.push_back(row);
+		}
+		else {
+			list.insert(std::upper_bound(list.begin(), list.end(), row), row);
+		}
+	}
+}
+
+// Distinct trigrams of the folded text, each packed into the low 24 bits of a key
+void ExpenseSearchIndex::CollectTrigrams(std::string_view text)
+{
+	trigrams.clear();
+	for (size_t i = 0; i + GramLength <= text.size(); i++) {
+		trigrams.push_back(static_cast<uint32_t>(Fold(text[i])) << 16
+			| static_cast<uint32_t>(Fold(text[i + 1])) << 8
+			| Fold(text[i + 2]));
+	}
+	std::sort(trigrams.begin(), trigrams.end());
+	trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+}
+
+bool ExpenseSearchIndex::Contains(ExpenseStore::RowId row, const std::string& foldedText) const
+{
+	if (foldedText.empty()) {
+		return true;
+	}
+	std::string_view description = store.Description(row);
+	if (description.size() < foldedText.size()) {
+		return false;
+	}
+	// memchr skips to each possible first byte, in either case, far faster than folding every byte
+	const char first = foldedText[0];
+	const char upperFirst = first >= 'a' && first <= 'z' ? static_cast<char>(first - ('a' - 'A')) : first;
+	const size_t starts = description.size() - foldedText.size() + 1;
+	for (char variant : { first, upperFirst }) {
+		const char* cursor = description.data();
+		const char* end = description.data() + starts;
+		while (cursor < end) {
+			cursor = static_cast<const char*>(std::memchr(cursor, variant, static_cast<size_t>(end - cursor)));
+			if (!cursor) {
+				break;
+			}
+			size_t j = 1;
+			while (j < foldedText.size() && Fold(cursor[j]) == static_cast<unsigned char>(foldedText[j])) {
+				j++;
+			}
+			if (j == foldedText.size()) {
+				return true;
+			}
+			cursor++;
+		}
+		if (upperFirst == first) {
+			break;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "ExpenseRowEdits.h"
+#include "ExpenseStore.h"
+
+// Case-insensitive substring search over the descriptions, backed by a trigram inverted index.
+// Every three-byte window of a description (ASCII letters folded to lower case) maps to the
+// ascending list of rows that contain it. A query intersects the lists of its own trigrams and
+// checks only the surviving rows, so the work depends on how rare the query is rather than on
+// the size of the store. One- and two-character queries fall back to a scan of a 64-bit
+// character mask per row. The index is built on the first search and then kept up to date:
+// rows added at the end go straight into it, other single adds and removes are recorded and
+// applied to the results at query time, and folded into the lists once enough have piled up.
+class ExpenseSearchIndex
+{
+public:
+	explicit ExpenseSearchIndex(const ExpenseStore& store);
+
+	// Rows whose description contains text, in ascending row order. Queries shorter than a
+	// trigram are answered by scanning the per-row character masks.
+	std::vector<ExpenseStore::RowId> Find(std::string_view text);
+
+	// Call after the row was added to the store, or inserted into it with the later rows shifted up
+	void Insert(ExpenseStore::RowId row);
+	// Call before the row is removed from the store
+	void Erase(ExpenseStore::RowId row);
+	// Call before the ascending rows are removed from the store with RemoveRows
+	void EraseRows(const std::vector<ExpenseStore::RowId>& rows);
+	// Drops the index; it is rebuilt on next use
+	void Clear();
+
+private:
+	const ExpenseStore& store;
+	std::unordered_map<uint32_t, std::vector<ExpenseStore::RowId>> postings;  // trigram -> ascending rows
+	std::vector<uint64_t> characterMasks;  // row -> which characters its description contains
+	bool built = false;
+	ExpenseRowEdits pending;  // edits since the lists and masks were last renumbered
+	std::vector<uint32_t> trigrams;  // scratch buffer for one description
+
+	void Build();
+	void CatchUp();
+	void AddToLists(ExpenseStore::RowId row);
+	void CollectTrigrams(std::string_view text);
+	bool Contains(ExpenseStore::RowId row, const std::string& foldedText) const;
+};
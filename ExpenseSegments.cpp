@@ -0,0 +1,755 @@
+#include "ExpenseSegments.h"
+#include "ExpensePack.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <unordered_set>
+
+namespace {
+	const char ManifestMagic[8] = { 'B', 'B', 'S', 'E', 'G', 'S', '\r', '\n' };
+	// Version 2 adds the row order after the entries: a uint64 count of ManifestRun records
+	const uint32_t ManifestVersion = 2;
+
+	struct ManifestHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t segmentCount;
+		uint64_t sequence;
+	};
+
+	struct ManifestEntry
+	{
+		uint32_t file;
+		int32_t month;
+		uint64_t rows;
+		int64_t cents;
+		int32_t minDay;
+		int32_t maxDay;
+	};
+
+	struct ManifestRun
+	{
+		uint32_t segment;
+		uint32_t rows;
+	};
+
+	std::string SegmentDirectory(const std::string& snapshotFile) {
+		return snapshotFile + ".segments";
+	}
+
+	std::string SegmentFile(const std::string& directory, uint32_t file) {
+		return directory + "/" + std::to_string(file) + ".bbs";
+	}
+}
+
+uint64_t ExpenseSegmentLayout::Rows() const
+{
+	uint64_t rows = 0;
+	for (const Segment& segment : segments) {
+		rows += segment.rows;
+	}
+	return rows;
+}
+
+uint64_t ExpenseSegmentLayout::DirtyRows() const
+{
+	uint64_t rows = 0;
+	for (const Segment& segment : segments) {
+		rows += segment.dirty ? segment.rows : 0;
+	}
+	return rows;
+}
+
+void ExpenseSegmentLayout::Add(int32_t day)
+{
+	uint32_t segment = SegmentFor(day);
+	segments[segment].rows++;
+	segments[segment].dirty = true;
+	AppendRun(runs, segment, 1);
+}
+
+void ExpenseSegmentLayout::Insert(ExpenseStore::RowId row, int32_t day)
+{
+	if (row >= Rows()) {
+		Add(day);
+		return;
+	}
+	uint32_t segment = SegmentFor(day);
+	segments[segment].rows++;
+	segments[segment].dirty = true;
+
+	// The row goes in ahead of the one now at its position, splitting that one's run if it is from another month
+	uint64_t first;
+	size_t index = RunOf(row, first);
+	const uint32_t offset = static_cast<uint32_t>(row - first);
+	if (runs[index].segment == segment) {
+		runs[index].rows++;
+	}
+	else if (offset == 0 && index > 0 && runs[index - 1].segment == segment) {
+		runs[index - 1].rows++;
+	}
+	else if (offset == 0) {
+		runs.insert(runs.begin() + index, Run{ segment, 1 });
+	}
+	else {
+		Run tail = { runs[index].segment, runs[index].rows - offset };
+		runs[index].rows = offset;
+		runs.insert(runs.begin() + index + 1, { Run{ segment, 1 }, tail });
+	}
+}
+
+void ExpenseSegmentLayout::InsertRows(const std::vector<ExpenseStore::RowId>& rows, const std::vector<int32_t>& days)
+{
+	// One walk rebuilds the order: the old rows ahead of each new one are copied over, then it goes in
+	std::vector<Run> order;
+	order.reserve(runs.size() + 2 * rows.size());
+	size_t index = 0;
+	uint64_t taken = 0;   // rows of runs[index] already copied
+	uint64_t copied = 0;  // old rows copied in all
+	for (size_t i = 0; i < rows.size(); i++) {
+		const uint64_t before = rows[i] - i;
+		while (copied < before && index < runs.size()) {
+			uint64_t count = std::min<uint64_t>(runs[index].rows - taken, before - copied);
+			AppendRun(order, runs[index].segment, count);
+			taken += count;
+			copied += count;
+			if (taken == runs[index].rows) {
+				index++;
+				taken = 0;
+			}
+		}
+		uint32_t segment = SegmentFor(days[i]);
+		segments[segment].rows++;
+		segments[segment].dirty = true;
+		AppendRun(order, segment, 1);
+	}
+	for (; index < runs.size(); index++, taken = 0) {
+		AppendRun(order, runs[index].segment, runs[index].rows - taken);
+	}
+	runs.swap(order);
+}
+
+void ExpenseSegmentLayout::Remove(ExpenseStore::RowId row)
+{
+	if (row >= Rows()) {
+		return;
+	}
+	uint64_t first;
+	Run& run = runs[RunOf(row, first)];
+	Segment& segment = segments[run.segment];
+	segment.rows--;
+	segment.dirty = true;
+	if (--run.rows == 0) {
+		DropEmpty();
+	}
+}
+
+void ExpenseSegmentLayout::RemoveRows(const std::vector<ExpenseStore::RowId>& rows)
+{
+	// One walk: the rows ascend, and so do the runs' row ranges
+	std::vector<Run> order;
+	order.reserve(runs.size());
+	size_t next = 0;
+	uint64_t first = 0;
+	for (const Run& run : runs) {
+		const uint64_t end = first + run.rows;
+		uint32_t removed = 0;
+		for (; next < rows.size() && rows[next] < end; next++) {
+			removed++;
+		}
+		if (removed > 0) {
+			segments[run.segment].rows -= removed;
+			segments[run.segment].dirty = true;
+		}
+		AppendRun(order, run.segment, run.rows - removed);
+		first = end;
+	}
+	runs.swap(order);
+	DropEmpty();
+}
+
+void ExpenseSegmentLayout::Clear()
+{
+	segments.clear();
+	runs.clear();
+}
+
+void ExpenseSegmentLayout::Partition(const ExpenseStore& store)
+{
+	Clear();
+	for (ExpenseStore::RowId row = 0; row < store.Size(); row++) {
+		Add(store.Day(row));
+	}
+}
+
+void ExpenseSegmentLayout::Assign(std::vector<Segment> saved, std::vector<Run> order)
+{
+	segments = std::move(saved);
+	runs = std::move(order);
+	nextFile = 1;
+	for (Segment& segment : segments) {
+		segment.dirty = false;
+		nextFile = std::max(nextFile, segment.file + 1);
+	}
+}
+
+ExpenseSegmentLayout ExpenseSegmentLayout::PlanSave(const ExpenseStore& store, ExpenseStore& dirtyRows)
+{
+	// Where the rows of each dirty segment are, in row order
+	std::vector<std::vector<std::pair<uint64_t, uint64_t>>> ranges(segments.size());
+	uint64_t position = 0;
+	for (const Run& run : runs) {
+		if (segments[run.segment].dirty) {
+			ranges[run.segment].emplace_back(position, position + run.rows);
+		}
+		position += run.rows;
+	}
+
+	ExpenseSegmentLayout plan = *this;
+	for (size_t i = 0; i < segments.size(); i++) {
+		if (!segments[i].dirty) {
+			continue;
+		}
+		const ExpenseStore::RowId first = static_cast<ExpenseStore::RowId>(dirtyRows.Size());
+		for (const std::pair<uint64_t, uint64_t>& range : ranges[i]) {
+			for (uint64_t row = range.first; row < range.second; row++) {
+				ExpenseStore::RowId id = static_cast<ExpenseStore::RowId>(row);
+				dirtyRows.Add(store.Description(id), store.Category(id), store.AmountCents(id), store.Day(id));
+			}
+		}
+		PlanSegment(i, dirtyRows, first, plan);
+	}
+	plan.nextFile = nextFile;
+	return plan;
+}
+
+ExpenseSegmentLayout ExpenseSegmentLayout::PlanSave(std::vector<ExpenseStore>& segmentRows, ExpenseStore& dirtyRows)
+{
+	ExpenseSegmentLayout plan = *this;
+	for (size_t i = 0; i < segments.size(); i++) {
+		if (!segments[i].dirty) {
+			continue;
+		}
+		const ExpenseStore::RowId first = static_cast<ExpenseStore::RowId>(dirtyRows.Size());
+		const ExpenseStore& rows = segmentRows[i];
+		for (ExpenseStore::RowId row = 0; row < rows.Size(); row++) {
+			dirtyRows.Add(rows.Description(row), rows.Category(row), rows.AmountCents(row), rows.Day(row));
+		}
+		segmentRows[i].Clear();
+		PlanSegment(i, dirtyRows, first, plan);
+	}
+	plan.nextFile = nextFile;
+	return plan;
+}
+
+void ExpenseSegmentLayout::PlanSegment(size_t index, const ExpenseStore& dirtyRows, ExpenseStore::RowId first, ExpenseSegmentLayout& plan)
+{
+	Segment& segment = segments[index];
+	segment.file = nextFile++;
+	segment.cents = 0;
+	segment.minDay = INT32_MAX;
+	segment.maxDay = INT32_MIN;
+	for (ExpenseStore::RowId row = first; row < dirtyRows.Size(); row++) {
+		segment.cents += dirtyRows.AmountCents(row);
+		segment.minDay = std::min(segment.minDay, dirtyRows.Day(row));
+		segment.maxDay = std::max(segment.maxDay, dirtyRows.Day(row));
+	}
+	segment.dirty = false;
+	plan.segments[index] = segment;
+	plan.segments[index].dirty = true;
+}
+
+uint32_t ExpenseSegmentLayout::SegmentFor(int32_t day)
+{
+	// Rows mostly go to the current month, whose segment is usually the last one
+	const int32_t month = MonthOfDay(day);
+	for (size_t i = segments.size(); i-- > 0;) {
+		if (segments[i].month == month && segments[i].rows < MaxSegmentRows) {
+			return static_cast<uint32_t>(i);
+		}
+	}
+	segments.emplace_back();
+	segments.back().month = month;
+	return static_cast<uint32_t>(segments.size() - 1);
+}
+
+size_t ExpenseSegmentLayout::RunOf(uint64_t row, uint64_t& first) const
+{
+	first = 0;
+	size_t index = 0;
+	while (index + 1 < runs.size() && row >= first + runs[index].rows) {
+		first += runs[index].rows;
+		index++;
+	}
+	return index;
+}
+
+void ExpenseSegmentLayout::AppendRun(std::vector<Run>& order, uint32_t segment, uint64_t rows)
+{
+	if (rows == 0) {
+		return;
+	}
+	if (!order.empty() && order.back().segment == segment) {
+		order.back().rows += static_cast<uint32_t>(rows);
+	}
+	else {
+		order.push_back(Run{ segment, static_cast<uint32_t>(rows) });
+	}
+}
+
+void ExpenseSegmentLayout::DropEmpty()
+{
+	std::vector<uint32_t> ids(segments.size());
+	size_t kept = 0;
+	for (size_t i = 0; i < segments.size(); i++) {
+		ids[i] = static_cast<uint32_t>(kept);
+		if (segments[i].rows > 0) {
+			segments[kept++] = segments[i];
+		}
+	}
+	segments.resize(kept);
+	std::vector<Run> order;
+	order.reserve(runs.size());
+	for (const Run& run : runs) {
+		AppendRun(order, ids[run.segment], run.rows);
+	}
+	runs.swap(order);
+}
+
+bool ExpenseSegmentedSnapshot::Open(const std::string& snapshotFile)
+{
+	Close();
+	ManifestHeader header = {};
+	std::ifstream istream(snapshotFile, std::ios::binary);
+	if (!istream.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, ManifestMagic, sizeof(ManifestMagic)) != 0) {
+		// A snapshot from before segments holds the rows itself
+		Part part;
+		part.snapshot = std::make_unique<ExpenseSnapshot>();
+		if (!part.snapshot->Open(snapshotFile)) {
+			return false;
+		}
+		rowCount = part.snapshot->Size();
+		sequence = part.snapshot->Sequence();
+		part.rows = rowCount;
+		parts.push_back(std::move(part));
+		runs.push_back(RunEntry{ 0, rowCount, 0, 0 });
+		return true;
+	}
+	if (header.version != 1 && header.version != ManifestVersion) {
+		return false;
+	}
+
+	std::vector<ManifestEntry> entries(header.segmentCount);
+	if (!istream.read(reinterpret_cast<char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(ManifestEntry)))) {
+		return false;
+	}
+	std::vector<ManifestRun> order;
+	if (header.version == 1) {
+		// Version 1 segments were runs of rows in order, one after another
+		for (uint32_t i = 0; i < entries.size(); i++) {
+			if (entries[i].rows >= UINT32_MAX) {
+				return false;
+			}
+			order.push_back(ManifestRun{ i, static_cast<uint32_t>(entries[i].rows) });
+		}
+	}
+	else {
+		const std::string rest((std::istreambuf_iterator<char>(istream)), std::istreambuf_iterator<char>());
+		uint64_t runCount = 0;
+		if (rest.size() < sizeof(runCount)) {
+			return false;
+		}
+		std::memcpy(&runCount, rest.data(), sizeof(runCount));
+		if (runCount != (rest.size() - sizeof(runCount)) / sizeof(ManifestRun)) {
+			return false;
+		}
+		order.resize(static_cast<size_t>(runCount));
+		std::memcpy(order.data(), rest.data() + sizeof(runCount), order.size() * sizeof(ManifestRun));
+	}
+	if (istream.peek() != std::char_traits<char>::eof()) {
+		return false;
+	}
+
+	// The files are only looked for here; each is read and checked when it is paged in
+	const std::string directory = SegmentDirectory(snapshotFile);
+	std::error_code ec;
+	for (const ManifestEntry& entry : entries) {
+		Part part;
+		part.fileName = SegmentFile(directory, entry.file);
+		part.rows = static_cast<size_t>(entry.rows);
+		if (!std::filesystem::is_regular_file(part.fileName, ec)) {
+			Close();
+			return false;
+		}
+		parts.push_back(std::move(part));
+
+		ExpenseSegmentLayout::Segment segment;
+		segment.file = entry.file;
+		segment.rows = entry.rows;
+		segment.cents = entry.cents;
+		segment.minDay = entry.minDay;
+		segment.maxDay = entry.maxDay;
+		segment.month = entry.month;
+		segment.dirty = false;
+		segments.push_back(segment);
+	}
+
+	// Every run has to continue its segment, and together they have to use up every segment
+	std::vector<uint64_t> used(entries.size());
+	uint64_t rows = 0;
+	for (const ManifestRun& run : order) {
+		if (run.segment >= entries.size() || run.rows == 0 || used[run.segment] + run.rows > entries[run.segment].rows) {
+			Close();
+			return false;
+		}
+		runs.push_back(RunEntry{ static_cast<size_t>(rows), run.rows, run.segment, static_cast<size_t>(used[run.segment]) });
+		layoutRuns.push_back(ExpenseSegmentLayout::Run{ run.segment, run.rows });
+		used[run.segment] += run.rows;
+		rows += run.rows;
+	}
+	for (size_t i = 0; i < entries.size(); i++) {
+		if (used[i] != entries[i].rows) {
+			Close();
+			return false;
+		}
+	}
+	LinkRuns();
+	if (rows >= UINT32_MAX) {
+		Close();
+		return false;
+	}
+	rowCount = static_cast<size_t>(rows);
+	sequence = header.sequence;
+	// A version 1 layout has segments that mix months, so it is saved afresh
+	segmented = header.version == ManifestVersion;
+	if (!segmented) {
+		segments.clear();
+		layoutRuns.clear();
+	}
+	return true;
+}
+
+void ExpenseSegmentedSnapshot::Close()
+{
+	parts.clear();
+	runs.clear();
+	segments.clear();
+	layoutRuns.clear();
+	rowCount = 0;
+	sequence = 0;
+	segmented = false;
+	lastRun = 0;
+	passedRuns = 0;
+	pagedRows = 0;
+	decodedRows = 0;
+	redecodedRows = 0;
+	failed = false;
+}
+
+void ExpenseSegmentedSnapshot::LinkRuns()
+{
+	for (Part& part : parts) {
+		part.nextRun = SIZE_MAX;
+	}
+	for (size_t i = runs.size(); i-- > 0;) {
+		Part& part = parts[runs[i].part];
+		runs[i].next = part.nextRun;
+		part.nextRun = i;
+	}
+}
+
+void ExpenseSegmentedSnapshot::Rewind()
+{
+	lastRun = 0;
+	passedRuns = 0;
+	LinkRuns();
+}
+
+const ExpenseSegmentedSnapshot::RunEntry& ExpenseSegmentedSnapshot::FindRun(size_t row) const
+{
+	const RunEntry& last = runs[lastRun];
+	if (row < last.first || row - last.first >= last.rows) {
+		auto next = std::upper_bound(runs.begin(), runs.end(), row, [](size_t value, const RunEntry& run) {
+			return value < run.first;
+			});
+		lastRun = static_cast<size_t>(next - runs.begin()) - 1;
+		Advance(lastRun);
+	}
+	return runs[lastRun];
+}
+
+void ExpenseSegmentedSnapshot::Advance(size_t run) const
+{
+	// Reading in row order, a segment is not needed again once its last run is behind
+	for (; passedRuns < run; passedRuns++) {
+		Part& part = parts[runs[passedRuns].part];
+		part.nextRun = runs[passedRuns].next;
+		if (part.nextRun == SIZE_MAX && part.decoded) {
+			pagedRows -= part.rows;
+			part.decoded.reset();
+		}
+	}
+}
+
+const ExpenseSegmentedSnapshot::Part& ExpenseSegmentedSnapshot::PartOf(size_t row, size_t& index) const
+{
+	const RunEntry& run = FindRun(row);
+	index = run.offset + (row - run.first);
+	PageIn(run.part);
+	return parts[run.part];
+}
+
+bool ExpenseSegmentedSnapshot::PageIn(size_t index) const
+{
+	Part& part = parts[index];
+	if (part.snapshot || part.decoded) {
+		return true;
+	}
+	if (part.evicted) {
+		redecodedRows += part.rows;
+	}
+
+	// Rows out of date order keep several segments in use at once; past the limit, the one
+	// needed again furthest ahead makes room, unless evicting has stopped paying off
+	while (pagedRows + part.rows > pagedRowLimit && redecodedRows <= rowCount) {
+		size_t furthest = SIZE_MAX;
+		for (size_t i = 0; i < parts.size(); i++) {
+			if (parts[i].decoded && (furthest == SIZE_MAX || parts[i].nextRun > parts[furthest].nextRun)) {
+				furthest = i;
+			}
+		}
+		if (furthest == SIZE_MAX) {
+			break;
+		}
+		pagedRows -= parts[furthest].rows;
+		parts[furthest].decoded.reset();
+		parts[furthest].evicted = true;
+	}
+	pagedRows += part.rows;
+
+	std::string packed;
+	{
+		std::ifstream istream(part.fileName, std::ios::binary);
+		istream.seekg(0, std::ios::end);
+		std::streamoff size = istream.tellg();
+		if (istream && size > 0) {
+			packed.resize(static_cast<size_t>(size));
+			istream.seekg(0);
+			istream.read(&packed[0], static_cast<std::streamsize>(packed.size()));
+		}
+		if (!istream) {
+			packed.clear();
+		}
+	}
+	uint64_t packRows = 0;
+	if (IsExpensePack(packed.data(), packed.size())) {
+		decodedRows += part.rows;
+		part.decoded = std::make_unique<ExpenseBatch>();
+		if (CheckExpensePack(packed.data(), packed.size(), &packRows) && packRows == part.rows
+			&& DecodeExpensePack(packed.data(), packed.size(), *part.decoded)) {
+			return true;
+		}
+	}
+	else {
+		// A mapped snapshot costs no memory of its own, so it does not count as paged
+		pagedRows -= part.rows;
+		part.snapshot = std::make_unique<ExpenseSnapshot>();
+		if (part.snapshot->Open(part.fileName) && part.snapshot->Size() == part.rows) {
+			return true;
+		}
+		part.snapshot.reset();
+		pagedRows += part.rows;
+	}
+
+	// A damaged segment reads as empty rows rather than past the end of anything
+	failed = true;
+	part.decoded = std::make_unique<ExpenseBatch>();
+	part.decoded->categoryNames.emplace_back();
+	part.decoded->amounts.assign(part.rows, 0);
+	part.decoded->days.assign(part.rows, 0);
+	part.decoded->categories.assign(part.rows, 0);
+	part.decoded->descriptionOffsets.assign(part.rows + 1, 0);
+	return false;
+}
+
+int64_t ExpenseSegmentedSnapshot::AmountCents(size_t row) const
+{
+	size_t index;
+	const Part& part = PartOf(row, index);
+	return part.snapshot ? part.snapshot->AmountCents(index) : part.decoded->amounts[index];
+}
+
+int32_t ExpenseSegmentedSnapshot::Day(size_t row) const
+{
+	size_t index;
+	const Part& part = PartOf(row, index);
+	return part.snapshot ? part.snapshot->Day(index) : part.decoded->days[index];
+}
+
+std::string_view ExpenseSegmentedSnapshot::Category(size_t row) const
+{
+	size_t index;
+	const Part& part = PartOf(row, index);
+	return part.snapshot ? part.snapshot->Category(index) : part.decoded->categoryNames[part.decoded->categories[index]];
+}
+
+std::string_view ExpenseSegmentedSnapshot::Description(size_t row) const
+{
+	size_t index;
+	const Part& part = PartOf(row, index);
+	return part.snapshot ? part.snapshot->Description(index) : part.decoded->Description(index);
+}
+
+void ExpenseSegmentedSnapshot::RunOf(size_t row, int32_t& minDay, int32_t& maxDay, size_t& runEnd) const
+{
+	const RunEntry& run = FindRun(row);
+	runEnd = run.first + run.rows;
+	if (segmented) {
+		minDay = segments[run.part].minDay;
+		maxDay = segments[run.part].maxDay;
+	}
+	else {
+		minDay = INT32_MIN;
+		maxDay = INT32_MAX;
+	}
+}
+
+bool ExpenseSegmentedSnapshot::AppendRun(size_t index, ExpenseStore& store) const
+{
+	const RunEntry& run = runs[index];
+	Advance(index);
+	if (!PageIn(run.part)) {
+		return false;
+	}
+	const Part& part = parts[run.part];
+	if (part.snapshot) {
+		std::vector<std::string_view> categoryNames(part.snapshot->CategoryCount());
+		for (uint32_t id = 0; id < categoryNames.size(); id++) {
+			categoryNames[id] = part.snapshot->CategoryName(id);
+		}
+		store.AppendColumns(run.rows, part.snapshot->Amounts() + run.offset, part.snapshot->Days() + run.offset,
+			part.snapshot->Categories() + run.offset, categoryNames, part.snapshot->DescriptionOffsets() + run.offset,
+			part.snapshot->DescriptionHeap());
+		return true;
+	}
+	part.decoded->AppendTo(store, run.offset, run.rows);
+	return true;
+}
+
+bool WriteExpenseSegments(const std::string& snapshotFile, const ExpenseSegmentLayout& layout,
+	const ExpenseStore& dirtyRows, uint64_t sequence, uint64_t* bytesWritten)
+{
+	const std::vector<ExpenseSegmentLayout::Segment>& segments = layout.Segments();
+	const std::string directory = SegmentDirectory(snapshotFile);
+	std::error_code ec;
+	std::filesystem::create_directories(directory, ec);
+
+	// The dirty segments get files no manifest names yet, so nothing in use is overwritten
+	uint64_t bytes = 0;
+	ExpenseStore::RowId next = 0;
+	for (const ExpenseSegmentLayout::Segment& segment : segments) {
+		if (!segment.dirty) {
+			continue;
+		}
+		const ExpenseStore::RowId end = next + static_cast<ExpenseStore::RowId>(segment.rows);
+		const std::string fileName = SegmentFile(directory, segment.file);
+		if (!WriteExpensePack(fileName, dirtyRows, next, static_cast<size_t>(segment.rows), sequence)) {
+			return false;
+		}
+		std::uintmax_t size = std::filesystem::file_size(fileName, ec);
+		bytes += ec ? 0 : size;
+		next = end;
+	}
+
+	std::string manifest;
+	ManifestHeader header = {};
+	std::memcpy(header.magic, ManifestMagic, sizeof(ManifestMagic));
+	header.version = ManifestVersion;
+	header.segmentCount = static_cast<uint32_t>(segments.size());
+	header.sequence = sequence;
+	manifest.append(reinterpret_cast<const char*>(&header), sizeof(header));
+	for (const ExpenseSegmentLayout::Segment& segment : segments) {
+		ManifestEntry entry = { segment.file, segment.month, segment.rows, segment.cents, segment.minDay, segment.maxDay };
+		manifest.append(reinterpret_cast<const char*>(&entry), sizeof(entry));
+	}
+	const uint64_t runCount = layout.Runs().size();
+	manifest.append(reinterpret_cast<const char*>(&runCount), sizeof(runCount));
+	for (const ExpenseSegmentLayout::Run& run : layout.Runs()) {
+		ManifestRun entry = { run.segment, run.rows };
+		manifest.append(reinterpret_cast<const char*>(&entry), sizeof(entry));
+	}
+	const std::string manifestTemp = snapshotFile + ".tmp";
+	{
+		std::ofstream ostream(manifestTemp, std::ios::binary | std::ios::trunc);
+		ostream.write(manifest.data(), static_cast<std::streamsize>(manifest.size()));
+		ostream.flush();
+		if (!ostream.good()) {
+			ostream.close();
+			std::filesystem::remove(manifestTemp, ec);
+			return false;
+		}
+	}
+	std::filesystem::rename(manifestTemp, snapshotFile, ec);
+	if (ec) {
+		std::filesystem::remove(manifestTemp, ec);
+		return false;
+	}
+	bytes += manifest.size();
+
+	// Files of segments that were rewritten or dropped, and any left by an earlier failed save
+	std::unordered_set<std::string> listed;
+	for (const ExpenseSegmentLayout::Segment& segment : segments) {
+		listed.insert(std::to_string(segment.file) + ".bbs");
+	}
+	std::vector<std::filesystem::path> stale;
+	for (std::filesystem::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+		if (it->path().extension() == ".bbs" && listed.count(it->path().filename().string()) == 0) {
+			stale.push_back(it->path());
+		}
+	}
+	for (const std::filesystem::path& path : stale) {
+		std::filesystem::remove(path, ec);
+	}
+
+	if (bytesWritten) {
+		*bytesWritten = bytes;
+	}
+	return true;
+}
+
+bool LoadExpenseSegments(ExpenseStore& store, const std::string& snapshotFile, uint64_t* sequence, ExpenseSegmentLayout* layout)
+{
+	ExpenseSegmentedSnapshot snapshot;
+	if (!snapshot.Open(snapshotFile)) {
+		return false;
+	}
+	// Every row is loaded anyway, so a segment might as well stay decoded until its last run
+	snapshot.LimitPagedRows(SIZE_MAX);
+
+	const size_t first = store.Size();
+	for (size_t index = 0; index < snapshot.RunCount(); index++) {
+		if (!snapshot.AppendRun(index, store)) {
+			// Take back the segments already appended, so the caller can fall back to the legacy file
+			std::vector<ExpenseStore::RowId> appended(store.Size() - first);
+			for (size_t i = 0; i < appended.size(); i++) {
+				appended[i] = static_cast<ExpenseStore::RowId>(first + i);
+			}
+			store.RemoveRows(appended);
+			return false;
+		}
+	}
+	if (sequence) {
+		*sequence = snapshot.Sequence();
+	}
+	if (layout) {
+		if (snapshot.Segmented()) {
+			layout->Assign(snapshot.Segments(), snapshot.Runs());
+		}
+		else {
+			layout->Assign({}, {});
+		}
+	}
+	return true;
+}
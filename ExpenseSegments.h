@@ -0,0 +1,200 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ExpenseSnapshot.h"
+#include "ExpenseStore.h"
+
+// Month-partitioned snapshot storage.
+//
+// The snapshot file holds a small manifest instead of the rows: the segments, each with its row
+// count, total and day range, and the row order as runs of consecutive rows from the same
+// segment. A segment holds the rows of one month (a month with more than MaxSegmentRows rows
+// gets several), saved as a compressed ExpensePack in <snapshot>.segments/<file>.bbs. Reading the
+// runs in order gives the store back in its exact row order, so the row positions in the journal
+// stay valid; a history entered in date order is one run per month, and a back-dated row adds
+// one or two more.
+//
+// A change marks only the segment holding its row dirty, and a save rewrites only the dirty
+// segments; the others keep their files.
+class ExpenseSegmentLayout
+{
+public:
+	static constexpr uint64_t MaxSegmentRows = 256 * 1024;
+
+	struct Segment
+	{
+		uint32_t file = 0;         // <file>.bbs in the segment directory; meaningless while dirty
+		uint64_t rows = 0;
+		int64_t cents = 0;         // total and day range as of the last save
+		int32_t minDay = 0;
+		int32_t maxDay = 0;
+		int32_t month = 0;         // the month of every row in it
+		bool dirty = true;
+	};
+
+	// Consecutive rows that belong to one segment
+	struct Run
+	{
+		uint32_t segment = 0;      // index into Segments()
+		uint32_t rows = 0;
+	};
+
+	const std::vector<Segment>& Segments() const { return segments; }
+	// The row order: the rows of the runs in turn, each run continuing its segment where its
+	// previous run there stopped
+	const std::vector<Run>& Runs() const { return runs; }
+	uint64_t Rows() const;
+	uint64_t DirtyRows() const;
+
+	// Mirror the store changes the journal logs, by row position
+	void Add(int32_t day);
+	void Insert(ExpenseStore::RowId row, int32_t day);
+	// Rows at the ascending positions they have once all of them are in, with their days
+	void InsertRows(const std::vector<ExpenseStore::RowId>& rows, const std::vector<int32_t>& days);
+	void Remove(ExpenseStore::RowId row);
+	void RemoveRows(const std::vector<ExpenseStore::RowId>& rows);
+	void Clear();
+
+	// Splits the whole store into fresh, all dirty segments, for when nothing is known about the
+	// saved layout or the store changed in ways the journal does not describe
+	void Partition(const ExpenseStore& store);
+	// The layout read back from a manifest, every segment clean
+	void Assign(std::vector<Segment> saved, std::vector<Run> order);
+
+	// Hands every dirty segment a new file, fills in its totals from the store and copies its rows
+	// to dirtyRows, segment by segment in row order. Returns the layout to save, in which those
+	// segments are still marked dirty; in this layout they count as clean from now on.
+	ExpenseSegmentLayout PlanSave(const ExpenseStore& store, ExpenseStore& dirtyRows);
+	// The same for a caller that streams the rows rather than holding them: segmentRows has an
+	// entry per segment holding the rows of each dirty one in row order, and is emptied on the way
+	ExpenseSegmentLayout PlanSave(std::vector<ExpenseStore>& segmentRows, ExpenseStore& dirtyRows);
+
+private:
+	std::vector<Segment> segments;
+	std::vector<Run> runs;
+	uint32_t nextFile = 1;
+
+	// Gives a dirty segment a new file and the totals of its rows, dirtyRows from first on
+	void PlanSegment(size_t index, const ExpenseStore& dirtyRows, ExpenseStore::RowId first, ExpenseSegmentLayout& plan);
+	// The segment a new row from this day goes into; a month with no segment that has room gets one
+	uint32_t SegmentFor(int32_t day);
+	// The run holding the row and the position of its first row
+	size_t RunOf(uint64_t row, uint64_t& first) const;
+	// Appends rows of a segment to the order, extending the last run if it is of the same segment
+	static void AppendRun(std::vector<Run>& order, uint32_t segment, uint64_t rows);
+	// Drops empty segments and runs, merging the runs that end up side by side
+	void DropEmpty();
+};
+
+// The segments of a manifest read as one snapshot. A snapshot file written before segments
+// existed reads as a single segment, and a manifest from before the row order was kept (version
+// 1, whose segments were runs of rows in order) as its segments one after another, so older
+// data files load unchanged.
+//
+// Segments are paged in on demand: Open reads only the manifest, and a segment file is read,
+// checked and decoded when a row of it is first asked for, so the months nobody reads are never
+// loaded. Reading in row order, a segment is dropped again after its last run, so a history in
+// date order has about one segment decoded at a time; rows out of date order keep more of them
+// in use, up to a limit on the rows decoded. Past the limit the segment whose next run is
+// furthest ahead makes room, and once segments had to be decoded again for more rows than the
+// snapshot holds, the runs are too interleaved to page and nothing more is dropped before its
+// last run: decoding then costs at most about three times the rows, in memory bounded by the
+// history.
+class ExpenseSegmentedSnapshot
+{
+public:
+	static constexpr size_t MaxPagedRows = 1024 * 1024;
+
+	bool Open(const std::string& snapshotFile);
+	void Close();
+
+	size_t Size() const { return rowCount; }
+	uint64_t Sequence() const { return sequence; }
+	// False for a file from before month segments, whose layout has to be worked out from the rows
+	bool Segmented() const { return segmented; }
+	const std::vector<ExpenseSegmentLayout::Segment>& Segments() const { return segments; }
+	const std::vector<ExpenseSegmentLayout::Run>& Runs() const { return layoutRuns; }
+
+	// Rows are mostly read in order, so the run of the last lookup is tried first. A segment that
+	// turns out to be damaged reads as empty rows and sets Failed.
+	int64_t AmountCents(size_t row) const;
+	int32_t Day(size_t row) const;
+	std::string_view Category(size_t row) const;
+	std::string_view Description(size_t row) const;
+	bool Failed() const { return failed; }
+
+	// The saved day range of the segment holding the row and the position just past its run,
+	// without paging the segment in; a file from before month segments reports every day
+	void RunOf(size_t row, int32_t& minDay, int32_t& maxDay, size_t& runEnd) const;
+
+	// MaxPagedRows by default
+	void LimitPagedRows(size_t rows) { pagedRowLimit = rows; }
+	// Rows decoded so far, a segment paged in again counting each time
+	size_t DecodedRows() const { return decodedRows; }
+
+	// Starts reading in row order again from the first row, so segments are released after
+	// their last run once more
+	void Rewind();
+
+	size_t RunCount() const { return runs.size(); }
+	// Appends the rows of one run to the store; false if its segment cannot be read
+	bool AppendRun(size_t index, ExpenseStore& store) const;
+
+private:
+
+	// One segment file: a mapped snapshot (as older versions wrote) or an ExpensePack, decoded
+	// while paged in
+	struct Part
+	{
+		std::string fileName;
+		size_t rows = 0;
+		std::unique_ptr<ExpenseSnapshot> snapshot;
+		std::unique_ptr<ExpenseBatch> decoded;
+		size_t nextRun = 0;        // its first run not yet passed, SIZE_MAX after the last
+		bool evicted = false;      // dropped before its last run to make room
+	};
+
+	struct RunEntry
+	{
+		size_t first = 0;          // position of its first row
+		size_t rows = 0;
+		size_t part = 0;
+		size_t offset = 0;         // where its rows start within the part
+		size_t next = SIZE_MAX;    // the part's run after this one
+	};
+
+	mutable std::vector<Part> parts;
+	std::vector<RunEntry> runs;
+	std::vector<ExpenseSegmentLayout::Segment> segments;
+	std::vector<ExpenseSegmentLayout::Run> layoutRuns;
+	size_t rowCount = 0;
+	uint64_t sequence = 0;
+	bool segmented = false;
+	size_t pagedRowLimit = MaxPagedRows;
+	mutable size_t lastRun = 0;
+	mutable size_t passedRuns = 0;     // runs before this one have been left behind
+	mutable size_t pagedRows = 0;      // rows of the decoded packs
+	mutable size_t decodedRows = 0;
+	mutable size_t redecodedRows = 0;  // rows of evicted packs paged in again
+	mutable bool failed = false;
+
+	// The part holding the row, paged in, and the row's index within it
+	const Part& PartOf(size_t row, size_t& index) const;
+	const RunEntry& FindRun(size_t row) const;
+	// Links each part's runs, so eviction can tell which part is needed again furthest ahead
+	void LinkRuns();
+	void Advance(size_t run) const;
+	bool PageIn(size_t index) const;
+};
+
+// Saves the layout PlanSave returned: a new file for each dirty segment, then the manifest,
+// swapped in with a rename so a crash leaves either the old or the new one, and finally the
+// segment files the manifest no longer lists. dirtyRows holds the dirty segments' rows in order.
+bool WriteExpenseSegments(const std::string& snapshotFile, const ExpenseSegmentLayout& layout,
+	const ExpenseStore& dirtyRows, uint64_t sequence, uint64_t* bytesWritten = nullptr);
+// Appends the rows of a manifest (or an older single snapshot) to the store and reports the
+// saved layout, which is empty for an older snapshot. False if the files are missing or invalid.
+bool LoadExpenseSegments(ExpenseStore& store, const std::string& snapshotFile, uint64_t* sequence, ExpenseSegmentLayout* layout);
@@ -0,0 +1,259 @@
+#include "ExpenseSeries.h"
+#include <algorithm>
+#include <cmath>
+
+int ExpenseDailySeries::WindowDays(Window window)
+{
+	switch (window) {
+	case Window::Week:
+		return 7;
+	case Window::Month:
+		return 30;
+	default:
+		return 1;
+	}
+}
+
+ExpenseDailySeries::ExpenseDailySeries(const ExpenseStore& store)
+	: store(store)
+{
+}
+
+void ExpenseDailySeries::Insert(ExpenseStore::RowId row)
+{
+	if (built) {
+		Add(store.CategoryOf(row), store.Day(row), store.AmountCents(row), 1);
+	}
+}
+
+void ExpenseDailySeries::Erase(ExpenseStore::RowId row)
+{
+	// The range is left as it is; days without rows simply read as zero
+	if (built) {
+		Add(store.CategoryOf(row), store.Day(row), -store.AmountCents(row), -1);
+	}
+}
+
+void ExpenseDailySeries::EraseRows(const std::vector<ExpenseStore::RowId>& rows)
+{
+	for (ExpenseStore::RowId row : rows) {
+		Erase(row);
+	}
+}
+
+void ExpenseDailySeries::Clear()
+{
+	categories.clear();
+	all = Series();
+	firstDay = 0;
+	dayCount = 0;
+	built = false;
+}
+
+int32_t ExpenseDailySeries::FirstDay()
+{
+	Build();
+	return firstDay;
+}
+
+size_t ExpenseDailySeries::DayCount()
+{
+	Build();
+	return dayCount;
+}
+
+const std::vector<int64_t>& ExpenseDailySeries::Values(ExpenseStore::CategoryId category, Window window)
+{
+	Build();
+	Series& series = category == ExpenseStore::NoCategory ? all : SeriesOf(category);
+	if (series.sums[0].size() != dayCount) {
+		series.sums[0].assign(dayCount, 0);  // a category without rows
+	}
+	const size_t index = static_cast<size_t>(window);
+	if (series.sums[index].size() != dayCount) {
+		ComputeRolling(series, index);
+	}
+	return series.sums[index];
+}
+
+std::vector<ExpenseStore::CategoryId> ExpenseDailySeries::CategoriesBySpending()
+{
+	Build();
+	std::vector<ExpenseStore::CategoryId> ids;
+	for (ExpenseStore::CategoryId id = 0; id < categories.size(); id++) {
+		if (categories[id].rows > 0) {
+			ids.push_back(id);
+		}
+	}
+	std::stable_sort(ids.begin(), ids.end(), [this](ExpenseStore::CategoryId a, ExpenseStore::CategoryId b) {
+		return categories[a].cents > categories[b].cents;
+		});
+	return ids;
+}
+
+void ExpenseDailySeries::Build()
+{
+	if (built) {
+		return;
+	}
+	const std::vector<int32_t>& days = store.Days();
+	categories.assign(store.CategoryCount(), Series());
+	all = Series();
+	dayCount = 0;
+	if (!days.empty()) {
+		auto range = std::minmax_element(days.begin(), days.end());
+		firstDay = *range.first;
+		dayCount = static_cast<size_t>(*range.second - *range.first) + 1;
+	}
+	// Only the daily sums are filled in here; a rolling series is computed when first asked for
+	const std::vector<int64_t>& amounts = store.Amounts();
+	const std::vector<ExpenseStore::CategoryId>& ids = store.CategoryIds();
+	for (size_t row = 0; row < days.size(); row++) {
+		const size_t index = static_cast<size_t>(days[row] - firstDay);
+		AddToSeries(categories[ids[row]], index, amounts[row], 1);
+		AddToSeries(all, index, amounts[row], 1);
+	}
+	built = true;
+}
+
+void ExpenseDailySeries::Add(ExpenseStore::CategoryId category, int32_t day, int64_t cents, int rows)
+{
+	Cover(day);
+	const size_t index = static_cast<size_t>(day - firstDay);
+	AddToSeries(SeriesOf(category), index, cents, rows);
+	AddToSeries(all, index, cents, rows);
+}
+
+void ExpenseDailySeries::AddToSeries(Series& series, size_t index, int64_t cents, int rows)
+{
+	if (series.sums[0].size() != dayCount) {
+		series.sums[0].assign(dayCount, 0);
+	}
+	series.cents += cents;
+	series.rows = rows > 0 ? series.rows + 1 : series.rows - 1;
+	series.sums[0][index] += cents;
+	// A day's amount is in the window of itself and the days after it, up to the window length
+	for (size_t window = 1; window < WindowCount; window++) {
+		std::vector<int64_t>& sums = series.sums[window];
+		if (sums.empty()) {
+			continue;
+		}
+		const size_t end = std::min(dayCount, index + WindowDays(static_cast<Window>(window)));
+		for (size_t day = index; day < end; day++) {
+			sums[day] += cents;
+		}
+	}
+}
+
+void ExpenseDailySeries::Cover(int32_t day)
+{
+	if (dayCount > 0 && day >= firstDay && static_cast<size_t>(day - firstDay) < dayCount) {
+		return;
+	}
+	const int32_t lastDay = dayCount > 0 ? firstDay + static_cast<int32_t>(dayCount) - 1 : day;
+	const int32_t newFirst = dayCount > 0 ? std::min(firstDay, day) : day;
+	const size_t newCount = static_cast<size_t>(std::max(lastDay, day) - newFirst) + 1;
+	const size_t shift = dayCount > 0 ? static_cast<size_t>(firstDay - newFirst) : 0;
+
+	auto widen = [&](Series& series) {
+		if (series.sums[0].empty()) {
+			return;  // filled in on first use
+		}
+		std::vector<int64_t> daily(newCount, 0);
+		std::copy(series.sums[0].begin(), series.sums[0].end(), daily.begin() + shift);
+		series.sums[0].swap(daily);
+	};
+	for (Series& series : categories) {
+		widen(series);
+	}
+	widen(all);
+	firstDay = newFirst;
+	dayCount = newCount;
+
+	for (size_t window = 1; window < WindowCount; window++) {
+		for (Series& series : categories) {
+			if (!series.sums[window].empty()) {
+				ComputeRolling(series, window);
+			}
+		}
+		if (!all.sums[window].empty()) {
+			ComputeRolling(all, window);
+		}
+	}
+}
+
+void ExpenseDailySeries::ComputeRolling(Series& series, size_t window)
+{
+	// One pass with a running sum: add the day entering the window, drop the one leaving it
+	const std::vector<int64_t>& daily = series.sums[0];
+	std::vector<int64_t>& sums = series.sums[window];
+	const size_t length = static_cast<size_t>(WindowDays(static_cast<Window>(window)));
+	sums.assign(dayCount, 0);
+	int64_t sum = 0;
+	for (size_t day = 0; day < dayCount; day++) {
+		sum += daily[day];
+		if (day >= length) {
+			sum -= daily[day - length];
+		}
+		sums[day] = sum;
+	}
+}
+
+ExpenseDailySeries::Series& ExpenseDailySeries::SeriesOf(ExpenseStore::CategoryId category)
+{
+	if (category >= categories.size()) {
+		categories.resize(static_cast<size_t>(category) + 1);
+	}
+	return categories[category];
+}
+
+void DownsampleLttb(const int64_t* values, size_t first, size_t last, size_t threshold, std::vector<SeriesPoint>& out)
+{
+	out.clear();
+	const size_t count = last > first ? last - first : 0;
+	threshold = std::max<size_t>(threshold, 3);
+	if (count <= threshold) {
+		for (size_t i = first; i < last; i++) {
+			out.push_back(SeriesPoint{ i, values[i] });
+		}
+		return;
+	}
+
+	// The first and last points are kept; the rest is split into threshold - 2 buckets, and each
+	// bucket keeps the point forming the largest triangle with the point kept before it and the
+	// average of the next bucket
+	out.reserve(threshold);
+	out.push_back(SeriesPoint{ first, values[first] });
+	const double bucketSize = static_cast<double>(count - 2) / static_cast<double>(threshold - 2);
+	size_t kept = first;
+	for (size_t bucket = 0; bucket + 2 < threshold; bucket++) {
+		const size_t nextStart = first + static_cast<size_t>(std::floor((bucket + 1) * bucketSize)) + 1;
+		const size_t nextEnd = std::min(first + static_cast<size_t>(std::floor((bucket + 2) * bucketSize)) + 1, last);
+		double averageX = 0, averageY = 0;
+		for (size_t i = nextStart; i < nextEnd; i++) {
+			averageX += static_cast<double>(i);
+			averageY += static_cast<double>(values[i]);
+		}
+		const double nextCount = static_cast<double>(std::max<size_t>(nextEnd - nextStart, 1));
+		averageX /= nextCount;
+		averageY /= nextCount;
+
+		const size_t start = first + static_cast<size_t>(std::floor(bucket * bucketSize)) + 1;
+		const size_t end = nextStart;
+		const double keptX = static_cast<double>(kept);
+		const double keptY = static_cast<double>(values[kept]);
+		double largestArea = -1;
+		size_t chosen = start;
+		for (size_t i = start; i < end; i++) {
+			const double area = std::abs((keptX - averageX) * (static_cast<double>(values[i]) - keptY)
+				- (keptX - static_cast<double>(i)) * (averageY - keptY));
+			if (area > largestArea) {
+				largestArea = area;
+				chosen = i;
+			}
+		}
+		out.push_back(SeriesPoint{ chosen, values[chosen] });
+		kept = chosen;
+	}
+	out.push_back(SeriesPoint{ last - 1, values[last - 1] });
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "ExpenseStore.h"
+
+// Spending per day over the whole history, for each category and for all of them together,
+// with rolling sums over the last 7 and 30 days. Like ExpenseTotalsCache it is built from the
+// store the first time it is read; after that an add or remove touches one day of the daily
+// series and the few days of each rolling series whose window holds it, so a chart never
+// rescans the store.
+class ExpenseDailySeries
+{
+public:
+	enum class Window { Day, Week, Month };
+	static int WindowDays(Window window);
+
+	explicit ExpenseDailySeries(const ExpenseStore& store);
+
+	// Call after the row was added to the store
+	void Insert(ExpenseStore::RowId row);
+	// Call before the row is removed from the store
+	void Erase(ExpenseStore::RowId row);
+	// Call before the ascending rows are removed from the store with RemoveRows
+	void EraseRows(const std::vector<ExpenseStore::RowId>& rows);
+	void Clear();
+
+	// The days covered are [FirstDay(), FirstDay() + DayCount()), from the earliest row to the latest
+	int32_t FirstDay();
+	size_t DayCount();
+	// Cents per day of the range, over the window ending that day; NoCategory gives all categories together
+	const std::vector<int64_t>& Values(ExpenseStore::CategoryId category, Window window);
+	// Categories that have rows, by total spending, largest first
+	std::vector<ExpenseStore::CategoryId> CategoriesBySpending();
+
+private:
+	static constexpr size_t WindowCount = 3;
+
+	// The rolling series are only computed for categories that were asked for, and from then on kept up to date
+	struct Series
+	{
+		std::vector<int64_t> sums[WindowCount];
+		int64_t cents = 0;
+		size_t rows = 0;
+	};
+
+	const ExpenseStore& store;
+	std::vector<Series> categories;   // by category id
+	Series all;
+	int32_t firstDay = 0;
+	size_t dayCount = 0;
+	bool built = false;
+
+	void Build();
+	void Add(ExpenseStore::CategoryId category, int32_t day, int64_t cents, int rows);
+	void AddToSeries(Series& series, size_t index, int64_t cents, int rows);
+	// Widens the range to include the day, moving the daily sums and recomputing the rolling ones
+	void Cover(int32_t day);
+	void ComputeRolling(Series& series, size_t window);
+	Series& SeriesOf(ExpenseStore::CategoryId category);
+};
+
+// A point kept by downsampling: its index in the series and its value
+struct SeriesPoint
+{
+	size_t index;
+	int64_t value;
+};
+
+// Largest-Triangle-Three-Buckets: reduces values[first, last) to at most threshold points that
+// keep the shape of the line, always including the first and last. The cost is linear in the
+// range, so a chart can downsample to its pixel width on every pan and zoom.
+void DownsampleLttb(const int64_t* values, size_t first, size_t last, size_t threshold, std::vector<SeriesPoint>& out);
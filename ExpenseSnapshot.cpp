@@ -0,0 +1,327 @@
+#include "ExpenseSnapshot.h"
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace {
+	const char SnapshotMagic[8] = { 'B', 'B', 'S', 'N', 'A', 'P', '\r', '\n' };
+
+	struct SnapshotHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t headerSize;
+		uint64_t rowCount;
+		uint64_t categoryCount;
+		uint64_t sequence;
+		uint64_t amountsOffset;
+		uint64_t daysOffset;
+		uint64_t categoriesOffset;
+		uint64_t descriptionOffsetsOffset;
+		uint64_t descriptionHeapOffset;
+		uint64_t descriptionHeapSize;
+		uint64_t categoryOffsetsOffset;
+		uint64_t categoryHeapOffset;
+		uint64_t categoryHeapSize;
+	};
+
+	uint64_t AlignUp(uint64_t offset) {
+		return (offset + 7) & ~uint64_t(7);
+	}
+
+	// True if [offset, offset + count * width) lies inside the file
+	bool SectionFits(uint64_t offset, uint64_t count, uint64_t width, uint64_t fileSize) {
+		return offset <= fileSize && count <= (fileSize - offset) / width;
+	}
+
+	bool OffsetsValid(const uint64_t* offsets, uint64_t count, uint64_t heapSize) {
+		if (offsets[0] != 0) {
+			return false;
+		}
+		for (uint64_t i = 0; i < count; i++) {
+			if (offsets[i + 1] < offsets[i]) {
+				return false;
+			}
+		}
+		return offsets[count] <= heapSize;
+	}
+
+	// Places the row sections; the category sections follow the description heap
+	void LayoutRows(SnapshotHeader& header, uint64_t rows, uint64_t descriptionBytes) {
+		header.rowCount = rows;
+		header.amountsOffset = AlignUp(sizeof(SnapshotHeader));
+		header.daysOffset = AlignUp(header.amountsOffset + rows * sizeof(int64_t));
+		header.categoriesOffset = AlignUp(header.daysOffset + rows * sizeof(int32_t));
+		header.descriptionOffsetsOffset = AlignUp(header.categoriesOffset + rows * sizeof(uint32_t));
+		header.descriptionHeapOffset = header.descriptionOffsetsOffset + (rows + 1) * sizeof(uint64_t);
+		header.descriptionHeapSize = descriptionBytes;
+	}
+
+	void LayoutCategories(SnapshotHeader& header, uint64_t categories, uint64_t nameBytes) {
+		header.categoryCount = categories;
+		header.categoryOffsetsOffset = AlignUp(header.descriptionHeapOffset + header.descriptionHeapSize);
+		header.categoryHeapOffset = header.categoryOffsetsOffset + (categories + 1) * sizeof(uint64_t);
+		header.categoryHeapSize = nameBytes;
+	}
+
+	SnapshotHeader MakeHeader(uint64_t sequence) {
+		SnapshotHeader header = {};
+		std::memcpy(header.magic, SnapshotMagic, sizeof(SnapshotMagic));
+		header.version = ExpenseSnapshot::Version;
+		header.headerSize = sizeof(SnapshotHeader);
+		header.sequence = sequence;
+		return header;
+	}
+
+	void WritePadding(std::ofstream& ostream, uint64_t& position) {
+		static const char zeros[8] = {};
+		uint64_t aligned = AlignUp(position);
+		ostream.write(zeros, static_cast<std::streamsize>(aligned - position));
+		position = aligned;
+	}
+
+	void WriteBytes(std::ofstream& ostream, uint64_t& position, const void* data, uint64_t size) {
+		ostream.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+		position += size;
+	}
+}
+
+bool ExpenseSnapshot::Open(const std::string& fileName)
+{
+	Close();
+	if (!file.Open(fileName) || file.Size() < sizeof(SnapshotHeader)) {
+		file.Close();
+		return false;
+	}
+
+	SnapshotHeader header;
+	std::memcpy(&header, file.Data(), sizeof(header));
+	const uint64_t fileSize = file.Size();
+	bool valid = std::memcmp(header.magic, SnapshotMagic, sizeof(SnapshotMagic)) == 0
+		&& header.version == Version
+		&& header.headerSize == sizeof(SnapshotHeader)
+		&& header.rowCount < UINT32_MAX
+		&& header.categoryCount < UINT32_MAX
+		&& header.amountsOffset % 8 == 0 && header.descriptionOffsetsOffset % 8 == 0 && header.categoryOffsetsOffset % 8 == 0
+		&& header.daysOffset % 4 == 0 && header.categoriesOffset % 4 == 0
+		&& SectionFits(header.amountsOffset, header.rowCount, sizeof(int64_t), fileSize)
+		&& SectionFits(header.daysOffset, header.rowCount, sizeof(int32_t), fileSize)
+		&& SectionFits(header.categoriesOffset, header.rowCount, sizeof(uint32_t), fileSize)
+		&& SectionFits(header.descriptionOffsetsOffset, header.rowCount + 1, sizeof(uint64_t), fileSize)
+		&& SectionFits(header.descriptionHeapOffset, header.descriptionHeapSize, 1, fileSize)
+		&& SectionFits(header.categoryOffsetsOffset, header.categoryCount + 1, sizeof(uint64_t), fileSize)
+		&& SectionFits(header.categoryHeapOffset, header.categoryHeapSize, 1, fileSize);
+	if (!valid) {
+		file.Close();
+		return false;
+	}
+
+	const char* base = file.Data();
+	rowCount = static_cast<size_t>(header.rowCount);
+	categoryCount = static_cast<size_t>(header.categoryCount);
+	sequence = header.sequence;
+	amounts = reinterpret_cast<const int64_t*>(base + header.amountsOffset);
+	days = reinterpret_cast<const int32_t*>(base + header.daysOffset);
+	categories = reinterpret_cast<const uint32_t*>(base + header.categoriesOffset);
+	descriptionOffsets = reinterpret_cast<const uint64_t*>(base + header.descriptionOffsetsOffset);
+	descriptionHeap = base + header.descriptionHeapOffset;
+	categoryOffsets = reinterpret_cast<const uint64_t*>(base + header.categoryOffsetsOffset);
+	categoryHeap = base + header.categoryHeapOffset;
+
+	// One sequential pass so later reads through string_view can never leave the mapping
+	valid = OffsetsValid(descriptionOffsets, rowCount, header.descriptionHeapSize)
+		&& OffsetsValid(categoryOffsets, categoryCount, header.categoryHeapSize);
+	for (size_t row = 0; valid && row < rowCount; row++) {
+		valid = categories[row] < categoryCount;
+	}
+	if (!valid) {
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void ExpenseSnapshot::Close()
+{
+	file.Close();
+	rowCount = 0;
+	categoryCount = 0;
+	sequence = 0;
+	amounts = nullptr;
+	days = nullptr;
+	categories = nullptr;
+	descriptionOffsets = nullptr;
+	descriptionHeap = nullptr;
+	categoryOffsets = nullptr;
+	categoryHeap = nullptr;
+}
+
+bool WriteExpenseSnapshot(const ExpenseStore& store, const std::string& fileName, uint64_t sequence)
+{
+	const uint64_t rows = store.Size();
+	const uint64_t cats = store.CategoryCount();
+
+	std::vector<uint64_t> descriptionOffsets(rows + 1);
+	for (ExpenseStore::RowId row = 0; row < rows; row++) {
+		descriptionOffsets[row + 1] = descriptionOffsets[row] + store.Description(row).size();
+	}
+	std::vector<uint64_t> categoryOffsets(cats + 1);
+	for (ExpenseStore::CategoryId id = 0; id < cats; id++) {
+		categoryOffsets[id + 1] = categoryOffsets[id] + store.CategoryName(id).size();
+	}
+
+	SnapshotHeader header = MakeHeader(sequence);
+	LayoutRows(header, rows, descriptionOffsets[rows]);
+	LayoutCategories(header, cats, categoryOffsets[cats]);
+
+	std::ofstream ostream(fileName, std::ios::binary | std::ios::trunc);
+	uint64_t position = 0;
+	WriteBytes(ostream, position, &header, sizeof(header));
+	WritePadding(ostream, position);
+	WriteBytes(ostream, position, store.Amounts().data(), rows * sizeof(int64_t));
+	WritePadding(ostream, position);
+	WriteBytes(ostream, position, store.Days().data(), rows * sizeof(int32_t));
+	WritePadding(ostream, position);
+	WriteBytes(ostream, position, store.CategoryIds().data(), rows * sizeof(uint32_t));
+	WritePadding(ostream, position);
+	WriteBytes(ostream, position, descriptionOffsets.data(), descriptionOffsets.size() * sizeof(uint64_t));
+	for (ExpenseStore::RowId row = 0; row < rows; row++) {
+		std::string_view description = store.Description(row);
+		WriteBytes(ostream, position, description.data(), description.size());
+	}
+	WritePadding(ostream, position);
+	WriteBytes(ostream, position, categoryOffsets.data(), categoryOffsets.size() * sizeof(uint64_t));
+	for (ExpenseStore::CategoryId id = 0; id < cats; id++) {
+		std::string_view name = store.CategoryName(id);
+		WriteBytes(ostream, position, name.data(), name.size());
+	}
+	ostream.flush();
+	return ostream.good();
+}
+
+bool ExpenseSnapshotWriter::Open(const std::string& fileName, uint64_t rows, uint64_t descriptionBytes, uint64_t sequence)
+{
+	ostream.open(fileName, std::ios::binary | std::ios::trunc);
+	expectedRows = rows;
+	expectedDescriptionBytes = descriptionBytes;
+	this->sequence = sequence;
+	this->rows = 0;
+	this->descriptionBytes = 0;
+	categoryNames.clear();
+	categoryLookup.clear();
+
+	SnapshotHeader header = {};
+	LayoutRows(header, rows, descriptionBytes);
+	sections[Amounts].position = header.amountsOffset;
+	sections[Days].position = header.daysOffset;
+	sections[Categories].position = header.categoriesOffset;
+	sections[DescriptionOffsets].position = header.descriptionOffsetsOffset;
+	sections[DescriptionHeap].position = header.descriptionHeapOffset;
+	for (Section& section : sections) {
+		section.buffer.clear();
+	}
+	const uint64_t firstOffset = 0;
+	Append(sections[DescriptionOffsets], &firstOffset, sizeof(firstOffset));
+	return ostream.good();
+}
+
+void ExpenseSnapshotWriter::Add(std::string_view description, std::string_view category, int64_t amountCents, int32_t day)
+{
+	auto found = categoryLookup.find(std::string(category));
+	uint32_t categoryId;
+	if (found != categoryLookup.end()) {
+		categoryId = found->second;
+	}
+	else {
+		categoryId = static_cast<uint32_t>(categoryNames.size());
+		categoryNames.emplace_back(category);
+		categoryLookup.emplace(categoryNames.back(), categoryId);
+	}
+
+	rows++;
+	descriptionBytes += description.size();
+	// Rows past the announced count would run into the next section, so they only get counted
+	if (rows > expectedRows || descriptionBytes > expectedDescriptionBytes) {
+		return;
+	}
+	Append(sections[Amounts], &amountCents, sizeof(amountCents));
+	Append(sections[Days], &day, sizeof(day));
+	Append(sections[Categories], &categoryId, sizeof(categoryId));
+	Append(sections[DescriptionOffsets], &descriptionBytes, sizeof(descriptionBytes));
+	Append(sections[DescriptionHeap], description.data(), description.size());
+}
+
+bool ExpenseSnapshotWriter::Close()
+{
+	for (Section& section : sections) {
+		Flush(section);
+	}
+	bool complete = rows == expectedRows && descriptionBytes == expectedDescriptionBytes;
+
+	std::vector<uint64_t> categoryOffsets(categoryNames.size() + 1);
+	for (size_t id = 0; id < categoryNames.size(); id++) {
+		categoryOffsets[id + 1] = categoryOffsets[id] + categoryNames[id].size();
+	}
+	SnapshotHeader header = MakeHeader(sequence);
+	LayoutRows(header, expectedRows, expectedDescriptionBytes);
+	LayoutCategories(header, categoryNames.size(), categoryOffsets.back());
+
+	uint64_t position = header.categoryOffsetsOffset;
+	ostream.seekp(static_cast<std::streamoff>(position));
+	WriteBytes(ostream, position, categoryOffsets.data(), categoryOffsets.size() * sizeof(uint64_t));
+	for (const std::string& name : categoryNames) {
+		WriteBytes(ostream, position, name.data(), name.size());
+	}
+	ostream.seekp(0);
+	WriteBytes(ostream, position, &header, sizeof(header));
+	ostream.flush();
+	bool good = ostream.good();
+	ostream.close();
+	return complete && good;
+}
+
+void ExpenseSnapshotWriter::Append(Section& section, const void* data, size_t size)
+{
+	section.buffer.append(static_cast<const char*>(data), size);
+	if (section.buffer.size() >= 256 * 1024) {
+		Flush(section);
+	}
+}
+
+void ExpenseSnapshotWriter::Flush(Section& section)
+{
+	if (section.buffer.empty()) {
+		return;
+	}
+	ostream.seekp(static_cast<std::streamoff>(section.position));
+	WriteBytes(ostream, section.position, section.buffer.data(), section.buffer.size());
+	section.buffer.clear();
+}
+
+bool LoadExpenseSnapshot(ExpenseStore& store, const std::string& fileName, uint64_t* sequence)
+{
+	ExpenseSnapshot snapshot;
+	if (!snapshot.Open(fileName)) {
+		return false;
+	}
+
+	std::vector<std::string_view> categoryNames(snapshot.CategoryCount());
+	for (uint32_t id = 0; id < categoryNames.size(); id++) {
+		categoryNames[id] = snapshot.CategoryName(id);
+	}
+	store.AppendColumns(snapshot.Size(), snapshot.Amounts(), snapshot.Days(), snapshot.Categories(),
+		categoryNames, snapshot.DescriptionOffsets(), snapshot.DescriptionHeap());
+	if (sequence) {
+		*sequence = snapshot.Sequence();
+	}
+	return true;
+}
+
+size_t ConvertExpenseFileToSnapshot(const std::string& textFile, const std::string& snapshotFile)
+{
+	ExpenseStore store;
+	uint64_t sequence = 0;
+	size_t skipped = LoadExpenseFromFile(store, textFile, &sequence);
+	WriteExpenseSnapshot(store, snapshotFile, sequence);
+	return skipped;
+}
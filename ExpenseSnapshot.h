@@ -0,0 +1,103 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+#include "ExpenseStore.h"
+#include "MappedFile.h"
+
+// Versioned binary snapshot of an ExpenseStore.
+//
+// Layout: a fixed header followed by 8-byte aligned sections
+//   amounts      int64[rows]        cents
+//   days         int32[rows]        day numbers
+//   categories   uint32[rows]       ids into the category table
+//   descOffsets  uint64[rows + 1]   offsets into the description heap
+//   descHeap     char[]             descriptions back to back
+//   catOffsets   uint64[cats + 1]   offsets into the category heap
+//   catHeap      char[]             category names back to back
+//
+// The file is mapped and read in place: nothing is parsed and no row allocates.
+class ExpenseSnapshot
+{
+public:
+	static constexpr uint32_t Version = 1;
+
+	bool Open(const std::string& fileName);
+	void Close();
+
+	size_t Size() const { return rowCount; }
+	uint64_t Sequence() const { return sequence; }
+	int64_t AmountCents(size_t row) const { return amounts[row]; }
+	int32_t Day(size_t row) const { return days[row]; }
+	uint32_t CategoryOf(size_t row) const { return categories[row]; }
+	std::string_view Category(size_t row) const { return CategoryName(categories[row]); }
+	std::string_view Description(size_t row) const {
+		return std::string_view(descriptionHeap + descriptionOffsets[row], descriptionOffsets[row + 1] - descriptionOffsets[row]);
+	}
+	size_t CategoryCount() const { return categoryCount; }
+	std::string_view CategoryName(uint32_t id) const {
+		return std::string_view(categoryHeap + categoryOffsets[id], categoryOffsets[id + 1] - categoryOffsets[id]);
+	}
+
+	const int64_t* Amounts() const { return amounts; }
+	const int32_t* Days() const { return days; }
+	const uint32_t* Categories() const { return categories; }
+	const uint64_t* DescriptionOffsets() const { return descriptionOffsets; }
+	const char* DescriptionHeap() const { return descriptionHeap; }
+
+private:
+	MappedFile file;
+	size_t rowCount = 0;
+	size_t categoryCount = 0;
+	uint64_t sequence = 0;
+	const int64_t* amounts = nullptr;
+	const int32_t* days = nullptr;
+	const uint32_t* categories = nullptr;
+	const uint64_t* descriptionOffsets = nullptr;
+	const char* descriptionHeap = nullptr;
+	const uint64_t* categoryOffsets = nullptr;
+	const char* categoryHeap = nullptr;
+};
+
+// Writes a snapshot one row at a time in bounded memory, for histories too large to hold in an
+// ExpenseStore. The row count and total description bytes must be known when the file is opened;
+// the category table and the header are written by Close.
+class ExpenseSnapshotWriter
+{
+public:
+	bool Open(const std::string& fileName, uint64_t rows, uint64_t descriptionBytes, uint64_t sequence);
+	void Add(std::string_view description, std::string_view category, int64_t amountCents, int32_t day);
+	// False on a write error or if the rows added do not match what Open was told
+	bool Close();
+
+private:
+	// A column being written at its own place in the file through a small buffer
+	struct Section
+	{
+		uint64_t position = 0;
+		std::string buffer;
+	};
+	enum { Amounts, Days, Categories, DescriptionOffsets, DescriptionHeap, SectionCount };
+
+	std::ofstream ostream;
+	Section sections[SectionCount];
+	uint64_t expectedRows = 0;
+	uint64_t expectedDescriptionBytes = 0;
+	uint64_t sequence = 0;
+	uint64_t rows = 0;
+	uint64_t descriptionBytes = 0;
+	std::vector<std::string> categoryNames;
+	std::unordered_map<std::string, uint32_t> categoryLookup;
+
+	void Append(Section& section, const void* data, size_t size);
+	void Flush(Section& section);
+};
+
+bool WriteExpenseSnapshot(const ExpenseStore& store, const std::string& fileName, uint64_t sequence = 0);
+// Appends the snapshot's rows to the store with bulk column copies. Returns false if the file is missing or invalid.
+bool LoadExpenseSnapshot(ExpenseStore& store, const std::string& fileName, uint64_t* sequence = nullptr);
+// One-shot conversion of a legacy expense.txt. Returns the number of rows that were skipped.
+size_t ConvertExpenseFileToSnapshot(const std::string& textFile, const std::string& snapshotFile);
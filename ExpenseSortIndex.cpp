@@ -0,0 +1,241 @@
+#include "ExpenseSortIndex.h"
+#include <algorithm>
+#include <numeric>
+#include <utility>
+
+namespace {
+	// Recording an edit costs O(k) in the edits already pending, so a permutation that is not
+	// read for a long while catches up after this many
+	const size_t MaxPendingEdits = 1024;
+}
+
+ExpenseSortIndex::ExpenseSortIndex(const ExpenseStore& store)
+	: store(store)
+{
+}
+
+const std::vector<ExpenseStore::RowId>& ExpenseSortIndex::Order(SortColumn column)
+{
+	int c = static_cast<int>(column);
+	if (!built[c]) {
+		if (column == SortColumn::Category) {
+			UpdateCategoryRanks();
+		}
+		// Sorting (key, row) pairs keeps the comparisons on contiguous memory instead of
+		// chasing row ids into the store columns
+		std::vector<std::pair<int64_t, ExpenseStore::RowId>> keyed(store.Size());
+		for (ExpenseStore::RowId row = 0; row < keyed.size(); row++) {
+			keyed[row] = { Key(column, row), row };
+		}
+		std::sort(keyed.begin(), keyed.end());
+
+		std::vector<ExpenseStore::RowId>& order = orders[c];
+		order.resize(keyed.size());
+		for (size_t i = 0; i < keyed.size(); i++) {
+			order[i] = keyed[i].second;
+		}
+		built[c] = true;
+	}
+	CatchUp(c);
+	return orders[c];
+}
+
+std::pair<size_t, size_t> ExpenseSortIndex::DateRange(int32_t fromDay, int32_t toDay)
+{
+	const std::vector<ExpenseStore::RowId>& order = Order(SortColumn::Date);
+	auto first = std::partition_point(order.begin(), order.end(), [this, fromDay](ExpenseStore::RowId row) {
+		return store.Day(row) < fromDay;
+		});
+	auto last = std::partition_point(first, order.end(), [this, toDay](ExpenseStore::RowId row) {
+		return store.Day(row) <= toDay;
+		});
+	return { static_cast<size_t>(first - order.begin()), static_cast<size_t>(last - order.begin()) };
+}
+
+void ExpenseSortIndex::SortRows(SortColumn column, std::vector<ExpenseStore::RowId>& rows)
+{
+	// A large share of the store is cheaper to pick out of the full ordering than to sort
+	if (rows.size() > store.Size() / 16) {
+		std::vector<bool> selected(store.Size());
+		for (ExpenseStore::RowId row : rows) {
+			selected[row] = true;
+		}
+		rows.clear();
+		for (ExpenseStore::RowId row : Order(column)) {
+			if (selected[row]) {
+				rows.push_back(row);
+			}
+		}
+		return;
+	}
+	if (column == SortColumn::Category) {
+		UpdateCategoryRanks();
+	}
+	std::sort(rows.begin(), rows.end(), [this, column](ExpenseStore::RowId a, ExpenseStore::RowId b) {
+		return Less(column, a, b);
+		});
+}
+
+void ExpenseSortIndex::Insert(ExpenseStore::RowId row)
+{
+	for (int c = 0; c < ColumnCount; c++) {
+		if (!built[c]) {
+			continue;
+		}
+		pending[c].Insert(row);
+		if (pending[c].Size() >= MaxPendingEdits) {
+			CatchUp(c);
+		}
+	}
+}
+
+void ExpenseSortIndex::InsertRange(ExpenseStore::RowId first, ExpenseStore::RowId last)
+{
+	for (int c = 0; c < ColumnCount; c++) {
+		if (!built[c] || first >= last) {
+			continue;
+		}
+		SortColumn column = static_cast<SortColumn>(c);
+		CatchUp(c);
+		if (column == SortColumn::Category) {
+			UpdateCategoryRanks();
+		}
+		// Sort the new rows on their own and merge them in: O(n + k log k) instead of k inserts
+		std::vector<ExpenseStore::RowId>& order = orders[c];
+		size_t middle = order.size();
+		for (ExpenseStore::RowId row = first; row < last; row++) {
+			order.push_back(row);
+		}
+		auto less = [this, column](ExpenseStore::RowId a, ExpenseStore::RowId b) {
+			return Less(column, a, b);
+		};
+		std::sort(order.begin() + middle, order.end(), less);
+		std::inplace_merge(order.begin(), order.begin() + middle, order.end(), less);
+	}
+}
+
+void ExpenseSortIndex::EraseRows(const std::vector<ExpenseStore::RowId>& rows)
+{
+	if (rows.empty()) {
+		return;
+	}
+	// One pass per ordering drops the removed rows and renumbers the rest, whatever their number
+	std::vector<ExpenseStore::RowId> ids;
+	for (int c = 0; c < ColumnCount; c++) {
+		if (!built[c]) {
+			continue;
+		}
+		CatchUp(c);
+		if (ids.empty()) {
+			ids = store.IdsAfterRemoving(rows);
+		}
+		std::vector<ExpenseStore::RowId>& order = orders[c];
+		size_t kept = 0;
+		for (ExpenseStore::RowId id : order) {
+			if (ids[id] != ExpenseStore::NoRow) {
+				order[kept++] = ids[id];
+			}
+		}
+		order.resize(kept);
+	}
+}
+
+void ExpenseSortIndex::Erase(ExpenseStore::RowId row)
+{
+	for (int c = 0; c < ColumnCount; c++) {
+		if (!built[c]) {
+			continue;
+		}
+		// Catching up reads the store, which still matches the pending edits until this row goes
+		if (pending[c].Size() >= MaxPendingEdits) {
+			CatchUp(c);
+		}
+		pending[c].Erase(row);
+	}
+}
+
+void ExpenseSortIndex::Clear()
+{
+	for (int c = 0; c < ColumnCount; c++) {
+		orders[c].clear();
+		orders[c].shrink_to_fit();
+		pending[c].Clear();
+		built[c] = false;
+	}
+}
+
+// Drops the removed rows, renumbers the rest and merges the added ones in, in one pass however
+// many edits are pending
+void ExpenseSortIndex::CatchUp(int c)
+{
+	ExpenseRowEdits& edits = pending[c];
+	if (edits.Empty()) {
+		return;
+	}
+	std::vector<ExpenseStore::RowId>& order = orders[c];
+	if (edits.Renumbers(order.size())) {
+		// Renumbering is monotonic, so the relative order of the surviving rows is unchanged
+		size_t kept = 0;
+		for (ExpenseStore::RowId id : order) {
+			ExpenseStore::RowId current = edits.Map(id);
+			if (current != ExpenseStore::NoRow) {
+				order[kept++] = current;
+			}
+		}
+		order.resize(kept);
+	}
+
+	const std::vector<ExpenseStore::RowId>& added = edits.Inserted();
+	if (!added.empty()) {
+		SortColumn column = static_cast<SortColumn>(c);
+		if (column == SortColumn::Category) {
+			for (ExpenseStore::RowId row : added) {
+				if (store.CategoryOf(row) >= categoryRank.size()) {
+					UpdateCategoryRanks();
+					break;
+				}
+			}
+		}
+		auto less = [this, column](ExpenseStore::RowId a, ExpenseStore::RowId b) {
+			return Less(column, a, b);
+		};
+		size_t middle = order.size();
+		order.insert(order.end(), added.begin(), added.end());
+		std::sort(order.begin() + middle, order.end(), less);
+		std::inplace_merge(order.begin(), order.begin() + middle, order.end(), less);
+	}
+	edits.Clear();
+}
+
+// Adding a category only shifts ranks, so existing permutations stay correctly ordered
+void ExpenseSortIndex::UpdateCategoryRanks()
+{
+	std::vector<ExpenseStore::CategoryId> ids(store.CategoryCount());
+	std::iota(ids.begin(), ids.end(), 0);
+	std::sort(ids.begin(), ids.end(), [this](ExpenseStore::CategoryId a, ExpenseStore::CategoryId b) {
+		return store.CategoryName(a) < store.CategoryName(b);
+		});
+	categoryRank.resize(ids.size());
+	for (uint32_t rank = 0; rank < ids.size(); rank++) {
+		categoryRank[ids[rank]] = rank;
+	}
+}
+
+int64_t ExpenseSortIndex::Key(SortColumn column, ExpenseStore::RowId row) const
+{
+	switch (column) {
+	case SortColumn::Category:
+		return categoryRank[store.CategoryOf(row)];
+	case SortColumn::Amount:
+		return store.AmountCents(row);
+	case SortColumn::Date:
+	default:
+		return store.Day(row);
+	}
+}
+
+bool ExpenseSortIndex::Less(SortColumn column, ExpenseStore::RowId a, ExpenseStore::RowId b) const
+{
+	int64_t keyA = Key(column, a), keyB = Key(column, b);
+	return keyA != keyB ? keyA < keyB : a < b;
+}
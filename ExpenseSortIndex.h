@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "ExpenseRowEdits.h"
+#include "ExpenseStore.h"
+
+enum class SortColumn { Category, Amount, Date };
+
+// Sorted permutations of the store rows, one per sortable column.
+// Each permutation is ordered by (key, row id); row ids follow insertion order, so ties are
+// always broken the same way. A permutation is built the first time it is asked for and is
+// then kept up to date instead of being re-sorted: single adds and removes are only recorded,
+// and a permutation catches up with all of them in one pass the next time it is read.
+class ExpenseSortIndex
+{
+public:
+	explicit ExpenseSortIndex(const ExpenseStore& store);
+
+	// Rows in ascending key order; iterate backwards for descending
+	const std::vector<ExpenseStore::RowId>& Order(SortColumn column);
+
+	// Positions [first, last) of the date ordering whose days fall in [fromDay, toDay], in O(log n)
+	std::pair<size_t, size_t> DateRange(int32_t fromDay, int32_t toDay);
+	// Orders a set of distinct rows the same way Order(column) does
+	void SortRows(SortColumn column, std::vector<ExpenseStore::RowId>& rows);
+
+	// Call after the row was added to the store, or inserted into it with the later rows shifted up
+	void Insert(ExpenseStore::RowId row);
+	// Call after rows [first, last) were appended in one go
+	void InsertRange(ExpenseStore::RowId first, ExpenseStore::RowId last);
+	// Call before the row is removed from the store
+	void Erase(ExpenseStore::RowId row);
+	// Call before the ascending rows are removed from the store with RemoveRows
+	void EraseRows(const std::vector<ExpenseStore::RowId>& rows);
+	// Drops every permutation; they are rebuilt on next use
+	void Clear();
+
+private:
+	static constexpr int ColumnCount = 3;
+
+	const ExpenseStore& store;
+	std::vector<ExpenseStore::RowId> orders[ColumnCount];
+	bool built[ColumnCount] = {};
+	ExpenseRowEdits pending[ColumnCount];  // edits a built permutation has yet to catch up with
+	std::vector<uint32_t> categoryRank;  // category id -> position of its name in sorted order
+
+	void CatchUp(int c);
+	void UpdateCategoryRanks();
+	int64_t Key(SortColumn column, ExpenseStore::RowId row) const;
+	bool Less(SortColumn column, ExpenseStore::RowId a, ExpenseStore::RowId b) const;
+};
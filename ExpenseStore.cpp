@@ -0,0 +1,432 @@
+#include "ExpenseStore.h"
+#include "ExpenseParser.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+ExpenseStore::ExpenseStore(const ExpenseStore& other)
+	: amounts(other.amounts), days(other.days), categoryIds(other.categoryIds),
+	descriptionLengths(other.descriptionLengths), descriptionHashes(other.descriptionHashes), categoryNames(other.categoryNames)
+{
+	// The copy gets its own arena with only the live text in it
+	descriptionText.resize(other.descriptionText.size());
+	descriptionArena.Reserve(static_cast<size_t>(other.descriptionArena.UsedBytes() - other.deadDescriptionBytes));
+	for (size_t row = 0; row < descriptionText.size(); row++) {
+		descriptionText[row] = descriptionArena.Append(std::string_view(other.descriptionText[row], descriptionLengths[row]));
+	}
+	// The lookup keys point into categoryNames, so they must be rebuilt for the copy
+	for (CategoryId id = 0; id < categoryNames.size(); id++) {
+		categoryLookup.emplace(categoryNames[id], id);
+	}
+}
+
+uint32_t ExpenseStore::HashDescription(std::string_view description)
+{
+	// FNV-1a; descriptions are short, so a byte at a time is cheap enough
+	uint32_t hash = 2166136261u;
+	for (char c : description) {
+		hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+	}
+	return hash;
+}
+
+ExpenseStore& ExpenseStore::operator=(const ExpenseStore& other)
+{
+	if (this != &other) {
+		ExpenseStore copy(other);
+		*this = std::move(copy);
+	}
+	return *this;
+}
+
+void ExpenseStore::Reserve(size_t rows, size_t descriptionBytes)
+{
+	amounts.reserve(rows);
+	days.reserve(rows);
+	categoryIds.reserve(rows);
+	descriptionText.reserve(rows);
+	descriptionLengths.reserve(rows);
+	descriptionHashes.reserve(rows);
+	descriptionArena.Reserve(descriptionBytes);
+}
+
+ExpenseStore::RowId ExpenseStore::Add(std::string_view description, std::string_view category, int64_t amountCents, int32_t day)
+{
+	RowId row = static_cast<RowId>(amounts.size());
+	amounts.push_back(amountCents);
+	days.push_back(day);
+	categoryIds.push_back(InternCategory(category));
+	descriptionText.push_back(descriptionArena.Append(description));
+	descriptionLengths.push_back(static_cast<uint32_t>(description.size()));
+	descriptionHashes.push_back(HashDescription(description));
+	return row;
+}
+
+bool ExpenseStore::Add(const Expense& expense)
+{
+	int64_t cents;
+	int32_t day;
+	if (!ParseAmountCents(expense.amount, cents) || !ParseIsoDate(expense.date, day)) {
+		return false;
+	}
+	Add(expense.description, expense.category, cents, day);
+	return true;
+}
+
+void ExpenseStore::AppendColumns(size_t count, const int64_t* amountCents, const int32_t* dayNumbers, const uint32_t* categories,
+	const std::vector<std::string_view>& columnCategories, const uint64_t* heapOffsets, const char* heap)
+{
+	std::vector<CategoryId> mapping(columnCategories.size());
+	bool identity = true;
+	for (size_t i = 0; i < columnCategories.size(); i++) {
+		mapping[i] = InternCategory(columnCategories[i]);
+		identity = identity && mapping[i] == i;
+	}
+
+	const size_t first = amounts.size();
+	amounts.insert(amounts.end(), amountCents, amountCents + count);
+	days.insert(days.end(), dayNumbers, dayNumbers + count);
+	if (identity) {
+		categoryIds.insert(categoryIds.end(), categories, categories + count);
+	}
+	else {
+		categoryIds.resize(first + count);
+		for (size_t i = 0; i < count; i++) {
+			categoryIds[first + i] = mapping[categories[i]];
+		}
+	}
+
+	// The descriptions are copied as one block and only their offsets are rebased
+	const size_t heapBytes = static_cast<size_t>(heapOffsets[count] - heapOffsets[0]);
+	const char* base = heap + heapOffsets[0];
+	if (heapBytes > 0) {
+		char* block = descriptionArena.Allocate(heapBytes);
+		std::memcpy(block, base, heapBytes);
+		base = block;
+	}
+	descriptionText.resize(first + count);
+	descriptionLengths.resize(first + count);
+	descriptionHashes.resize(first + count);
+	for (size_t i = 0; i < count; i++) {
+		descriptionText[first + i] = base + (heapOffsets[i] - heapOffsets[0]);
+		descriptionLengths[first + i] = static_cast<uint32_t>(heapOffsets[i + 1] - heapOffsets[i]);
+		descriptionHashes[first + i] = HashDescription(std::string_view(descriptionText[first + i], descriptionLengths[first + i]));
+	}
+}
+
+ExpenseStore::RowId ExpenseStore::Insert(RowId row, std::string_view description, std::string_view category, int64_t amountCents, int32_t day)
+{
+	amounts.insert(amounts.begin() + row, amountCents);
+	days.insert(days.begin() + row, day);
+	categoryIds.insert(categoryIds.begin() + row, InternCategory(category));
+	descriptionText.insert(descriptionText.begin() + row, descriptionArena.Append(description));
+	descriptionLengths.insert(descriptionLengths.begin() + row, static_cast<uint32_t>(description.size()));
+	descriptionHashes.insert(descriptionHashes.begin() + row, HashDescription(description));
+	return row;
+}
+
+void ExpenseStore::Remove(RowId row)
+{
+	deadDescriptionBytes += descriptionLengths[row];
+	amounts.erase(amounts.begin() + row);
+	days.erase(days.begin() + row);
+	categoryIds.erase(categoryIds.begin() + row);
+	descriptionText.erase(descriptionText.begin() + row);
+	descriptionLengths.erase(descriptionLengths.begin() + row);
+	descriptionHashes.erase(descriptionHashes.begin() + row);
+
+	// Reclaim the arena once more than half of it belongs to removed rows
+	if (deadDescriptionBytes > descriptionArena.UsedBytes() / 2) {
+		CompactDescriptions();
+	}
+}
+
+void ExpenseStore::RemoveRows(const std::vector<RowId>& rows)
+{
+	if (rows.empty()) {
+		return;
+	}
+	// Every kept row moves down over the removed ones before it, so each column is walked once
+	size_t next = 0;
+	RowId write = rows[0];
+	for (RowId read = rows[0]; read < amounts.size(); read++) {
+		if (next < rows.size() && rows[next] == read) {
+			deadDescriptionBytes += descriptionLengths[read];
+			next++;
+			continue;
+		}
+		amounts[write] = amounts[read];
+		days[write] = days[read];
+		categoryIds[write] = categoryIds[read];
+		descriptionText[write] = descriptionText[read];
+		descriptionLengths[write] = descriptionLengths[read];
+		descriptionHashes[write] = descriptionHashes[read];
+		write++;
+	}
+	amounts.resize(write);
+	days.resize(write);
+	categoryIds.resize(write);
+	descriptionText.resize(write);
+	descriptionLengths.resize(write);
+	descriptionHashes.resize(write);
+
+	if (deadDescriptionBytes > descriptionArena.UsedBytes() / 2) {
+		CompactDescriptions();
+	}
+}
+
+void ExpenseStore::InsertRows(const std::vector<RowId>& positions, const ExpenseStore& rows)
+{
+	if (positions.empty()) {
+		return;
+	}
+	// Filled from the back, so every old row moves at most once
+	size_t oldSize = amounts.size();
+	size_t newSize = oldSize + positions.size();
+	amounts.resize(newSize);
+	days.resize(newSize);
+	categoryIds.resize(newSize);
+	descriptionText.resize(newSize);
+	descriptionLengths.resize(newSize);
+	descriptionHashes.resize(newSize);
+
+	size_t read = oldSize;
+	size_t next = positions.size();
+	for (size_t write = newSize; write-- > positions[0];) {
+		if (next > 0 && positions[next - 1] == write) {
+			RowId source = static_cast<RowId>(--next);
+			amounts[write] = rows.AmountCents(source);
+			days[write] = rows.Day(source);
+			categoryIds[write] = InternCategory(rows.Category(source));
+			descriptionText[write] = descriptionArena.Append(rows.Description(source));
+			descriptionLengths[write] = static_cast<uint32_t>(rows.Description(source).size());
+			descriptionHashes[write] = rows.descriptionHashes[source];
+		}
+		else {
+			read--;
+			amounts[write] = amounts[read];
+			days[write] = days[read];
+			categoryIds[write] = categoryIds[read];
+			descriptionText[write] = descriptionText[read];
+			descriptionLengths[write] = descriptionLengths[read];
+			descriptionHashes[write] = descriptionHashes[read];
+		}
+	}
+}
+
+std::vector<ExpenseStore::RowId> ExpenseStore::IdsAfterRemoving(const std::vector<RowId>& rows) const
+{
+	std::vector<RowId> ids(amounts.size());
+	size_t next = 0;
+	for (RowId row = 0; row < ids.size(); row++) {
+		if (next < rows.size() && rows[next] == row) {
+			ids[row] = NoRow;
+			next++;
+		}
+		else {
+			ids[row] = static_cast<RowId>(row - next);
+		}
+	}
+	return ids;
+}
+
+void ExpenseStore::Clear()
+{
+	amounts.clear();
+	days.clear();
+	categoryIds.clear();
+	descriptionText.clear();
+	descriptionLengths.clear();
+	descriptionHashes.clear();
+	descriptionArena.Clear();
+	deadDescriptionBytes = 0;
+	// The category dictionary is kept so ids stay valid for the combo box
+}
+
+ExpenseStore ExpenseStore::TakeRows()
+{
+	ExpenseStore rows;
+	rows.amounts.swap(amounts);
+	rows.days.swap(days);
+	rows.categoryIds.swap(categoryIds);
+	rows.descriptionText.swap(descriptionText);
+	rows.descriptionLengths.swap(descriptionLengths);
+	rows.descriptionHashes.swap(descriptionHashes);
+	std::swap(rows.descriptionArena, descriptionArena);
+	std::swap(rows.deadDescriptionBytes, deadDescriptionBytes);
+	// The taken rows keep a copy of the dictionary to stay readable; this store keeps its own, as Clear does
+	rows.categoryNames = categoryNames;
+	for (CategoryId id = 0; id < rows.categoryNames.size(); id++) {
+		rows.categoryLookup.emplace(rows.categoryNames[id], id);
+	}
+	return rows;
+}
+
+void ExpenseStore::RestoreRows(ExpenseStore&& rows)
+{
+	// The dictionary only ever grows, so the ids of the taken rows are still valid here
+	amounts.swap(rows.amounts);
+	days.swap(rows.days);
+	categoryIds.swap(rows.categoryIds);
+	descriptionText.swap(rows.descriptionText);
+	descriptionLengths.swap(rows.descriptionLengths);
+	descriptionHashes.swap(rows.descriptionHashes);
+	std::swap(descriptionArena, rows.descriptionArena);
+	std::swap(deadDescriptionBytes, rows.deadDescriptionBytes);
+	rows.Clear();
+}
+
+Expense ExpenseStore::GetExpense(RowId row) const
+{
+	return Expense{ std::string(Description(row)), std::string(Category(row)),
+		FormatAmountCents(amounts[row]), FormatIsoDate(days[row]) };
+}
+
+ExpenseStore::CategoryId ExpenseStore::InternCategory(std::string_view name)
+{
+	auto it = categoryLookup.find(name);
+	if (it != categoryLookup.end()) {
+		return it->second;
+	}
+	CategoryId id = static_cast<CategoryId>(categoryNames.size());
+	categoryNames.emplace_back(name);
+	categoryLookup.emplace(categoryNames.back(), id);
+	return id;
+}
+
+ExpenseStore::CategoryId ExpenseStore::FindCategory(std::string_view name) const
+{
+	auto it = categoryLookup.find(name);
+	return it == categoryLookup.end() ? NoCategory : it->second;
+}
+
+ExpenseStoreMemory ExpenseStore::MemoryUsage() const
+{
+	ExpenseStoreMemory memory;
+	memory.rows = amounts.size();
+	memory.columnBytes = amounts.capacity() * sizeof(int64_t) + days.capacity() * sizeof(int32_t)
+		+ categoryIds.capacity() * sizeof(CategoryId) + descriptionText.capacity() * sizeof(const char*)
+		+ descriptionLengths.capacity() * sizeof(uint32_t) + descriptionHashes.capacity() * sizeof(uint32_t);
+	memory.descriptionBytes = descriptionArena.UsedBytes() - deadDescriptionBytes;
+	memory.deadDescriptionBytes = deadDescriptionBytes;
+	memory.arenaBytes = descriptionArena.ReservedBytes();
+	memory.arenaChunks = descriptionArena.ChunkCount();
+	// Each name is a string in the deque plus a lookup node holding a view and an id
+	for (const std::string& name : categoryNames) {
+		memory.categoryBytes += sizeof(std::string) + name.capacity() + sizeof(std::string_view) + sizeof(CategoryId) + 2 * sizeof(void*);
+	}
+	return memory;
+}
+
+void ExpenseStore::CompactDescriptions()
+{
+	TextArena arena;
+	arena.Reserve(static_cast<size_t>(descriptionArena.UsedBytes() - deadDescriptionBytes));
+	for (size_t row = 0; row < descriptionText.size(); row++) {
+		descriptionText[row] = arena.Append(std::string_view(descriptionText[row], descriptionLengths[row]));
+	}
+	descriptionArena = std::move(arena);
+	deadDescriptionBytes = 0;
+}
+
+void ExpenseBatch::Reserve(size_t rows)
+{
+	amounts.reserve(rows);
+	days.reserve(rows);
+	categories.reserve(rows);
+	descriptionOffsets.reserve(rows + 1);
+}
+
+void ExpenseBatch::Add(std::string_view description, std::string_view category, int64_t amountCents, int32_t day)
+{
+	auto found = categoryLookup.find(category);
+	uint32_t categoryId;
+	if (found != categoryLookup.end()) {
+		categoryId = found->second;
+	}
+	else {
+		categoryId = static_cast<uint32_t>(categoryNames.size());
+		categoryNames.emplace_back(category);
+		categoryLookup.emplace(categoryNames.back(), categoryId);
+	}
+
+	amounts.push_back(amountCents);
+	days.push_back(day);
+	categories.push_back(categoryId);
+	descriptionHeap.append(description);
+	descriptionOffsets.push_back(descriptionHeap.size());
+}
+
+void ExpenseBatch::AppendTo(ExpenseStore& store) const
+{
+	if (amounts.empty()) {
+		return;
+	}
+	std::vector<std::string_view> names(categoryNames.begin(), categoryNames.end());
+	store.AppendColumns(amounts.size(), amounts.data(), days.data(), categories.data(), names, descriptionOffsets.data(), descriptionHeap.data());
+}
+
+void ExpenseBatch::AppendTo(ExpenseStore& store, size_t first, size_t count) const
+{
+	if (count == 0) {
+		return;
+	}
+	std::vector<std::string_view> names(categoryNames.begin(), categoryNames.end());
+	store.AppendColumns(count, amounts.data() + first, days.data() + first, categories.data() + first, names,
+		descriptionOffsets.data() + first, descriptionHeap.data());
+}
+
+void ExpenseBatch::AppendTo(ExpenseStore& store, const std::vector<bool>& skip) const
+{
+	ExpenseBatch kept;
+	for (size_t row = 0; row < amounts.size(); row++) {
+		if (!skip[row]) {
+			kept.Add(Description(row), categoryNames[categories[row]], amounts[row], days[row]);
+		}
+	}
+	kept.AppendTo(store);
+}
+
+std::string_view ExpenseBatch::Description(size_t row) const
+{
+	return std::string_view(descriptionHeap.data() + descriptionOffsets[row], descriptionOffsets[row + 1] - descriptionOffsets[row]);
+}
+
+bool AddExpenseToFile(const ExpenseStore& store, const std::string& fileName, uint64_t sequence)
+{
+	std::ofstream ostream(fileName);
+	ostream << store.Size();
+
+	// Build each line in one reusable buffer instead of copying every field into its own string
+	std::string line;
+	for (ExpenseStore::RowId row = 0; row < store.Size(); row++) {
+		line.assign(1, '\n');
+		line.append(store.Description(row));
+		line += ' ';
+		size_t categoryStart = line.size();
+		line.append(store.Category(row));
+		std::replace(line.begin(), line.begin() + categoryStart - 1, ' ', '_');
+		std::replace(line.begin() + categoryStart, line.end(), ' ', '_');
+		line += ' ';
+		line += FormatAmountCents(store.AmountCents(row));
+		line += ' ';
+		line += FormatIsoDate(store.Day(row));
+		ostream.write(line.data(), static_cast<std::streamsize>(line.size()));
+	}
+
+	if (sequence != 0) {
+		ostream << "\n#sequence " << sequence;
+	}
+	ostream.flush();
+	return ostream.good();
+}
+
+size_t LoadExpenseFromFile(ExpenseStore& store, const std::string& fileName, uint64_t* sequence)
+{
+	ExpenseParseReport report;
+	ParseExpenseFile(fileName, store, report);
+	if (sequence) {
+		*sequence = report.sequence;
+	}
+	return report.skippedLines;
+}
@@ -0,0 +1,146 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "Expense.h"
+#include "TextArena.h"
+
+// Memory held by an ExpenseStore, by what it is used for
+struct ExpenseStoreMemory
+{
+	size_t rows = 0;
+	uint64_t columnBytes = 0;           // amount, day, category, description reference and hash columns
+	uint64_t descriptionBytes = 0;      // live description text
+	uint64_t deadDescriptionBytes = 0;  // text of removed rows not yet compacted away
+	uint64_t arenaBytes = 0;            // allocated for description text, including unused chunk tails
+	size_t arenaChunks = 0;
+	uint64_t categoryBytes = 0;         // the category dictionary and its lookup
+
+	uint64_t TotalBytes() const { return columnBytes + arenaBytes + categoryBytes; }
+	double BytesPerRow() const { return rows ? static_cast<double>(TotalBytes()) / rows : 0; }
+};
+
+// Column-oriented, GUI-independent storage for all expenses.
+// Amounts are integer cents, dates are day numbers, categories are ids into a
+// dictionary and descriptions live back to back in a TextArena, with a hash of each kept
+// alongside so grouping by description never rehashes the text. Rows are read through
+// their id and views; nothing hands out a row as a copy except GetExpense.
+class ExpenseStore
+{
+public:
+	using RowId = uint32_t;
+	using CategoryId = uint32_t;
+	static constexpr CategoryId NoCategory = UINT32_MAX;
+	static constexpr RowId NoRow = UINT32_MAX;
+
+	// The hash kept for each description; equal descriptions have equal hashes
+	static uint32_t HashDescription(std::string_view description);
+
+	ExpenseStore() = default;
+	ExpenseStore(const ExpenseStore& other);
+	ExpenseStore& operator=(const ExpenseStore& other);
+	ExpenseStore(ExpenseStore&&) = default;
+	ExpenseStore& operator=(ExpenseStore&&) = default;
+
+	size_t Size() const { return amounts.size(); }
+	bool Empty() const { return amounts.empty(); }
+	void Reserve(size_t rows, size_t descriptionBytes = 0);
+
+	RowId Add(std::string_view description, std::string_view category, int64_t amountCents, int32_t day);
+	// Parses the text fields of an Expense; returns false (and adds nothing) if the amount or date is invalid
+	bool Add(const Expense& expense);
+	// Bulk append of already decoded columns. columnCategories maps the ids in categories to names and
+	// heapOffsets holds count + 1 offsets of the descriptions in heap.
+	void AppendColumns(size_t count, const int64_t* amountCents, const int32_t* dayNumbers, const uint32_t* categories,
+		const std::vector<std::string_view>& columnCategories, const uint64_t* heapOffsets, const char* heap);
+	// Puts a row at position row, shifting the later rows up by one (the inverse of Remove)
+	RowId Insert(RowId row, std::string_view description, std::string_view category, int64_t amountCents, int32_t day);
+	void Remove(RowId row);
+	// Removes many rows in one O(n) pass; rows must be ascending and distinct
+	void RemoveRows(const std::vector<RowId>& rows);
+	// Puts rows back at the ascending positions they will have afterwards, in one O(n) pass (the inverse of RemoveRows)
+	void InsertRows(const std::vector<RowId>& positions, const ExpenseStore& rows);
+	// The id every row will have once RemoveRows(rows) has run, NoRow for the removed ones, so
+	// side indexes can renumber in one pass
+	std::vector<RowId> IdsAfterRemoving(const std::vector<RowId>& rows) const;
+	void Clear();
+	// Clear that hands the rows back instead of dropping them, in O(1)
+	ExpenseStore TakeRows();
+	// Puts back rows taken by TakeRows, in O(1); this store must be empty
+	void RestoreRows(ExpenseStore&& rows);
+
+	std::string_view Description(RowId row) const { return std::string_view(descriptionText[row], descriptionLengths[row]); }
+	CategoryId CategoryOf(RowId row) const { return categoryIds[row]; }
+	std::string_view Category(RowId row) const { return categoryNames[categoryIds[row]]; }
+	int64_t AmountCents(RowId row) const { return amounts[row]; }
+	int32_t Day(RowId row) const { return days[row]; }
+	Expense GetExpense(RowId row) const;
+
+	// Direct access to the columns for scans
+	const std::vector<int64_t>& Amounts() const { return amounts; }
+	const std::vector<int32_t>& Days() const { return days; }
+	const std::vector<CategoryId>& CategoryIds() const { return categoryIds; }
+	const std::vector<uint32_t>& DescriptionHashes() const { return descriptionHashes; }
+
+	// Category dictionary
+	CategoryId InternCategory(std::string_view name);
+	CategoryId FindCategory(std::string_view name) const;
+	std::string_view CategoryName(CategoryId id) const { return categoryNames[id]; }
+	size_t CategoryCount() const { return categoryNames.size(); }
+
+	ExpenseStoreMemory MemoryUsage() const;
+
+private:
+	std::vector<int64_t> amounts;
+	std::vector<int32_t> days;
+	std::vector<CategoryId> categoryIds;
+	std::vector<const char*> descriptionText;   // into descriptionArena
+	std::vector<uint32_t> descriptionLengths;
+	std::vector<uint32_t> descriptionHashes;
+	TextArena descriptionArena;
+	size_t deadDescriptionBytes = 0;
+
+	// deque keeps the names at stable addresses so the lookup can key on string_view
+	std::deque<std::string> categoryNames;
+	std::unordered_map<std::string_view, CategoryId> categoryLookup;
+
+	void CompactDescriptions();
+};
+
+// Rows in store column layout, built away from the store (on a worker thread, say) and
+// appended to it in one go with AppendColumns
+struct ExpenseBatch
+{
+	std::vector<int64_t> amounts;
+	std::vector<int32_t> days;
+	std::vector<uint32_t> categories;              // ids into categoryNames
+	std::vector<uint64_t> descriptionOffsets{ 0 };
+	std::string descriptionHeap;
+	std::deque<std::string> categoryNames;
+
+	ExpenseBatch() = default;
+	ExpenseBatch(const ExpenseBatch&) = delete;
+	ExpenseBatch& operator=(const ExpenseBatch&) = delete;
+
+	size_t Size() const { return amounts.size(); }
+	void Reserve(size_t rows);
+	void Add(std::string_view description, std::string_view category, int64_t amountCents, int32_t day);
+	void AppendTo(ExpenseStore& store) const;
+	// Appends count rows starting at first
+	void AppendTo(ExpenseStore& store, size_t first, size_t count) const;
+	// Appends only the rows whose skip flag is not set
+	void AppendTo(ExpenseStore& store, const std::vector<bool>& skip) const;
+	std::string_view Description(size_t row) const;
+
+private:
+	std::unordered_map<std::string_view, uint32_t> categoryLookup;  // keys point into categoryNames
+};
+
+// A non-zero sequence is written as a trailing "#sequence N" line that legacy readers never reach.
+// Returns false if the file could not be written completely.
+bool AddExpenseToFile(const ExpenseStore& store, const std::string& fileName, uint64_t sequence = 0);
+// Returns the number of rows that were skipped because their amount or date could not be parsed
+size_t LoadExpenseFromFile(ExpenseStore& store, const std::string& fileName, uint64_t* sequence = nullptr);
@@ -0,0 +1,236 @@
+#include "ExpenseTotals.h"
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define BACHAT_X86_64 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define BACHAT_TARGET_AVX2
+#else
+#define BACHAT_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace {
+	int64_t SumCentsScalar(const int64_t* cents, size_t count) {
+		int64_t sum = 0;
+		for (size_t i = 0; i < count; i++) {
+			sum += cents[i];
+		}
+		return sum;
+	}
+
+	int64_t SumCentsBetweenScalar(const int64_t* cents, const int32_t* days, size_t count, int32_t fromDay, int32_t toDay) {
+		int64_t sum = 0;
+		for (size_t i = 0; i < count; i++) {
+			sum += (days[i] >= fromDay && days[i] <= toDay) ? cents[i] : 0;
+		}
+		return sum;
+	}
+
+#ifdef BACHAT_X86_64
+	bool HasAvx2() {
+#ifdef _MSC_VER
+		// AVX2 needs the CPU flag and the OS saving the upper halves of the ymm registers
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) {
+			return false;
+		}
+		__cpuid(info, 1);
+		bool osSavesYmm = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+		__cpuidex(info, 7, 0);
+		return osSavesYmm && (info[1] & (1 << 5));
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+
+	const bool UseAvx2 = HasAvx2();
+
+	int64_t HorizontalSum(__m128i sum) {
+		int64_t lanes[2];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum);
+		return lanes[0] + lanes[1];
+	}
+
+	// Two accumulators hide the add latency; SSE2 is part of every x86-64 CPU
+	int64_t SumCentsSse2(const int64_t* cents, size_t count) {
+		__m128i sum0 = _mm_setzero_si128(), sum1 = _mm_setzero_si128();
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4) {
+			sum0 = _mm_add_epi64(sum0, _mm_loadu_si128(reinterpret_cast<const __m128i*>(cents + i)));
+			sum1 = _mm_add_epi64(sum1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(cents + i + 2)));
+		}
+		return HorizontalSum(_mm_add_epi64(sum0, sum1)) + SumCentsScalar(cents + i, count - i);
+	}
+
+	BACHAT_TARGET_AVX2 int64_t SumCentsAvx2(const int64_t* cents, size_t count) {
+		__m256i sum0 = _mm256_setzero_si256(), sum1 = _mm256_setzero_si256();
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			sum0 = _mm256_add_epi64(sum0, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cents + i)));
+			sum1 = _mm256_add_epi64(sum1, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cents + i + 4)));
+		}
+		__m256i sum = _mm256_add_epi64(sum0, sum1);
+		__m128i half = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+		return HorizontalSum(half) + SumCentsScalar(cents + i, count - i);
+	}
+
+	// The day comparison gives 32-bit masks; unpacking each mask with itself widens it to the
+	// 64-bit lanes of the amounts
+	int64_t SumCentsBetweenSse2(const int64_t* cents, const int32_t* days, size_t count, int32_t fromDay, int32_t toDay) {
+		const __m128i from = _mm_set1_epi32(fromDay), to = _mm_set1_epi32(toDay);
+		__m128i sum = _mm_setzero_si128();
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4) {
+			__m128i day = _mm_loadu_si128(reinterpret_cast<const __m128i*>(days + i));
+			__m128i outside = _mm_or_si128(_mm_cmplt_epi32(day, from), _mm_cmpgt_epi32(day, to));
+			__m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cents + i));
+			__m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cents + i + 2));
+			sum = _mm_add_epi64(sum, _mm_andnot_si128(_mm_unpacklo_epi32(outside, outside), low));
+			sum = _mm_add_epi64(sum, _mm_andnot_si128(_mm_unpackhi_epi32(outside, outside), high));
+		}
+		return HorizontalSum(sum) + SumCentsBetweenScalar(cents + i, days + i, count - i, fromDay, toDay);
+	}
+
+	BACHAT_TARGET_AVX2 int64_t SumCentsBetweenAvx2(const int64_t* cents, const int32_t* days, size_t count, int32_t fromDay, int32_t toDay) {
+		const __m256i from = _mm256_set1_epi32(fromDay), to = _mm256_set1_epi32(toDay);
+		__m256i sum = _mm256_setzero_si256();
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			__m256i day = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(days + i));
+			__m256i outside = _mm256_or_si256(_mm256_cmpgt_epi32(from, day), _mm256_cmpgt_epi32(day, to));
+			// Sign extension widens each all-ones or all-zeros mask to 64 bits
+			__m256i low = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(outside));
+			__m256i high = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(outside, 1));
+			sum = _mm256_add_epi64(sum, _mm256_andnot_si256(low, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cents + i))));
+			sum = _mm256_add_epi64(sum, _mm256_andnot_si256(high, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cents + i + 4))));
+		}
+		__m128i half = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+		return HorizontalSum(half) + SumCentsBetweenScalar(cents + i, days + i, count - i, fromDay, toDay);
+	}
+#endif
+}
+
+ExpenseTotalsCache::ExpenseTotalsCache(const ExpenseStore& store)
+	: store(store)
+{
+}
+
+void ExpenseTotalsCache::Insert(ExpenseStore::RowId row)
+{
+	if (!built) {
+		return;
+	}
+	Sum& sum = sums[KeyOf(MonthOfDay(store.Day(row)), store.CategoryOf(row))];
+	sum.cents += store.AmountCents(row);
+	sum.rows++;
+}
+
+void ExpenseTotalsCache::EraseRows(const std::vector<ExpenseStore::RowId>& rows)
+{
+	// A cell only depends on its rows' values, so rows leave one at a time in O(1) each
+	for (ExpenseStore::RowId row : rows) {
+		Erase(row);
+	}
+}
+
+void ExpenseTotalsCache::Erase(ExpenseStore::RowId row)
+{
+	if (!built) {
+		return;
+	}
+	auto it = sums.find(KeyOf(MonthOfDay(store.Day(row)), store.CategoryOf(row)));
+	if (it == sums.end()) {
+		return;
+	}
+	it->second.cents -= store.AmountCents(row);
+	// A cell disappears together with its last row, like it would in a fresh scan
+	if (--it->second.rows == 0) {
+		sums.erase(it);
+	}
+}
+
+void ExpenseTotalsCache::Clear()
+{
+	sums.clear();
+	built = false;
+}
+
+std::vector<ExpenseTotalsCache::Cell> ExpenseTotalsCache::Cells()
+{
+	Build();
+	std::vector<Cell> cells;
+	cells.reserve(sums.size());
+	for (const auto& [key, sum] : sums) {
+		cells.push_back(Cell{ static_cast<int32_t>(key >> 32), static_cast<ExpenseStore::CategoryId>(key & 0xFFFFFFFFu), sum.cents, sum.rows });
+	}
+	std::sort(cells.begin(), cells.end(), [this](const Cell& a, const Cell& b) {
+		if (a.month != b.month) {
+			return a.month < b.month;
+		}
+		return store.CategoryName(a.category) < store.CategoryName(b.category);
+		});
+	return cells;
+}
+
+int64_t ExpenseTotalsCache::Total(int32_t month, ExpenseStore::CategoryId category)
+{
+	Build();
+	auto it = sums.find(KeyOf(month, category));
+	return it == sums.end() ? 0 : it->second.cents;
+}
+
+void ExpenseTotalsCache::Build()
+{
+	if (built) {
+		return;
+	}
+	// Rows are mostly appended in date order, so the month only needs recomputing when the day changes
+	const std::vector<int64_t>& amounts = store.Amounts();
+	const std::vector<int32_t>& days = store.Days();
+	const std::vector<ExpenseStore::CategoryId>& categories = store.CategoryIds();
+	int32_t lastDay = 0, month = MonthOfDay(0);
+	for (size_t row = 0; row < amounts.size(); row++) {
+		if (days[row] != lastDay) {
+			lastDay = days[row];
+			month = MonthOfDay(lastDay);
+		}
+		Sum& sum = sums[KeyOf(month, categories[row])];
+		sum.cents += amounts[row];
+		sum.rows++;
+	}
+	built = true;
+}
+
+int64_t SumCents(const int64_t* cents, size_t count)
+{
+#ifdef BACHAT_X86_64
+	return UseAvx2 ? SumCentsAvx2(cents, count) : SumCentsSse2(cents, count);
+#else
+	return SumCentsScalar(cents, count);
+#endif
+}
+
+int64_t SumCentsBetween(const int64_t* cents, const int32_t* days, size_t count, int32_t fromDay, int32_t toDay)
+{
+#ifdef BACHAT_X86_64
+	return UseAvx2 ? SumCentsBetweenAvx2(cents, days, count, fromDay, toDay) : SumCentsBetweenSse2(cents, days, count, fromDay, toDay);
+#else
+	return SumCentsBetweenScalar(cents, days, count, fromDay, toDay);
+#endif
+}
+
+std::vector<SumCentsPath> SumCentsPaths()
+{
+	std::vector<SumCentsPath> paths = { { "scalar", SumCentsScalar, SumCentsBetweenScalar } };
+#ifdef BACHAT_X86_64
+	paths.push_back({ "sse2", SumCentsSse2, SumCentsBetweenSse2 });
+	if (UseAvx2) {
+		paths.push_back({ "avx2", SumCentsAvx2, SumCentsBetweenAvx2 });
+	}
+#endif
+	return paths;
+}
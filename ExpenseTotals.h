@@ -0,0 +1,68 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "ExpenseStore.h"
+
+// Running month x category totals in exact integer cents.
+// The table is built from the store once, the first time it is read, and from then on every
+// add and remove adjusts a single cell in O(1).
+class ExpenseTotalsCache
+{
+public:
+	struct Cell
+	{
+		int32_t month;                        // see MonthOfDay
+		ExpenseStore::CategoryId category;
+		int64_t cents;
+		size_t rows;
+	};
+
+	explicit ExpenseTotalsCache(const ExpenseStore& store);
+
+	// Call after the row was added to the store
+	void Insert(ExpenseStore::RowId row);
+	// Call before the row is removed from the store
+	void Erase(ExpenseStore::RowId row);
+	// Call before the ascending rows are removed from the store with RemoveRows
+	void EraseRows(const std::vector<ExpenseStore::RowId>& rows);
+	void Clear();
+
+	// Non-empty cells ordered by month, then by category name
+	std::vector<Cell> Cells();
+	int64_t Total(int32_t month, ExpenseStore::CategoryId category);
+
+private:
+	struct Sum
+	{
+		int64_t cents = 0;
+		size_t rows = 0;
+	};
+
+	const ExpenseStore& store;
+	std::unordered_map<uint64_t, Sum> sums;  // (month << 32 | category) -> sum
+	bool built = false;
+
+	static uint64_t KeyOf(int32_t month, ExpenseStore::CategoryId category) {
+		return (static_cast<uint64_t>(static_cast<uint32_t>(month)) << 32) | category;
+	}
+	void Build();
+};
+
+// Exact sum of an amount column. Runs on AVX2 when the CPU has it, SSE2 on other x86-64 CPUs
+// and a plain loop elsewhere; all integer adds, so every path gives the same result.
+int64_t SumCents(const int64_t* cents, size_t count);
+// Sum of the amounts whose day falls in [fromDay, toDay], scanning both columns side by side
+// without branches
+int64_t SumCentsBetween(const int64_t* cents, const int32_t* days, size_t count, int32_t fromDay, int32_t toDay);
+
+// The implementations the two choose from, each of which must give the same sums: the plain
+// loops first, then those this CPU can run
+struct SumCentsPath
+{
+	const char* name;
+	int64_t (*sum)(const int64_t* cents, size_t count);
+	int64_t (*sumBetween)(const int64_t* cents, const int32_t* days, size_t count, int32_t fromDay, int32_t toDay);
+};
+std::vector<SumCentsPath> SumCentsPaths();
@@ -0,0 +1,83 @@
+#include "ExpenseUndoStack.h"
+
+ExpenseUndoStack::Step ExpenseUndoStack::RowStep(Action action, const ExpenseStore& store, ExpenseStore::RowId row)
+{
+	Step step;
+	step.action = action;
+	step.row = row;
+	step.description = std::string(store.Description(row));
+	step.category = std::string(store.Category(row));
+	step.amountCents = store.AmountCents(row);
+	step.day = store.Day(row);
+	return step;
+}
+
+ExpenseUndoStack::Step ExpenseUndoStack::RemoveRowsStep(const ExpenseStore& store, const std::vector<ExpenseStore::RowId>& rows)
+{
+	Step step;
+	step.action = Action::RemoveRows;
+	step.positions = rows;
+	step.rows.Reserve(rows.size());
+	for (ExpenseStore::RowId row : rows) {
+		step.rows.Add(store.Description(row), store.Category(row), store.AmountCents(row), store.Day(row));
+	}
+	return step;
+}
+
+void ExpenseUndoStack::Record(Step step)
+{
+	redoSteps.clear();
+	Redone(std::move(step));
+}
+
+bool ExpenseUndoStack::TakeUndo(Step& step)
+{
+	if (undoSteps.empty()) {
+		return false;
+	}
+	step = std::move(undoSteps.back());
+	undoSteps.pop_back();
+	return true;
+}
+
+bool ExpenseUndoStack::TakeRedo(Step& step)
+{
+	if (redoSteps.empty()) {
+		return false;
+	}
+	step = std::move(redoSteps.back());
+	redoSteps.pop_back();
+	return true;
+}
+
+void ExpenseUndoStack::Undone(Step step)
+{
+	redoSteps.push_back(std::move(step));
+}
+
+void ExpenseUndoStack::Redone(Step step)
+{
+	undoSteps.push_back(std::move(step));
+	// Dropping the oldest step is safe, as newer steps never depend on it
+	if (undoSteps.size() > MaxSteps) {
+		undoSteps.pop_front();
+	}
+}
+
+void ExpenseUndoStack::Clear()
+{
+	undoSteps.clear();
+	redoSteps.clear();
+}
+
+void ExpenseUndoStack::ShiftRows(ExpenseStore::RowId rows)
+{
+	for (std::deque<Step>* steps : { &undoSteps, &redoSteps }) {
+		for (Step& step : *steps) {
+			step.row += rows;
+			for (ExpenseStore::RowId& position : step.positions) {
+				position += rows;
+			}
+		}
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+#include "ExpenseSegments.h"
+#include "ExpenseStore.h"
+
+// Undo and redo history of the changes made in the app. A step keeps only what its change
+// touched: the rows an add or remove affected, or for a clear the cleared rows themselves,
+// moved out of the store by TakeRows instead of copied. A step therefore costs memory for the
+// rows it changed, never for the rest of the history. Row ids are positions, so steps are only
+// valid while they are undone newest first; a change made without a step (an import, say)
+// must Clear the history.
+class ExpenseUndoStack
+{
+public:
+	enum class Action { Add, Remove, RemoveRows, Clear };
+
+	struct Step
+	{
+		Action action = Action::Add;
+		ExpenseStore::RowId row = 0;       // Add, Remove: the row and its values
+		std::string description;
+		std::string category;
+		int64_t amountCents = 0;
+		int32_t day = 0;
+		ExpenseStore rows;                 // Clear, RemoveRows: the rows that went
+		std::vector<ExpenseStore::RowId> positions;  // RemoveRows: where they were, ascending
+		ExpenseSegmentLayout segments;     // Clear: the journal's segments before it, and its record
+		uint64_t sequence = 0;
+	};
+
+	// A step for adding or removing a row that is in the store
+	static Step RowStep(Action action, const ExpenseStore& store, ExpenseStore::RowId row);
+	// A step for removing the ascending rows, which are copied; O(rows) rather than O(store)
+	static Step RemoveRowsStep(const ExpenseStore& store, const std::vector<ExpenseStore::RowId>& rows);
+
+	// Records a change just made; whatever could be redone is dropped
+	void Record(Step step);
+	// Hand out the step to undo or redo; once the caller has applied it, it goes back with
+	// Undone or Redone so it can travel the other way
+	bool TakeUndo(Step& step);
+	bool TakeRedo(Step& step);
+	void Undone(Step step);
+	void Redone(Step step);
+	void Clear();
+	// Call after rows were put in front of every row the steps refer to, as the older history
+	// is once it has loaded
+	void ShiftRows(ExpenseStore::RowId rows);
+
+	bool CanUndo() const { return !undoSteps.empty(); }
+	bool CanRedo() const { return !redoSteps.empty(); }
+
+private:
+	static constexpr size_t MaxSteps = 1000;
+
+	std::deque<Step> undoSteps;
+	std::deque<Step> redoSteps;
+};
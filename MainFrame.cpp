@@ -1,12 +1,25 @@
 #include "MainFrame.h"
 #include <wx/wx.h>
 #include <wx/listctrl.h>
+#include <wx/textcompleter.h>
+#include <wx/checklst.h>
+#include <wx/grid.h>
+#include <wx/dcbuffer.h>
 #include "Expense.h"
+#include "ExpenseStore.h"
+#include "ExpenseCsv.h"
+#include "ExpensePivot.h"
 #include <vector>
 #include <algorithm>
 #include <fstream>
 #include <cstdlib>
-#include <map>
+#include <cmath>
+#include <limits>
+
+// Posted by the import pipeline's committer thread with a std::shared_ptr<ExpenseImporter::Batch>
+wxDEFINE_EVENT(EVT_IMPORT_BATCH, wxThreadEvent);
+// Posted by the history loader's thread with a std::shared_ptr<ExpenseHistoryLoader::Batch>
+wxDEFINE_EVENT(EVT_LOAD_BATCH, wxThreadEvent);
 
 // Color Palette Constants from https://coolors.co/palette/f8f9fa-e9ecef-dee2e6-ced4da-adb5bd-6c757d-495057-343a40-212529
 namespace ColorPalette {
@@ -21,30 +34,31 @@ namespace ColorPalette {
 	const wxColour RICH_BLACK(33, 37, 41);          // #212529
 }
 
-// Helper to extract all expenses from the list control
-std::vector<Expense> GetExpensesFromListCtrl(wxListCtrl* listCtrl) {
-	std::vector<Expense> expenses;
-	for (int i = 0; i < listCtrl->GetItemCount(); ++i) {
-		Expense exp;
-		exp.description = listCtrl->GetItemText(i, 0);
-		exp.category = listCtrl->GetItemText(i, 1);
-		exp.amount = listCtrl->GetItemText(i, 2);
-		exp.date = listCtrl->GetItemText(i, 3);
-		expenses.push_back(exp);
-	}
-	return expenses;
+// Helper to turn a view into the store into a wxString
+wxString ToWxString(std::string_view text) {
+	return wxString(text.data(), text.size());
 }
 
-// Helper to reload expenses into the list control
-void LoadExpensesToListCtrl(wxListCtrl* listCtrl, const std::vector<Expense>& expenses) {
-	listCtrl->DeleteAllItems();
-	for (const auto& exp : expenses) {
-		long idx = listCtrl->InsertItem(listCtrl->GetItemCount(), exp.description);
-		listCtrl->SetItem(idx, 1, exp.category);
-		listCtrl->SetItem(idx, 2, exp.amount);
-		listCtrl->SetItem(idx, 3, exp.date);
+// Suggests categories for the typed prefix, most used first
+class CategoryCompleter : public wxTextCompleterSimple {
+public:
+	CategoryCompleter(const ExpenseStore& store, ExpenseCategoryIndex& categoryIndex)
+		: store(store), categoryIndex(categoryIndex)
+	{
 	}
-}
+
+	void GetCompletions(const wxString& prefix, wxArrayString& res) override {
+		for (ExpenseStore::CategoryId id : categoryIndex.Complete(prefix.ToStdString(), MaxSuggestions)) {
+			res.Add(ToWxString(store.CategoryName(id)));
+		}
+	}
+
+private:
+	static constexpr size_t MaxSuggestions = 20;
+
+	const ExpenseStore& store;
+	ExpenseCategoryIndex& categoryIndex;
+};
 
 
 MainFrame::MainFrame(const wxString& title) : wxFrame(nullptr, wxID_ANY, title) {
@@ -110,6 +124,7 @@ void MainFrame::CreateControls() {
 	wxBoxSizer* catSizer = new wxBoxSizer(wxVERTICAL);
 	catText = new wxStaticText(panel, wxID_ANY, "Category");
 	catInput = new wxComboBox(panel, wxID_ANY, "", wxDefaultPosition, wxDefaultSize, 0, nullptr, wxCB_DROPDOWN);
+	catInput->AutoComplete(new CategoryCompleter(store, categoryIndex));  // the combo box owns the completer
 	catSizer->Add(catText, 0, wxBOTTOM, 5);
 	catSizer->Add(catInput, 1, wxEXPAND);
 	row1Sizer->Add(catSizer, 1, wxLEFT, 10);
@@ -144,8 +159,23 @@ void MainFrame::CreateControls() {
 
 	mainSizer->Add(inputSizer, 0, wxEXPAND | wxLEFT | wxRIGHT | wxBOTTOM, 10);
 
+	// Filter bar: only show expenses between two dates and/or matching a search
+	wxBoxSizer* filterSizer = new wxBoxSizer(wxHORIZONTAL);
+	dateFilterCheck = new wxCheckBox(panel, wxID_ANY, "Show from");
+	filterFromInput = new wxDatePickerCtrl(panel, wxID_ANY, wxDateTime::Today().SetDay(1));
+	filterToText = new wxStaticText(panel, wxID_ANY, "to");
+	filterToInput = new wxDatePickerCtrl(panel, wxID_ANY, wxDateTime::Today());
+	filterSizer->Add(dateFilterCheck, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 10);
+	filterSizer->Add(filterFromInput, 0, wxRIGHT, 10);
+	filterSizer->Add(filterToText, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 10);
+	filterSizer->Add(filterToInput, 0, wxRIGHT, 20);
+	searchInput = new wxTextCtrl(panel, wxID_ANY);
+	searchInput->SetHint("Search descriptions");
+	filterSizer->Add(searchInput, 1, wxEXPAND);
+	mainSizer->Add(filterSizer, 0, wxEXPAND | wxLEFT | wxRIGHT, 10);
+
 	// List control for expenses
-	listCtrl = new wxListCtrl(panel, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxLC_REPORT | wxBORDER_SUNKEN);
+	listCtrl = new ExpenseListCtrl(panel, store);
 	listCtrl->Bind(wxEVT_SIZE, &MainFrame::OnListCtrlResize, this);
 
 	listCtrl->InsertColumn(0, "Description", wxLIST_FORMAT_CENTER, 250);
@@ -166,12 +196,27 @@ void MainFrame::CreateControls() {
 
 
 
+	importButton = new wxButton(panel, wxID_ANY, "Import CSV");
+	importButton->SetMinSize(wxSize(130, -1));
+
+	diagnosticsButton = new wxButton(panel, wxID_ANY, "Diagnostics");
+	diagnosticsButton->SetMinSize(wxSize(130, -1));
+
+	plotButton = new wxButton(panel, wxID_ANY, "Charts");
+	plotButton->SetMinSize(wxSize(100, -1));
+
 	clearButton = new wxButton(panel, wxID_ANY, "Clear");
 	clearButton->SetMinSize(wxSize(100, -1));
 
+	totalText = new wxStaticText(panel, wxID_ANY, "");
+
 	buttonSizer->Add(settingsButton, 0, wxRIGHT, 10);
+	buttonSizer->Add(totalText, 0, wxALIGN_CENTER_VERTICAL | wxLEFT, 10);
 	buttonSizer->AddStretchSpacer(1);
 
+	buttonSizer->Add(plotButton, 0, wxRIGHT, 10);
+	buttonSizer->Add(diagnosticsButton, 0, wxRIGHT, 10);
+	buttonSizer->Add(importButton, 0, wxRIGHT, 10);
 	buttonSizer->Add(clearButton, 0);
 
 	mainSizer->Add(buttonSizer, 0, wxEXPAND | wxALL, 10);
@@ -241,6 +286,24 @@ void MainFrame::BindEvents() {
 	listCtrl->Bind(wxEVT_KEY_DOWN, &MainFrame::OnKeyDown, this);
 	this->Bind(wxEVT_CLOSE_WINDOW, &MainFrame::OnWindowClosed, this);
 	listCtrl->Bind(wxEVT_LIST_COL_CLICK, &MainFrame::OnListColClick, this);
+	dateFilterCheck->Bind(wxEVT_CHECKBOX, &MainFrame::OnDateFilterChanged, this);
+	filterFromInput->Bind(wxEVT_DATE_CHANGED, &MainFrame::OnDateFilterChanged, this);
+	filterToInput->Bind(wxEVT_DATE_CHANGED, &MainFrame::OnDateFilterChanged, this);
+	searchInput->Bind(wxEVT_TEXT, &MainFrame::OnSearchChanged, this);
+	importButton->Bind(wxEVT_BUTTON, &MainFrame::OnImportButtonClicked, this);
+	diagnosticsButton->Bind(wxEVT_BUTTON, &MainFrame::OnDiagnosticsButtonClicked, this);
+	plotButton->Bind(wxEVT_BUTTON, &MainFrame::OnPlotButtonClicked, this);
+	this->Bind(EVT_IMPORT_BATCH, &MainFrame::OnImportBatch, this);
+	this->Bind(EVT_LOAD_BATCH, &MainFrame::OnLoadBatch, this);
+
+	// Ctrl+Z and Ctrl+Y undo and redo anywhere in the window
+	wxAcceleratorEntry shortcuts[] = {
+		wxAcceleratorEntry(wxACCEL_CTRL, 'Z', wxID_UNDO),
+		wxAcceleratorEntry(wxACCEL_CTRL, 'Y', wxID_REDO),
+	};
+	SetAcceleratorTable(wxAcceleratorTable(2, shortcuts));
+	this->Bind(wxEVT_MENU, &MainFrame::OnUndo, this, wxID_UNDO);
+	this->Bind(wxEVT_MENU, &MainFrame::OnRedo, this, wxID_REDO);
 	settingsButton->Bind(wxEVT_BUTTON, &MainFrame::OnSettingsButtonClicked, this);
 
 
@@ -250,13 +313,11 @@ void MainFrame::BindEvents() {
 }
 
 void MainFrame::AddExpenseFromInput() {
+	if ((loader && !loadingOlder) || historyUnreadable || !JournalWritable()) {
+		return; // The journal only takes changes once it is resumed
+	}
 	wxString desc = descInput->GetValue();
 	wxString cat = catInput->GetValue();
-	// Add new category to the combo box if not already present
-	if (!cat.IsEmpty() && catInput->FindString(cat) == wxNOT_FOUND) {
-		catInput->Append(cat);
-		categoryList.push_back(cat);
-	}
 	wxString amount = amountInput->GetValue();
 	wxString date = dateInput->GetValue().FormatISODate();
 
@@ -266,11 +327,19 @@ void MainFrame::AddExpenseFromInput() {
 		return;
 	}
 
-	// Adding each field values to the list
-	long index = listCtrl->InsertItem(listCtrl->GetItemCount(), desc);
-	listCtrl->SetItem(index, 1, cat);
-	listCtrl->SetItem(index, 2, amount);
-	listCtrl->SetItem(index, 3, date);
+	// Error handling for when the amount is not a number
+	Money money;
+	if (!Money::Parse(amount.ToStdString(), money)) {
+		wxMessageBox("Please enter a valid amount!");
+		return;
+	}
+	int32_t day;
+	ParseIsoDate(date.ToStdString(), day);
+
+	// Adding the expense to the store; a sorted list shows it at its sorted position
+	ExpenseStore::RowId row = InsertRow(static_cast<ExpenseStore::RowId>(store.Size()), desc.ToStdString(), cat.ToStdString(), money.cents, day);
+	undoStack.Record(ExpenseUndoStack::RowStep(ExpenseUndoStack::Action::Add, store, row));
+	UpdateView();
 
 	// Clearing the input field after the values of the input fields have been listed
 	descInput->Clear();
@@ -288,14 +357,165 @@ void MainFrame::OnKeyDown(wxKeyEvent& evt) {
 }
 
 void MainFrame::DeleteExpense() {
-	long index = listCtrl->GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
+	if ((loader && !loadingOlder) || historyUnreadable || !JournalWritable()) {
+		return; // The journal only takes changes once it is resumed
+	}
+	std::vector<ExpenseStore::RowId> rows = listCtrl->SelectedRows();
 
-	if (index == -1) {
+	if (rows.empty()) {
 		wxMessageBox("No task is selected!");
 		return;
 	}
 
-	listCtrl->DeleteItem(index);
+	if (rows.size() == 1) {
+		undoStack.Record(ExpenseUndoStack::RowStep(ExpenseUndoStack::Action::Remove, store, rows[0]));
+		RemoveRow(rows[0]);
+	}
+	else {
+		undoStack.Record(ExpenseUndoStack::RemoveRowsStep(store, rows));
+		RemoveRows(rows);
+	}
+	listCtrl->ClearSelection();  // The selected items now show the rows that moved up
+	UpdateView();
+}
+
+// Puts a row into the store at position row, at the end for a new one, and logs and indexes it
+ExpenseStore::RowId MainFrame::InsertRow(ExpenseStore::RowId row, std::string_view description, std::string_view category, int64_t amountCents, int32_t day) {
+	size_t categoryCount = store.CategoryCount();
+	if (row == store.Size()) {
+		store.Add(description, category, amountCents, day);
+		journal.AppendAdd(store, row);
+	}
+	else {
+		store.Insert(row, description, category, amountCents, day);
+		journal.AppendInsert(store, row);
+	}
+	if (store.CategoryCount() > categoryCount) {
+		catInput->Append(ToWxString(category));  // The dictionary lookup already told us the category is new
+	}
+	journal.CompactIfNeeded(store);
+	sortIndex.Insert(row);
+	totalsCache.Insert(row);
+	dailySeries.Insert(row);
+	searchIndex.Insert(row);
+	categoryIndex.Insert(row);
+	duplicateIndex.Insert(row);
+	return row;
+}
+
+// Removing the row from the store shifts every later row id down by one
+void MainFrame::RemoveRow(ExpenseStore::RowId row) {
+	sortIndex.Erase(row);
+	totalsCache.Erase(row);
+	dailySeries.Erase(row);
+	searchIndex.Erase(row);
+	categoryIndex.Erase(row);
+	duplicateIndex.Erase(row);
+	store.Remove(row);
+	journal.AppendRemove(row);
+	journal.CompactIfNeeded(store);
+}
+
+// Removes the ascending rows with one pass over the store and each index and a single journal
+// record, so deleting thousands of rows costs about as much as deleting one
+void MainFrame::RemoveRows(const std::vector<ExpenseStore::RowId>& rows) {
+	sortIndex.EraseRows(rows);
+	totalsCache.EraseRows(rows);
+	dailySeries.EraseRows(rows);
+	searchIndex.EraseRows(rows);
+	categoryIndex.EraseRows(rows);
+	duplicateIndex.EraseRows(rows);
+	store.RemoveRows(rows);
+	journal.AppendRemoveRows(rows);
+	journal.CompactIfNeeded(store);
+}
+
+// Empties the store and moves the rows into the clear's undo step, so it can be undone without a
+// copy, along with what the journal needs to log the undo as a single record
+void MainFrame::ClearRows(ExpenseUndoStack::Step& step) {
+	step.rows = store.TakeRows();
+	sortIndex.Clear();
+	totalsCache.Clear();
+	dailySeries.Clear();
+	searchIndex.Clear();
+	categoryIndex.Clear();
+	duplicateIndex.Clear();
+	step.segments = journal.AppendClear();
+	step.sequence = journal.LastSequence();
+	journal.CompactIfNeeded(store);
+}
+
+// Reverts the latest change. Ctrl+Z in a text field undoes the typing instead.
+void MainFrame::OnUndo(wxCommandEvent& evt) {
+	if (wxTextEntry* entry = dynamic_cast<wxTextEntry*>(wxWindow::FindFocus())) {
+		entry->Undo();
+		return;
+	}
+	ExpenseUndoStack::Step step;
+	if ((loader && !loadingOlder) || importer || !undoStack.CanUndo() || !JournalWritable() || !undoStack.TakeUndo(step)) {
+		return;
+	}
+	switch (step.action) {
+	case ExpenseUndoStack::Action::Add:
+		RemoveRow(step.row);  // Later changes are undone first, so the added row is still the last
+		break;
+	case ExpenseUndoStack::Action::Remove:
+		InsertRow(step.row, step.description, step.category, step.amountCents, step.day);
+		break;
+	case ExpenseUndoStack::Action::RemoveRows:
+	case ExpenseUndoStack::Action::Clear:
+		// The rows go back in one pass (a clear's in O(1)) and the indexes rebuild on first use. A
+		// clear is undone with one record and leaves the segments as they were, unless a save has
+		// covered it since; its rows are then logged as adds. The others go in as one batch insert.
+		if (step.action == ExpenseUndoStack::Action::Clear) {
+			store.RestoreRows(std::move(step.rows));
+			if (!journal.AppendUndoClear(std::move(step.segments), step.sequence)) {
+				journal.AppendAdds(store, 0, static_cast<ExpenseStore::RowId>(store.Size()));
+			}
+		}
+		else {
+			store.InsertRows(step.positions, step.rows);
+			journal.AppendInsertRows(store, step.positions);
+		}
+		sortIndex.Clear();
+		totalsCache.Clear();
+		dailySeries.Clear();
+		searchIndex.Clear();
+		categoryIndex.Clear();
+		duplicateIndex.Clear();
+		journal.CompactIfNeeded(store);
+		break;
+	}
+	undoStack.Undone(std::move(step));
+	UpdateView();
+}
+
+// Makes the latest undone change again
+void MainFrame::OnRedo(wxCommandEvent& evt) {
+	if (wxTextEntry* entry = dynamic_cast<wxTextEntry*>(wxWindow::FindFocus())) {
+		entry->Redo();
+		return;
+	}
+	ExpenseUndoStack::Step step;
+	if ((loader && !loadingOlder) || importer || !undoStack.CanRedo() || !JournalWritable() || !undoStack.TakeRedo(step)) {
+		return;
+	}
+	switch (step.action) {
+	case ExpenseUndoStack::Action::Add:
+		InsertRow(step.row, step.description, step.category, step.amountCents, step.day);
+		break;
+	case ExpenseUndoStack::Action::Remove:
+		RemoveRow(step.row);
+		break;
+	case ExpenseUndoStack::Action::RemoveRows:
+		RemoveRows(step.positions);
+		break;
+	case ExpenseUndoStack::Action::Clear:
+		ClearRows(step);
+		break;
+	}
+	undoStack.Redone(std::move(step));
+	UpdateView();
 }
 
 // Event handling when add button is pressed
@@ -310,11 +530,15 @@ void MainFrame::OnInputEnter(wxCommandEvent& evt) {
 
 void MainFrame::OnClearButtonClicked(wxCommandEvent& evt) {
 	// Error handling for when the Clear button is pressed when there are no items in the list
-	if (listCtrl->GetItemCount() == 0) {
+	if (store.Empty()) {
 		wxMessageBox("There are no expenses!");
 		return;
 	}
 
+	if (!JournalWritable()) {
+		return;
+	}
+
 	// Dialog box to confirm that the user wants to clear the list
 	wxMessageDialog dialog(this, "Are you sure you want to clear all expenses?", "Clear", wxYES_NO | wxCANCEL);
 
@@ -323,7 +547,11 @@ void MainFrame::OnClearButtonClicked(wxCommandEvent& evt) {
 
 	// If the enum ID is matching with the enum ID of the yes button, then clear the input
 	if (result == wxID_YES) {
-		listCtrl->DeleteAllItems();
+		ExpenseUndoStack::Step step;
+		step.action = ExpenseUndoStack::Action::Clear;
+		ClearRows(step);
+		undoStack.Record(std::move(step));
+		UpdateView();
 	}
 }
 
@@ -340,101 +568,349 @@ void MainFrame::OnMouseLeave(wxMouseEvent& event) {
 }
 
 
-// Event Handling when the window is closed i.e., saving the list items in a text file
+// Event Handling when the window is closed. Every change is already in the journal,
+// so only a running compaction has to finish before the files are closed, unless a write to
+// the journal failed: the changes it missed are saved now, with a last try at the files.
 void MainFrame::OnWindowClosed(wxCloseEvent& evt) {
-	// Declaring a vector of Expense structures
-	std::vector<Expense> expenses;
-
-	// Iterating through the list
-	for (int i = 0; i < listCtrl->GetItemCount(); i++) {
-		Expense expense;           // Declaring a Expense structure
-		expense.description = listCtrl->GetItemText(i, 0); // Adding values from the list's column to the corresponding structure members
-		expense.category = listCtrl->GetItemText(i, 1);
-		expense.amount = listCtrl->GetItemText(i, 2);
-		expense.date = listCtrl->GetItemText(i, 3);
-		expenses.push_back(expense); // Adding the structure to the vector of structures
-	}
-	AddExpenseToFile(expenses, "expense.txt");  // Storing the vector in the text file
+	if (loader) {
+		loader->Cancel();  // any change made meanwhile is already in the journal
+		loader.reset();
+	}
+	if (importer) {
+		importer->Cancel();  // the rows committed so far are already in the journal
+		importer.reset();
+	}
+	if (journal.Failed() && !journal.Recover(store)) {
+		wxMessageBox("The latest changes could not be written to expense.journal or saved to expense.bbs "
+			"and are lost when the window closes.", "Expenses not saved", wxOK | wxICON_ERROR);
+	}
+	journal.Close();  // waits for a running compaction, so its save is in the dump
+	if (Diagnostics::Enabled()) {
+		Diagnostics::WriteJson("diagnostics.json");
+	}
 	evt.Skip();  // skipping event to prevent the window from not closing
 }
 
-// Adding saved expenses to the list from the text file to the list after the app has been re-opened
+// Adding saved expenses to the list after the app has been re-opened. The history is read on a
+// background thread and shown batch by batch, so the window is usable while a large file loads.
 void MainFrame::AddSavedExpense() {
-	catInput->Clear();
-	categoryList.clear();
-	std::vector<Expense> expenses = LoadExpenseFromFile("expense.txt");
+	undoStack.Clear();
+	store.Clear();
+	olderRows.Clear();
+	olderMonths.clear();
+	loadingOlder = false;
+	sortIndex.Clear();
+	totalsCache.Clear();
+	dailySeries.Clear();
+	searchIndex.Clear();
+	categoryIndex.Clear();
+	duplicateIndex.Clear();
+	UpdateView();
+
+	EnableEditing(false);
+	loader = std::make_unique<ExpenseHistoryLoader>();
+	loader->Start("expense.bbs", "expense.journal", "expense.txt", [this](std::shared_ptr<ExpenseHistoryLoader::Batch> batch) {
+		wxThreadEvent* event = new wxThreadEvent(EVT_LOAD_BATCH);
+		event->SetPayload(batch);
+		wxQueueEvent(this, event);
+		});
+}
 
-	for (const Expense& expense : expenses) {
-		int index = listCtrl->InsertItem(listCtrl->GetItemCount(), expense.description);
+// Appends one batch of the saved history and indexes it; the rows are already in the files
+void MainFrame::OnLoadBatch(wxThreadEvent& evt)
+{
+	std::shared_ptr<ExpenseHistoryLoader::Batch> batch = evt.GetPayload<std::shared_ptr<ExpenseHistoryLoader::Batch>>();
+	if (!loader) {
+		return; // Left over from a cancelled load
+	}
+	if (batch->last) {
+		FinishLoad(*batch);
+		return;
+	}
+	if (batch->newestLoaded) {
+		StartEditingNewest(*batch);
+		loader->Acknowledge();
+		return;
+	}
+	if (batch->older) {
+		// Kept aside, so the rows on show and the positions the journal logs stay as they are
+		batch->AppendTo(olderRows);
+		loader->Acknowledge();
+		return;
+	}
 
-		listCtrl->SetItem(index, 1, expense.category);
-		listCtrl->SetItem(index, 2, expense.amount);
-		listCtrl->SetItem(index, 3, expense.date);
+	size_t categoryCount = store.CategoryCount();
+	ExpenseStore::RowId first = static_cast<ExpenseStore::RowId>(store.Size());
+	batch->AppendTo(store);
+	IndexAppendedRows(first, categoryCount);
+	duplicateIndex.InsertRange(first, static_cast<ExpenseStore::RowId>(store.Size()));
+	loader->Acknowledge();
+	UpdateView();
+
+	totalText->SetLabel(wxString::Format("Loading expenses... %llu of %llu",
+		static_cast<unsigned long long>(batch->rowsDone), static_cast<unsigned long long>(batch->totalRows)));
+	totalText->GetContainingSizer()->Layout();
+}
 
-		// Add category to the combo box if it doesn't already exist
-		if (!expense.category.empty() && catInput->FindString(expense.category) == wxNOT_FOUND) {
-			catInput->Append(expense.category);
-			categoryList.push_back(expense.category);
+void MainFrame::FinishLoad(const ExpenseHistoryLoader::Batch& last)
+{
+	loader->Cancel();
+	loader.reset();
+
+	size_t skippedLines = last.skippedLines;
+	if (last.failed) {
+		// The streaming reader gave up on the files; let the journal load and repair them itself.
+		// Changes made since the newest month came in are in the log, so they come back too.
+		undoStack.Clear();
+		store.Clear();
+		olderRows.Clear();
+		olderMonths.clear();
+		loadingOlder = false;
+		sortIndex.Clear();
+		totalsCache.Clear();
+		dailySeries.Clear();
+		searchIndex.Clear();
+		categoryIndex.Clear();
+		duplicateIndex.Clear();
+		if (!journal.Open(store, &skippedLines)) {
+			// Nothing is written until the files are fixed, so the history on disk stays as it is
+			historyUnreadable = true;
+			EnableEditing(false);
+			UpdateView();
+			wxLogError("The saved expenses in expense.bbs could not be read. Editing is disabled so nothing is "
+				"overwritten; restore the file or its expense.bbs.segments folder and restart.");
+			return;
 		}
 	}
+	else if (loadingOlder) {
+		InsertOlderRows();
+		journal.CompactIfNeeded(store);
+	}
+	else {
+		journal.Resume(last.journal);
+		journal.CompactIfNeeded(store);  // saves rows from a legacy or unsegmented file as segments
+	}
+	if (skippedLines > 0) {
+		wxLogWarning("%zu saved expense lines could not be read and were skipped.", skippedLines);
+	}
+	EnableEditing(true);
+	UpdateView();
+
+	// Refill the combo box in one batch, most used categories first
+	wxArrayString categories;
+	for (ExpenseStore::CategoryId id : categoryIndex.Complete("")) {
+		if (!store.CategoryName(id).empty()) {
+			categories.Add(ToWxString(store.CategoryName(id)));
+		}
+	}
+	catInput->Set(categories);
+}
+
+// The newest month is in: from here on rows can be added and deleted, logged past the older rows
+// still to come. Clearing and importing wait for the rest.
+void MainFrame::StartEditingNewest(const ExpenseHistoryLoader::Batch& newest)
+{
+	journal.Resume(newest.journal);
+	journal.SetUnloadedRows(static_cast<ExpenseStore::RowId>(newest.olderRows));
+	loadingOlder = true;
+	olderMonths = newest.olderMonths;
+	olderRows.Reserve(static_cast<size_t>(newest.olderRows));
+	addButton->Enable();
+	UpdateView();
+}
+
+// Puts the older rows in front of the store in one pass. Every row on show and every undo step
+// moves up past them; the indexes rebuild on first use.
+void MainFrame::InsertOlderRows()
+{
+	const ExpenseStore::RowId count = static_cast<ExpenseStore::RowId>(olderRows.Size());
+	std::vector<ExpenseStore::RowId> positions(count);
+	for (ExpenseStore::RowId row = 0; row < count; row++) {
+		positions[row] = row;
+	}
+	store.InsertRows(positions, olderRows);
+	olderRows.Clear();
+	olderMonths.clear();
+	loadingOlder = false;
+	journal.SetUnloadedRows(0);
+	undoStack.ShiftRows(count);
+	listCtrl->ClearSelection();
+	sortIndex.Clear();
+	totalsCache.Clear();
+	dailySeries.Clear();
+	searchIndex.Clear();
+	categoryIndex.Clear();
+	duplicateIndex.Clear();
+}
+
+// Checked before every change. After a failed write the journal takes no records until it has saved
+// what it missed, so the change waits for that save rather than going unrecorded.
+bool MainFrame::JournalWritable()
+{
+	if (!journal.Failed() || journal.Recover(store)) {
+		return true;
+	}
+	wxLogError(loadingOlder
+		? "Changes could not be written to expense.journal. They are kept and saved once the older expenses have loaded; until then nothing else can be changed."
+		: "Changes could not be written to expense.journal or saved to expense.bbs. They are kept in memory; free up disk space or check the files' permissions and try again.");
+	return false;
+}
+
+// Everything that changes the history waits for the load, so the journal sees changes in order
+void MainFrame::EnableEditing(bool enable)
+{
+	addButton->Enable(enable);
+	clearButton->Enable(enable);
+	importButton->Enable(enable);
 }
 
 void MainFrame::OnListColClick(wxListEvent& event) {
 	int col = event.GetColumn();
-	auto expenses = GetExpensesFromListCtrl(listCtrl);
+	SortColumn column;
+	bool* ascending;
 
 	if (col == 1) { // Category column
-		if (categorySortAscending) {
-			std::sort(expenses.begin(), expenses.end(), [](const Expense& a, const Expense& b) {
-				return a.category < b.category;
-				});
+		column = SortColumn::Category;
+		ascending = &categorySortAscending;
+	}
+	else if (col == 2) { // Amount column
+		column = SortColumn::Amount;
+		ascending = &amountSortAscending;
+	}
+	else if (col == 3) { // Date column
+		column = SortColumn::Date;
+		ascending = &dateSortAscending;
+	}
+	else {
+		return;
+	}
+
+	DiagnosticsTimer timer(DiagnosticsMetric::Sort, store.Size());
+	sortColumn = col;
+	sortDescending = !*ascending;
+	*ascending = !*ascending;
+	UpdateView();
+}
+
+void MainFrame::OnDateFilterChanged(wxCommandEvent& evt) {
+	UpdateView();
+}
+
+// Runs on every keystroke; the search index keeps this well under a frame even at a million rows
+void MainFrame::OnSearchChanged(wxCommandEvent& evt) {
+	UpdateView();
+}
+
+// Points the list at the rows to show. The sort index keeps every column sorted already, so
+// an unfiltered view only selects an ordering and descending just walks it backwards.
+void MainFrame::UpdateView() {
+	DiagnosticsTimer timer(DiagnosticsMetric::ListFill, store.Size());
+	const SortColumn columns[] = { SortColumn::Category, SortColumn::Category, SortColumn::Amount, SortColumn::Date };
+	bool sorted = sortColumn >= 1 && sortColumn <= 3;
+	bool dateFiltered = dateFilterCheck->GetValue();
+	wxString searchText = searchInput->GetValue();
+
+	int32_t fromDay = 0, toDay = 0;
+	if (dateFiltered) {
+		ParseIsoDate(filterFromInput->GetValue().FormatISODate().ToStdString(), fromDay);
+		ParseIsoDate(filterToInput->GetValue().FormatISODate().ToStdString(), toDay);
+	}
+
+	std::vector<ExpenseStore::RowId> rows;
+	if (!searchText.IsEmpty()) {
+		// Matches come back in row order; drop the ones outside the date range
+		rows = searchIndex.Find(searchText.ToStdString());
+		if (dateFiltered) {
+			rows.erase(std::remove_if(rows.begin(), rows.end(), [this, fromDay, toDay](ExpenseStore::RowId row) {
+				return store.Day(row) < fromDay || store.Day(row) > toDay;
+				}), rows.end());
 		}
-		else {
-			std::sort(expenses.begin(), expenses.end(), [](const Expense& a, const Expense& b) {
-				return a.category > b.category;
-				});
+		Money total;
+		for (ExpenseStore::RowId row : rows) {
+			total.cents += store.AmountCents(row);
 		}
-		categorySortAscending = !categorySortAscending;
-		LoadExpensesToListCtrl(listCtrl, expenses);
+		ShowTotal(total, rows.size(), !loadingOlder);
 	}
-	else if (col == 2) { // Amount column
-		if (amountSortAscending) {
-			std::sort(expenses.begin(), expenses.end(), [](const Expense& a, const Expense& b) {
-				try {
-					return std::stod(a.amount) < std::stod(b.amount);
-				}
-				catch (...) {
-					return a.amount < b.amount; // fallback to string compare
-				}
-				});
+	else if (!dateFiltered) {
+		// Whole-column totals are a vectorised scan of the amount column
+		Money total{ SumCents(store.Amounts().data(), store.Size()) };
+		size_t count = store.Size();
+		bool complete = AddOlderTotals(false, 0, 0, total, count);
+		ShowTotal(total, count, complete);
+		if (sorted) {
+			listCtrl->ShowOrder(sortIndex.Order(columns[sortColumn]), sortDescending);
 		}
 		else {
-			std::sort(expenses.begin(), expenses.end(), [](const Expense& a, const Expense& b) {
-				try {
-					return std::stod(a.amount) > std::stod(b.amount);
-				}
-				catch (...) {
-					return a.amount > b.amount; // fallback to string compare
-				}
-				});
+			listCtrl->ShowAllRows();
 		}
-		amountSortAscending = !amountSortAscending;
-		LoadExpensesToListCtrl(listCtrl, expenses);
+		return;
 	}
-	else if (col == 3) { // Date column
-		if (dateSortAscending) {
-			std::sort(expenses.begin(), expenses.end(), [](const Expense& a, const Expense& b) {
-				return a.date < b.date;
-				});
+	else {
+		// The matching rows are one contiguous slice of the date ordering
+		std::pair<size_t, size_t> range = sortIndex.DateRange(fromDay, toDay);
+		const std::vector<ExpenseStore::RowId>& byDate = sortIndex.Order(SortColumn::Date);
+		// A narrow range is cheaper to sum row by row; a wide one streams both columns
+		Money total;
+		if ((range.second - range.first) * 8 < store.Size()) {
+			for (size_t i = range.first; i < range.second; i++) {
+				total.cents += store.AmountCents(byDate[i]);
+			}
 		}
 		else {
-			std::sort(expenses.begin(), expenses.end(), [](const Expense& a, const Expense& b) {
-				return a.date > b.date;
-				});
+			total.cents = SumCentsBetween(store.Amounts().data(), store.Days().data(), store.Size(), fromDay, toDay);
 		}
-		dateSortAscending = !dateSortAscending;
-		LoadExpensesToListCtrl(listCtrl, expenses);
+		size_t count = range.second - range.first;
+		bool complete = AddOlderTotals(true, fromDay, toDay, total, count);
+		ShowTotal(total, count, complete);
+		if (!sorted || columns[sortColumn] == SortColumn::Date) {
+			listCtrl->ShowOrder(byDate, sorted && sortDescending, range.first, range.second);
+			return;
+		}
+		rows.assign(byDate.begin() + range.first, byDate.begin() + range.second);
 	}
+
+	// Sorted by a column: order just the matching rows
+	if (sorted) {
+		sortIndex.SortRows(columns[sortColumn], rows);
+		if (sortDescending) {
+			std::reverse(rows.begin(), rows.end());
+		}
+	}
+	listCtrl->SetRows(std::move(rows));
+}
+
+// While the older rows load, their months' saved totals stand in for them. False when some of
+// them may belong in the total but are not in it: a month the date range only partly covers.
+bool MainFrame::AddOlderTotals(bool dateFiltered, int32_t fromDay, int32_t toDay, Money& total, size_t& rows) const {
+	bool complete = true;
+	for (const ExpenseMonthTotal& month : olderMonths) {
+		if (dateFiltered) {
+			const int32_t first = CivilToDay(month.month / 12, month.month % 12 + 1, 1);
+			const int32_t next = CivilToDay((month.month + 1) / 12, (month.month + 1) % 12 + 1, 1);
+			if (next <= fromDay || first > toDay) {
+				continue;
+			}
+			if (first < fromDay || next - 1 > toDay) {
+				complete = false;
+				continue;
+			}
+		}
+		total.cents += month.cents;
+		rows += static_cast<size_t>(month.rows);
+	}
+	return complete;
+}
+
+void MainFrame::ShowTotal(Money total, size_t rows, bool complete) {
+	wxString label = wxString::Format("%zu expenses, total ", rows) + ToWxString(total.ToString());
+	if (!complete) {
+		label += " so far; older months are still loading";
+	}
+	if (journal.Failed()) {
+		label += " (the latest changes could not be written to disk yet)";
+	}
+	totalText->SetLabel(label);
+	totalText->GetContainingSizer()->Layout();
 }
 
 void MainFrame::OnSettingsButtonClicked(wxCommandEvent& evt) {
@@ -452,6 +928,7 @@ void MainFrame::OnSettingsButtonClicked(wxCommandEvent& evt) {
 
 // Light Theme using grayscale palette
 void MainFrame::ApplyLightTheme() {
+	DiagnosticsTimer timer(DiagnosticsMetric::Theme);
 	// Main panel - lightest shade for background
 	panel->SetBackgroundColour(ColorPalette::WHITE_SMOKE);
 
@@ -468,6 +945,11 @@ void MainFrame::ApplyLightTheme() {
 	catText->SetForegroundColour(ColorPalette::DARK_SLATE_GRAY);
 	amountText->SetForegroundColour(ColorPalette::DARK_SLATE_GRAY);
 	dateText->SetForegroundColour(ColorPalette::DARK_SLATE_GRAY);
+	dateFilterCheck->SetForegroundColour(ColorPalette::DARK_SLATE_GRAY);
+	filterToText->SetForegroundColour(ColorPalette::DARK_SLATE_GRAY);
+	totalText->SetForegroundColour(ColorPalette::DARK_SLATE_GRAY);
+	searchInput->SetBackgroundColour(ColorPalette::LIGHT_GRAY);
+	searchInput->SetForegroundColour(ColorPalette::GUNMETAL);
 
 	// Input fields - clean white with dark text
 	descInput->SetBackgroundColour(ColorPalette::LIGHT_GRAY);
@@ -484,6 +966,12 @@ void MainFrame::ApplyLightTheme() {
 	addButton->SetForegroundColour(ColorPalette::DARK_SLATE_GRAY);
 	clearButton->SetBackgroundColour(ColorPalette::FRENCH_GRAY);
 	clearButton->SetForegroundColour(ColorPalette::DARK_SLATE_GRAY);
+	importButton->SetBackgroundColour(ColorPalette::FRENCH_GRAY);
+	importButton->SetForegroundColour(ColorPalette::DARK_SLATE_GRAY);
+	diagnosticsButton->SetBackgroundColour(ColorPalette::FRENCH_GRAY);
+	diagnosticsButton->SetForegroundColour(ColorPalette::DARK_SLATE_GRAY);
+	plotButton->SetBackgroundColour(ColorPalette::FRENCH_GRAY);
+	plotButton->SetForegroundColour(ColorPalette::DARK_SLATE_GRAY);
 
 
 	// Settings button - accent color
@@ -499,6 +987,7 @@ void MainFrame::ApplyLightTheme() {
 
 // Dark Theme using grayscale palette
 void MainFrame::ApplyDarkTheme() {
+	DiagnosticsTimer timer(DiagnosticsMetric::Theme);
 	// Main panel - darkest shade for background
 	panel->SetBackgroundColour(ColorPalette::RICH_BLACK);
 
@@ -514,6 +1003,11 @@ void MainFrame::ApplyDarkTheme() {
 	catText->SetForegroundColour(ColorPalette::LIGHT_GRAY);
 	amountText->SetForegroundColour(ColorPalette::LIGHT_GRAY);
 	dateText->SetForegroundColour(ColorPalette::LIGHT_GRAY);
+	dateFilterCheck->SetForegroundColour(ColorPalette::LIGHT_GRAY);
+	filterToText->SetForegroundColour(ColorPalette::LIGHT_GRAY);
+	totalText->SetForegroundColour(ColorPalette::LIGHT_GRAY);
+	searchInput->SetBackgroundColour(ColorPalette::DARK_SLATE_GRAY);
+	searchInput->SetForegroundColour(ColorPalette::WHITE_SMOKE);
 
 	// Input fields - dark background with light text
 	descInput->SetBackgroundColour(ColorPalette::DARK_SLATE_GRAY);
@@ -530,6 +1024,12 @@ void MainFrame::ApplyDarkTheme() {
 	addButton->SetForegroundColour(ColorPalette::WHITE_SMOKE);
 	clearButton->SetBackgroundColour(ColorPalette::SLATE_GRAY);
 	clearButton->SetForegroundColour(ColorPalette::WHITE_SMOKE);
+	importButton->SetBackgroundColour(ColorPalette::SLATE_GRAY);
+	importButton->SetForegroundColour(ColorPalette::WHITE_SMOKE);
+	diagnosticsButton->SetBackgroundColour(ColorPalette::SLATE_GRAY);
+	diagnosticsButton->SetForegroundColour(ColorPalette::WHITE_SMOKE);
+	plotButton->SetBackgroundColour(ColorPalette::SLATE_GRAY);
+	plotButton->SetForegroundColour(ColorPalette::WHITE_SMOKE);
 
 
 	// Settings button - accent in dark theme
@@ -540,7 +1040,7 @@ void MainFrame::ApplyDarkTheme() {
 	listCtrl->SetBackgroundColour(ColorPalette::GUNMETAL);
 	listCtrl->SetForegroundColour(ColorPalette::WHITE_SMOKE);
 
-	wxButton* buttons[] = { settingsButton, clearButton, addButton };
+	wxButton* buttons[] = { settingsButton, plotButton, diagnosticsButton, importButton, clearButton, addButton };
 
 	for (wxButton* btn : buttons) {
 		btn->SetBackgroundColour(ColorPalette::DARK_SLATE_GRAY);  // default color
@@ -556,47 +1056,1128 @@ void MainFrame::ApplyDarkTheme() {
 
 
 
+// Feeds the pivot to the grid. wxGrid asks only for the cells it is about to draw, so opening or
+// scrolling costs the same for ten periods as for ten thousand. The last row and column hold the
+// totals and stay in place when the rest is sorted.
+class PivotTable : public wxGridTableBase {
+public:
+	PivotTable(ExpensePivot pivot, AggregatePeriod period)
+		: pivot(std::move(pivot)), period(period), totalAttr(new wxGridCellAttr())
+	{
+		totalAttr->SetFont(wxNORMAL_FONT->Bold());
+	}
+	~PivotTable() override { totalAttr->DecRef(); }
+
+	ExpensePivot& Pivot() { return pivot; }
+	AggregatePeriod Period() const { return period; }
+	bool IsTotalRow(int row) const { return static_cast<size_t>(row) == pivot.RowCount(); }
+	bool IsTotalColumn(int col) const { return static_cast<size_t>(col) == pivot.ColumnCount(); }
+
+	int GetNumberRows() override { return static_cast<int>(pivot.RowCount() + 1); }
+	int GetNumberCols() override { return static_cast<int>(pivot.ColumnCount() + 1); }
+
+	wxString GetValue(int row, int col) override {
+		ExpensePivot::Cell cell = CellAt(row, col);
+		return cell.rows == 0 ? wxString() : ToWxString(FormatAmountCents(cell.cents));
+	}
+	void SetValue(int row, int col, const wxString& value) override {}
+	bool IsEmptyCell(int row, int col) override { return CellAt(row, col).rows == 0; }
+
+	wxString GetRowLabelValue(int row) override {
+		return IsTotalRow(row) ? wxString("Total") : ToWxString(FormatPeriod(period, pivot.Period(row)));
+	}
+	wxString GetColLabelValue(int col) override {
+		return IsTotalColumn(col) ? wxString("Total") : ToWxString(pivot.GroupName(col));
+	}
+
+	wxGridCellAttr* GetAttr(int row, int col, wxGridCellAttr::wxAttrKind kind) override {
+		if (IsTotalRow(row) || IsTotalColumn(col)) {
+			totalAttr->IncRef();
+			return totalAttr;
+		}
+		return nullptr;
+	}
+
+private:
+	ExpensePivot pivot;
+	AggregatePeriod period;
+	wxGridCellAttr* totalAttr;
+
+	ExpensePivot::Cell CellAt(int row, int col) const {
+		if (IsTotalRow(row)) {
+			return IsTotalColumn(col) ? pivot.GrandTotal() : pivot.ColumnTotal(col);
+		}
+		return IsTotalColumn(col) ? pivot.RowTotal(row) : pivot.At(row, col);
+	}
+};
+
+
+// The expenses behind one total of the pivot grid
+class DrillDownDialog : public wxDialog {
+public:
+	DrillDownDialog(wxWindow* parent, const wxString& title, const ExpenseStore& store, std::vector<ExpenseStore::RowId> rows)
+		: wxDialog(parent, wxID_ANY, title, wxDefaultPosition, wxSize(760, 460),
+			wxDEFAULT_DIALOG_STYLE | wxRESIZE_BORDER)
+	{
+		wxBoxSizer* sizer = new wxBoxSizer(wxVERTICAL);
+		Money total;
+		for (ExpenseStore::RowId row : rows) {
+			total.cents += store.AmountCents(row);
+		}
+		sizer->Add(new wxStaticText(this, wxID_ANY, wxString::Format("%zu expenses, total ", rows.size()) + ToWxString(total.ToString())),
+			0, wxLEFT | wxRIGHT | wxTOP, 10);
+
+		// The same virtual list as the main window, so a cell with a million rows opens as fast as one with ten
+		ExpenseListCtrl* rowsList = new ExpenseListCtrl(this, store);
+		rowsList->InsertColumn(0, "Description", wxLIST_FORMAT_LEFT, 250);
+		rowsList->InsertColumn(1, "Category", wxLIST_FORMAT_LEFT, 160);
+		rowsList->InsertColumn(2, "Amount", wxLIST_FORMAT_RIGHT, 140);
+		rowsList->InsertColumn(3, "Date", wxLIST_FORMAT_LEFT, 140);
+		rowsList->SetRows(std::move(rows));
+		sizer->Add(rowsList, 1, wxEXPAND | wxALL, 10);
+
+		SetSizer(sizer);
+		Layout();
+		Centre();
+	}
+};
+
+
 class TotalsDialog : public wxDialog {
 public:
-	TotalsDialog(wxWindow* parent, const std::map<std::string, std::map<std::string, double>>& data)
-		: wxDialog(parent, wxID_ANY, "Monthly Category Totals",
+	TotalsDialog(wxWindow* parent, const ExpenseStore& store, ExpenseTotalsCache& totalsCache, ExpenseSortIndex& sortIndex, ThreadPool& pool,
+		std::vector<ExpenseMonthTotal> olderMonths)
+		: wxDialog(parent, wxID_ANY, "Expense Totals",
 			wxDefaultPosition, wxSize(900, 600),
-			wxDEFAULT_DIALOG_STYLE | wxRESIZE_BORDER)
+			wxDEFAULT_DIALOG_STYLE | wxRESIZE_BORDER),
+		store(store), sortIndex(sortIndex), pool(pool), olderMonths(std::move(olderMonths))
 	{
 		wxBoxSizer* sizer = new wxBoxSizer(wxVERTICAL);
-		wxTextCtrl* text = new wxTextCtrl(this, wxID_ANY, "", wxDefaultPosition, wxDefaultSize,
-			wxTE_MULTILINE | wxTE_READONLY | wxTE_DONTWRAP);
 
-		wxString output;
-		for (const auto& [month, catMap] : data) {
-			output += "Month: " + month + "\n";
-			for (const auto& [cat, total] : catMap) {
-				output += "  " + cat + ": " + wxString::Format("%.2f", total) + "\n";
-			}
-			output += "\n";
+		// Query row: period, grouping and an optional date range
+		wxBoxSizer* querySizer = new wxBoxSizer(wxHORIZONTAL);
+		const wxString periods[] = { "Day", "Week", "Month", "Quarter", "Year" };
+		periodChoice = new wxChoice(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, WXSIZEOF(periods), periods);
+		periodChoice->SetSelection(static_cast<int>(AggregatePeriod::Month));
+		const wxString groups[] = { "Category", "Description" };
+		groupChoice = new wxChoice(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, WXSIZEOF(groups), groups);
+		groupChoice->SetSelection(static_cast<int>(AggregateGroup::Category));
+		rangeCheck = new wxCheckBox(this, wxID_ANY, "From");
+		fromInput = new wxDatePickerCtrl(this, wxID_ANY, wxDefaultDateTime);
+		wxStaticText* toText = new wxStaticText(this, wxID_ANY, "to");
+		toInput = new wxDatePickerCtrl(this, wxID_ANY, wxDefaultDateTime);
+		wxButton* showButton = new wxButton(this, wxID_ANY, "Show");
+
+		querySizer->Add(periodChoice, 0, wxRIGHT, 10);
+		querySizer->Add(groupChoice, 0, wxRIGHT, 10);
+		querySizer->Add(rangeCheck, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 5);
+		querySizer->Add(fromInput, 0, wxRIGHT, 5);
+		querySizer->Add(toText, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 5);
+		querySizer->Add(toInput, 0, wxRIGHT, 10);
+		querySizer->Add(showButton, 0);
+		sizer->Add(querySizer, 0, wxEXPAND | wxLEFT | wxRIGHT | wxTOP, 10);
+
+		// Fixed sizes: autosizing would read every cell, which is what the virtual table avoids
+		grid = new wxGrid(this, wxID_ANY);
+		grid->SetDefaultColSize(120);
+		grid->SetRowLabelSize(140);
+		grid->SetDefaultCellAlignment(wxALIGN_RIGHT, wxALIGN_CENTRE);
+		grid->DisableDragRowSize();
+		sizer->Add(grid, 1, wxEXPAND | wxALL, 10);
+		sizer->Add(new wxStaticText(this, wxID_ANY,
+			"Click a column heading to sort the periods by it, a period to sort the columns. Double-click a total to see its expenses."),
+			0, wxLEFT | wxRIGHT | wxBOTTOM, 10);
+
+		showButton->Bind(wxEVT_BUTTON, &TotalsDialog::OnShowButtonClicked, this);
+		grid->Bind(wxEVT_GRID_LABEL_LEFT_CLICK, &TotalsDialog::OnLabelClicked, this);
+		grid->Bind(wxEVT_GRID_CELL_LEFT_DCLICK, &TotalsDialog::OnCellDoubleClicked, this);
+
+		// The default monthly view comes straight from the totals cache
+		DiagnosticsTimer timer(DiagnosticsMetric::Aggregate, store.Size());
+		AggregateResult result;
+		for (ExpenseStore::CategoryId id = 0; id < store.CategoryCount(); id++) {
+			result.groupNames.push_back(store.CategoryName(id));
 		}
-		text->SetValue(output);
-		sizer->Add(text, 1, wxEXPAND | wxALL, 10);
+		for (const ExpenseTotalsCache::Cell& cell : totalsCache.Cells()) {
+			result.rows.push_back(AggregateResult::Row{ cell.month, cell.category, cell.cents, cell.rows });
+		}
+		AddOlderMonths(query, result);
+		ShowPivot(query, result);
+		timer.Stop();
+
 		SetSizer(sizer);
 		SetMinSize(wxSize(600, 400)); // Optional: set a minimum size
 		Layout();
 		Centre();
 	}
+
+private:
+	const ExpenseStore& store;
+	ExpenseSortIndex& sortIndex;  // a date range reads only its slice of the date order
+	ThreadPool& pool;
+	std::vector<ExpenseMonthTotal> olderMonths;  // saved totals of the months still loading
+	wxChoice* periodChoice;
+	wxChoice* groupChoice;
+	wxCheckBox* rangeCheck;
+	wxDatePickerCtrl* fromInput;
+	wxDatePickerCtrl* toInput;
+	wxGrid* grid;
+	PivotTable* table = nullptr;  // owned by the grid
+	AggregateQuery query;         // the query on show, for drilling into it
+	// The last sort, so a second click on the same heading flips it
+	bool sortedRows = false;
+	int sortedIndex = -1;
+	bool sortDescending = false;
+
+	void OnShowButtonClicked(wxCommandEvent& evt) {
+		AggregateQuery newQuery;
+		newQuery.period = static_cast<AggregatePeriod>(periodChoice->GetSelection());
+		newQuery.group = static_cast<AggregateGroup>(groupChoice->GetSelection());
+		if (rangeCheck->GetValue()) {
+			ParseIsoDate(fromInput->GetValue().FormatISODate().ToStdString(), newQuery.fromDay);
+			ParseIsoDate(toInput->GetValue().FormatISODate().ToStdString(), newQuery.toDay);
+		}
+
+		wxBusyCursor busy;
+		DiagnosticsTimer timer(DiagnosticsMetric::Aggregate, store.Size());
+		AggregateResult result = AggregateExpenses(store, newQuery, pool, &sortIndex);
+		AddOlderMonths(newQuery, result);
+		ShowPivot(newQuery, result);
+	}
+
+	// The months still loading have only their saved totals, so a monthly view shows them in a
+	// column of their own, as far as the date range covers whole months
+	void AddOlderMonths(const AggregateQuery& forQuery, AggregateResult& result) {
+		if (olderMonths.empty() || forQuery.period != AggregatePeriod::Month) {
+			return;
+		}
+		const uint32_t group = static_cast<uint32_t>(result.groupNames.size());
+		result.groupNames.push_back("(still loading)");
+		for (const ExpenseMonthTotal& month : olderMonths) {
+			const int32_t first = CivilToDay(month.month / 12, month.month % 12 + 1, 1);
+			const int32_t next = CivilToDay((month.month + 1) / 12, (month.month + 1) % 12 + 1, 1);
+			if (first >= forQuery.fromDay && next - 1 <= forQuery.toDay) {
+				result.rows.push_back(AggregateResult::Row{ month.month, group, month.cents, static_cast<size_t>(month.rows) });
+			}
+		}
+		std::stable_sort(result.rows.begin(), result.rows.end(), [&result](const AggregateResult::Row& a, const AggregateResult::Row& b) {
+			if (a.period != b.period) {
+				return a.period < b.period;
+			}
+			return result.groupNames[a.group] < result.groupNames[b.group];
+			});
+	}
+
+	void ShowPivot(const AggregateQuery& newQuery, const AggregateResult& result) {
+		query = newQuery;
+		ExpensePivot pivot;
+		pivot.Build(result);
+		table = new PivotTable(std::move(pivot), query.period);
+		grid->SetTable(table, true, wxGrid::wxGridSelectCells);
+		grid->UnsetSortingColumn();
+		sortedIndex = -1;
+		grid->ForceRefresh();
+	}
+
+	// A column heading sorts the periods by that column, a period label sorts the columns by
+	// that period and the corner puts both back in label order
+	void OnLabelClicked(wxGridEvent& evt) {
+		int row = evt.GetRow(), col = evt.GetCol();
+		ExpensePivot& pivot = table->Pivot();
+		if (row < 0 && col < 0) {
+			pivot.SortRows(ExpensePivot::ByLabel, false);
+			pivot.SortColumns(ExpensePivot::ByLabel, false);
+			grid->UnsetSortingColumn();
+			sortedIndex = -1;
+		}
+		else {
+			bool byRows = row < 0;
+			int index = byRows ? col : row;
+			// Amounts start out largest first; a second click on the same label reverses them
+			sortDescending = byRows == sortedRows && index == sortedIndex ? !sortDescending : true;
+			sortedRows = byRows;
+			sortedIndex = index;
+			if (byRows) {
+				pivot.SortRows(table->IsTotalColumn(col) ? ExpensePivot::ByTotal : static_cast<size_t>(col), sortDescending);
+				grid->SetSortingColumn(col, !sortDescending);
+			}
+			else if (!table->IsTotalRow(row)) {
+				pivot.SortColumns(static_cast<size_t>(row), sortDescending);
+				grid->UnsetSortingColumn();
+			}
+			else {
+				pivot.SortColumns(ExpensePivot::ByTotal, sortDescending);
+				grid->UnsetSortingColumn();
+			}
+		}
+		grid->ForceRefresh();
+	}
+
+	void OnCellDoubleClicked(wxGridEvent& evt) {
+		int row = evt.GetRow(), col = evt.GetCol();
+		ExpensePivot& pivot = table->Pivot();
+		int32_t period = 0;
+		std::string group;
+		bool anyPeriod = table->IsTotalRow(row), anyGroup = table->IsTotalColumn(col);
+		wxString title = "All periods";
+		if (!anyPeriod) {
+			period = pivot.Period(row);
+			title = ToWxString(FormatPeriod(query.period, period));
+		}
+		if (!anyGroup) {
+			group = pivot.GroupName(col);
+			title += " - " + ToWxString(group);
+		}
+
+		std::vector<ExpenseStore::RowId> rows;
+		{
+			wxBusyCursor busy;
+			std::string_view groupView = group;
+			rows = AggregatedRows(store, query, anyPeriod ? nullptr : &period, anyGroup ? nullptr : &groupView, &sortIndex);
+		}
+		DrillDownDialog dlg(this, title, store, std::move(rows));
+		dlg.ShowModal();
+	}
 };
 
 
 void MainFrame::OnViewTotalsButtonClicked(wxCommandEvent& evt)
 {
-	auto expenses = GetExpensesFromListCtrl(listCtrl);
-	// Map: month -> category -> total
-	std::map<std::string, std::map<std::string, double>> totals;
-	for (const auto& exp : expenses) {
-		std::string month = exp.date.substr(0, 7);
-		double amt = 0.0;
-		try { amt = std::stod(exp.amount); }
-		catch (...) { continue; }
-		totals[month][exp.category] += amt;
-	}
-	TotalsDialog dlg(this, totals);
+	// The monthly view is served by the totals cache; other periods and ranges run on the thread
+	// pool. Months still loading come from their saved totals.
+	TotalsDialog dlg(this, store, totalsCache, sortIndex, pool, olderMonths);
+	dlg.ShowModal();
+}
+
+
+// Spending over time, one line per chosen category. The series live in ExpenseDailySeries and
+// are only read here: each paint downsamples the visible days of each line to the plot's pixel
+// width with LTTB, so a ten-year history pans and zooms while drawing a few thousand points.
+class SpendingChart : public wxPanel {
+public:
+	struct Line
+	{
+		ExpenseStore::CategoryId category;   // NoCategory for all categories together
+		wxString name;
+		wxColour colour;
+	};
+
+	SpendingChart(wxWindow* parent, ExpenseDailySeries& series)
+		: wxPanel(parent, wxID_ANY, wxDefaultPosition, wxSize(600, 360)), series(series)
+	{
+		SetBackgroundStyle(wxBG_STYLE_PAINT);
+		Bind(wxEVT_PAINT, &SpendingChart::OnPaint, this);
+		Bind(wxEVT_SIZE, [this](wxSizeEvent& evt) { Refresh(); evt.Skip(); });
+		Bind(wxEVT_MOUSEWHEEL, &SpendingChart::OnMouseWheel, this);
+		Bind(wxEVT_LEFT_DOWN, &SpendingChart::OnLeftDown, this);
+		Bind(wxEVT_LEFT_UP, &SpendingChart::OnLeftUp, this);
+		Bind(wxEVT_MOTION, &SpendingChart::OnMotion, this);
+		Bind(wxEVT_LEFT_DCLICK, [this](wxMouseEvent&) { ResetView(); });
+		Bind(wxEVT_MOUSE_CAPTURE_LOST, [this](wxMouseCaptureLostEvent&) { dragging = false; });
+	}
+
+	void SetLines(std::vector<Line> newLines, ExpenseDailySeries::Window newWindow) {
+		lines = std::move(newLines);
+		window = newWindow;
+		Refresh();
+	}
+
+	void ResetView() {
+		viewFirst = 0;
+		viewLast = std::max<double>(static_cast<double>(series.DayCount()) - 1, MinVisibleDays);
+		Refresh();
+	}
+
+private:
+	static constexpr double MinVisibleDays = 7;
+	static constexpr int LeftMargin = 90, RightMargin = 15, TopMargin = 30, BottomMargin = 30;
+
+	ExpenseDailySeries& series;
+	std::vector<Line> lines;
+	ExpenseDailySeries::Window window = ExpenseDailySeries::Window::Month;
+	double viewFirst = 0;       // day indexes at the left and right edges of the plot
+	double viewLast = 0;
+	bool dragging = false;
+	int dragX = 0;
+	double dragFirst = 0;
+	std::vector<SeriesPoint> points;
+	std::vector<wxPoint> screenPoints;
+
+	wxRect PlotRect() const {
+		wxSize size = GetClientSize();
+		return wxRect(LeftMargin, TopMargin, std::max(size.x - LeftMargin - RightMargin, 10), std::max(size.y - TopMargin - BottomMargin, 10));
+	}
+
+	// Keeps the view inside the history and no narrower than a week
+	void ClampView() {
+		const double lastDay = std::max<double>(static_cast<double>(series.DayCount()) - 1, MinVisibleDays);
+		double span = std::min(std::max(viewLast - viewFirst, MinVisibleDays), lastDay);
+		viewFirst = std::min(std::max(viewFirst, 0.0), lastDay - span);
+		viewLast = viewFirst + span;
+	}
+
+	// 1, 2 or 5 times a power of ten, the smallest such step above rough
+	static int64_t NiceStep(double rough) {
+		double power = std::pow(10.0, std::floor(std::log10(std::max(rough, 1.0))));
+		for (double factor : { 1.0, 2.0, 5.0, 10.0 }) {
+			if (factor * power >= rough) {
+				return static_cast<int64_t>(factor * power);
+			}
+		}
+		return static_cast<int64_t>(10 * power);
+	}
+
+	void OnPaint(wxPaintEvent&) {
+		wxAutoBufferedPaintDC dc(this);
+		dc.SetBackground(*wxWHITE_BRUSH);
+		dc.Clear();
+		dc.SetFont(GetFont());
+
+		const size_t dayCount = series.DayCount();
+		const wxRect plot = PlotRect();
+		if (dayCount == 0 || lines.empty()) {
+			const wxString message = dayCount == 0 ? "No expenses to chart yet." : "Choose a category to chart.";
+			wxSize extent = dc.GetTextExtent(message);
+			dc.DrawText(message, (GetClientSize().x - extent.x) / 2, (GetClientSize().y - extent.y) / 2);
+			return;
+		}
+		ClampView();
+		const size_t first = static_cast<size_t>(std::floor(viewFirst));
+		const size_t last = std::min(dayCount, static_cast<size_t>(std::ceil(viewLast)) + 1);
+
+		// The vertical scale fits the visible days of every line
+		int64_t low = 0, high = 0;
+		for (const Line& line : lines) {
+			const std::vector<int64_t>& values = series.Values(line.category, window);
+			for (size_t day = first; day < last; day++) {
+				low = std::min(low, values[day]);
+				high = std::max(high, values[day]);
+			}
+		}
+		const int64_t step = NiceStep(std::max<double>(static_cast<double>(high - low), 100.0) / 4);
+		low = (low >= 0 ? low / step : (low - step + 1) / step) * step;
+		high = ((high + step - 1) / step) * step;
+		if (high <= low) {
+			high = low + step;
+		}
+		const double scaleX = plot.width / std::max(viewLast - viewFirst, 1.0);
+		const double scaleY = plot.height / static_cast<double>(high - low);
+
+		dc.SetPen(wxPen(wxColour(225, 225, 225)));
+		dc.SetTextForeground(wxColour(90, 90, 90));
+		for (int64_t value = low; value <= high; value += step) {
+			const int y = plot.GetBottom() - static_cast<int>((value - low) * scaleY);
+			dc.DrawLine(plot.GetLeft(), y, plot.GetRight(), y);
+			const wxString label = ToWxString(FormatAmountCents(value));
+			wxSize extent = dc.GetTextExtent(label);
+			dc.DrawText(label, plot.GetLeft() - extent.x - 6, y - extent.y / 2);
+		}
+
+		// Month labels, or year labels once months would crowd each other
+		const double daysVisible = viewLast - viewFirst;
+		const bool years = daysVisible * 70 / plot.width > 31;
+		const int32_t firstDay = series.FirstDay();
+		int32_t month = MonthOfDay(firstDay + static_cast<int32_t>(first));
+		const int32_t lastMonth = MonthOfDay(firstDay + static_cast<int32_t>(last) - 1);
+		int labelRight = std::numeric_limits<int>::min();
+		for (month = years ? (month / 12 + 1) * 12 : month + 1; month <= lastMonth; month += years ? 12 : 1) {
+			const int32_t day = CivilToDay(month / 12, month % 12 + 1, 1);
+			const int x = plot.GetLeft() + static_cast<int>((day - firstDay - viewFirst) * scaleX);
+			const wxString label = years ? wxString::Format("%d", month / 12) : ToWxString(FormatMonth(month));
+			wxSize extent = dc.GetTextExtent(label);
+			dc.DrawLine(x, plot.GetTop(), x, plot.GetBottom());
+			if (x - extent.x / 2 > labelRight + 8) {
+				dc.DrawText(label, x - extent.x / 2, plot.GetBottom() + 6);
+				labelRight = x + extent.x / 2;
+			}
+		}
+
+		dc.SetPen(wxPen(wxColour(150, 150, 150)));
+		dc.SetBrush(*wxTRANSPARENT_BRUSH);
+		dc.DrawRectangle(plot);
+
+		{
+			wxDCClipper clip(dc, plot);
+			for (const Line& line : lines) {
+				const std::vector<int64_t>& values = series.Values(line.category, window);
+				DownsampleLttb(values.data(), first, last, static_cast<size_t>(plot.width), points);
+				screenPoints.resize(points.size());
+				for (size_t i = 0; i < points.size(); i++) {
+					screenPoints[i] = wxPoint(plot.GetLeft() + static_cast<int>((points[i].index - viewFirst) * scaleX),
+						plot.GetBottom() - static_cast<int>((points[i].value - low) * scaleY));
+				}
+				dc.SetPen(wxPen(line.colour, 2));
+				if (screenPoints.size() > 1) {
+					dc.DrawLines(static_cast<int>(screenPoints.size()), screenPoints.data());
+				}
+			}
+		}
+
+		int legendX = plot.GetLeft();
+		for (const Line& line : lines) {
+			dc.SetBrush(wxBrush(line.colour));
+			dc.SetPen(wxPen(line.colour));
+			dc.DrawRectangle(legendX, 10, 12, 12);
+			dc.SetTextForeground(wxColour(40, 40, 40));
+			dc.DrawText(line.name, legendX + 16, 8);
+			legendX += 16 + dc.GetTextExtent(line.name).x + 14;
+		}
+	}
+
+	// Zooms around the day under the pointer
+	void OnMouseWheel(wxMouseEvent& evt) {
+		const wxRect plot = PlotRect();
+		const double span = viewLast - viewFirst;
+		const double anchor = viewFirst + span * (evt.GetX() - plot.GetLeft()) / plot.width;
+		const double factor = evt.GetWheelRotation() > 0 ? 0.8 : 1.25;
+		viewFirst = anchor - (anchor - viewFirst) * factor;
+		viewLast = viewFirst + span * factor;
+		ClampView();
+		Refresh();
+	}
+
+	void OnLeftDown(wxMouseEvent& evt) {
+		dragging = true;
+		dragX = evt.GetX();
+		dragFirst = viewFirst;
+		CaptureMouse();
+	}
+
+	void OnLeftUp(wxMouseEvent&) {
+		if (dragging && HasCapture()) {
+			ReleaseMouse();
+		}
+		dragging = false;
+	}
+
+	void OnMotion(wxMouseEvent& evt) {
+		if (!dragging) {
+			return;
+		}
+		const double span = viewLast - viewFirst;
+		viewFirst = dragFirst - (evt.GetX() - dragX) * span / PlotRect().width;
+		viewLast = viewFirst + span;
+		ClampView();
+		Refresh();
+	}
+};
+
+
+// Chooses the categories and window for a SpendingChart. The categories are listed by total
+// spending; all of them together and the five largest are shown at first.
+class ChartDialog : public wxDialog {
+public:
+	ChartDialog(wxWindow* parent, const ExpenseStore& store, ExpenseDailySeries& series)
+		: wxDialog(parent, wxID_ANY, "Spending Over Time", wxDefaultPosition, wxSize(1000, 600),
+			wxDEFAULT_DIALOG_STYLE | wxRESIZE_BORDER)
+	{
+		wxBoxSizer* sizer = new wxBoxSizer(wxVERTICAL);
+
+		const wxString windows[] = { "Daily", "Rolling 7 days", "Rolling 30 days" };
+		windowChoice = new wxChoice(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, WXSIZEOF(windows), windows);
+		windowChoice->SetSelection(static_cast<int>(ExpenseDailySeries::Window::Month));
+		sizer->Add(windowChoice, 0, wxLEFT | wxRIGHT | wxTOP, 10);
+
+		wxBoxSizer* chartSizer = new wxBoxSizer(wxHORIZONTAL);
+		categoryList = new wxCheckListBox(this, wxID_ANY, wxDefaultPosition, wxSize(200, -1));
+		categories.push_back(ExpenseStore::NoCategory);
+		categoryList->Append("All categories");
+		categoryList->Check(0);
+		for (ExpenseStore::CategoryId id : series.CategoriesBySpending()) {
+			categories.push_back(id);
+			unsigned int item = categoryList->Append(ToWxString(store.CategoryName(id)));
+			categoryList->Check(item, item <= 5);
+		}
+		chart = new SpendingChart(this, series);
+		chartSizer->Add(categoryList, 0, wxEXPAND | wxRIGHT, 10);
+		chartSizer->Add(chart, 1, wxEXPAND);
+		sizer->Add(chartSizer, 1, wxEXPAND | wxALL, 10);
+
+		wxBoxSizer* bottomSizer = new wxBoxSizer(wxHORIZONTAL);
+		bottomSizer->Add(new wxStaticText(this, wxID_ANY, "Scroll to zoom, drag to pan, double-click to see the whole history."),
+			1, wxALIGN_CENTER_VERTICAL);
+		bottomSizer->Add(new wxButton(this, wxID_OK, "Close"), 0);
+		sizer->Add(bottomSizer, 0, wxEXPAND | wxLEFT | wxRIGHT | wxBOTTOM, 10);
+
+		windowChoice->Bind(wxEVT_CHOICE, [this](wxCommandEvent&) { UpdateChart(); });
+		categoryList->Bind(wxEVT_CHECKLISTBOX, [this](wxCommandEvent&) { UpdateChart(); });
+
+		UpdateChart();
+		chart->ResetView();
+		SetSizer(sizer);
+		Layout();
+		Centre();
+	}
+
+private:
+	wxChoice* windowChoice;
+	wxCheckListBox* categoryList;
+	SpendingChart* chart;
+	std::vector<ExpenseStore::CategoryId> categories;   // by list position
+
+	void UpdateChart() {
+		static const wxColour palette[] = {
+			wxColour(60, 60, 60), wxColour(31, 119, 180), wxColour(255, 127, 14), wxColour(44, 160, 44),
+			wxColour(214, 39, 40), wxColour(148, 103, 189), wxColour(140, 86, 75), wxColour(227, 119, 194),
+			wxColour(188, 189, 34), wxColour(23, 190, 207),
+		};
+		std::vector<SpendingChart::Line> lines;
+		for (unsigned int item = 0; item < categoryList->GetCount(); item++) {
+			if (categoryList->IsChecked(item)) {
+				lines.push_back(SpendingChart::Line{ categories[item], categoryList->GetString(item), palette[item % WXSIZEOF(palette)] });
+			}
+		}
+		chart->SetLines(std::move(lines), static_cast<ExpenseDailySeries::Window>(windowChoice->GetSelection()));
+	}
+};
+
+
+void MainFrame::OnPlotButtonClicked(wxCommandEvent& evt)
+{
+	// The daily series are built from the store the first time, then kept up to date by every change
+	ChartDialog dlg(this, store, dailySeries);
 	dlg.ShowModal();
 }
+
+
+// Timings and counters of the hot paths, one line per metric. Reading them is a handful of
+// relaxed loads, so the dialog can be refreshed while a load or import is running.
+class DiagnosticsDialog : public wxDialog {
+public:
+	DiagnosticsDialog(wxWindow* parent, const ExpenseStore& store)
+		: wxDialog(parent, wxID_ANY, "Diagnostics", wxDefaultPosition, wxSize(820, 380),
+			wxDEFAULT_DIALOG_STYLE | wxRESIZE_BORDER), store(store)
+	{
+		wxBoxSizer* sizer = new wxBoxSizer(wxVERTICAL);
+
+		metricsList = new wxListCtrl(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxLC_REPORT | wxBORDER_SUNKEN);
+		const char* headings[] = { "Metric", "Calls", "Rows", "Bytes read", "Bytes written", "Mean", "p50", "p95", "Max" };
+		for (int column = 0; column < static_cast<int>(WXSIZEOF(headings)); column++) {
+			metricsList->InsertColumn(column, headings[column], column == 0 ? wxLIST_FORMAT_LEFT : wxLIST_FORMAT_RIGHT, column == 0 ? 110 : 85);
+		}
+		sizer->Add(metricsList, 1, wxEXPAND | wxALL, 10);
+		memoryText = new wxStaticText(this, wxID_ANY, "");
+		sizer->Add(memoryText, 0, wxEXPAND | wxLEFT | wxRIGHT | wxBOTTOM, 10);
+
+		wxBoxSizer* buttonSizer = new wxBoxSizer(wxHORIZONTAL);
+		collectCheck = new wxCheckBox(this, wxID_ANY, "Collect timings");
+		collectCheck->SetValue(Diagnostics::Enabled());
+		wxButton* refreshButton = new wxButton(this, wxID_ANY, "Refresh");
+		wxButton* resetButton = new wxButton(this, wxID_ANY, "Reset");
+		wxButton* saveButton = new wxButton(this, wxID_ANY, "Save JSON...");
+		buttonSizer->Add(collectCheck, 0, wxALIGN_CENTER_VERTICAL);
+		buttonSizer->AddStretchSpacer(1);
+		buttonSizer->Add(refreshButton, 0, wxRIGHT, 10);
+		buttonSizer->Add(resetButton, 0, wxRIGHT, 10);
+		buttonSizer->Add(saveButton, 0, wxRIGHT, 10);
+		buttonSizer->Add(new wxButton(this, wxID_OK, "Close"), 0);
+		sizer->Add(buttonSizer, 0, wxEXPAND | wxLEFT | wxRIGHT | wxBOTTOM, 10);
+
+		collectCheck->Bind(wxEVT_CHECKBOX, [this](wxCommandEvent&) { Diagnostics::Enable(collectCheck->GetValue()); });
+		refreshButton->Bind(wxEVT_BUTTON, [this](wxCommandEvent&) { ShowMetrics(); });
+		resetButton->Bind(wxEVT_BUTTON, [this](wxCommandEvent&) {
+			Diagnostics::Reset();
+			ShowMetrics();
+			});
+		saveButton->Bind(wxEVT_BUTTON, &DiagnosticsDialog::OnSaveButtonClicked, this);
+
+		ShowMetrics();
+		SetSizer(sizer);
+		Layout();
+		Centre();
+	}
+
+private:
+	const ExpenseStore& store;
+	wxListCtrl* metricsList;
+	wxStaticText* memoryText;
+	wxCheckBox* collectCheck;
+
+	static wxString FormatBytes(uint64_t bytes) {
+		if (bytes < 1024 * 1024) {
+			return wxString::Format("%.1f KB", bytes / 1024.0);
+		}
+		return wxString::Format("%.1f MB", bytes / (1024.0 * 1024.0));
+	}
+
+	static wxString FormatNanos(uint64_t nanos) {
+		if (nanos < 1000000) {
+			return wxString::Format("%.1f us", nanos / 1e3);
+		}
+		return wxString::Format("%.2f ms", nanos / 1e6);
+	}
+
+	void ShowMetrics() {
+		metricsList->DeleteAllItems();
+		for (int m = 0; m < Diagnostics::MetricCount; m++) {
+			DiagnosticsMetric metric = static_cast<DiagnosticsMetric>(m);
+			Diagnostics::Stats stats = Diagnostics::Read(metric);
+			long item = metricsList->InsertItem(m, Diagnostics::Name(metric));
+			metricsList->SetItem(item, 1, wxString::Format("%llu", static_cast<unsigned long long>(stats.calls)));
+			metricsList->SetItem(item, 2, wxString::Format("%llu", static_cast<unsigned long long>(stats.rows)));
+			metricsList->SetItem(item, 3, wxString::Format("%llu", static_cast<unsigned long long>(stats.bytesRead)));
+			metricsList->SetItem(item, 4, wxString::Format("%llu", static_cast<unsigned long long>(stats.bytesWritten)));
+			if (stats.calls > 0) {
+				metricsList->SetItem(item, 5, FormatNanos(stats.totalNanos / stats.calls));
+				metricsList->SetItem(item, 6, FormatNanos(stats.PercentileNanos(0.5)));
+				metricsList->SetItem(item, 7, FormatNanos(stats.PercentileNanos(0.95)));
+				metricsList->SetItem(item, 8, FormatNanos(stats.maxNanos));
+			}
+		}
+
+		const ExpenseStoreMemory memory = store.MemoryUsage();
+		memoryText->SetLabel(wxString::Format("Memory: %zu rows in %s (%.1f bytes per row): columns %s, descriptions %s "
+			"(%s of removed rows) in %zu arena chunks of %s, categories %s",
+			memory.rows, FormatBytes(memory.TotalBytes()), memory.BytesPerRow(), FormatBytes(memory.columnBytes),
+			FormatBytes(memory.descriptionBytes), FormatBytes(memory.deadDescriptionBytes), memory.arenaChunks,
+			FormatBytes(memory.arenaBytes), FormatBytes(memory.categoryBytes)));
+	}
+
+	void OnSaveButtonClicked(wxCommandEvent& evt) {
+		wxFileDialog fileDialog(this, "Save diagnostics", "", "diagnostics.json", "JSON files (*.json)|*.json",
+			wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+		if (fileDialog.ShowModal() != wxID_OK) {
+			return;
+		}
+		if (!Diagnostics::WriteJson(fileDialog.GetPath().ToStdString())) {
+			wxMessageBox("The diagnostics could not be written to " + fileDialog.GetPath() + ".", "Diagnostics", wxOK | wxICON_ERROR, this);
+		}
+	}
+};
+
+
+void MainFrame::OnDiagnosticsButtonClicked(wxCommandEvent& evt)
+{
+	DiagnosticsDialog dlg(this, store);
+	dlg.ShowModal();
+}
+
+
+// Lets the user map the columns of a bank or spreadsheet export before it is imported
+class CsvImportDialog : public wxDialog {
+public:
+	CsvImportDialog(wxWindow* parent, const std::vector<std::string>& previewLines)
+		: wxDialog(parent, wxID_ANY, "Import CSV",
+			wxDefaultPosition, wxSize(800, 560),
+			wxDEFAULT_DIALOG_STYLE | wxRESIZE_BORDER),
+		lines(previewLines)
+	{
+		// Start from what the first line tells us: its delimiter and, if it is a header, its columns
+		if (!lines.empty()) {
+			options.delimiter = DetectCsvDelimiter(lines[0]);
+			options.hasHeader = MapCsvHeader(lines[0], options);
+		}
+
+		wxBoxSizer* sizer = new wxBoxSizer(wxVERTICAL);
+		wxFlexGridSizer* grid = new wxFlexGridSizer(4, wxSize(10, 8));
+		grid->AddGrowableCol(1);
+		grid->AddGrowableCol(3);
+
+		const wxString delimiters[] = { "Comma", "Semicolon", "Tab", "Pipe" };
+		delimiterChoice = new wxChoice(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, WXSIZEOF(delimiters), delimiters);
+		delimiterChoice->SetSelection(static_cast<int>(std::string(",;\t|").find(options.delimiter)));
+		const wxString quotes[] = { "Double quote", "Single quote", "None" };
+		quoteChoice = new wxChoice(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, WXSIZEOF(quotes), quotes);
+		quoteChoice->SetSelection(0);
+		headerCheck = new wxCheckBox(this, wxID_ANY, "First line is a header");
+		headerCheck->SetValue(options.hasHeader);
+		const wxString dateFormats[] = { "YYYY-MM-DD", "DD/MM/YYYY", "MM/DD/YYYY" };
+		dateFormatChoice = new wxChoice(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, WXSIZEOF(dateFormats), dateFormats);
+		dateFormatChoice->SetSelection(static_cast<int>(options.dateFormat));
+		const wxString decimals[] = { "1,234.56", "1.234,56" };
+		decimalChoice = new wxChoice(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, WXSIZEOF(decimals), decimals);
+		decimalChoice->SetSelection(0);
+		negateCheck = new wxCheckBox(this, wxID_ANY, "Spending is listed as negative");
+		skipDuplicatesCheck = new wxCheckBox(this, wxID_ANY, "Skip rows already in the history");
+		skipDuplicatesCheck->SetValue(true);
+		defaultCategoryInput = new wxTextCtrl(this, wxID_ANY, options.defaultCategory);
+
+		const wxString columnNames[] = { "Description", "Category", "Amount", "Date" };
+		for (int i = 0; i < ColumnCount; i++) {
+			columnChoices[i] = new wxChoice(this, wxID_ANY);
+		}
+
+		grid->Add(new wxStaticText(this, wxID_ANY, "Delimiter"), 0, wxALIGN_CENTER_VERTICAL);
+		grid->Add(delimiterChoice, 1, wxEXPAND);
+		grid->Add(new wxStaticText(this, wxID_ANY, "Quotes"), 0, wxALIGN_CENTER_VERTICAL);
+		grid->Add(quoteChoice, 1, wxEXPAND);
+		for (int i = 0; i < ColumnCount; i++) {
+			grid->Add(new wxStaticText(this, wxID_ANY, columnNames[i] + " column"), 0, wxALIGN_CENTER_VERTICAL);
+			grid->Add(columnChoices[i], 1, wxEXPAND);
+		}
+		grid->Add(new wxStaticText(this, wxID_ANY, "Date format"), 0, wxALIGN_CENTER_VERTICAL);
+		grid->Add(dateFormatChoice, 1, wxEXPAND);
+		grid->Add(new wxStaticText(this, wxID_ANY, "Numbers"), 0, wxALIGN_CENTER_VERTICAL);
+		grid->Add(decimalChoice, 1, wxEXPAND);
+		grid->Add(new wxStaticText(this, wxID_ANY, "Default category"), 0, wxALIGN_CENTER_VERTICAL);
+		grid->Add(defaultCategoryInput, 1, wxEXPAND);
+		grid->Add(headerCheck, 0, wxALIGN_CENTER_VERTICAL);
+		grid->Add(negateCheck, 0, wxALIGN_CENTER_VERTICAL);
+		grid->Add(skipDuplicatesCheck, 0, wxALIGN_CENTER_VERTICAL);
+		sizer->Add(grid, 0, wxEXPAND | wxALL, 10);
+
+		preview = new wxTextCtrl(this, wxID_ANY, "", wxDefaultPosition, wxDefaultSize,
+			wxTE_MULTILINE | wxTE_READONLY | wxTE_DONTWRAP);
+		sizer->Add(preview, 1, wxEXPAND | wxLEFT | wxRIGHT, 10);
+		sizer->Add(CreateStdDialogButtonSizer(wxOK | wxCANCEL), 0, wxEXPAND | wxALL, 10);
+
+		delimiterChoice->Bind(wxEVT_CHOICE, &CsvImportDialog::OnLayoutChanged, this);
+		quoteChoice->Bind(wxEVT_CHOICE, &CsvImportDialog::OnLayoutChanged, this);
+		headerCheck->Bind(wxEVT_CHECKBOX, &CsvImportDialog::OnLayoutChanged, this);
+		for (int i = 0; i < ColumnCount; i++) {
+			columnChoices[i]->Bind(wxEVT_CHOICE, &CsvImportDialog::OnMappingChanged, this);
+		}
+		dateFormatChoice->Bind(wxEVT_CHOICE, &CsvImportDialog::OnMappingChanged, this);
+		decimalChoice->Bind(wxEVT_CHOICE, &CsvImportDialog::OnMappingChanged, this);
+		negateCheck->Bind(wxEVT_CHECKBOX, &CsvImportDialog::OnMappingChanged, this);
+
+		FillColumnChoices();
+		ShowPreview();
+
+		SetSizer(sizer);
+		SetMinSize(wxSize(600, 450));
+		Layout();
+		Centre();
+	}
+
+	CsvImportOptions Options() {
+		ReadOptions();
+		return options;
+	}
+
+	bool SkipDuplicates() const { return skipDuplicatesCheck->GetValue(); }
+
+private:
+	static constexpr int ColumnCount = 4;
+
+	std::vector<std::string> lines;
+	CsvImportOptions options;
+	wxChoice* delimiterChoice;
+	wxChoice* quoteChoice;
+	wxCheckBox* headerCheck;
+	wxChoice* columnChoices[ColumnCount];
+	wxChoice* dateFormatChoice;
+	wxChoice* decimalChoice;
+	wxCheckBox* negateCheck;
+	wxCheckBox* skipDuplicatesCheck;
+	wxTextCtrl* defaultCategoryInput;
+	wxTextCtrl* preview;
+
+	int* Column(int i) {
+		int* columns[ColumnCount] = { &options.descriptionColumn, &options.categoryColumn, &options.amountColumn, &options.dateColumn };
+		return columns[i];
+	}
+
+	void ReadOptions() {
+		const char delimiters[] = { ',', ';', '\t', '|' };
+		const char quotes[] = { '"', '\'', '\0' };
+		options.delimiter = delimiters[delimiterChoice->GetSelection()];
+		options.quote = quotes[quoteChoice->GetSelection()];
+		options.hasHeader = headerCheck->GetValue();
+		for (int i = 0; i < ColumnCount; i++) {
+			*Column(i) = columnChoices[i]->GetSelection() - 1;  // the first entry is "(none)"
+		}
+		options.dateFormat = static_cast<CsvDateFormat>(dateFormatChoice->GetSelection());
+		options.decimalSeparator = decimalChoice->GetSelection() == 1 ? ',' : '.';
+		options.negateAmounts = negateCheck->GetValue();
+		options.defaultCategory = defaultCategoryInput->GetValue().ToStdString();
+	}
+
+	// Lists the fields of the first line, by name when it is a header and by sample value otherwise
+	void FillColumnChoices() {
+		std::vector<std::string_view> fields;
+		std::string scratch;
+		size_t count = lines.empty() ? 0 : SplitCsvLine(lines[0], options.delimiter, options.quote, fields, scratch);
+		for (int i = 0; i < ColumnCount; i++) {
+			wxArrayString items;
+			items.Add("(none)");
+			for (size_t f = 0; f < count; f++) {
+				items.Add(wxString::Format("%zu: ", f + 1) + ToWxString(fields[f].substr(0, 30)));
+			}
+			columnChoices[i]->Set(items);
+			int column = *Column(i);
+			columnChoices[i]->SetSelection(column >= 0 && static_cast<size_t>(column) < count ? column + 1 : 0);
+		}
+	}
+
+	// Shows how the first rows read with the current settings
+	void ShowPreview() {
+		ReadOptions();
+		std::vector<std::string_view> fields;
+		std::string scratch;
+		CsvRow row;
+		wxString output;
+		for (size_t i = options.hasHeader ? 1 : 0; i < lines.size(); i++) {
+			if (!ParseCsvRow(lines[i], options, row, fields, scratch)) {
+				continue;
+			}
+			if (row.error) {
+				output += wxString::Format("line %zu: ", i + 1) + row.error + " '" + ToWxString(row.errorField) + "'\n";
+			}
+			else {
+				output += ToWxString(FormatIsoDate(row.day)) + "  " + ToWxString(FormatAmountCents(row.amountCents)) + "  "
+					+ ToWxString(row.category) + "  " + ToWxString(row.description) + "\n";
+			}
+		}
+		preview->SetValue(output);
+	}
+
+	void OnLayoutChanged(wxCommandEvent& evt) {
+		ReadOptions();
+		if (options.hasHeader && !lines.empty()) {
+			MapCsvHeader(lines[0], options);
+		}
+		FillColumnChoices();
+		ShowPreview();
+	}
+
+	void OnMappingChanged(wxCommandEvent& evt) {
+		ShowPreview();
+	}
+};
+
+
+void MainFrame::OnImportButtonClicked(wxCommandEvent& evt)
+{
+	if (importer || !JournalWritable()) {
+		return;
+	}
+	wxFileDialog fileDialog(this, "Import expenses", "", "", "CSV files (*.csv;*.txt)|*.csv;*.txt|All files (*.*)|*.*",
+		wxFD_OPEN | wxFD_FILE_MUST_EXIST);
+	if (fileDialog.ShowModal() != wxID_OK) {
+		return;
+	}
+	std::string fileName = fileDialog.GetPath().ToStdString();
+
+	// The first lines are enough to map the columns
+	std::vector<std::string> previewLines;
+	std::ifstream preview(fileName, std::ios::binary);
+	std::string line;
+	while (previewLines.size() < 20 && std::getline(preview, line)) {
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		previewLines.push_back(line);
+	}
+
+	CsvImportDialog mapping(this, previewLines);
+	if (mapping.ShowModal() != wxID_OK) {
+		return;
+	}
+
+	// The pipeline parses on worker threads; its committer hands each batch to the UI thread
+	importer = std::make_unique<ExpenseImporter>();
+	importedRows = 0;
+	importSkipped = 0;
+	importErrors.clear();
+	importFirstRow = static_cast<ExpenseStore::RowId>(store.Size());
+	importSkipDuplicates = mapping.SkipDuplicates();
+	importDuplicateCount = 0;
+	importMatched.clear();
+	importDuplicates.Clear();
+	bool started = importer->Start(fileName, mapping.Options(), [this](std::shared_ptr<ExpenseImporter::Batch> batch) {
+		wxThreadEvent* event = new wxThreadEvent(EVT_IMPORT_BATCH);
+		event->SetPayload(batch);
+		wxQueueEvent(this, event);
+		});
+	if (!started) {
+		importer.reset();
+		wxMessageBox("Could not open " + fileDialog.GetPath());
+		return;
+	}
+	importButton->Disable();
+	importProgress = new wxProgressDialog("Importing", "Reading " + fileDialog.GetFilename(), 1000, this,
+		wxPD_CAN_ABORT | wxPD_AUTO_HIDE | wxPD_ELAPSED_TIME | wxPD_REMAINING_TIME);
+}
+
+// Commits one batch: a bulk append to the store, one journal write and a merge into each index
+void MainFrame::OnImportBatch(wxThreadEvent& evt)
+{
+	std::shared_ptr<ExpenseImporter::Batch> batch = evt.GetPayload<std::shared_ptr<ExpenseImporter::Batch>>();
+	if (!importer) {
+		return; // Left over from a cancelled import
+	}
+	if (batch->last) {
+		FinishImport(false);
+		return;
+	}
+
+	// A row is a duplicate while the history still has an unmatched row with the same fingerprint,
+	// so a statement with three identical coffees against a history with two adds just one. The
+	// duplicate index only learns this import's rows at the end and so answers for the history.
+	std::vector<bool> duplicate(batch->Size());
+	for (size_t i = 0; i < batch->Size(); i++) {
+		uint64_t fingerprint = batch->fingerprints[i];
+		uint32_t inHistory = duplicateIndex.Count(fingerprint);
+		if (inHistory == 0) {
+			continue;
+		}
+		uint32_t& matched = importMatched[fingerprint];
+		if (matched < inHistory) {
+			matched++;
+			duplicate[i] = true;
+			importDuplicateCount++;
+			if (importDuplicates.Size() < MaxReviewedDuplicates) {
+				importDuplicates.Add(batch->Description(i), batch->categoryNames[batch->categories[i]], batch->amounts[i], batch->days[i]);
+			}
+		}
+	}
+
+	size_t categoryCount = store.CategoryCount();
+	ExpenseStore::RowId first = static_cast<ExpenseStore::RowId>(store.Size());
+	if (importSkipDuplicates) {
+		batch->AppendTo(store, duplicate);
+	}
+	else {
+		batch->AppendTo(store);
+	}
+	CommitAppendedRows(first, categoryCount);
+	importedRows += store.Size() - first;
+	importSkipped += batch->errorCount;
+	for (ExpenseParseError& error : batch->errors) {
+		if (importErrors.size() < 10) {
+			importErrors.push_back(std::move(error));
+		}
+	}
+	importer->Acknowledge();
+	UpdateView();
+
+	int progress = importer->FileSize() ? static_cast<int>(batch->bytesDone * 999 / importer->FileSize()) : 0;
+	if (!importProgress->Update(progress, wxString::Format("%zu expenses imported", importedRows))) {
+		FinishImport(true);
+	}
+}
+
+// Logs and indexes rows appended in one go; the duplicate index is left to the caller
+void MainFrame::CommitAppendedRows(ExpenseStore::RowId first, size_t categoryCount)
+{
+	undoStack.Clear();  // Imported rows have no undo steps, so the earlier steps would no longer line up with the rows
+	journal.AppendAdds(store, first, static_cast<ExpenseStore::RowId>(store.Size()));
+	IndexAppendedRows(first, categoryCount);
+}
+
+void MainFrame::IndexAppendedRows(ExpenseStore::RowId first, size_t categoryCount)
+{
+	ExpenseStore::RowId last = static_cast<ExpenseStore::RowId>(store.Size());
+	sortIndex.InsertRange(first, last);
+	for (ExpenseStore::RowId row = first; row < last; row++) {
+		totalsCache.Insert(row);
+		dailySeries.Insert(row);
+		searchIndex.Insert(row);
+		categoryIndex.Insert(row);
+	}
+	for (ExpenseStore::CategoryId id = static_cast<ExpenseStore::CategoryId>(categoryCount); id < store.CategoryCount(); id++) {
+		catInput->Append(ToWxString(store.CategoryName(id)));
+	}
+}
+
+void MainFrame::FinishImport(bool cancelled)
+{
+	importer->Cancel();
+	importer.reset();
+	delete importProgress;
+	importProgress = nullptr;
+	importButton->Enable();
+	duplicateIndex.InsertRange(importFirstRow, static_cast<ExpenseStore::RowId>(store.Size()));
+	importMatched.clear();
+	journal.CompactIfNeeded(store);
+
+	wxString message = wxString::Format(cancelled ? "Import cancelled after %zu expenses." : "Imported %zu expenses.", importedRows);
+	if (importSkipped > 0) {
+		message += wxString::Format("\n%zu lines could not be read and were skipped:", importSkipped);
+		for (const ExpenseParseError& error : importErrors) {
+			message += wxString::Format("\n  line %zu: ", error.line) + error.message;
+		}
+	}
+	if (importDuplicateCount == 0) {
+		wxMessageBox(message, "Import CSV");
+		return;
+	}
+	message += wxString::Format(importSkipDuplicates ? "\n\n%zu rows were already in the history and were skipped."
+		: "\n\n%zu rows were already in the history and were imported again.", importDuplicateCount);
+	message += "\nReview them now?";
+	if (wxMessageBox(message, "Import CSV", wxYES_NO) == wxYES) {
+		ReviewDuplicates();
+	}
+	importDuplicates.Clear();
+}
+
+// Lists the duplicates of the last import; skipped ones can still be imported one by one
+class DuplicateReviewDialog : public wxDialog {
+public:
+	DuplicateReviewDialog(wxWindow* parent, const ExpenseStore& duplicates, size_t total, bool skipped)
+		: wxDialog(parent, wxID_ANY, "Duplicate Expenses",
+			wxDefaultPosition, wxSize(800, 500),
+			wxDEFAULT_DIALOG_STYLE | wxRESIZE_BORDER)
+	{
+		wxBoxSizer* sizer = new wxBoxSizer(wxVERTICAL);
+		wxString note = skipped ? "These rows matched expenses already in the history and were not imported. Check the ones to import anyway."
+			: "These rows matched expenses already in the history and were imported again.";
+		if (total > duplicates.Size()) {
+			note += wxString::Format(" Showing the first %zu of %zu.", duplicates.Size(), total);
+		}
+		wxStaticText* noteText = new wxStaticText(this, wxID_ANY, note);
+		noteText->Wrap(760);
+		sizer->Add(noteText, 0, wxEXPAND | wxALL, 10);
+
+		wxArrayString items;
+		items.Alloc(duplicates.Size());
+		for (ExpenseStore::RowId row = 0; row < duplicates.Size(); row++) {
+			items.Add(ToWxString(FormatIsoDate(duplicates.Day(row))) + "   " + ToWxString(FormatAmountCents(duplicates.AmountCents(row)))
+				+ "   " + ToWxString(duplicates.Category(row)) + "   " + ToWxString(duplicates.Description(row)));
+		}
+		if (skipped) {
+			checkList = new wxCheckListBox(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, items);
+			sizer->Add(checkList, 1, wxEXPAND | wxLEFT | wxRIGHT, 10);
+			wxBoxSizer* buttonSizer = new wxBoxSizer(wxHORIZONTAL);
+			buttonSizer->AddStretchSpacer(1);
+			buttonSizer->Add(new wxButton(this, wxID_OK, "Import checked"), 0, wxRIGHT, 10);
+			buttonSizer->Add(new wxButton(this, wxID_CANCEL, "Close"), 0);
+			sizer->Add(buttonSizer, 0, wxEXPAND | wxALL, 10);
+		}
+		else {
+			sizer->Add(new wxListBox(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, items), 1, wxEXPAND | wxLEFT | wxRIGHT, 10);
+			sizer->Add(CreateStdDialogButtonSizer(wxCLOSE), 0, wxEXPAND | wxALL, 10);
+			SetEscapeId(wxID_CLOSE);
+		}
+
+		SetSizer(sizer);
+		SetMinSize(wxSize(500, 300));
+		Layout();
+		Centre();
+	}
+
+	std::vector<ExpenseStore::RowId> CheckedRows() const {
+		std::vector<ExpenseStore::RowId> rows;
+		for (unsigned int i = 0; checkList && i < checkList->GetCount(); i++) {
+			if (checkList->IsChecked(i)) {
+				rows.push_back(i);
+			}
+		}
+		return rows;
+	}
+
+private:
+	wxCheckListBox* checkList = nullptr;
+};
+
+void MainFrame::ReviewDuplicates()
+{
+	DuplicateReviewDialog dialog(this, importDuplicates, importDuplicateCount, importSkipDuplicates);
+	if (dialog.ShowModal() != wxID_OK) {
+		return;
+	}
+	std::vector<ExpenseStore::RowId> rows = dialog.CheckedRows();
+	if (rows.empty() || !JournalWritable()) {
+		return;
+	}
+	size_t categoryCount = store.CategoryCount();
+	ExpenseStore::RowId first = static_cast<ExpenseStore::RowId>(store.Size());
+	for (ExpenseStore::RowId row : rows) {
+		store.Add(importDuplicates.Description(row), importDuplicates.Category(row), importDuplicates.AmountCents(row), importDuplicates.Day(row));
+	}
+	CommitAppendedRows(first, categoryCount);
+	duplicateIndex.InsertRange(first, static_cast<ExpenseStore::RowId>(store.Size()));
+	journal.CompactIfNeeded(store);
+	UpdateView();
+}
@@ -3,8 +3,26 @@
 #include <wx/listctrl.h>
 #include <wx/datectrl.h>
 #include <wx/dateevt.h>
+#include <wx/progdlg.h>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 #include "Expense.h"
+#include "ExpenseStore.h"
+#include "ExpenseListCtrl.h"
+#include "ExpenseJournal.h"
+#include "ExpenseSortIndex.h"
+#include "ExpenseSearchIndex.h"
+#include "ExpenseCategoryIndex.h"
+#include "ExpenseDuplicateIndex.h"
+#include "ExpenseTotals.h"
+#include "ExpenseSeries.h"
+#include "ExpenseAggregator.h"
+#include "ExpenseImporter.h"
+#include "ExpenseLoader.h"
+#include "ExpenseUndoStack.h"
+#include "Diagnostics.h"
+#include "ThreadPool.h"
 
 class MainFrame : public wxFrame
 {
@@ -24,10 +42,19 @@ private:
     wxStaticText* dateText;
     wxDatePickerCtrl* dateInput;
     wxButton* addButton;
-    wxListCtrl* listCtrl;
+    ExpenseListCtrl* listCtrl;
     wxButton* clearButton;
+    wxButton* importButton;
+    wxButton* diagnosticsButton;
+    wxButton* plotButton;
     wxButton* settingsButton;
     wxStaticBox* inputBox;
+    wxCheckBox* dateFilterCheck;
+    wxDatePickerCtrl* filterFromInput;
+    wxStaticText* filterToText;
+    wxDatePickerCtrl* filterToInput;
+    wxTextCtrl* searchInput;
+    wxStaticText* totalText;
 
 
 
@@ -39,17 +66,58 @@ private:
 
 
     // Member variables
-    std::vector<wxString> categoryList;
+    ExpenseStore store;
+    ExpenseJournal journal{ "expense.bbs", "expense.journal", "expense.txt" };
+    ExpenseSortIndex sortIndex{ store };
+    ExpenseSearchIndex searchIndex{ store };
+    ExpenseCategoryIndex categoryIndex{ store };
+    ExpenseTotalsCache totalsCache{ store };
+    ExpenseDailySeries dailySeries{ store };
+    ExpenseDuplicateIndex duplicateIndex{ store };
+    ExpenseUndoStack undoStack;
+    ThreadPool pool;
     bool isDarkMode = false;
     bool categorySortAscending = true;
     bool amountSortAscending = true;
     bool dateSortAscending = true;
+    int sortColumn = -1;          // list column the view is sorted by, -1 for insertion order
+    bool sortDescending = false;
+
+    // Saved history still being loaded; batches arrive as wxThreadEvents and nothing can be
+    // changed until the journal is resumed. A history in month segments resumes it once the
+    // newest month is in: rows can then be added and deleted while the older rows collect in
+    // olderRows, to go in front of the store when the last of them arrives, and their months'
+    // saved totals stand in for them meanwhile.
+    std::unique_ptr<ExpenseHistoryLoader> loader;
+    bool loadingOlder = false;
+    ExpenseStore olderRows;
+    std::vector<ExpenseMonthTotal> olderMonths;
+    bool historyUnreadable = false;  // the snapshot exists but could not be read; nothing may be logged
+
+    // Running CSV import; batches arrive as wxThreadEvents and are committed on the UI thread
+    std::unique_ptr<ExpenseImporter> importer;
+    wxProgressDialog* importProgress = nullptr;
+    size_t importedRows = 0;
+    size_t importSkipped = 0;
+    std::vector<ExpenseParseError> importErrors;
+    ExpenseStore::RowId importFirstRow = 0;   // rows from here on join the duplicate index when the import ends
+    bool importSkipDuplicates = true;
+    size_t importDuplicateCount = 0;
+    std::unordered_map<uint64_t, uint32_t> importMatched;  // fingerprint -> history rows already matched
+    ExpenseStore importDuplicates;            // the first duplicates, kept for review
+    static constexpr size_t MaxReviewedDuplicates = 10000;
 
     // Methods
     void CreateControls();
     void BindEvents();
     void AddExpenseFromInput();
     void DeleteExpense();
+    ExpenseStore::RowId InsertRow(ExpenseStore::RowId row, std::string_view description, std::string_view category, int64_t amountCents, int32_t day);
+    void RemoveRow(ExpenseStore::RowId row);
+    void RemoveRows(const std::vector<ExpenseStore::RowId>& rows);
+    void ClearRows(ExpenseUndoStack::Step& step);
+    void OnUndo(wxCommandEvent& evt);
+    void OnRedo(wxCommandEvent& evt);
     void EnableDarkMode();
     void EnableLightMode();
 
@@ -69,6 +137,24 @@ private:
     void OnMouseLeave(wxMouseEvent& event);
     void OnListCtrlResize(wxSizeEvent& event);
     void AdjustColumns();
+    void OnDateFilterChanged(wxCommandEvent& evt);
+    void OnSearchChanged(wxCommandEvent& evt);
+    void OnImportButtonClicked(wxCommandEvent& evt);
+    void OnDiagnosticsButtonClicked(wxCommandEvent& evt);
+    void OnImportBatch(wxThreadEvent& evt);
+    void FinishImport(bool cancelled);
+    void ReviewDuplicates();
+    void CommitAppendedRows(ExpenseStore::RowId first, size_t categoryCount);
+    void IndexAppendedRows(ExpenseStore::RowId first, size_t categoryCount);
+    void OnLoadBatch(wxThreadEvent& evt);
+    void FinishLoad(const ExpenseHistoryLoader::Batch& last);
+    void StartEditingNewest(const ExpenseHistoryLoader::Batch& newest);
+    void InsertOlderRows();
+    bool AddOlderTotals(bool dateFiltered, int32_t fromDay, int32_t toDay, Money& total, size_t& rows) const;
+    bool JournalWritable();
+    void EnableEditing(bool enable);
+    void UpdateView();
+    void ShowTotal(Money total, size_t rows, bool complete = true);
 
     // File operations
     void AddSavedExpense();
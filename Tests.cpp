@@ -0,0 +1,1346 @@
+// bachat-tests: checks the file formats and incremental indexes against plain reference
+// implementations. Each check is its own ctest test; run one by name or all without arguments.
+//
+//   bachat-tests [--dir DIR] [NAME]...
+#include "ExpenseAggregator.h"
+#include "ExpenseCategoryIndex.h"
+#include "ExpenseCsv.h"
+#include "ExpenseDuplicateIndex.h"
+#include "ExpenseJournal.h"
+#include "ExpensePack.h"
+#include "ExpenseParser.h"
+#include "ExpensePivot.h"
+#include "ExpenseReader.h"
+#include "ExpenseSearchIndex.h"
+#include "ExpenseSegments.h"
+#include "ExpenseSeries.h"
+#include "ExpenseSortIndex.h"
+#include "ExpenseStore.h"
+#include "ExpenseTotals.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace {
+	std::string testDir = "bachat-tests-data";
+	size_t failures = 0;
+
+#define CHECK(condition) Check((condition), #condition, __FILE__, __LINE__)
+
+	bool Check(bool condition, const char* text, const char* file, int line) {
+		if (!condition) {
+			std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, text);
+			failures++;
+		}
+		return condition;
+	}
+
+	std::string TestFile(const std::string& name) {
+		return (std::filesystem::path(testDir) / name).string();
+	}
+
+	void RemoveFiles(const std::vector<std::string>& names) {
+		std::error_code ec;
+		for (const std::string& name : names) {
+			std::filesystem::remove(TestFile(name), ec);
+		}
+		std::filesystem::remove_all(TestFile("expense.bbs.segments"), ec);
+	}
+
+	// Descriptions with spaces and the odd leading '#', the way people type them
+	std::string RandomDescription(std::mt19937& random) {
+		static const char* const words[] = { "coffee", "rent", "#1", "bus pass", "gift", "#sequence", "tea", "x" };
+		std::string text = words[random() % 8];
+		for (size_t i = random() % 3; i > 0; i--) {
+			text += ' ';
+			text += words[random() % 8];
+		}
+		return text;
+	}
+
+	void AddRandomRow(ExpenseStore& store, std::mt19937& random) {
+		store.Add(RandomDescription(random), "category " + std::to_string(random() % 12),
+			static_cast<int64_t>(random() % 200000) - 20000, 18000 + static_cast<int32_t>(random() % 3000));
+	}
+
+	bool SameRows(const ExpenseStore& a, const ExpenseStore& b) {
+		if (a.Size() != b.Size()) {
+			return false;
+		}
+		for (ExpenseStore::RowId row = 0; row < a.Size(); row++) {
+			if (a.Description(row) != b.Description(row) || a.Category(row) != b.Category(row)
+				|| a.AmountCents(row) != b.AmountCents(row) || a.Day(row) != b.Day(row)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Random edits logged the way MainFrame logs them, then the files reopened and compared with
+	// the store the edits were made to
+	void TestJournalReplay() {
+		const std::vector<std::string> files = { "expense.bbs", "expense.journal", "expense.txt" };
+		RemoveFiles(files);
+		std::mt19937 random(3);
+		ExpenseStore expected;
+		for (int session = 0; session < 6; session++) {
+			ExpenseStore store;
+			ExpenseJournal journal(TestFile("expense.bbs"), TestFile("expense.journal"), TestFile("expense.txt"));
+			CHECK(journal.Open(store));
+			CHECK(SameRows(store, expected));
+			for (int edit = 0; edit < 3000; edit++) {
+				const unsigned kind = random() % 100;
+				if (kind < 60 || store.Empty()) {
+					AddRandomRow(store, random);
+					journal.AppendAdd(store, static_cast<ExpenseStore::RowId>(store.Size() - 1));
+				}
+				else if (kind < 80) {
+					const ExpenseStore::RowId row = random() % store.Size();
+					journal.AppendRemove(row);
+					store.Remove(row);
+				}
+				else if (kind < 90) {
+					const ExpenseStore::RowId row = random() % (store.Size() + 1);
+					store.Insert(row, RandomDescription(random), "inserted", 500, 19000);
+					journal.AppendInsert(store, row);
+				}
+				else if (kind < 99) {
+					std::vector<ExpenseStore::RowId> rows;
+					for (ExpenseStore::RowId row = 0; row < store.Size(); row++) {
+						if (random() % 10 == 0) {
+							rows.push_back(row);
+						}
+					}
+					ExpenseStore removed;
+					for (ExpenseStore::RowId row : rows) {
+						removed.Add(store.Description(row), store.Category(row), store.AmountCents(row), store.Day(row));
+					}
+					journal.AppendRemoveRows(rows);
+					store.RemoveRows(rows);
+					if (random() % 3 == 0) {
+						// Undone, as MainFrame::OnUndo puts the rows back
+						store.InsertRows(rows, removed);
+						journal.AppendInsertRows(store, rows);
+					}
+				}
+				else if (session % 2 == 1) {
+					ExpenseStore cleared = store.TakeRows();
+					ExpenseSegmentLayout before = journal.AppendClear();
+					const uint64_t clearSequence = journal.LastSequence();
+					journal.CompactIfNeeded(store);
+					if (random() % 2 == 0) {
+						// Undone as MainFrame::OnUndo does, after a row added since was undone first
+						if (random() % 2 == 0) {
+							store.Add("after the clear", "undone", 100, 19000);
+							journal.AppendAdd(store, 0);
+							store.Remove(0);
+							journal.AppendRemove(0);
+						}
+						store.RestoreRows(std::move(cleared));
+						if (!journal.AppendUndoClear(std::move(before), clearSequence)) {
+							journal.AppendAdds(store, 0, static_cast<ExpenseStore::RowId>(store.Size()));
+						}
+					}
+				}
+				journal.CompactIfNeeded(store);
+			}
+			journal.Close();
+			expected = store;
+		}
+		ExpenseStore store;
+		ExpenseJournal journal(TestFile("expense.bbs"), TestFile("expense.journal"), TestFile("expense.txt"));
+		size_t skippedLines = 0;
+		CHECK(journal.Open(store, &skippedLines) && skippedLines == 0);
+		CHECK(SameRows(store, expected));
+		journal.Close();
+		RemoveFiles(files);
+	}
+
+	// Undoing a large batch removal logs the rows put back in several records; both the journal and
+	// the streaming reader must read them back in place
+	void TestUndoRestore() {
+		const std::vector<std::string> files = { "expense.bbs", "expense.journal", "expense.txt" };
+		RemoveFiles(files);
+		std::mt19937 random(17);
+		ExpenseStore expected;
+		{
+			ExpenseStore store;
+			ExpenseJournal journal(TestFile("expense.bbs"), TestFile("expense.journal"), TestFile("expense.txt"));
+			CHECK(journal.Open(store));
+			for (int row = 0; row < 200000; row++) {
+				AddRandomRow(store, random);
+			}
+			journal.AppendAdds(store, 0, static_cast<ExpenseStore::RowId>(store.Size()));
+			journal.CompactIfNeeded(store);
+			std::vector<ExpenseStore::RowId> rows;
+			ExpenseStore removed;
+			for (ExpenseStore::RowId row = 0; row < store.Size(); row += 2) {
+				rows.push_back(row);
+				removed.Add(store.Description(row), store.Category(row), store.AmountCents(row), store.Day(row));
+			}
+			journal.AppendRemoveRows(rows);
+			store.RemoveRows(rows);
+			store.InsertRows(rows, removed);
+			journal.AppendInsertRows(store, rows);
+			journal.AppendRemove(1);
+			store.Remove(1);
+			journal.Close();
+			expected = store;
+		}
+		ExpenseStore store;
+		ExpenseJournal journal(TestFile("expense.bbs"), TestFile("expense.journal"), TestFile("expense.txt"));
+		CHECK(journal.Open(store));
+		CHECK(SameRows(store, expected));
+		journal.Close();
+
+		ExpenseHistoryReader reader;
+		CHECK(reader.Open(TestFile("expense.bbs"), TestFile("expense.journal"), TestFile("expense.txt")));
+		CHECK(reader.Size() == expected.Size());
+		ExpenseStore streamed;
+		ExpenseRecord record;
+		while (reader.Next(record)) {
+			streamed.Add(record.description, record.category, record.amountCents, record.day);
+		}
+		CHECK(SameRows(streamed, expected));
+		reader.Close();
+		RemoveFiles(files);
+	}
+
+	// Undoing a clear logs one record and leaves the saved segments clean; once a save has covered
+	// the clear, the rows are logged again instead
+	void TestUndoClear() {
+		const std::vector<std::string> files = { "expense.bbs", "expense.journal", "expense.txt" };
+		RemoveFiles(files);
+		std::mt19937 random(29);
+		ExpenseStore expected;
+		for (int row = 0; row < 20000; row++) {
+			AddRandomRow(expected, random);
+		}
+		// The reader first: opening the journal may start a save
+		auto readBack = [&](bool undoneInOneRecord) {
+			ExpenseHistoryReader reader;
+			CHECK(reader.Open(TestFile("expense.bbs"), TestFile("expense.journal"), TestFile("expense.txt")));
+			ExpenseStore streamed;
+			ExpenseRecord record;
+			while (reader.Next(record)) {
+				streamed.Add(record.description, record.category, record.amountCents, record.day);
+			}
+			CHECK(SameRows(streamed, expected));
+			const ExpenseJournal::LoadState state = reader.JournalState();
+			CHECK(state.segments.Rows() == expected.Size());
+			CHECK((state.segments.DirtyRows() == 0) == undoneInOneRecord);
+			reader.Close();
+
+			ExpenseStore store;
+			ExpenseJournal journal(TestFile("expense.bbs"), TestFile("expense.journal"), TestFile("expense.txt"));
+			CHECK(journal.Open(store));
+			CHECK(SameRows(store, expected));
+			journal.Close();
+		};
+		{
+			ExpenseStore store;
+			ExpenseJournal journal(TestFile("expense.bbs"), TestFile("expense.journal"), TestFile("expense.txt"));
+			CHECK(journal.Open(store));
+			store = expected;
+			journal.AppendAdds(store, 0, static_cast<ExpenseStore::RowId>(store.Size()));
+			journal.CompactIfNeeded(store);
+			journal.Close();
+			store.Clear();
+			CHECK(journal.Open(store) && SameRows(store, expected));
+
+			ExpenseStore cleared = store.TakeRows();
+			ExpenseSegmentLayout before = journal.AppendClear();
+			const uint64_t clearSequence = journal.LastSequence();
+			store.Add("after the clear", "undone", 100, 19000);
+			journal.AppendAdd(store, 0);
+			store.Remove(0);
+			journal.AppendRemove(0);
+			store.RestoreRows(std::move(cleared));
+			const uint64_t sequence = journal.LastSequence();
+			CHECK(journal.AppendUndoClear(std::move(before), clearSequence));
+			CHECK(journal.LastSequence() == sequence + 1);
+			journal.Close();
+		}
+		readBack(true);
+		{
+			ExpenseStore store;
+			ExpenseJournal journal(TestFile("expense.bbs"), TestFile("expense.journal"), TestFile("expense.txt"));
+			CHECK(journal.Open(store));
+			ExpenseStore cleared = store.TakeRows();
+			ExpenseSegmentLayout before = journal.AppendClear();
+			const uint64_t clearSequence = journal.LastSequence();
+			// Enough changes since the clear for a save, which drops the clear's record from the log
+			for (int row = 0; row < 5000; row++) {
+				AddRandomRow(store, random);
+			}
+			journal.AppendAdds(store, 0, static_cast<ExpenseStore::RowId>(store.Size()));
+			std::vector<ExpenseStore::RowId> rows(store.Size());
+			for (ExpenseStore::RowId row = 0; row < rows.size(); row++) {
+				rows[row] = row;
+			}
+			store.RemoveRows(rows);
+			journal.AppendRemoveRows(rows);
+			journal.CompactIfNeeded(store);
+			store.RestoreRows(std::move(cleared));
+			CHECK(!journal.AppendUndoClear(std::move(before), clearSequence));
+			journal.AppendAdds(store, 0, static_cast<ExpenseStore::RowId>(store.Size()));
+			journal.Close();
+		}
+		readBack(false);
+		RemoveFiles(files);
+	}
+
+	// A log that cannot be written takes no more records, and the save that clears that state holds
+	// the changes it missed. The log's folder is missing until the test creates it.
+	void TestJournalWriteFailure() {
+		const std::vector<std::string> files = { "expense.bbs", "expense.txt" };
+		RemoveFiles(files);
+		std::error_code ec;
+		std::filesystem::remove_all(TestFile("unwritable"), ec);
+		std::mt19937 random(37);
+		ExpenseStore expected;
+		{
+			ExpenseStore store;
+			ExpenseJournal journal(TestFile("expense.bbs"), TestFile("unwritable/expense.journal"), TestFile("expense.txt"));
+			CHECK(journal.Open(store));
+			CHECK(journal.Failed());
+			for (int row = 0; row < 50; row++) {
+				AddRandomRow(store, random);
+				journal.AppendAdd(store, static_cast<ExpenseStore::RowId>(store.Size() - 1));
+				journal.CompactIfNeeded(store);
+			}
+			CHECK(!journal.Recover(store) && journal.Failed());
+
+			std::filesystem::create_directories(TestFile("unwritable"), ec);
+			CHECK(journal.Recover(store) && !journal.Failed());
+			for (int row = 0; row < 10; row++) {
+				AddRandomRow(store, random);
+				journal.AppendAdd(store, static_cast<ExpenseStore::RowId>(store.Size() - 1));
+			}
+			store.Remove(3);
+			journal.AppendRemove(3);
+			CHECK(!journal.Failed());
+			journal.Close();
+			expected = store;
+		}
+		ExpenseStore store;
+		ExpenseJournal journal(TestFile("expense.bbs"), TestFile("unwritable/expense.journal"), TestFile("expense.txt"));
+		CHECK(journal.Open(store) && !journal.Failed());
+		CHECK(SameRows(store, expected));
+		journal.Close();
+		RemoveFiles(files);
+		std::filesystem::remove_all(TestFile("unwritable"), ec);
+	}
+
+	// Segments hold one month each whatever order the rows come in, the row order survives a save
+	// and reload, and a reader limited to a range of days never reads the other months' files
+	void TestMonthSegments() {
+		std::mt19937 random(23);
+		// The layout alone, under every kind of edit, against the months of a plain list of rows
+		ExpenseSegmentLayout layout;
+		std::vector<int32_t> days;
+		auto randomDay = [&random]() { return 18000 + static_cast<int32_t>(random() % 400); };
+		for (int edit = 0; edit < 3000; edit++) {
+			const unsigned kind = random() % 10;
+			if (kind < 4 || days.empty()) {
+				days.push_back(randomDay());
+				layout.Add(days.back());
+			}
+			else if (kind < 6) {
+				ExpenseStore::RowId row = random() % (days.size() + 1);
+				days.insert(days.begin() + row, randomDay());
+				layout.Insert(row, days[row]);
+			}
+			else if (kind < 8) {
+				ExpenseStore::RowId row = random() % days.size();
+				days.erase(days.begin() + row);
+				layout.Remove(row);
+			}
+			else if (kind < 9) {
+				std::vector<ExpenseStore::RowId> rows;
+				std::vector<int32_t> kept;
+				for (ExpenseStore::RowId row = 0; row < days.size(); row++) {
+					if (random() % 16 == 0) {
+						rows.push_back(row);
+					}
+					else {
+						kept.push_back(days[row]);
+					}
+				}
+				days.swap(kept);
+				layout.RemoveRows(rows);
+			}
+			else {
+				std::vector<ExpenseStore::RowId> rows;
+				std::vector<int32_t> added;
+				for (ExpenseStore::RowId row = 0; row < days.size(); row++) {
+					if (random() % 32 == 0) {
+						rows.push_back(row);
+						added.push_back(randomDay());
+					}
+				}
+				std::vector<int32_t> merged;
+				size_t next = 0, old = 0;
+				for (ExpenseStore::RowId row = 0; next < rows.size() || old < days.size(); row++) {
+					merged.push_back(next < rows.size() && rows[next] == row ? added[next++] : days[old++]);
+				}
+				days.swap(merged);
+				layout.InsertRows(rows, added);
+			}
+
+			if (!CHECK(layout.Rows() == days.size())) {
+				return;
+			}
+			std::vector<uint64_t> counted(layout.Segments().size());
+			size_t row = 0;
+			for (const ExpenseSegmentLayout::Run& run : layout.Runs()) {
+				CHECK(run.rows > 0);
+				for (uint32_t i = 0; i < run.rows; i++, row++) {
+					if (!CHECK(MonthOfDay(days[row]) == layout.Segments()[run.segment].month)) {
+						return;
+					}
+				}
+				counted[run.segment] += run.rows;
+			}
+			for (size_t i = 0; i < counted.size(); i++) {
+				CHECK(counted[i] == layout.Segments()[i].rows && counted[i] > 0);
+			}
+		}
+
+		// Two years entered in date order with some rows back-dated, saved and read back
+		const std::vector<std::string> files = { "expense.bbs", "expense.journal", "expense.txt" };
+		RemoveFiles(files);
+		ExpenseStore expected;
+		{
+			ExpenseJournal journal(TestFile("expense.bbs"), TestFile("expense.journal"), TestFile("expense.txt"));
+			CHECK(journal.Open(expected));
+			for (int row = 0; row < 20000; row++) {
+				int32_t day = 18000 + row * 730 / 20000;
+				if (row % 50 == 49) {
+					day -= static_cast<int32_t>(random() % 365);
+				}
+				expected.Add(RandomDescription(random), "category " + std::to_string(random() % 12), random() % 5000, day);
+			}
+			journal.AppendAdds(expected, 0, static_cast<ExpenseStore::RowId>(expected.Size()));
+			journal.CompactIfNeeded(expected);
+			journal.Close();
+		}
+		ExpenseStore store;
+		ExpenseSegmentLayout saved;
+		uint64_t sequence = 0;
+		CHECK(LoadExpenseSegments(store, TestFile("expense.bbs"), &sequence, &saved));
+		CHECK(SameRows(store, expected));
+		CHECK(saved.Rows() == expected.Size() && saved.Segments().size() >= 24);
+		for (const ExpenseSegmentLayout::Segment& segment : saved.Segments()) {
+			CHECK(MonthOfDay(segment.minDay) == segment.month && MonthOfDay(segment.maxDay) == segment.month);
+		}
+
+		// Damage the first month's file: a reader limited to the second year never pages it in
+		const ExpenseSegmentLayout::Segment& first = saved.Segments()[0];
+		{
+			std::fstream segmentFile(TestFile("expense.bbs.segments/" + std::to_string(first.file) + ".bbs"), std::ios::binary | std::ios::in | std::ios::out);
+			segmentFile.seekp(60);
+			segmentFile.write("damaged", 7);
+		}
+		const int32_t fromDay = 18365;
+		size_t inRange = 0;
+		for (ExpenseStore::RowId row = 0; row < expected.Size(); row++) {
+			inRange += expected.Day(row) >= fromDay;
+		}
+		ExpenseHistoryReader reader;
+		CHECK(reader.Open(TestFile("expense.bbs"), TestFile("expense.journal"), TestFile("expense.txt")));
+		reader.LimitDays(fromDay, INT32_MAX);
+		ExpenseRecord record;
+		size_t matched = 0;
+		while (reader.Next(record)) {
+			matched += record.day >= fromDay;
+		}
+		CHECK(!reader.Failed() && matched == inRange);
+
+		// Reading every row has to run into the damage and say so
+		CHECK(reader.Open(TestFile("expense.bbs"), TestFile("expense.journal"), TestFile("expense.txt")));
+		while (reader.Next(record)) {
+		}
+		CHECK(reader.Failed());
+		reader.Close();
+		ExpenseStore damaged;
+		CHECK(!LoadExpenseSegments(damaged, TestFile("expense.bbs"), nullptr, nullptr) && damaged.Empty());
+		RemoveFiles(files);
+
+		// Rows cycling through two years' months, as a CSV sorted by payee imports, make every run
+		// a single row: paged under a cap, the snapshot has to evict without decoding the same
+		// segments over and over, and without getting a row wrong
+		ExpenseStore interleaved;
+		for (int row = 0; row < 24 * 1000; row++) {
+			interleaved.Add(RandomDescription(random), "category " + std::to_string(random() % 12), random() % 5000,
+				18000 + (row % 24) * 31 + row / 24 % 28);
+		}
+		ExpenseSegmentLayout cycling;
+		cycling.Partition(interleaved);
+		ExpenseStore dirtyRows;
+		ExpenseSegmentLayout plan = cycling.PlanSave(interleaved, dirtyRows);
+		CHECK(WriteExpenseSegments(TestFile("expense.bbs"), plan, dirtyRows, 1));
+		ExpenseSegmentedSnapshot paged;
+		CHECK(paged.Open(TestFile("expense.bbs")) && paged.Size() == interleaved.Size());
+		paged.LimitPagedRows(interleaved.Size() / 4);
+		bool same = true;
+		for (ExpenseStore::RowId row = 0; row < interleaved.Size(); row++) {
+			same = same && paged.AmountCents(row) == interleaved.AmountCents(row) && paged.Day(row) == interleaved.Day(row)
+				&& paged.Category(row) == interleaved.Category(row) && paged.Description(row) == interleaved.Description(row);
+		}
+		CHECK(same && !paged.Failed());
+		CHECK(paged.DecodedRows() <= 3 * interleaved.Size() + 1000);
+		paged.Close();
+		RemoveFiles(files);
+	}
+
+	// The loader's newest-month-first order: the newest month's rows and the journal's come first
+	// and the older ones after, the older months' totals are right without reading their rows,
+	// and changes logged in between end up where they would have with everything loaded
+	void TestNewestFirst() {
+		const std::vector<std::string> files = { "expense.bbs", "expense.journal", "expense.txt" };
+		RemoveFiles(files);
+		std::mt19937 random(31);
+		ExpenseStore expected;
+		{
+			ExpenseJournal journal(TestFile("expense.bbs"), TestFile("expense.journal"), TestFile("expense.txt"));
+			CHECK(journal.Open(expected));
+			for (int row = 0; row < 6000; row++) {
+				int32_t day = 18000 + row * 180 / 6000;
+				if (row % 40 == 39) {
+					day -= static_cast<int32_t>(random() % 120);
+				}
+				expected.Add(RandomDescription(random), "category " + std::to_string(random() % 12), random() % 5000, day);
+			}
+			journal.AppendAdds(expected, 0, static_cast<ExpenseStore::RowId>(expected.Size()));
+			journal.CompactIfNeeded(expected);
+			journal.Close();
+
+			// Changes since the save reach into the older months too
+			ExpenseStore store;
+			CHECK(journal.Open(store) && SameRows(store, expected));
+			for (ExpenseStore::RowId row : { 4000u, 1500u, 10u }) {
+				store.Remove(row);
+				expected.Remove(row);
+				journal.AppendRemove(row);
+			}
+			store.Add("late receipt", "category 1", 1234, 18030);
+			expected.Add("late receipt", "category 1", 1234, 18030);
+			journal.AppendAdd(store, static_cast<ExpenseStore::RowId>(store.Size() - 1));
+			journal.Close();
+		}
+
+		ExpenseHistoryReader reader;
+		CHECK(reader.Open(TestFile("expense.bbs"), TestFile("expense.journal"), TestFile("expense.txt")));
+		const ExpenseStore::RowId older = static_cast<ExpenseStore::RowId>(reader.SkipOlderRows());
+		if (!CHECK(older > 0 && older < expected.Size())) {
+			return;
+		}
+		std::map<int32_t, std::pair<int64_t, uint64_t>> months;
+		for (ExpenseStore::RowId row = 0; row < older; row++) {
+			auto& total = months[MonthOfDay(expected.Day(row))];
+			total.first += expected.AmountCents(row);
+			total.second++;
+		}
+		CHECK(reader.OlderMonths().size() == months.size());
+		for (const ExpenseMonthTotal& month : reader.OlderMonths()) {
+			CHECK(months.count(month.month) && months[month.month] == std::make_pair(month.cents, month.rows));
+		}
+		ExpenseStore store;
+		ExpenseRecord record;
+		while (reader.Next(record)) {
+			store.Add(record.description, record.category, record.amountCents, record.day);
+		}
+		CHECK(!reader.Failed() && store.Size() == expected.Size() - older);
+
+		// Edits while the older rows load, logged past them
+		ExpenseJournal journal(TestFile("expense.bbs"), TestFile("expense.journal"), TestFile("expense.txt"));
+		journal.Resume(reader.JournalState());
+		journal.SetUnloadedRows(older);
+		for (int edit = 0; edit < 200; edit++) {
+			const unsigned kind = random() % 4;
+			if (kind == 0 || store.Size() < 10) {
+				store.Add(RandomDescription(random), "category 2", random() % 5000, 18000 + static_cast<int32_t>(random() % 200));
+				expected.Add(store.Description(static_cast<ExpenseStore::RowId>(store.Size() - 1)), "category 2",
+					store.AmountCents(static_cast<ExpenseStore::RowId>(store.Size() - 1)), store.Day(static_cast<ExpenseStore::RowId>(store.Size() - 1)));
+				journal.AppendAdd(store, static_cast<ExpenseStore::RowId>(store.Size() - 1));
+			}
+			else if (kind == 1) {
+				ExpenseStore::RowId row = random() % store.Size();
+				store.Remove(row);
+				expected.Remove(row + older);
+				journal.AppendRemove(row);
+			}
+			else if (kind == 2) {
+				ExpenseStore::RowId row = random() % (store.Size() + 1);
+				store.Insert(row, "put back", "category 3", 77, 18100);
+				expected.Insert(row + older, "put back", "category 3", 77, 18100);
+				journal.AppendInsert(store, row);
+			}
+			else {
+				std::vector<ExpenseStore::RowId> rows, shifted;
+				for (ExpenseStore::RowId row = 0; row < store.Size(); row += 1 + random() % 64) {
+					rows.push_back(row);
+					shifted.push_back(row + older);
+				}
+				store.RemoveRows(rows);
+				expected.RemoveRows(shifted);
+				journal.AppendRemoveRows(rows);
+			}
+		}
+
+		reader.ReadOlderRows();
+		ExpenseStore olderRows;
+		while (reader.Next(record)) {
+			olderRows.Add(record.description, record.category, record.amountCents, record.day);
+		}
+		CHECK(!reader.Failed() && olderRows.Size() == older);
+		reader.Close();
+		std::vector<ExpenseStore::RowId> positions(older);
+		for (ExpenseStore::RowId row = 0; row < older; row++) {
+			positions[row] = row;
+		}
+		store.InsertRows(positions, olderRows);
+		CHECK(SameRows(store, expected));
+		journal.SetUnloadedRows(0);
+		journal.Close();
+
+		ExpenseStore reloaded;
+		CHECK(journal.Open(reloaded) && SameRows(reloaded, expected));
+		journal.Close();
+		RemoveFiles(files);
+	}
+
+	// A snapshot that exists but cannot be read must not be swapped for the older legacy file,
+	// whose rows the journal's positions do not refer to
+	void TestUnreadableSnapshot() {
+		const std::vector<std::string> files = { "expense.bbs", "expense.journal", "expense.txt" };
+		RemoveFiles(files);
+		std::mt19937 random(13);
+		{
+			ExpenseStore store;
+			ExpenseJournal journal(TestFile("expense.bbs"), TestFile("expense.journal"), TestFile("expense.txt"));
+			CHECK(journal.Open(store));
+			// Enough records for a compaction, which writes the snapshot
+			for (int row = 0; row < 5000; row++) {
+				AddRandomRow(store, random);
+			}
+			journal.AppendAdds(store, 0, static_cast<ExpenseStore::RowId>(store.Size()));
+			journal.CompactIfNeeded(store);
+			journal.AppendRemove(5);
+			journal.Close();
+		}
+		ExpenseStore legacy;
+		legacy.Add("stale", "legacy", 100, 19000);
+		CHECK(AddExpenseToFile(legacy, TestFile("expense.txt")));
+		std::error_code ec;
+		std::filesystem::remove_all(TestFile("expense.bbs.segments"), ec);
+		const uintmax_t journalBytes = std::filesystem::file_size(TestFile("expense.journal"), ec);
+
+		ExpenseStore store;
+		ExpenseJournal journal(TestFile("expense.bbs"), TestFile("expense.journal"), TestFile("expense.txt"));
+		CHECK(!journal.Open(store));
+		CHECK(store.Empty());
+		journal.Close();
+		CHECK(std::filesystem::file_size(TestFile("expense.journal"), ec) == journalBytes);
+		ExpenseHistoryReader reader;
+		CHECK(!reader.Open(TestFile("expense.bbs"), TestFile("expense.journal"), TestFile("expense.txt")));
+		RemoveFiles(files);
+	}
+
+	void TestPackRoundTrip() {
+		std::mt19937 random(5);
+		for (int round = 0; round < 100; round++) {
+			ExpenseStore store;
+			const size_t rows = random() % 3000;
+			for (size_t row = 0; row < rows; row++) {
+				std::string description;
+				for (size_t length = random() % 40; length > 0; length--) {
+					description += static_cast<char>(random() % 5 ? 'a' + random() % 26 : random());
+				}
+				store.Add(description, "category " + std::to_string(random() % 12), static_cast<int64_t>(random() % 200000) - 100000,
+					static_cast<int32_t>(random() % 40000) - 2000);
+			}
+			const ExpenseStore::RowId first = rows ? random() % rows : 0;
+			const size_t count = rows - first;
+			std::string pack;
+			EncodeExpensePack(store, first, count, round, pack);
+
+			uint64_t packRows = 0, sequence = 0;
+			if (!CHECK(CheckExpensePack(pack.data(), pack.size(), &packRows, &sequence))) {
+				continue;
+			}
+			CHECK(packRows == count && sequence == static_cast<uint64_t>(round));
+			ExpenseBatch batch;
+			if (!CHECK(DecodeExpensePack(pack.data(), pack.size(), batch)) || !CHECK(batch.Size() == count)) {
+				continue;
+			}
+			for (size_t i = 0; i < count; i++) {
+				const ExpenseStore::RowId row = first + static_cast<ExpenseStore::RowId>(i);
+				if (!CHECK(batch.amounts[i] == store.AmountCents(row) && batch.days[i] == store.Day(row)
+					&& batch.categoryNames[batch.categories[i]] == store.Category(row) && batch.Description(i) == store.Description(row))) {
+					break;
+				}
+			}
+
+			// Any damaged payload byte has to be caught by the CRC
+			const size_t headerBytes = 40;
+			for (int damage = 0; damage < 10 && pack.size() > headerBytes; damage++) {
+				std::string damaged = pack;
+				damaged[headerBytes + random() % (damaged.size() - headerBytes)] ^= static_cast<char>(1 + random() % 255);
+				CHECK(!CheckExpensePack(damaged.data(), damaged.size()));
+			}
+			CHECK(!CheckExpensePack(pack.data(), pack.size() - 1));
+		}
+	}
+
+	void TestDuplicateIndex() {
+		std::mt19937 random(7);
+		ExpenseStore store;
+		ExpenseDuplicateIndex index(store);
+		std::map<std::tuple<std::string, std::string, int64_t, int32_t>, uint32_t> reference;
+		auto key = [&store](ExpenseStore::RowId row) {
+			return std::make_tuple(std::string(store.Description(row)), std::string(store.Category(row)), store.AmountCents(row), store.Day(row));
+		};
+		// Few distinct values, so most rows have duplicates
+		auto addRow = [&]() {
+			store.Add("row " + std::to_string(random() % 50), "c" + std::to_string(random() % 3), random() % 20, 19000 + random() % 10);
+		};
+		for (int edit = 0; edit < 20000; edit++) {
+			const unsigned kind = random() % 10;
+			if (kind < 6 || store.Empty()) {
+				addRow();
+				const ExpenseStore::RowId row = static_cast<ExpenseStore::RowId>(store.Size() - 1);
+				index.Insert(row);
+				reference[key(row)]++;
+			}
+			else if (kind < 8) {
+				const ExpenseStore::RowId row = random() % store.Size();
+				index.Erase(row);
+				reference[key(row)]--;
+				store.Remove(row);
+			}
+			else if (kind < 9) {
+				std::vector<ExpenseStore::RowId> rows;
+				for (ExpenseStore::RowId row = 0; row < store.Size(); row++) {
+					if (random() % 8 == 0) {
+						rows.push_back(row);
+						reference[key(row)]--;
+					}
+				}
+				index.EraseRows(rows);
+				store.RemoveRows(rows);
+			}
+			else {
+				const ExpenseStore::RowId first = static_cast<ExpenseStore::RowId>(store.Size());
+				for (int i = 0; i < 20; i++) {
+					addRow();
+					reference[key(static_cast<ExpenseStore::RowId>(store.Size() - 1))]++;
+				}
+				index.InsertRange(first, static_cast<ExpenseStore::RowId>(store.Size()));
+			}
+			if (edit % 500 == 0) {
+				for (const auto& entry : reference) {
+					const uint64_t fingerprint = ExpenseDuplicateIndex::Fingerprint(std::get<0>(entry.first), std::get<1>(entry.first),
+						std::get<2>(entry.first), std::get<3>(entry.first));
+					if (!CHECK(index.Count(fingerprint) == entry.second)) {
+						return;
+					}
+				}
+			}
+		}
+		CHECK(index.Count(ExpenseDuplicateIndex::Fingerprint("never added", "c0", 1, 19000)) == 0);
+
+		// bachat-cli import counts a streamed history this way, over an empty store
+		ExpenseStore noRows;
+		ExpenseDuplicateIndex streamed(noRows);
+		for (ExpenseStore::RowId row = 0; row < store.Size(); row++) {
+			streamed.InsertFingerprint(ExpenseDuplicateIndex::Fingerprint(store.Description(row), store.Category(row), store.AmountCents(row), store.Day(row)));
+		}
+		for (const auto& entry : reference) {
+			const uint64_t fingerprint = ExpenseDuplicateIndex::Fingerprint(std::get<0>(entry.first), std::get<1>(entry.first),
+				std::get<2>(entry.first), std::get<3>(entry.first));
+			if (!CHECK(streamed.Count(fingerprint) == entry.second)) {
+				return;
+			}
+		}
+	}
+
+	// The sort and search indexes under random adds, inserts and removes, read both after every
+	// few edits and after long stretches that pile up pending edits, against a full sort and scan
+	void TestRowIndexes() {
+		std::mt19937 random(5);
+		ExpenseStore store;
+		for (int row = 0; row < 3000; row++) {
+			AddRandomRow(store, random);
+		}
+		ExpenseSortIndex sortIndex(store);
+		ExpenseSearchIndex searchIndex(store);
+		const SortColumn columns[] = { SortColumn::Category, SortColumn::Amount, SortColumn::Date };
+		const char* const queries[] = { "e", "ss", "bus", "#SEQ", "pass gift", "coffee tea" };
+		auto addRow = [&store, &random](ExpenseStore::RowId row) {
+			store.Insert(row, RandomDescription(random), "category " + std::to_string(random() % 14),
+				static_cast<int64_t>(random() % 2000) - 200, 18000 + static_cast<int32_t>(random() % 300));
+		};
+		auto checkIndexes = [&]() {
+			for (SortColumn column : columns) {
+				std::vector<ExpenseStore::RowId> expected(store.Size());
+				for (ExpenseStore::RowId row = 0; row < expected.size(); row++) {
+					expected[row] = row;
+				}
+				std::stable_sort(expected.begin(), expected.end(), [&store, column](ExpenseStore::RowId a, ExpenseStore::RowId b) {
+					switch (column) {
+					case SortColumn::Category:
+						return store.Category(a) < store.Category(b);
+					case SortColumn::Amount:
+						return store.AmountCents(a) < store.AmountCents(b);
+					default:
+						return store.Day(a) < store.Day(b);
+					}
+					});
+				if (!CHECK(sortIndex.Order(column) == expected)) {
+					return false;
+				}
+			}
+			for (const char* query : queries) {
+				std::string folded(query);
+				std::transform(folded.begin(), folded.end(), folded.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+				std::vector<ExpenseStore::RowId> expected;
+				for (ExpenseStore::RowId row = 0; row < store.Size(); row++) {
+					std::string description(store.Description(row));
+					std::transform(description.begin(), description.end(), description.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+					if (description.find(folded) != std::string::npos) {
+						expected.push_back(row);
+					}
+				}
+				if (!CHECK(searchIndex.Find(query) == expected)) {
+					return false;
+				}
+			}
+			return true;
+		};
+		if (!checkIndexes()) {
+			return;
+		}
+
+		for (int edit = 1; edit <= 8000; edit++) {
+			const unsigned kind = random() % 20;
+			if (kind < 8 || store.Empty()) {
+				addRow(static_cast<ExpenseStore::RowId>(store.Size()));
+				sortIndex.Insert(static_cast<ExpenseStore::RowId>(store.Size() - 1));
+				searchIndex.Insert(static_cast<ExpenseStore::RowId>(store.Size() - 1));
+			}
+			else if (kind < 12) {
+				// An undone remove puts the row back in the middle
+				const ExpenseStore::RowId row = random() % (store.Size() + 1);
+				addRow(row);
+				sortIndex.Insert(row);
+				searchIndex.Insert(row);
+			}
+			else if (kind < 18) {
+				// Undoing the last add removes the end row; anything else comes from the middle
+				const ExpenseStore::RowId row = kind < 14 ? static_cast<ExpenseStore::RowId>(store.Size() - 1) : random() % store.Size();
+				sortIndex.Erase(row);
+				searchIndex.Erase(row);
+				store.Remove(row);
+			}
+			else if (kind < 19) {
+				std::vector<ExpenseStore::RowId> rows;
+				for (ExpenseStore::RowId row = 0; row < store.Size(); row++) {
+					if (random() % 64 == 0) {
+						rows.push_back(row);
+					}
+				}
+				sortIndex.EraseRows(rows);
+				searchIndex.EraseRows(rows);
+				store.RemoveRows(rows);
+			}
+			else {
+				const ExpenseStore::RowId first = static_cast<ExpenseStore::RowId>(store.Size());
+				for (int i = 0; i < 10; i++) {
+					addRow(static_cast<ExpenseStore::RowId>(store.Size()));
+					searchIndex.Insert(static_cast<ExpenseStore::RowId>(store.Size() - 1));
+				}
+				sortIndex.InsertRange(first, static_cast<ExpenseStore::RowId>(store.Size()));
+			}
+			if ((edit < 1000 && edit % 25 == 0) || edit % 2500 == 0) {
+				if (!checkIndexes()) {
+					return;
+				}
+			}
+		}
+		checkIndexes();
+	}
+
+	// Totals by period and group, with and without the sort index's date slice and on several
+	// threads, against a plain map over every row
+	void TestAggregate() {
+		std::mt19937 random(11);
+		ExpenseStore store;
+		for (int row = 0; row < 30000; row++) {
+			AddRandomRow(store, random);
+		}
+		ExpenseSortIndex sortIndex(store);
+		for (AggregateGroup groupBy : { AggregateGroup::Category, AggregateGroup::Description }) {
+			AggregateQuery query;
+			query.group = groupBy;
+			query.period = AggregatePeriod::Week;
+			query.fromDay = 18500;
+			query.toDay = 19700;
+			std::map<std::pair<int32_t, std::string>, std::pair<int64_t, size_t>> reference;
+			for (ExpenseStore::RowId row = 0; row < store.Size(); row++) {
+				if (store.Day(row) >= query.fromDay && store.Day(row) <= query.toDay) {
+					std::string group(groupBy == AggregateGroup::Category ? store.Category(row) : store.Description(row));
+					auto& sum = reference[{ PeriodOfDay(query.period, store.Day(row)), group }];
+					sum.first += store.AmountCents(row);
+					sum.second++;
+				}
+			}
+			for (unsigned threads : { 1u, 4u }) {
+				ThreadPool pool(threads);
+				for (ExpenseSortIndex* index : { static_cast<ExpenseSortIndex*>(nullptr), &sortIndex }) {
+					AggregateResult result = AggregateExpenses(store, query, pool, index);
+					if (!CHECK(result.rows.size() == reference.size())) {
+						return;
+					}
+					auto expected = reference.begin();
+					for (const AggregateResult::Row& row : result.rows) {
+						CHECK(row.period == expected->first.first && result.groupNames[row.group] == expected->first.second
+							&& row.cents == expected->second.first && row.rows == expected->second.second);
+						++expected;
+					}
+				}
+			}
+			// The rows behind one total, in row order
+			const auto& first = *reference.begin();
+			std::string_view group = first.first.second;
+			std::vector<ExpenseStore::RowId> rows = AggregatedRows(store, query, &first.first.first, &group, &sortIndex);
+			CHECK(rows.size() == first.second.second && std::is_sorted(rows.begin(), rows.end()));
+			CHECK(rows == AggregatedRows(store, query, &first.first.first, &group));
+		}
+	}
+
+	// The daily series, the month x category totals, the category counts and the pivot of an
+	// aggregation, kept up to date through adds, removals and back-dated rows, against the same
+	// tables built afresh from the store
+	void TestAggregateIndexes() {
+		std::mt19937 random(13);
+		ExpenseStore store;
+		for (int row = 0; row < 2000; row++) {
+			AddRandomRow(store, random);
+		}
+		ExpenseDailySeries series(store);
+		ExpenseTotalsCache totals(store);
+		ExpenseCategoryIndex categories(store);
+		const ExpenseDailySeries::Window windows[] = { ExpenseDailySeries::Window::Day, ExpenseDailySeries::Window::Week, ExpenseDailySeries::Window::Month };
+		const char* const prefixes[] = { "", "c", "CAT", "category 1", "Category 2", "new" };
+		// Rows land before, inside and after the days seen so far, in new categories now and then
+		auto addRow = [&store, &random](ExpenseStore::RowId row) {
+			int32_t day = 18000 + static_cast<int32_t>(random() % 3000);
+			const unsigned reach = random() % 10;
+			if (reach == 0) {
+				day = 16000 + static_cast<int32_t>(random() % 2000);
+			}
+			else if (reach == 1) {
+				day = 21000 + static_cast<int32_t>(random() % 2000);
+			}
+			std::string category = random() % 20 == 0 ? "new " + std::to_string(random() % 1000) : "category " + std::to_string(random() % 14);
+			store.Insert(row, RandomDescription(random), category, static_cast<int64_t>(random() % 200000) - 20000, day);
+		};
+		auto checkTables = [&]() {
+			ExpenseDailySeries freshSeries(store);
+			ExpenseTotalsCache freshTotals(store);
+			ExpenseCategoryIndex freshCategories(store);
+
+			// The kept range only grows; the days a fresh build leaves out must read as zero
+			const int32_t first = series.FirstDay(), freshFirst = freshSeries.FirstDay();
+			const size_t count = series.DayCount(), freshCount = freshSeries.DayCount();
+			if (!CHECK(store.Empty() || (first <= freshFirst && freshFirst + static_cast<int64_t>(freshCount) <= first + static_cast<int64_t>(count)))) {
+				return false;
+			}
+			std::vector<ExpenseStore::CategoryId> seriesCategories = { ExpenseStore::NoCategory };
+			for (ExpenseStore::CategoryId category : freshSeries.CategoriesBySpending()) {
+				seriesCategories.push_back(category);
+			}
+			if (!CHECK(series.CategoriesBySpending() == freshSeries.CategoriesBySpending())) {
+				return false;
+			}
+			for (ExpenseStore::CategoryId category : seriesCategories) {
+				for (ExpenseDailySeries::Window window : windows) {
+					const std::vector<int64_t> values = series.Values(category, window);
+					const std::vector<int64_t> freshValues = freshSeries.Values(category, window);
+					for (size_t index = 0; index < count; index++) {
+						const int64_t day = first + static_cast<int64_t>(index);
+						if (day >= freshFirst && day < freshFirst + static_cast<int64_t>(freshCount)) {
+							if (!CHECK(values[index] == freshValues[static_cast<size_t>(day - freshFirst)])) {
+								return false;
+							}
+						}
+						else if (window == ExpenseDailySeries::Window::Day && !CHECK(values[index] == 0)) {
+							return false;
+						}
+					}
+				}
+			}
+
+			const std::vector<ExpenseTotalsCache::Cell> cells = totals.Cells(), freshCells = freshTotals.Cells();
+			if (!CHECK(cells.size() == freshCells.size())) {
+				return false;
+			}
+			for (size_t i = 0; i < cells.size(); i++) {
+				if (!CHECK(cells[i].month == freshCells[i].month && cells[i].category == freshCells[i].category
+					&& cells[i].cents == freshCells[i].cents && cells[i].rows == freshCells[i].rows)) {
+					return false;
+				}
+			}
+
+			for (ExpenseStore::CategoryId category = 0; category < store.CategoryCount(); category++) {
+				if (!CHECK(categories.Uses(category) == freshCategories.Uses(category))) {
+					return false;
+				}
+			}
+			for (const char* prefix : prefixes) {
+				if (!CHECK(categories.Complete(prefix) == freshCategories.Complete(prefix))) {
+					return false;
+				}
+			}
+
+			// The pivot of a month x category aggregation, cell by cell and in its totals
+			ThreadPool pool(2);
+			AggregateQuery query;
+			query.group = AggregateGroup::Category;
+			query.period = AggregatePeriod::Month;
+			query.fromDay = INT32_MIN;
+			query.toDay = INT32_MAX;
+			ExpensePivot pivot;
+			pivot.Build(AggregateExpenses(store, query, pool));
+			std::map<std::pair<int32_t, std::string>, std::pair<int64_t, size_t>> reference;
+			for (ExpenseStore::RowId row = 0; row < store.Size(); row++) {
+				auto& sum = reference[{ PeriodOfDay(query.period, store.Day(row)), std::string(store.Category(row)) }];
+				sum.first += store.AmountCents(row);
+				sum.second++;
+			}
+			size_t cellCount = 0;
+			ExpensePivot::Cell grand;
+			for (size_t row = 0; row < pivot.RowCount(); row++) {
+				ExpensePivot::Cell rowTotal;
+				for (size_t column = 0; column < pivot.ColumnCount(); column++) {
+					const ExpensePivot::Cell cell = pivot.At(row, column);
+					auto expected = reference.find({ pivot.Period(row), pivot.GroupName(column) });
+					if (cell.rows == 0) {
+						if (!CHECK(expected == reference.end())) {
+							return false;
+						}
+						continue;
+					}
+					if (!CHECK(expected != reference.end() && cell.cents == expected->second.first && cell.rows == expected->second.second)) {
+						return false;
+					}
+					cellCount++;
+					rowTotal.cents += cell.cents;
+					rowTotal.rows += cell.rows;
+				}
+				if (!CHECK(pivot.RowTotal(row).cents == rowTotal.cents && pivot.RowTotal(row).rows == rowTotal.rows)) {
+					return false;
+				}
+				grand.cents += rowTotal.cents;
+				grand.rows += rowTotal.rows;
+			}
+			return CHECK(cellCount == reference.size() && pivot.GrandTotal().cents == grand.cents
+				&& pivot.GrandTotal().rows == store.Size() && grand.rows == store.Size());
+		};
+		if (!checkTables()) {
+			return;
+		}
+
+		for (int edit = 1; edit <= 3000; edit++) {
+			const unsigned kind = random() % 20;
+			if (kind < 8 || store.Empty()) {
+				addRow(static_cast<ExpenseStore::RowId>(store.Size()));
+				const ExpenseStore::RowId row = static_cast<ExpenseStore::RowId>(store.Size() - 1);
+				series.Insert(row);
+				totals.Insert(row);
+				categories.Insert(row);
+			}
+			else if (kind < 11) {
+				const ExpenseStore::RowId row = random() % (store.Size() + 1);
+				addRow(row);
+				series.Insert(row);
+				totals.Insert(row);
+				categories.Insert(row);
+			}
+			else if (kind < 17) {
+				const ExpenseStore::RowId row = random() % store.Size();
+				series.Erase(row);
+				totals.Erase(row);
+				categories.Erase(row);
+				store.Remove(row);
+			}
+			else if (kind < 19) {
+				std::vector<ExpenseStore::RowId> rows;
+				for (ExpenseStore::RowId row = 0; row < store.Size(); row++) {
+					if (random() % 32 == 0) {
+						rows.push_back(row);
+					}
+				}
+				series.EraseRows(rows);
+				totals.EraseRows(rows);
+				categories.EraseRows(rows);
+				store.RemoveRows(rows);
+			}
+			else if (edit % 7 == 0) {
+				// Cleared, as MainFrame::ClearRows does; everything rebuilds on the next read
+				store.Clear();
+				series.Clear();
+				totals.Clear();
+				categories.Clear();
+			}
+			if ((edit < 500 && edit % 20 == 0) || edit % 500 == 0) {
+				if (!checkTables()) {
+					return;
+				}
+			}
+		}
+		checkTables();
+	}
+
+	// Every vector path of SumCents and SumCentsBetween against the plain loops, over lengths
+	// that leave a tail for each vector width and starts that are not aligned
+	void TestSumCents() {
+		std::mt19937 random(19);
+		std::vector<int64_t> cents(1100);
+		std::vector<int32_t> days(cents.size());
+		for (size_t i = 0; i < cents.size(); i++) {
+			cents[i] = static_cast<int64_t>(random() % 2000000) - 1000000;
+			days[i] = 18000 + static_cast<int32_t>(random() % 100);
+		}
+		cents[7] = INT64_MAX / 4;
+		cents[8] = INT64_MIN / 4;
+		const std::vector<SumCentsPath> paths = SumCentsPaths();
+		CHECK(paths.size() >= 1 && std::strcmp(paths[0].name, "scalar") == 0);
+		for (size_t offset : { 0, 1, 3 }) {
+			for (size_t count = 0; count + offset <= cents.size(); count += count < 40 ? 1 : 97) {
+				const int64_t* column = cents.data() + offset;
+				const int32_t* dayColumn = days.data() + offset;
+				int64_t sum = 0, between = 0;
+				for (size_t i = 0; i < count; i++) {
+					sum += column[i];
+					between += dayColumn[i] >= 18020 && dayColumn[i] <= 18060 ? column[i] : 0;
+				}
+				CHECK(SumCents(column, count) == sum);
+				CHECK(SumCentsBetween(column, dayColumn, count, 18020, 18060) == between);
+				for (const SumCentsPath& path : paths) {
+					if (!CHECK(path.sum(column, count) == sum && path.sumBetween(column, dayColumn, count, 18020, 18060) == between)) {
+						std::fprintf(stderr, "  path %s, offset %zu, count %zu\n", path.name, offset, count);
+						return;
+					}
+				}
+			}
+		}
+		// Bounds at the extremes of the day range
+		CHECK(SumCentsBetween(cents.data(), days.data(), 1001, INT32_MIN, INT32_MAX) == SumCents(cents.data(), 1001));
+		CHECK(SumCentsBetween(cents.data(), days.data(), 1001, 18100, 18000) == 0);
+	}
+
+	// Pivot rows and columns sorted by amounts that tie keep label order both ways, also after the
+	// other axis was reordered
+	void TestPivotSort() {
+		AggregateResult result;
+		std::vector<std::string> names = { "bus", "food", "rent", "tea" };
+		for (const std::string& name : names) {
+			result.groupNames.push_back(name);
+		}
+		// period: cents per group (bus, food, rent, tea); 0 leaves the cell out
+		const std::map<int32_t, std::vector<int64_t>> table = {
+			{ 100, { 5, 0, 9, 5 } },
+			{ 101, { 0, 7, 0, 0 } },
+			{ 102, { 5, 2, 9, 0 } },
+			{ 103, { 7, 0, 0, 0 } },
+			{ 104, { 2, 5, 0, 9 } },
+		};
+		for (const auto& period : table) {
+			for (uint32_t group = 0; group < names.size(); group++) {
+				if (period.second[group] != 0) {
+					result.rows.push_back({ period.first, group, period.second[group], 1 });
+				}
+			}
+		}
+		ExpensePivot pivot;
+		pivot.Build(result);
+		auto periods = [&pivot]() {
+			std::vector<int32_t> order;
+			for (size_t row = 0; row < pivot.RowCount(); row++) {
+				order.push_back(pivot.Period(row));
+			}
+			return order;
+		};
+		auto groups = [&pivot]() {
+			std::vector<std::string> order;
+			for (size_t column = 0; column < pivot.ColumnCount(); column++) {
+				order.push_back(pivot.GroupName(column));
+			}
+			return order;
+		};
+
+		// Totals per period: 19, 7, 16, 7, 16
+		pivot.SortRows(ExpensePivot::ByTotal, false);
+		CHECK(periods() == std::vector<int32_t>({ 101, 103, 102, 104, 100 }));
+		pivot.SortRows(ExpensePivot::ByTotal, true);
+		CHECK(periods() == std::vector<int32_t>({ 100, 102, 104, 101, 103 }));
+		// By bus: 5, 0, 5, 7, 2
+		pivot.SortRows(0, true);
+		CHECK(periods() == std::vector<int32_t>({ 103, 100, 102, 104, 101 }));
+		pivot.SortRows(ExpensePivot::ByLabel, true);
+		CHECK(periods() == std::vector<int32_t>({ 104, 103, 102, 101, 100 }));
+
+		// Totals per group: bus 19, food 14, rent 18, tea 14
+		pivot.SortColumns(ExpensePivot::ByTotal, false);
+		CHECK(groups() == std::vector<std::string>({ "food", "tea", "rent", "bus" }));
+		pivot.SortColumns(ExpensePivot::ByTotal, true);
+		CHECK(groups() == std::vector<std::string>({ "bus", "rent", "food", "tea" }));
+		// Display row 0 is period 104 while the rows run by label descending: bus 2, food 5, rent 0, tea 9
+		pivot.SortColumns(0, false);
+		CHECK(groups() == std::vector<std::string>({ "rent", "bus", "food", "tea" }));
+		// Period 100 ties bus and tea at 5 and leaves food out
+		pivot.SortRows(ExpensePivot::ByLabel, false);
+		pivot.SortColumns(0, true);
+		CHECK(groups() == std::vector<std::string>({ "rent", "bus", "tea", "food" }));
+		// Rows by the display column that is now tea: 5, 0, 0, 0, 9
+		pivot.SortRows(2, false);
+		CHECK(periods() == std::vector<int32_t>({ 101, 102, 103, 100, 104 }));
+		CHECK(pivot.At(4, 2).cents == 9 && pivot.At(0, 2).rows == 0 && pivot.RowTotal(4).cents == 16);
+	}
+
+	void TestParserRoundTrip() {
+		const std::vector<std::string> files = { "round-trip.txt" };
+		std::mt19937 random(11);
+		ExpenseStore store;
+		// Enough rows that the parser cuts the file into several chunks
+		for (int row = 0; row < 40000; row++) {
+			AddRandomRow(store, random);
+		}
+		for (uint64_t sequence : { uint64_t(0), uint64_t(42) }) {
+			CHECK(AddExpenseToFile(store, TestFile("round-trip.txt"), sequence));
+			for (unsigned threads : { 1u, 4u }) {
+				ExpenseStore loaded;
+				ExpenseParseReport report;
+				CHECK(ParseExpenseFile(TestFile("round-trip.txt"), loaded, report, threads));
+				CHECK(report.Ok() && report.sequence == sequence);
+				CHECK(SameRows(store, loaded));
+			}
+		}
+		RemoveFiles(files);
+	}
+
+	// Lines starting with '#' are rows like any other; only a "#sequence N" after the declared
+	// rows is the trailer, and one before them is a malformed row
+	void TestParserHashLines() {
+		const std::vector<std::string> files = { "hash-lines.txt" };
+		const std::string text = "4\n#1_gift gifts 10 2024-01-02\n#sequence food 2.50 2024-01-03\n#sequence 7\nrent home 900 2024-01-04\n#sequence 9\n";
+		ExpenseStore store;
+		ExpenseParseReport report;
+		CHECK(ParseExpenseText(text, store, report, 1));
+		CHECK(store.Size() == 3 && report.sequence == 9);
+		CHECK(report.skippedLines == 1 && report.errorCount == 1 && !report.errors.empty() && report.errors[0].line == 4);
+		if (store.Size() == 3) {
+			CHECK(store.Description(0) == "#1 gift" && store.Description(1) == "#sequence");
+		}
+
+		// A trailer where a declared row should be is that row, malformed
+		store.Clear();
+		CHECK(ParseExpenseText("2\nrent home 900 2024-01-04\n#sequence 9", store, report, 1));
+		CHECK(store.Size() == 1 && report.sequence == 0 && report.skippedLines == 1);
+
+		// The streaming reader follows the same rules
+		{
+			std::ofstream(TestFile("hash-lines.txt"), std::ios::binary) << text;
+		}
+		ExpenseFileReader reader;
+		CHECK(reader.Open(TestFile("hash-lines.txt")));
+		ExpenseRecord record;
+		size_t rows = 0;
+		while (reader.Next(record)) {
+			rows++;
+		}
+		CHECK(rows == 3 && reader.SkippedLines() == 1 && reader.Sequence() == 9);
+		reader.Close();
+		RemoveFiles(files);
+	}
+
+	void TestCsvAmounts() {
+		const std::pair<const char*, int64_t> valid[] = {
+			{ "12.50", 1250 }, { "$1,234.56", 123456 }, { "-$12.50", -1250 }, { "(12.50)", -1250 },
+			{ "12.50 USD", 1250 }, { "EUR 7", 700 }, { "\xE2\x82\xAC" "3.20", 320 }, { " 99 ", 9900 },
+		};
+		for (const auto& amount : valid) {
+			int64_t cents = 0;
+			CHECK(ParseCsvAmount(amount.first, '.', cents) && cents == amount.second);
+		}
+		int64_t cents = 0;
+		CHECK(ParseCsvAmount("1.234,56 \xE2\x82\xAC", ',', cents) && cents == 123456);
+		// Letters inside the number are not a currency
+		for (const char* amount : { "1e3", "12abc34", "1$2", "", "USD" }) {
+			CHECK(!ParseCsvAmount(amount, '.', cents));
+		}
+	}
+
+	const std::vector<std::pair<const char*, std::function<void()>>> tests = {
+		{ "journal_replay", TestJournalReplay },
+		{ "undo_restore", TestUndoRestore },
+		{ "undo_clear", TestUndoClear },
+		{ "journal_write_failure", TestJournalWriteFailure },
+		{ "month_segments", TestMonthSegments },
+		{ "newest_first", TestNewestFirst },
+		{ "unreadable_snapshot", TestUnreadableSnapshot },
+		{ "pack_round_trip", TestPackRoundTrip },
+		{ "duplicate_index", TestDuplicateIndex },
+		{ "row_indexes", TestRowIndexes },
+		{ "aggregate", TestAggregate },
+		{ "aggregate_indexes", TestAggregateIndexes },
+		{ "sum_cents", TestSumCents },
+		{ "pivot_sort", TestPivotSort },
+		{ "parser_round_trip", TestParserRoundTrip },
+		{ "parser_hash_lines", TestParserHashLines },
+		{ "csv_amounts", TestCsvAmounts },
+	};
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<std::string> names;
+	for (int i = 1; i < argc; i++) {
+		if (std::strcmp(argv[i], "--dir") == 0 && i + 1 < argc) {
+			testDir = argv[++i];
+		}
+		else {
+			names.push_back(argv[i]);
+		}
+	}
+	std::error_code ec;
+	std::filesystem::create_directories(testDir, ec);
+
+	size_t run = 0;
+	for (const auto& test : tests) {
+		if (!names.empty() && std::find(names.begin(), names.end(), test.first) == names.end()) {
+			continue;
+		}
+		const size_t failuresBefore = failures;
+		test.second();
+		std::printf("%s %s\n", failures == failuresBefore ? "ok  " : "FAIL", test.first);
+		run++;
+	}
+	if (run == 0) {
+		std::fprintf(stderr, "no test matches\n");
+		return 1;
+	}
+	return failures == 0 ? 0 : 1;
+}
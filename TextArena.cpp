@@ -0,0 +1,51 @@
+#include "TextArena.h"
+#include <algorithm>
+#include <cstring>
+
+const char* TextArena::Append(std::string_view text)
+{
+	if (text.empty()) {
+		return "";
+	}
+	char* target = Allocate(text.size());
+	std::memcpy(target, text.data(), text.size());
+	return target;
+}
+
+char* TextArena::Allocate(size_t size)
+{
+	if (chunks.empty() || chunks.back().size - chunks.back().used < size) {
+		AddChunk(size);
+	}
+	Chunk& chunk = chunks.back();
+	char* target = chunk.data.get() + chunk.used;
+	chunk.used += size;
+	usedBytes += size;
+	return target;
+}
+
+void TextArena::Reserve(size_t size)
+{
+	if (size > 0 && (chunks.empty() || chunks.back().size - chunks.back().used < size)) {
+		AddChunk(size);
+	}
+}
+
+void TextArena::Clear()
+{
+	chunks.clear();
+	usedBytes = 0;
+	reservedBytes = 0;
+}
+
+void TextArena::AddChunk(size_t minimum)
+{
+	// Chunks double from MinChunkSize up to ChunkSize, so a store of a few rows stays small;
+	// new char[] leaves the memory uninitialised, so untouched pages are never committed
+	const size_t size = std::max(minimum, std::min(ChunkSize, std::max(MinChunkSize, static_cast<size_t>(reservedBytes))));
+	Chunk chunk;
+	chunk.data.reset(new char[size]);
+	chunk.size = size;
+	chunks.push_back(std::move(chunk));
+	reservedBytes += size;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Bump allocator for short strings that live as long as the arena. Text is appended to the
+// current chunk and a full chunk is simply left behind, so stored text never moves: growing the
+// arena copies nothing, there is no moment with the old and new buffer both allocated as when a
+// single string doubles, and the pointers handed out stay valid (also when the arena is moved)
+// until Clear.
+class TextArena
+{
+public:
+	static constexpr size_t MinChunkSize = 4 * 1024;
+	static constexpr size_t ChunkSize = 1024 * 1024;
+
+	TextArena() = default;
+	TextArena(const TextArena&) = delete;
+	TextArena& operator=(const TextArena&) = delete;
+	TextArena(TextArena&&) = default;
+	TextArena& operator=(TextArena&&) = default;
+
+	// Copies the text in and returns where it now lives
+	const char* Append(std::string_view text);
+	// Contiguous space for size bytes, for copying in many strings at once
+	char* Allocate(size_t size);
+	// Makes sure the next size bytes fit in one chunk, so a bulk load allocates once
+	void Reserve(size_t size);
+	void Clear();
+
+	uint64_t UsedBytes() const { return usedBytes; }
+	// Allocated bytes, including the unused tails of chunks
+	uint64_t ReservedBytes() const { return reservedBytes; }
+	size_t ChunkCount() const { return chunks.size(); }
+
+private:
+	struct Chunk
+	{
+		std::unique_ptr<char[]> data;
+		size_t size = 0;
+		size_t used = 0;
+	};
+
+	std::vector<Chunk> chunks;
+	uint64_t usedBytes = 0;
+	uint64_t reservedBytes = 0;
+
+	void AddChunk(size_t minimum);
+};
@@ -0,0 +1,71 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned threads)
+{
+	if (threads == 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	// The thread calling ParallelFor does a share of the work itself
+	for (unsigned i = 1; i < threads; i++) {
+		workers.emplace_back(&ThreadPool::WorkerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(unsigned part, size_t begin, size_t end)>& body)
+{
+	const unsigned parts = static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(ThreadCount(), count)));
+	const size_t step = (count + parts - 1) / parts;
+
+	std::mutex doneMutex;
+	std::condition_variable doneSignal;
+	unsigned remaining = parts - 1;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (unsigned part = 1; part < parts; part++) {
+			size_t begin = std::min(count, part * step), end = std::min(count, begin + step);
+			tasks.push([&, part, begin, end]() {
+				body(part, begin, end);
+				std::lock_guard<std::mutex> doneLock(doneMutex);
+				if (--remaining == 0) {
+					doneSignal.notify_one();
+				}
+				});
+		}
+	}
+	wake.notify_all();
+
+	body(0, 0, std::min(count, step));
+
+	std::unique_lock<std::mutex> doneLock(doneMutex);
+	doneSignal.wait(doneLock, [&remaining]() { return remaining == 0; });
+}
+
+void ThreadPool::WorkerLoop()
+{
+	for (;;) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+			if (stopping && tasks.empty()) {
+				return;
+			}
+			task = std::move(tasks.front());
+			tasks.pop();
+		}
+		task();
+	}
+}
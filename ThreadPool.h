@@ -0,0 +1,34 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data-parallel scans
+class ThreadPool
+{
+public:
+	// threads == 0 uses every hardware thread
+	explicit ThreadPool(unsigned threads = 0);
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	unsigned ThreadCount() const { return static_cast<unsigned>(workers.size()) + 1; }
+
+	// Splits [0, count) into one part per thread and calls body(part, begin, end) for each,
+	// using the calling thread as one of the workers. Returns once every part is done.
+	void ParallelFor(size_t count, const std::function<void(unsigned part, size_t begin, size_t end)>& body);
+
+private:
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping = false;
+
+	void WorkerLoop();
+};
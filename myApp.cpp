@@ -1,10 +1,15 @@
 #include "myApp.h"
 #include "MainFrame.h"
+#include "Diagnostics.h"
 #include <wx/wx.h>
 
 wxIMPLEMENT_APP(myApp);
 
 bool myApp::OnInit() {
+	// Timings are collected from the start, so the first load is measured too
+	if (wxGetEnv("BACHAT_DIAGNOSTICS", nullptr)) {
+		Diagnostics::Enable(true);
+	}
 	MainFrame* frame = new MainFrame("BachatBuddy");
 	wxFont::AddPrivateFont("fonts/BrassMono-Regular.ttf");
 	frame->Show(true);